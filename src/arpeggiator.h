@@ -0,0 +1,122 @@
+#ifndef ARPEGGIATOR_H
+#define ARPEGGIATOR_H
+
+// Arpeggiator
+// Plays the held keys one after the other, lowest first, one step every
+// 'stepFrames'. Steps are scheduled into a TimerWheel as note on/off pairs at
+// their absolute sample time, up to the end of the range being processed, so
+// the caller pops them back out at the exact frame they fall on. The first
+// step plays at the moment a key goes down with none held, and the pattern
+// runs free from there.
+
+#include <cplug.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "midi.h"
+#include "timer_wheel.h"
+
+#define ARP_MAX_NOTES 32
+// Part of a step a note sounds for
+#define ARP_GATE 0.5
+
+typedef struct Arpeggiator {
+    // Held keys, lowest note first
+    uint8_t notes[ARP_MAX_NOTES];
+    uint8_t channels[ARP_MAX_NOTES];
+    uint8_t velocities[ARP_MAX_NOTES];
+    uint32_t numNotes;
+
+    uint32_t step;
+    // Sample time of the next step. Fractional, so steps don't drift at
+    // tempos that aren't a whole number of samples per step
+    double nextStep;
+    // 0 while off
+    double stepFrames;
+} Arpeggiator;
+
+static inline void arp_init(Arpeggiator *arp) { memset(arp, 0, sizeof(*arp)); }
+
+// Beats per step for a PARAM_ARPEGGIATOR value: a 1/4 to a 1/32 note, or 0
+// when off
+static inline double arp_step_beats(float value) {
+    const uint32_t rate = (uint32_t)value;
+    return rate > 0 ? 2.0 / (double)(1u << rate) : 0;
+}
+
+// Lets go of every key. Notes already scheduled still play out
+static inline void arp_clear(Arpeggiator *arp) { arp->numNotes = 0; }
+
+// Adds a key going down at 'time'
+static inline void arp_note_on(Arpeggiator *arp, uint32_t channel,
+                               uint32_t note, uint32_t velocity,
+                               uint64_t time) {
+    if (arp->numNotes == 0) {
+        arp->step = 0;
+        arp->nextStep = (double)time;
+    }
+    uint32_t i = 0;
+    while (i < arp->numNotes && arp->notes[i] < note)
+        i++;
+    if (i < arp->numNotes && arp->notes[i] == note &&
+        arp->channels[i] == channel) {
+        arp->velocities[i] = (uint8_t)velocity;
+        return;
+    }
+    if (arp->numNotes == ARP_MAX_NOTES)
+        return;
+    const uint32_t numAfter = arp->numNotes - i;
+    memmove(&arp->notes[i + 1], &arp->notes[i], numAfter);
+    memmove(&arp->channels[i + 1], &arp->channels[i], numAfter);
+    memmove(&arp->velocities[i + 1], &arp->velocities[i], numAfter);
+    arp->notes[i] = (uint8_t)note;
+    arp->channels[i] = (uint8_t)channel;
+    arp->velocities[i] = (uint8_t)velocity;
+    arp->numNotes++;
+}
+
+static inline void arp_note_off(Arpeggiator *arp, uint32_t channel,
+                                uint32_t note) {
+    for (uint32_t i = 0; i < arp->numNotes; i++) {
+        if (arp->notes[i] != note || arp->channels[i] != channel)
+            continue;
+        const uint32_t numAfter = arp->numNotes - i - 1;
+        memmove(&arp->notes[i], &arp->notes[i + 1], numAfter);
+        memmove(&arp->channels[i], &arp->channels[i + 1], numAfter);
+        memmove(&arp->velocities[i], &arp->velocities[i + 1], numAfter);
+        arp->numNotes--;
+        return;
+    }
+}
+
+// Schedules the steps due before 'end' into 'wheel'. Their note offs may fall
+// after it
+static inline void arp_schedule(Arpeggiator *arp, TimerWheel *wheel,
+                                uint64_t end) {
+    if (arp->stepFrames <= 0)
+        return;
+    while (arp->numNotes > 0 && arp->nextStep < (double)end) {
+        const uint32_t i = arp->step % arp->numNotes;
+        const uint64_t time = (uint64_t)arp->nextStep;
+        const double gate = arp->stepFrames * ARP_GATE;
+        CplugEvent event;
+        event.midi.type = CPLUG_EVENT_MIDI;
+        event.midi.status = (uint8_t)(MIDI_NOTE_OFF | arp->channels[i]);
+        event.midi.data1 = arp->notes[i];
+        event.midi.data2 = 0;
+        // The note off goes first: a step whose note off doesn't fit in the
+        // wheel is skipped rather than left hanging
+        if (timer_wheel_schedule(wheel,
+                                 time + (uint64_t)(gate > 1 ? gate : 1),
+                                 &event)) {
+            event.midi.status = (uint8_t)(MIDI_NOTE_ON | arp->channels[i]);
+            event.midi.data2 = arp->velocities[i];
+            timer_wheel_schedule(wheel, time, &event);
+        }
+
+        arp->step++;
+        arp->nextStep += arp->stepFrames;
+    }
+}
+
+#endif // ARPEGGIATOR_H
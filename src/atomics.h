@@ -0,0 +1,218 @@
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+// Acquire/release atomics on plain integers
+// CPLUG's cplug_atomic_* helpers are sequentially consistent, which costs a
+// full fence on every store. The lock-free structures here only need
+// acquire/release ordering. <stdatomic.h> can't be used because these headers
+// are also included from C++.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+static inline uint32_t atomic_load_acquire_u32(const volatile uint32_t *p) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_ARM64)
+    return __ldar32((volatile unsigned __int32 *)p);
+#else
+    // x86 loads already have acquire semantics, only the compiler needs fencing
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+#endif
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void atomic_store_release_u32(volatile uint32_t *p, uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_ARM64)
+    __stlr32((volatile unsigned __int32 *)p, v);
+#else
+    _ReadWriteBarrier();
+    *p = v;
+#endif
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline uint32_t atomic_load_relaxed_u32(const volatile uint32_t *p) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return *p;
+#else
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void atomic_store_relaxed_u32(volatile uint32_t *p, uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    *p = v;
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline uint32_t atomic_fetch_or_release_u32(volatile uint32_t *p,
+                                                   uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedOr((volatile long *)p, (long)v);
+#else
+    return __atomic_fetch_or(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline uint32_t atomic_exchange_acquire_u32(volatile uint32_t *p,
+                                                   uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedExchange((volatile long *)p, (long)v);
+#else
+    return __atomic_exchange_n(p, v, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline uint32_t atomic_exchange_acq_rel_u32(volatile uint32_t *p,
+                                                   uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedExchange((volatile long *)p, (long)v);
+#else
+    return __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Stores 'desired' if '*p' still holds '*expected'. Otherwise loads what it
+// holds into '*expected' and returns false
+static inline bool atomic_compare_exchange_acq_rel_u32(volatile uint32_t *p,
+                                                       uint32_t *expected,
+                                                       uint32_t desired) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    const uint32_t seen = (uint32_t)_InterlockedCompareExchange(
+        (volatile long *)p, (long)desired, (long)*expected);
+    if (seen == *expected)
+        return true;
+    *expected = seen;
+    return false;
+#else
+    return __atomic_compare_exchange_n(p, expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline uint32_t atomic_fetch_add_release_u32(volatile uint32_t *p,
+                                                    uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedExchangeAdd((volatile long *)p, (long)v);
+#else
+    return __atomic_fetch_add(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline void *atomic_load_acquire_ptr(void *const volatile *p) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_ARM64)
+    return (void *)__ldar64((volatile unsigned __int64 *)p);
+#else
+    void *v = *p;
+    _ReadWriteBarrier();
+    return v;
+#endif
+#else
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void atomic_store_release_ptr(void *volatile *p, void *v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_ARM64)
+    __stlr64((volatile unsigned __int64 *)p, (unsigned __int64)v);
+#else
+    _ReadWriteBarrier();
+    *p = v;
+#endif
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+// Hands a pointer from one thread to another: the previous value is returned
+// with acquire semantics and the new one published with release semantics
+static inline void *atomic_exchange_acq_rel_ptr(void *volatile *p, void *v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _InterlockedExchangePointer(p, v);
+#else
+    return __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Statistics counters. No ordering, only atomicity
+static inline uint32_t atomic_fetch_add_relaxed_u32(volatile uint32_t *p,
+                                                    uint32_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (uint32_t)_InterlockedExchangeAdd((volatile long *)p, (long)v);
+#else
+    return __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+#endif
+}
+
+// 64 bit values published by a single writer. Whole values, never torn, even
+// on 32 bit targets
+static inline uint64_t atomic_load_relaxed_u64(const volatile uint64_t *p) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_IX86)
+    return (uint64_t)_InterlockedCompareExchange64((volatile __int64 *)p, 0,
+                                                   0);
+#else
+    return *p;
+#endif
+#else
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void atomic_store_relaxed_u64(volatile uint64_t *p, uint64_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_IX86)
+    _InterlockedExchange64((volatile __int64 *)p, (__int64)v);
+#else
+    *p = v;
+#endif
+#else
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+#endif
+}
+
+// Fences for seqlocks: a release fence after marking data as being written
+// keeps the writes to the data after the mark, and an acquire fence before
+// checking the mark again keeps the reads of the data before it
+static inline void atomic_fence_release(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_ARM64)
+    __dmb(_ARM64_BARRIER_ISH);
+#else
+    _ReadWriteBarrier();
+#endif
+#else
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+static inline void atomic_fence_acquire(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_ARM64)
+    __dmb(_ARM64_BARRIER_ISH);
+#else
+    _ReadWriteBarrier();
+#endif
+#else
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+#endif // ATOMICS_H
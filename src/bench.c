@@ -0,0 +1,3138 @@
+// Headless benchmark host
+// Drives cplug_process() with a scripted stream of MIDI, parameter and audio
+// events over a matrix of block sizes and sample rates, and reports the cost of
+// every configuration. No DAW, audio device or window is required.
+//
+// Usage: cplug_example_bench [-s seconds] [-p polyphony] [-b blocksize]
+//                            [-r samplerate]
+//        cplug_example_bench osc [-s seconds]
+//        cplug_example_bench params [-s seconds]
+//        cplug_example_bench smooth [-s seconds]
+//        cplug_example_bench ring [-s seconds]
+//        cplug_example_bench notify [-s seconds]
+//        cplug_example_bench state [-s seconds]
+//        cplug_example_bench presets [-s seconds]
+//        cplug_example_bench meter [-s seconds] [-p polyphony] [-b blocksize]
+//        cplug_example_bench oversample [-s seconds]
+//        cplug_example_bench wavetable [-s seconds]
+//        cplug_example_bench raster [-s seconds]
+//        cplug_example_bench scope [-s seconds]
+//        cplug_example_bench buses [-s seconds]
+//        cplug_example_bench grid [-s seconds]
+//        cplug_example_bench midi [-s seconds]
+//        cplug_example_bench midiout [-s seconds]
+//        cplug_example_bench mod [-s seconds]
+//        cplug_example_bench envelope [-s seconds]
+//        cplug_example_bench workers [-s seconds]
+//        cplug_example_bench offline [-s seconds]
+#include "defs.h"
+#include "perfect_hash.h"
+#include "preset_bank.h"
+#include "saturator.h"
+#include "scope.h"
+#include "soft_raster.h"
+#include "spsc_ring.h"
+#include "state.h"
+#include "voice_groups.h"
+#include "worker_pool.h"
+#include <cplug.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// main.c is linked without an editor. The host never opens one, but the symbols
+// still need to resolve
+void imgui_library_load(void) {}
+void imgui_library_unload(void) {}
+void imgui_init(GUI *gui) {}
+void imgui_deinit(GUI *gui) {}
+void imgui_start(GUI *gui) {}
+bool imgui_tick(GUI *gui) { return false; }
+void imgui_set_scale(GUI *gui, float scale) {}
+void imgui_handle_event(GUI *gui, const PWEvent *event) {}
+
+// Results of timed loops are stored here so the compiler can't drop the work
+static volatile uint64_t g_benchSink;
+
+static const uint32_t BENCH_BLOCK_SIZES[] = {1,   2,   4,   8,    16,   32,  64,
+                                             128, 256, 512, 1024, 2048, 4096};
+static const double BENCH_SAMPLE_RATES[] = {44100, 48000, 96000, 192000};
+
+typedef struct BenchEvent {
+    uint64_t time; // absolute sample position
+    CplugEvent event;
+} BenchEvent;
+
+typedef struct BenchScript {
+    BenchEvent *events;
+    uint32_t numEvents;
+    uint32_t capacity;
+} BenchScript;
+
+// Stub process context. The embedded CplugProcessContext must stay the first
+// member so the callbacks can cast back
+typedef struct BenchContext {
+    CplugProcessContext proc;
+
+    const BenchScript *script;
+    uint32_t cursor;
+    uint64_t blockStart;
+
+    float *outputs[PLUGIN_NUM_OUTPUT_BUSES][2];
+    float *inputs[2];
+    // Output buses the host connected. The rest read as NULL
+    uint32_t numConnected;
+    uint64_t numEnqueued;
+    // When set, the MIDI the plugin sends is kept here at its sample time
+    BenchScript *captured;
+} BenchContext;
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift, so every run of the benchmark replays the exact same script
+static uint32_t bench_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void bench_script_push(BenchScript *script, uint64_t time,
+                              const CplugEvent *event) {
+    if (script->numEvents == script->capacity) {
+        script->capacity = script->capacity ? script->capacity * 2 : 1024;
+        script->events = (BenchEvent *)realloc(
+            script->events, sizeof(BenchEvent) * script->capacity);
+    }
+    script->events[script->numEvents].time = time;
+    script->events[script->numEvents].event = *event;
+    script->numEvents++;
+}
+
+// Builds a timeline that keeps 'polyphony' notes held, replacing the oldest one
+// every 'noteInterval' samples, while automating 'pf32' every 64 samples.
+// Events are generated in time order, so no sorting is needed
+static void bench_script_build(BenchScript *script, uint64_t numSamples,
+                               double sampleRate, int polyphony) {
+    script->numEvents = 0;
+
+    uint32_t seed = 0x1234567;
+    int held[128];
+    int numHeld = 0;
+    int oldest = 0;
+
+    const uint64_t noteInterval = (uint64_t)(sampleRate * 0.25);
+    const uint64_t automationInterval = 64;
+
+    uint64_t nextNote = 0;
+    uint64_t nextAutomation = 0;
+    while (nextNote < numSamples || nextAutomation < numSamples) {
+        CplugEvent event;
+        memset(&event, 0, sizeof(event));
+
+        if (nextNote <= nextAutomation) {
+            if (numHeld == polyphony && polyphony > 0) {
+                event.midi.type = CPLUG_EVENT_MIDI;
+                event.midi.status = 0x80;
+                event.midi.data1 = (uint8_t)held[oldest];
+                event.midi.data2 = 0;
+                bench_script_push(script, nextNote, &event);
+
+                held[oldest] = 36 + bench_rand(&seed) % 60;
+                event.midi.status = 0x90;
+                event.midi.data1 = (uint8_t)held[oldest];
+                event.midi.data2 = (uint8_t)(1 + bench_rand(&seed) % 127);
+                bench_script_push(script, nextNote, &event);
+                oldest = (oldest + 1) % polyphony;
+            } else if (numHeld < polyphony) {
+                held[numHeld] = 36 + bench_rand(&seed) % 60;
+                event.midi.type = CPLUG_EVENT_MIDI;
+                event.midi.status = 0x90;
+                event.midi.data1 = (uint8_t)held[numHeld];
+                event.midi.data2 = (uint8_t)(1 + bench_rand(&seed) % 127);
+                bench_script_push(script, nextNote, &event);
+                numHeld++;
+            }
+            nextNote += numHeld < polyphony ? 1 : noteInterval;
+        } else {
+            event.parameter.type = CPLUG_EVENT_PARAM_CHANGE_UPDATE;
+            event.parameter.id = 'pf32';
+            event.parameter.value = (double)(bench_rand(&seed) % 10000) / 100.0;
+            bench_script_push(script, nextAutomation, &event);
+            nextAutomation += automationInterval;
+        }
+    }
+}
+
+static bool bench_enqueue_event(CplugProcessContext *ctx,
+                                const CplugEvent *event, uint32_t frameIdx) {
+    BenchContext *bench = (BenchContext *)ctx;
+    bench->numEnqueued++;
+    if (bench->captured && event->type == CPLUG_EVENT_MIDI)
+        bench_script_push(bench->captured, bench->blockStart + frameIdx,
+                          event);
+    return true;
+}
+
+// Mirrors the contract of the CPLUG format wrappers: events due at or before
+// 'frame' are returned first, then a CPLUG_EVENT_PROCESS_AUDIO event spanning
+// up to the next event (or the end of the block)
+static bool bench_dequeue_event(CplugProcessContext *ctx, CplugEvent *event,
+                                uint32_t frame) {
+    BenchContext *bench = (BenchContext *)ctx;
+    if (frame >= ctx->numFrames)
+        return false;
+
+    const BenchScript *script = bench->script;
+    const uint64_t blockEnd = bench->blockStart + ctx->numFrames;
+    if (bench->cursor < script->numEvents) {
+        const BenchEvent *next = &script->events[bench->cursor];
+        if (next->time <= bench->blockStart + frame) {
+            *event = next->event;
+            bench->cursor++;
+            return true;
+        }
+        event->processAudio.type = CPLUG_EVENT_PROCESS_AUDIO;
+        event->processAudio.endFrame =
+            next->time < blockEnd ? (uint32_t)(next->time - bench->blockStart)
+                                  : ctx->numFrames;
+        return true;
+    }
+    event->processAudio.type = CPLUG_EVENT_PROCESS_AUDIO;
+    event->processAudio.endFrame = ctx->numFrames;
+    return true;
+}
+
+static float **bench_get_audio_input(const CplugProcessContext *ctx,
+                                     uint32_t busIdx) {
+    BenchContext *bench = (BenchContext *)ctx;
+    return busIdx == 0 ? bench->inputs : NULL;
+}
+
+static float **bench_get_audio_output(const CplugProcessContext *ctx,
+                                      uint32_t busIdx) {
+    BenchContext *bench = (BenchContext *)ctx;
+    return busIdx < bench->numConnected ? bench->outputs[busIdx] : NULL;
+}
+
+static uint32_t bench_count_voices(const Plugin *plugin) {
+    return plugin->voices.numActive;
+}
+
+// The bench runs faster than real time, which the Auto render mode would take
+// for a bounce. Every mode but "offline" measures the realtime paths
+static void *bench_create_plugin(void) {
+    void *plugin = cplug_createPlugin(NULL);
+    cplug_setParameterValue(plugin, 'rmod', RENDER_MODE_REALTIME);
+    return plugin;
+}
+
+static void bench_context_init(BenchContext *bench, const BenchScript *script,
+                               uint32_t blockSize) {
+    memset(bench, 0, sizeof(*bench));
+    bench->proc.enqueueEvent = bench_enqueue_event;
+    bench->proc.dequeueEvent = bench_dequeue_event;
+    bench->proc.getAudioInput = bench_get_audio_input;
+    bench->proc.getAudioOutput = bench_get_audio_output;
+    bench->script = script;
+    // Like a host with a stereo output only
+    bench->numConnected = 1;
+    for (int ch = 0; ch < 2; ch++) {
+        for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+            bench->outputs[b][ch] = (float *)calloc(blockSize, sizeof(float));
+        bench->inputs[ch] = (float *)calloc(blockSize, sizeof(float));
+    }
+}
+
+static void bench_context_free(BenchContext *bench) {
+    for (int ch = 0; ch < 2; ch++) {
+        for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+            free(bench->outputs[b][ch]);
+        free(bench->inputs[ch]);
+    }
+}
+
+typedef struct BenchResult {
+    double nsPerSample;
+    double worstBlockNs;
+    double deadlineNs;
+    uint64_t numOverruns;
+    double voiceSamplesPerSecond;
+} BenchResult;
+
+static BenchResult bench_run(uint32_t blockSize, double sampleRate,
+                             double seconds, int polyphony) {
+    BenchResult result;
+    memset(&result, 0, sizeof(result));
+
+    const uint64_t numSamples = (uint64_t)(seconds * sampleRate);
+    // A short unmeasured warm up lets the held notes and caches settle before
+    // timing starts
+    const uint64_t warmupSamples = (uint64_t)(0.1 * sampleRate);
+
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    bench_script_build(&script, warmupSamples + numSamples, sampleRate,
+                       polyphony);
+
+    BenchContext bench;
+    bench_context_init(&bench, &script, blockSize);
+
+    void *plugin = bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, blockSize);
+
+    uint64_t totalNs = 0;
+    uint64_t worstNs = 0;
+    double voiceSamples = 0;
+    const double deadlineNs = 1e9 * blockSize / sampleRate;
+
+    for (uint64_t pos = 0; pos < warmupSamples + numSamples; pos += blockSize) {
+        bench.blockStart = pos;
+        bench.proc.numFrames = blockSize;
+
+        uint64_t start = bench_now_ns();
+        cplug_process(plugin, &bench.proc);
+        uint64_t elapsed = bench_now_ns() - start;
+
+        if (pos < warmupSamples)
+            continue;
+        totalNs += elapsed;
+        if (elapsed > worstNs)
+            worstNs = elapsed;
+        if (elapsed > deadlineNs)
+            result.numOverruns++;
+        voiceSamples +=
+            (double)bench_count_voices((const Plugin *)plugin) * blockSize;
+    }
+
+    cplug_destroyPlugin(plugin);
+    bench_context_free(&bench);
+    free(script.events);
+
+    result.nsPerSample = (double)totalNs / (double)numSamples;
+    result.worstBlockNs = (double)worstNs;
+    result.deadlineNs = deadlineNs;
+    result.voiceSamplesPerSecond =
+        totalNs ? voiceSamples * 1e9 / (double)totalNs : 0;
+    return result;
+}
+
+// The per-sample loop cplug_process used before the oscillator kernels, kept as
+// the baseline
+static float bench_sine_add_libm(float *out, uint32_t numFrames, float phase,
+                                 float inc, float gain, float gainMul,
+                                 float gainAdd) {
+    static const float mypi = 3.141592653589793f;
+    for (uint32_t i = 0; i < numFrames; i++) {
+        out[i] += gain * sinf(2 * mypi * phase);
+        gain = gain * gainMul + gainAdd;
+        phase += inc;
+        phase -= (int)phase;
+    }
+    return phase;
+}
+
+// Checks every oscillator kernel the CPU supports against libm, steady and
+// under an envelope's exponential gain, then times it against the libm loop
+static int bench_osc(double seconds) {
+    enum {
+        NUM_ACCURACY_SAMPLES = 1 << 20,
+        NUM_RAMP_SAMPLES = 4800,
+        NUM_VOICES = 64,
+        BLOCK_SIZE = 4096
+    };
+    float *out = (float *)malloc(sizeof(float) * NUM_ACCURACY_SAMPLES);
+
+    // An increment of 2^-20 keeps every phase exactly representable, so the
+    // only error left is the approximation
+    const float accuracyInc = 1.0f / NUM_ACCURACY_SAMPLES;
+
+    printf("%-8s %14s %14s %14s %12s\n", "kernel", "max abs error",
+           "ramp error", "ns/voice/smp", "speedup");
+
+    double baselineNs = 0;
+    int failed = 0;
+    for (int level = -1; level < OSC_KERNEL_COUNT; level++) {
+        OscSineAddFn kernel =
+            level < 0 ? bench_sine_add_libm : osc_get_kernel(level);
+        const char *name = level < 0 ? "libm" : osc_kernel_name(level);
+        if (kernel == NULL) {
+            printf("%-8s %14s\n", name, "unsupported");
+            continue;
+        }
+
+        memset(out, 0, sizeof(float) * NUM_ACCURACY_SAMPLES);
+        kernel(out, NUM_ACCURACY_SAMPLES, 0.0f, accuracyInc, 1.0f, 1.0f,
+               0.0f);
+        double maxError = 0;
+        for (int i = 0; i < NUM_ACCURACY_SAMPLES; i++) {
+            double expected =
+                sin(2 * 3.14159265358979323846 * i / NUM_ACCURACY_SAMPLES);
+            double err = fabs((double)out[i] - expected);
+            if (err > maxError)
+                maxError = err;
+        }
+        // Documented bound in osc.h
+        if (level >= 0 && maxError > 3e-7)
+            failed = 1;
+
+        // 60 dB down over 100 ms, like a release. Rounding builds up along
+        // the gain recurrence, so the error is measured against its closed
+        // form with a looser bound
+        const double rampRate = log(1e-3) / NUM_RAMP_SAMPLES;
+        memset(out, 0, sizeof(float) * NUM_RAMP_SAMPLES);
+        kernel(out, NUM_RAMP_SAMPLES, 0.0f, 1.0f / 128, 1.0f,
+               (float)exp(rampRate), 0.0f);
+        double maxRampError = 0;
+        for (int i = 0; i < NUM_RAMP_SAMPLES; i++) {
+            double expected =
+                exp(rampRate * i) * sin(2 * 3.14159265358979323846 * i / 128);
+            double err = fabs((double)out[i] - expected);
+            if (err > maxRampError)
+                maxRampError = err;
+        }
+        if (level >= 0 && maxRampError > 1e-5)
+            failed = 1;
+
+        float phases[NUM_VOICES];
+        float incs[NUM_VOICES];
+        for (int v = 0; v < NUM_VOICES; v++) {
+            phases[v] = 0;
+            incs[v] = 440.0f * exp2f((float)(v - 32) / 12.0f) / 48000.0f;
+        }
+
+        uint64_t numSamples = 0;
+        uint64_t start = bench_now_ns();
+        uint64_t elapsed = 0;
+        while (elapsed < seconds * 1e9) {
+            memset(out, 0, sizeof(float) * BLOCK_SIZE);
+            for (int v = 0; v < NUM_VOICES; v++)
+                phases[v] = kernel(out, BLOCK_SIZE, phases[v], incs[v], 0.1f,
+                                   1.0f, 0.0f);
+            numSamples += (uint64_t)NUM_VOICES * BLOCK_SIZE;
+            elapsed = bench_now_ns() - start;
+        }
+        double ns = (double)elapsed / (double)numSamples;
+        if (level < 0)
+            baselineNs = ns;
+        printf("%-8s %14.3g %14.3g %14.3f %11.2fx\n", name, maxError,
+               maxRampError, ns, baselineNs / ns);
+    }
+
+    free(out);
+    if (failed)
+        printf("FAILED: kernel error above the 3e-7 bound documented in "
+               "osc.h, or ramp error above 1e-5\n");
+    return failed;
+}
+
+// ID -> index lookup at patch sizes far beyond the plugin's own table: perfect
+// hash against the old linear scan
+static int bench_params(double seconds) {
+    static const uint32_t sizes[] = {NUM_PARAMS, 1000, 10000};
+    enum { NUM_QUERIES = 4096 };
+
+    printf("%8s %12s %16s %16s\n", "params", "build (us)", "hash ns/lookup",
+           "linear ns/lookup");
+    int failed = 0;
+    for (int s = 0; s < ARRLEN(sizes); s++) {
+        const uint32_t numKeys = sizes[s];
+        uint32_t *keys = (uint32_t *)malloc(sizeof(uint32_t) * numKeys);
+        uint32_t queries[NUM_QUERIES];
+        uint32_t seed = 0xbeef;
+
+        if (numKeys == NUM_PARAMS) {
+            memcpy(keys, PARAM_IDS, sizeof(PARAM_IDS));
+        } else {
+            // Distinct IDs: multiplying by an odd constant is a bijection
+            for (uint32_t i = 0; i < numKeys; i++)
+                keys[i] = (i + 1) * 0x9e3779b1u;
+        }
+        for (int q = 0; q < NUM_QUERIES; q++)
+            queries[q] = keys[bench_rand(&seed) % numKeys];
+
+        PerfectHash hash;
+        uint64_t start = bench_now_ns();
+        bool ok = perfect_hash_build(&hash, keys, numKeys);
+        uint64_t buildNs = bench_now_ns() - start;
+        if (!ok) {
+            printf("%8u FAILED to build\n", numKeys);
+            failed = 1;
+            free(keys);
+            continue;
+        }
+        for (uint32_t i = 0; i < numKeys; i++)
+            if (perfect_hash_find(&hash, keys, keys[i]) != i)
+                failed = 1;
+        if (perfect_hash_find(&hash, keys, 0) != numKeys)
+            failed = 1;
+
+        uint64_t sum = 0;
+        uint64_t numLookups = 0;
+        start = bench_now_ns();
+        uint64_t elapsed = 0;
+        while (elapsed < seconds * 0.5e9) {
+            for (int q = 0; q < NUM_QUERIES; q++)
+                sum += perfect_hash_find(&hash, keys, queries[q]);
+            numLookups += NUM_QUERIES;
+            elapsed = bench_now_ns() - start;
+        }
+        double hashNs = (double)elapsed / (double)numLookups;
+
+        numLookups = 0;
+        start = bench_now_ns();
+        elapsed = 0;
+        while (elapsed < seconds * 0.5e9) {
+            for (int q = 0; q < NUM_QUERIES; q++) {
+                uint32_t i = 0;
+                for (; i < numKeys; i++)
+                    if (keys[i] == queries[q])
+                        break;
+                sum += i;
+            }
+            numLookups += NUM_QUERIES;
+            elapsed = bench_now_ns() - start;
+        }
+        double linearNs = (double)elapsed / (double)numLookups;
+
+        g_benchSink = sum;
+        printf("%8u %12.1f %16.2f %16.2f\n", numKeys, buildNs / 1000.0, hashNs,
+               linearNs);
+        perfect_hash_free(&hash);
+        free(keys);
+    }
+    if (failed)
+        printf("FAILED: perfect hash returned a wrong index\n");
+    return failed;
+}
+
+// Smoothed value of a parameter one sample on from 'value', on its way from
+// 'start' to 'target' over 'rampSamples', computed sample by sample in double
+static double bench_smooth_reference(uint32_t param, double value,
+                                     double start, double target,
+                                     double rampSamples) {
+    switch (PARAM_INFO[param].smoothing) {
+    case SMOOTH_ONE_POLE:
+        return target +
+               (value - target) * pow(SMOOTH_ONE_POLE_SETTLE, 1 / rampSamples);
+    case SMOOTH_MULTIPLICATIVE:
+        return value * pow(target / start, 1 / rampSamples);
+    default:
+        return value + (target - start) / rampSamples;
+    }
+}
+
+// Checks every smoothing mode against a reference computed sample by sample,
+// advancing the bank by blocks of random length, with a new target arriving a
+// third of the way into the ramp. Then times an advance of a control rate
+// chunk
+static int bench_smooth(double seconds) {
+    const float sampleRate = 48000;
+    static const struct {
+        uint32_t param;
+        float start, target, newTarget;
+    } cases[] = {
+        {PARAM_GAIN, -60, 6, -20},
+        {PARAM_FLOAT, 0, 100, 30},
+        {PARAM_LFO1_RATE, 0.05f, 20, 1},
+    };
+    static const char *mode_names[] = {"none", "linear", "one pole",
+                                       "multiplicative"};
+    static SmootherBank bank;
+    float values[NUM_PARAMS];
+    bool ok = true;
+
+    printf("%16s %12s %16s\n", "mode", "max error", "ns/advance");
+    for (int c = 0; c < ARRLEN(cases); c++) {
+        const uint32_t param = cases[c].param;
+        const ParamInfo *info = &PARAM_INFO[param];
+        for (uint32_t p = 0; p < NUM_PARAMS; p++)
+            values[p] = PARAM_INFO[p].defaultValue;
+        values[param] = cases[c].start;
+        smoother_bank_init(&bank, values);
+        smoother_bank_set_sample_rate(&bank, sampleRate);
+        const double rampSamples = bank.rampSamples[param];
+
+        double start = cases[c].start, target = cases[c].target;
+        double reference = start, remaining = rampSamples;
+        bool retargeted = false;
+        double maxErr = 0;
+        uint32_t seed = 0x5eed + c;
+        smoother_bank_set_target(&bank, param, cases[c].target);
+        for (uint32_t frame = 0; frame < 3 * rampSamples;) {
+            if (!retargeted && frame >= rampSamples / 3) {
+                smoother_bank_set_target(&bank, param, cases[c].newTarget);
+                start = reference;
+                target = cases[c].newTarget;
+                remaining = rampSamples;
+                retargeted = true;
+            }
+            const uint32_t numFrames = 1 + bench_rand(&seed) % 40;
+            smoother_bank_advance(&bank, numFrames);
+            for (uint32_t i = 0; i < numFrames; i++, remaining--)
+                reference = remaining > 1
+                                ? bench_smooth_reference(param, reference,
+                                                         start, target,
+                                                         rampSamples)
+                                : target;
+            frame += numFrames;
+            maxErr = fmax(maxErr, fabs(bank.value[param] - reference) /
+                                      (info->max - info->min));
+        }
+        // Settled exactly, and off the lanes
+        ok &= bank.value[param] == cases[c].newTarget &&
+              !smoother_bank_is_ramping(&bank, param) && maxErr < 1e-5;
+
+        uint64_t numAdvances = 0, elapsed = 0;
+        const uint64_t begin = bench_now_ns();
+        while (elapsed < seconds * 1e9 / ARRLEN(cases)) {
+            smoother_bank_set_target(&bank, param, cases[c].target);
+            // Chunks of 32 frames, as main.c renders while ramping
+            for (uint32_t i = 0; i < 16; i++)
+                smoother_bank_advance(&bank, 32);
+            smoother_bank_set_target(&bank, param, cases[c].start);
+            for (uint32_t i = 0; i < 16; i++)
+                smoother_bank_advance(&bank, 32);
+            numAdvances += 32;
+            elapsed = bench_now_ns() - begin;
+        }
+        g_benchSink += (uint64_t)bank.value[param];
+        printf("%16s %12.2g %16.2f\n", mode_names[info->smoothing], maxErr,
+               (double)elapsed / (double)numAdvances);
+    }
+    if (!ok)
+        printf("FAILED: smoothed value more than 1e-5 of the range from the "
+               "reference, or not settled on its target\n");
+    return ok ? 0 : 1;
+}
+
+typedef struct BenchRingThread {
+    SpscRing *ring;
+    uint32_t maxBatch;
+    uint64_t numEvents;
+    uint64_t numErrors;
+} BenchRingThread;
+
+// Spins briefly, then sleeps so the other thread gets to run on machines with
+// fewer cores than threads
+static void bench_ring_backoff(uint32_t *spins) {
+    if (++*spins < 64) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 1000};
+        nanosleep(&ts, NULL);
+        *spins = 0;
+    }
+}
+
+// Pushes events numbered 0 to numEvents - 1 in random sized batches, retrying
+// whatever didn't fit
+static void *bench_ring_producer(void *arg) {
+    BenchRingThread *t = (BenchRingThread *)arg;
+    uint32_t seed = 0x1234;
+    CplugEvent batch[256];
+    uint32_t spins = 0;
+    uint64_t next = 0;
+    while (next < t->numEvents) {
+        uint32_t count = 1 + bench_rand(&seed) % t->maxBatch;
+        if (count > t->numEvents - next)
+            count = (uint32_t)(t->numEvents - next);
+        for (uint32_t i = 0; i < count; i++) {
+            batch[i].parameter.type = CPLUG_EVENT_PARAM_CHANGE_UPDATE;
+            batch[i].parameter.id = (uint32_t)(next + i);
+            batch[i].parameter.value = (double)(next + i);
+        }
+        uint32_t done = 0;
+        while (done < count) {
+            uint32_t n = spsc_ring_push(t->ring, batch + done, count - done);
+            if (n == 0)
+                bench_ring_backoff(&spins);
+            done += n;
+        }
+        next += count;
+    }
+    return NULL;
+}
+
+// Pops in random sized batches and checks that every event arrives once, in
+// order and intact
+static void *bench_ring_consumer(void *arg) {
+    BenchRingThread *t = (BenchRingThread *)arg;
+    uint32_t seed = 0x5678;
+    CplugEvent batch[256];
+    uint32_t spins = 0;
+    uint64_t expected = 0;
+    while (expected < t->numEvents) {
+        uint32_t count = 1 + bench_rand(&seed) % t->maxBatch;
+        uint32_t n = spsc_ring_pop(t->ring, batch, count);
+        if (n == 0)
+            bench_ring_backoff(&spins);
+        for (uint32_t i = 0; i < n; i++, expected++) {
+            if (batch[i].parameter.id != (uint32_t)expected ||
+                batch[i].parameter.value != (double)expected)
+                t->numErrors++;
+        }
+    }
+    return NULL;
+}
+
+// Single threaded check of the overflow policy, then a producer and a consumer
+// thread hammering the ring with random batch sizes
+static int bench_ring(double seconds) {
+    static const uint32_t batchSizes[] = {1, 8, 64, 256};
+    int failed = 0;
+
+    {
+        CplugEvent storage[8], in[10], out[10];
+        SpscRing ring;
+        spsc_ring_init(&ring, storage, sizeof(CplugEvent), ARRLEN(storage));
+        for (uint32_t i = 0; i < ARRLEN(in); i++)
+            in[i].parameter.id = i;
+        uint32_t numPushed = spsc_ring_push(&ring, in, ARRLEN(in));
+        uint32_t numPopped = spsc_ring_pop(&ring, out, ARRLEN(out));
+        if (numPushed != 8 || ring.numDropped != 2 || ring.highWater != 8 ||
+            numPopped != 8 || spsc_ring_size(&ring) != 0)
+            failed = 1;
+        for (uint32_t i = 0; i < numPopped; i++)
+            if (out[i].parameter.id != i)
+                failed = 1;
+        printf("overflow: pushed %u/%u, dropped %u, popped %u %s\n", numPushed,
+               (uint32_t)ARRLEN(in), ring.numDropped, numPopped,
+               failed ? "FAILED" : "ok");
+    }
+
+    printf("%9s %12s %14s %10s %8s\n", "max batch", "events", "events/s",
+           "rejected", "errors");
+    for (int b = 0; b < ARRLEN(batchSizes); b++) {
+        static CplugEvent storage[CPLUG_EVENT_QUEUE_SIZE];
+        SpscRing ring;
+        spsc_ring_init(&ring, storage, sizeof(CplugEvent), ARRLEN(storage));
+
+        BenchRingThread t;
+        t.ring = &ring;
+        t.maxBatch = batchSizes[b];
+        t.numEvents = (uint64_t)(seconds * 2e7);
+        t.numErrors = 0;
+
+        pthread_t producer, consumer;
+        uint64_t start = bench_now_ns();
+        pthread_create(&consumer, NULL, bench_ring_consumer, &t);
+        pthread_create(&producer, NULL, bench_ring_producer, &t);
+        pthread_join(producer, NULL);
+        pthread_join(consumer, NULL);
+        uint64_t elapsed = bench_now_ns() - start;
+
+        if (t.numErrors != 0 || spsc_ring_size(&ring) != 0)
+            failed = 1;
+        printf("%9u %12llu %14.4g %10u %8llu\n", batchSizes[b],
+               (unsigned long long)t.numEvents,
+               (double)t.numEvents * 1e9 / (double)elapsed, ring.numDropped,
+               (unsigned long long)t.numErrors);
+    }
+    if (failed)
+        printf("FAILED: events lost, duplicated or reordered\n");
+    return failed;
+}
+
+typedef struct BenchNotifyThread {
+    ParamNotify *notify;
+    volatile uint32_t done;
+    uint64_t numChanges;
+} BenchNotifyThread;
+
+// Audio side: every parameter counts up from 0, changed in random order
+static void *bench_notify_audio(void *arg) {
+    BenchNotifyThread *t = (BenchNotifyThread *)arg;
+    float values[NUM_PARAMS] = {0};
+    uint32_t seed = 0x9abc;
+    for (uint64_t i = 0; i < t->numChanges; i++) {
+        uint32_t param = bench_rand(&seed) % NUM_PARAMS;
+        values[param] += 1.0f;
+        param_notify_set(t->notify, param, values[param]);
+    }
+    atomic_store_release_u32(&t->done, 1);
+    return NULL;
+}
+
+// Cost of notifying the GUI from the audio thread under dense automation,
+// queued (one ring event per change) against coalesced, then a concurrent check
+// that the GUI always ends up with the latest value of every parameter
+static int bench_notify(double seconds) {
+    static const uint32_t changesPerBlock[] = {16, 256, 4096};
+    static CplugEvent storage[CPLUG_EVENT_QUEUE_SIZE];
+    static ParamNotify notify;
+    float values[NUM_PARAMS];
+    int failed = 0;
+
+    printf("%10s %14s %14s %14s %16s\n", "changes", "queued ns", "dropped",
+           "coalesced ns", "GUI collect ns");
+    for (int c = 0; c < ARRLEN(changesPerBlock); c++) {
+        const uint32_t numChanges = changesPerBlock[c];
+        const uint32_t numBlocks = (uint32_t)(seconds * 1e6 / numChanges) + 1;
+        SpscRing ring;
+        spsc_ring_init(&ring, storage, sizeof(CplugEvent), ARRLEN(storage));
+        memset(&notify, 0, sizeof(notify));
+        uint32_t seed = 0xdef0;
+
+        // The GUI drains once per block in both cases
+        uint64_t queuedNs = 0, coalescedNs = 0, collectNs = 0;
+        for (uint32_t b = 0; b < numBlocks; b++) {
+            uint64_t start = bench_now_ns();
+            for (uint32_t i = 0; i < numChanges; i++) {
+                CplugEvent event;
+                event.parameter.type = CPLUG_EVENT_PARAM_CHANGE_UPDATE;
+                event.parameter.id = PARAM_IDS[i % NUM_PARAMS];
+                event.parameter.value = (double)i;
+                spsc_ring_push_one(&ring, &event);
+            }
+            queuedNs += bench_now_ns() - start;
+            CplugEvent drained[64];
+            while (spsc_ring_pop(&ring, drained, ARRLEN(drained)) > 0) {
+            }
+
+            start = bench_now_ns();
+            for (uint32_t i = 0; i < numChanges; i++)
+                param_notify_set(&notify, bench_rand(&seed) % NUM_PARAMS,
+                                 (float)i);
+            coalescedNs += bench_now_ns() - start;
+
+            start = bench_now_ns();
+            g_benchSink += param_notify_collect(&notify, values);
+            collectNs += bench_now_ns() - start;
+        }
+        const double total = (double)numBlocks * numChanges;
+        printf("%10u %14.2f %14u %14.2f %16.1f\n", numChanges,
+               queuedNs / total, ring.numDropped, coalescedNs / total,
+               (double)collectNs / numBlocks);
+    }
+
+    BenchNotifyThread t;
+    memset(&notify, 0, sizeof(notify));
+    t.notify = &notify;
+    t.done = 0;
+    t.numChanges = (uint64_t)(seconds * 2e7);
+    float seen[NUM_PARAMS] = {0};
+    float expected[NUM_PARAMS] = {0};
+    uint32_t seed = 0x9abc;
+    for (uint64_t i = 0; i < t.numChanges; i++)
+        expected[bench_rand(&seed) % NUM_PARAMS] += 1.0f;
+
+    pthread_t audio;
+    pthread_create(&audio, NULL, bench_notify_audio, &t);
+    uint64_t numFrames = 0;
+    for (;;) {
+        // Read 'done' before collecting, so the last collect sees every change
+        uint32_t done = atomic_load_acquire_u32(&t.done);
+        memcpy(values, seen, sizeof(values));
+        param_notify_collect(&notify, values);
+        for (int i = 0; i < NUM_PARAMS; i++)
+            if (values[i] < seen[i])
+                failed = 1; // went backwards
+        memcpy(seen, values, sizeof(seen));
+        numFrames++;
+        if (done)
+            break;
+        sched_yield();
+    }
+    pthread_join(audio, NULL);
+    for (int i = 0; i < NUM_PARAMS; i++)
+        if (seen[i] != expected[i])
+            failed = 1;
+    printf("concurrent: %llu changes seen in %llu GUI frames %s\n",
+           (unsigned long long)t.numChanges, (unsigned long long)numFrames,
+           failed ? "FAILED" : "ok");
+    return failed;
+}
+
+// In-memory stand-in for the host's state stream. 'maxRead' makes reads return
+// short, like hosts that deliver the state in pieces
+typedef struct BenchStream {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    size_t pos;
+    size_t maxRead;
+} BenchStream;
+
+static int64_t bench_stream_write(const void *stateCtx, void *writePos,
+                                  size_t numBytesToWrite) {
+    BenchStream *s = (BenchStream *)stateCtx;
+    if (s->size + numBytesToWrite > s->capacity) {
+        s->capacity = (s->size + numBytesToWrite) * 2;
+        s->data = (uint8_t *)realloc(s->data, s->capacity);
+    }
+    memcpy(s->data + s->size, writePos, numBytesToWrite);
+    s->size += numBytesToWrite;
+    return (int64_t)numBytesToWrite;
+}
+
+static int64_t bench_stream_read(const void *stateCtx, void *readPos,
+                                 size_t maxBytesToRead) {
+    BenchStream *s = (BenchStream *)stateCtx;
+    size_t n = s->size - s->pos;
+    if (n > maxBytesToRead)
+        n = maxBytesToRead;
+    if (s->maxRead && n > s->maxRead)
+        n = s->maxRead;
+    memcpy(readPos, s->data + s->pos, n);
+    s->pos += n;
+    return (int64_t)n;
+}
+
+typedef struct BenchStateLoad {
+    const PerfectHash *hash;
+    const uint32_t *ids;
+    float *values;
+    uint32_t numParams;
+} BenchStateLoad;
+
+static void bench_state_param(void *user, uint32_t paramId, float value) {
+    BenchStateLoad *load = (BenchStateLoad *)user;
+    uint32_t index = perfect_hash_find(load->hash, load->ids, paramId);
+    if (index < load->numParams)
+        load->values[index] = value;
+}
+
+// Round trip through the plugin, including the legacy format and the snapshot
+// handoff, then save/load times of the format itself at 10k parameters
+static int bench_state(double seconds) {
+    enum { NUM_BIG = 10000 };
+    int failed = 0;
+
+    // Plugin round trip
+    {
+        BenchScript script;
+        memset(&script, 0, sizeof(script));
+        BenchContext bench;
+        bench_context_init(&bench, &script, 64);
+        bench.proc.numFrames = 64;
+
+        cplug_libraryLoad();
+        void *src = bench_create_plugin();
+        void *dst = bench_create_plugin();
+        cplug_setSampleRateAndBlockSize(dst, 48000, 64);
+        cplug_setParameterValue(src, 'pf32', 12.5);
+        cplug_setParameterValue(src, 'poly', 7);
+        cplug_setParameterValue(src, 'gain', -3);
+        // IDs the plugin doesn't have are ignored, not written past the end
+        cplug_setParameterValue(src, 'nope', 1);
+
+        BenchStream stream;
+        memset(&stream, 0, sizeof(stream));
+        stream.maxRead = 5; // odd sized pieces cross every field boundary
+        cplug_saveState(src, &stream, bench_stream_write);
+        // Saving leaves the host's changes for the editor to redraw with
+        float seen[NUM_PARAMS] = {0};
+        param_notify_collect(&((Plugin *)src)->audioToMain, seen);
+        if (seen[PARAM_GAIN] != -3)
+            failed = 1;
+        cplug_loadState(dst, &stream, bench_stream_read);
+        // Hosts read the values back before the next process call, and after
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < NUM_PARAMS; i++)
+                if (cplug_getParameterValue(dst, PARAM_IDS[i]) !=
+                    cplug_getParameterValue(src, PARAM_IDS[i]))
+                    failed = 1;
+            cplug_process(dst, &bench.proc);
+        }
+        const uint32_t size = (uint32_t)stream.size;
+
+        // The flat {id, value} array older versions wrote
+        struct {
+            uint32_t paramId;
+            float value;
+        } legacy[2] = {{'pf32', 99.0f}, {'nope', 1.0f}};
+        stream.size = stream.pos = 0;
+        bench_stream_write(&stream, legacy, sizeof(legacy));
+        cplug_loadState(dst, &stream, bench_stream_read);
+        if (cplug_getParameterValue(dst, 'pf32') != 99.0)
+            failed = 1;
+        cplug_process(dst, &bench.proc);
+        if (cplug_getParameterValue(dst, 'pf32') != 99.0)
+            failed = 1;
+
+        printf("plugin round trip: %u bytes, legacy load %s\n", size,
+               failed ? "FAILED" : "ok");
+        cplug_destroyPlugin(src);
+        cplug_destroyPlugin(dst);
+        cplug_libraryUnload();
+        bench_context_free(&bench);
+        free(stream.data);
+    }
+
+    uint32_t *ids = (uint32_t *)malloc(sizeof(uint32_t) * NUM_BIG);
+    float *values = (float *)malloc(sizeof(float) * NUM_BIG);
+    float *loaded = (float *)malloc(sizeof(float) * NUM_BIG);
+    for (uint32_t i = 0; i < NUM_BIG; i++) {
+        ids[i] = (i + 1) * 0x9e3779b1u;
+        values[i] = (float)i * 0.25f;
+    }
+    PerfectHash hash;
+    perfect_hash_build(&hash, ids, NUM_BIG);
+    BenchStateLoad load = {&hash, ids, loaded, NUM_BIG};
+
+    BenchStream stream;
+    memset(&stream, 0, sizeof(stream));
+    uint64_t saveNs = 0, loadNs = 0, numRuns = 0;
+    StateResult result = STATE_OK;
+    while ((saveNs + loadNs) < seconds * 1e9) {
+        stream.size = stream.pos = 0;
+        uint64_t start = bench_now_ns();
+        state_write_all(&stream, bench_stream_write, ids, values, NUM_BIG);
+        saveNs += bench_now_ns() - start;
+
+        start = bench_now_ns();
+        result = state_read_all(&stream, bench_stream_read, bench_state_param,
+                                &load);
+        loadNs += bench_now_ns() - start;
+        numRuns++;
+    }
+    if (result != STATE_OK || memcmp(values, loaded, sizeof(float) * NUM_BIG))
+        failed = 1;
+
+    const double mb = (double)stream.size / (1024.0 * 1024.0);
+    const double saveUs = saveNs / 1000.0 / numRuns;
+    const double loadUs = loadNs / 1000.0 / numRuns;
+    printf("%8s %10s %10s %10s %10s %10s\n", "params", "bytes", "save (us)",
+           "save MB/s", "load (us)", "load MB/s");
+    printf("%8u %10u %10.1f %10.0f %10.1f %10.0f\n", NUM_BIG,
+           (uint32_t)stream.size, saveUs, mb / (saveUs * 1e-6), loadUs,
+           mb / (loadUs * 1e-6));
+
+    // Damage detection
+    stream.data[stream.size / 2] ^= 0x10;
+    stream.pos = 0;
+    StateResult corrupt =
+        state_read_all(&stream, bench_stream_read, bench_state_param, &load);
+    stream.data[stream.size / 2] ^= 0x10;
+    stream.size -= 3;
+    stream.pos = 0;
+    StateResult truncated =
+        state_read_all(&stream, bench_stream_read, bench_state_param, &load);
+    if (corrupt != STATE_BAD_CHECKSUM || truncated != STATE_TRUNCATED)
+        failed = 1;
+    printf("flipped bit: %s, truncated: %s\n",
+           corrupt == STATE_BAD_CHECKSUM ? "rejected" : "MISSED",
+           truncated == STATE_TRUNCATED ? "rejected" : "MISSED");
+
+    perfect_hash_free(&hash);
+    free(stream.data);
+    free(ids);
+    free(values);
+    free(loaded);
+    if (failed)
+        printf("FAILED: state did not survive the round trip\n");
+    return failed;
+}
+
+static bool bench_matches_snapshot(const Plugin *plugin,
+                                   const ParamSnapshot *snapshot) {
+    return memcmp(plugin->paramValuesAudio, snapshot->values,
+                  sizeof(snapshot->values)) == 0;
+}
+
+// Writes and opens a bank of 512 presets, then switches to a random preset
+// every block while notes play, compared with the same blocks without
+// switching. Also checks program changes and that replaced banks get freed
+static int bench_presets(double seconds) {
+    enum { NUM_PRESETS = 512, BLOCK_SIZE = 64 };
+    const double sampleRate = 48000;
+    int failed = 0;
+
+    char path[256];
+    const char *tmp = getenv("TMPDIR");
+    snprintf(path, sizeof(path), "%s/cplug_bench_presets.cpbk",
+             tmp ? tmp : "/tmp");
+
+    ParamSnapshot *presets =
+        (ParamSnapshot *)malloc(sizeof(ParamSnapshot) * NUM_PRESETS);
+    char(*nameStorage)[PRESET_NAME_SIZE] =
+        (char(*)[PRESET_NAME_SIZE])malloc(PRESET_NAME_SIZE * NUM_PRESETS);
+    const char **names = (const char **)malloc(sizeof(char *) * NUM_PRESETS);
+    uint32_t seed = 0x5eed;
+    for (uint32_t i = 0; i < NUM_PRESETS; i++) {
+        for (uint32_t p = 0; p < NUM_PARAMS; p++) {
+            const ParamInfo *info = &PARAM_INFO[p];
+            float t = (float)(bench_rand(&seed) % 1001) / 1000.0f;
+            float value = info->min + t * (info->max - info->min);
+            if (info->flags & (PARAM_INTEGER | PARAM_BOOL))
+                value = roundf(value);
+            presets[i].values[p] = value;
+        }
+        snprintf(nameStorage[i], PRESET_NAME_SIZE, "Preset %u", i);
+        names[i] = nameStorage[i];
+    }
+    if (!preset_bank_write(path, names, presets, NUM_PRESETS)) {
+        printf("FAILED: couldn't write %s\n", path);
+        return 1;
+    }
+
+    cplug_libraryLoad();
+    Plugin *plugin = (Plugin *)bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, BLOCK_SIZE);
+
+    uint64_t start = bench_now_ns();
+    if (!plugin_load_preset_bank(plugin, path)) {
+        printf("FAILED: couldn't open %s\n", path);
+        return 1;
+    }
+    const uint64_t openNs = bench_now_ns() - start;
+    for (uint32_t i = 0; i < NUM_PRESETS; i++)
+        if (memcmp(plugin->presetBank->snapshots[i].values, presets[i].values,
+                   sizeof(presets[i].values)) != 0 ||
+            strcmp(plugin_get_preset_name(plugin, i), names[i]) != 0)
+            failed = 1;
+    printf("opened %u presets in %.1f us (%.2f us per preset)\n", NUM_PRESETS,
+           openNs / 1000.0, openNs / 1000.0 / NUM_PRESETS);
+
+    // Program change on channel 1, half way into the block
+    {
+        BenchScript script;
+        memset(&script, 0, sizeof(script));
+        CplugEvent event;
+        memset(&event, 0, sizeof(event));
+        event.midi.type = CPLUG_EVENT_MIDI;
+        event.midi.status = 0xc0;
+        event.midi.data1 = 42;
+        bench_script_push(&script, BLOCK_SIZE / 2, &event);
+
+        BenchContext bench;
+        bench_context_init(&bench, &script, BLOCK_SIZE);
+        bench.proc.numFrames = BLOCK_SIZE;
+        cplug_process(plugin, &bench.proc);
+        if (!bench_matches_snapshot(plugin, &presets[42]) ||
+            plugin->currentPreset != 42)
+            failed = 1;
+        printf("program change: %s\n",
+               bench_matches_snapshot(plugin, &presets[42]) ? "ok" : "FAILED");
+        bench_context_free(&bench);
+        free(script.events);
+    }
+
+    const uint64_t numSamples = (uint64_t)(seconds * sampleRate);
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    bench_script_build(&script, numSamples, sampleRate, 8);
+
+    printf("%10s %10s %12s %10s\n", "switching", "ns/sample", "worst (us)",
+           "reloads");
+    uint32_t lastPreset = 0;
+    for (int switching = 0; switching <= 1; switching++) {
+        BenchContext bench;
+        bench_context_init(&bench, &script, BLOCK_SIZE);
+        uint64_t totalNs = 0, worstNs = 0;
+        uint32_t numReloads = 0;
+
+        for (uint64_t pos = 0; pos < numSamples; pos += BLOCK_SIZE) {
+            bench.blockStart = pos;
+            bench.proc.numFrames = BLOCK_SIZE;
+            if (switching) {
+                lastPreset = bench_rand(&seed) % NUM_PRESETS;
+                plugin_select_preset(plugin, lastPreset);
+                // Replace the bank now and then, so old ones must be retired
+                // while the audio thread is running
+                if ((pos / BLOCK_SIZE) % 256 == 255) {
+                    failed |= !plugin_load_preset_bank(plugin, path);
+                    plugin_select_preset(plugin, lastPreset);
+                    numReloads++;
+                }
+            }
+
+            start = bench_now_ns();
+            cplug_process(plugin, &bench.proc);
+            const uint64_t elapsed = bench_now_ns() - start;
+            totalNs += elapsed;
+            if (elapsed > worstNs)
+                worstNs = elapsed;
+        }
+        printf("%10s %10.2f %12.2f %10u\n", switching ? "every block" : "none",
+               (double)totalNs / numSamples, worstNs / 1000.0, numReloads);
+        bench_context_free(&bench);
+    }
+
+    // The script automates 'pf32', so check the last switch on a quiet block
+    {
+        BenchScript quiet;
+        memset(&quiet, 0, sizeof(quiet));
+        BenchContext bench;
+        bench_context_init(&bench, &quiet, BLOCK_SIZE);
+        bench.proc.numFrames = BLOCK_SIZE;
+        plugin_select_preset(plugin, lastPreset);
+        cplug_process(plugin, &bench.proc);
+        if (!bench_matches_snapshot(plugin, &presets[lastPreset]))
+            failed = 1;
+        bench_context_free(&bench);
+    }
+
+    // Every bank but the one replaced last has seen a process call finish
+    failed |= !plugin_load_preset_bank(plugin, path);
+    if (plugin->retiredBanks == NULL || plugin->retiredBanks->nextRetired)
+        failed = 1;
+    printf("retired banks: %s\n", plugin->retiredBanks &&
+                                           !plugin->retiredBanks->nextRetired
+                                       ? "freed"
+                                       : "LEAKED");
+
+    cplug_destroyPlugin(plugin);
+    cplug_libraryUnload();
+    free(script.events);
+    free(presets);
+    free(nameStorage);
+    free(names);
+    remove(path);
+    if (failed)
+        printf("FAILED: presets did not switch as expected\n");
+    return failed;
+}
+
+#if PLUGIN_WANT_LOAD_METER
+// Compares the plugin's own load meter with the wall clock around each process
+// call, so a miscalibrated cycle counter shows up
+static int bench_meter(double seconds, int polyphony, uint32_t blockSize) {
+    const double sampleRate = 48000;
+    const uint64_t numSamples = (uint64_t)(seconds * sampleRate);
+    int failed = 0;
+
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    bench_script_build(&script, numSamples, sampleRate, polyphony);
+    BenchContext bench;
+    bench_context_init(&bench, &script, blockSize);
+
+    cplug_libraryLoad();
+    Plugin *plugin = (Plugin *)bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, blockSize);
+
+    uint64_t totalNs = 0, worstNs = 0, numBlocks = 0;
+    for (uint64_t pos = 0; pos < numSamples; pos += blockSize) {
+        bench.blockStart = pos;
+        bench.proc.numFrames = blockSize;
+        uint64_t start = bench_now_ns();
+        cplug_process(plugin, &bench.proc);
+        uint64_t elapsed = bench_now_ns() - start;
+        totalNs += elapsed;
+        if (elapsed > worstNs)
+            worstNs = elapsed;
+        numBlocks++;
+    }
+
+    LoadMeterSummary load;
+    load_meter_summarize(&plugin->loadMeter, &load, NULL);
+    const double deadlineUs = 1e6 * blockSize / sampleRate;
+    printf("%.3g ticks per second, %u frame blocks (%.1f us deadline)\n",
+           plugin->loadMeter.ticksPerSecond, blockSize, deadlineUs);
+    printf("%10s %10s %10s %10s %10s %10s\n", "", "min (us)", "mean (us)",
+           "max (us)", "p99 %", "overruns");
+    printf("%10s %10.2f %10.2f %10.2f %10.1f %10llu\n", "meter", load.minUs,
+           load.meanUs, load.maxUs, load.p99Percent,
+           (unsigned long long)load.numOverruns);
+    printf("%10s %10s %10.2f %10.2f\n", "clock", "",
+           totalNs / 1000.0 / numBlocks, worstNs / 1000.0);
+
+    // The clock brackets the meter, so it can only read a little higher
+    if (load.numBlocks != numBlocks || load.meanUs > totalNs / 1000.0 /
+                                                        numBlocks * 1.05)
+        failed = 1;
+
+    load_meter_request_reset(&plugin->loadMeter);
+    bench.proc.numFrames = blockSize;
+    cplug_process(plugin, &bench.proc);
+    load_meter_summarize(&plugin->loadMeter, &load, NULL);
+    if (load.numBlocks != 1)
+        failed = 1;
+
+    cplug_destroyPlugin(plugin);
+    cplug_libraryUnload();
+    bench_context_free(&bench);
+    free(script.events);
+    if (failed)
+        printf("FAILED: load meter disagrees with the clock\n");
+    return failed;
+}
+#endif
+
+// Moves the notes of 'script' to the first 'numChannels' MIDI channels. The
+// channel follows the note number, so every note off finds its note on
+static void bench_script_spread(BenchScript *script, uint32_t numChannels) {
+    for (uint32_t i = 0; i < script->numEvents; i++) {
+        CplugEvent *event = &script->events[i].event;
+        if (event->type == CPLUG_EVENT_MIDI)
+            event->midi.status = (uint8_t)((event->midi.status & 0xf0) |
+                                           event->midi.data1 % numChannels);
+    }
+}
+
+typedef struct BenchBusesResult {
+    double nsPerSample;
+    // Loudest sample of every bus over the run
+    float peak[PLUGIN_NUM_OUTPUT_BUSES];
+} BenchBusesResult;
+
+static BenchBusesResult bench_buses_run(const BenchScript *script,
+                                        uint32_t numConnected,
+                                        uint32_t blockSize, double sampleRate,
+                                        uint64_t numSamples) {
+    BenchBusesResult result;
+    memset(&result, 0, sizeof(result));
+    BenchContext bench;
+    bench_context_init(&bench, script, blockSize);
+    bench.numConnected = numConnected;
+    void *plugin = bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, blockSize);
+
+    uint64_t totalNs = 0;
+    for (uint64_t pos = 0; pos < numSamples; pos += blockSize) {
+        bench.blockStart = pos;
+        bench.proc.numFrames = blockSize;
+        const uint64_t start = bench_now_ns();
+        cplug_process(plugin, &bench.proc);
+        totalNs += bench_now_ns() - start;
+
+        for (uint32_t b = 0; b < numConnected; b++)
+            for (int ch = 0; ch < 2; ch++)
+                for (uint32_t i = 0; i < blockSize; i++)
+                    result.peak[b] = fmaxf(result.peak[b],
+                                           fabsf(bench.outputs[b][ch][i]));
+    }
+    result.nsPerSample = (double)totalNs / (double)numSamples;
+
+    cplug_destroyPlugin(plugin);
+    bench_context_free(&bench);
+    return result;
+}
+
+// Cost of rendering to several output buses. Notes either all go to the main
+// bus or are spread over every bus, which the host connects all of or only the
+// main one. Silent buses must be exactly 0 and cost only their clearing,
+// disconnected ones must cost nothing and their notes must play on the main bus
+static int bench_buses(double seconds) {
+    const double sampleRate = 48000;
+    const uint32_t blockSize = 64;
+    const uint64_t numSamples = (uint64_t)(seconds / 4 * sampleRate);
+    int failed = 0;
+
+    BenchScript oneChannel, spread;
+    memset(&oneChannel, 0, sizeof(oneChannel));
+    memset(&spread, 0, sizeof(spread));
+    bench_script_build(&oneChannel, numSamples, sampleRate, 16);
+    bench_script_build(&spread, numSamples, sampleRate, 16);
+    bench_script_spread(&spread, PLUGIN_NUM_OUTPUT_BUSES);
+
+    cplug_libraryLoad();
+    printf("%d output buses, 16 held notes, %u frame blocks\n",
+           PLUGIN_NUM_OUTPUT_BUSES, blockSize);
+    printf("%-12s %10s %10s %s\n", "notes", "connected", "ns/sample",
+           "peak per bus");
+    static const struct {
+        bool spread;
+        uint32_t numConnected;
+    } configs[] = {
+        {false, 1},
+        {false, PLUGIN_NUM_OUTPUT_BUSES},
+        {true, PLUGIN_NUM_OUTPUT_BUSES},
+        {true, 1},
+    };
+    float mainPeak = 0.0f;
+    for (int c = 0; c < ARRLEN(configs); c++) {
+        const BenchBusesResult res = bench_buses_run(
+            configs[c].spread ? &spread : &oneChannel, configs[c].numConnected,
+            blockSize, sampleRate, numSamples);
+        printf("%-12s %10u %10.2f",
+               configs[c].spread ? "every bus" : "main bus",
+               configs[c].numConnected, res.nsPerSample);
+        for (uint32_t b = 0; b < configs[c].numConnected; b++)
+            printf(" %6.3f", res.peak[b]);
+
+        // Voices reach a bus only when their notes go there
+        bool ok = res.peak[0] > 0.0f;
+        for (uint32_t b = 1; b < configs[c].numConnected; b++)
+            ok &= (res.peak[b] > 0.0f) == configs[c].spread;
+        // Folded into the main bus, the notes sound as if they were sent there
+        if (configs[c].spread && configs[c].numConnected == 1)
+            ok &= res.peak[0] == mainPeak;
+        if (c == 0)
+            mainPeak = res.peak[0];
+        printf("%s\n", ok ? "" : "  FAILED");
+        if (!ok)
+            failed = 1;
+    }
+
+    cplug_libraryUnload();
+    free(oneChannel.events);
+    free(spread.events);
+    return failed;
+}
+
+// 'notes' moved onto a grid of 'noteGrid' frames, with the output gain
+// automated every 3 to 18 frames on top, like a host playing back a dense curve
+static void bench_script_dense(BenchScript *dense, const BenchScript *notes,
+                               uint64_t numSamples, uint32_t noteGrid) {
+    uint32_t seed = 0x9e3779b9;
+    dense->numEvents = 0;
+    uint32_t n = 0;
+    for (uint64_t time = 0; time < numSamples;
+         time += 3 + bench_rand(&seed) % 16) {
+        for (; n < notes->numEvents &&
+               notes->events[n].time / noteGrid * noteGrid <= time;
+             n++)
+            bench_script_push(dense,
+                              notes->events[n].time / noteGrid * noteGrid,
+                              &notes->events[n].event);
+        CplugEvent event;
+        memset(&event, 0, sizeof(event));
+        event.parameter.type = CPLUG_EVENT_PARAM_CHANGE_UPDATE;
+        event.parameter.id = 'gain';
+        event.parameter.value = -12.0 + (bench_rand(&seed) % 1200) / 100.0;
+        bench_script_push(dense, time, &event);
+    }
+    for (; n < notes->numEvents; n++)
+        bench_script_push(dense, notes->events[n].time / noteGrid * noteGrid,
+                          &notes->events[n].event);
+}
+
+// Throughput and accuracy of the event grid. The same dense script is played
+// sample accurately and on every grid; the error is the difference with the
+// sample accurate output, relative to it. Notes start on the coarsest grid:
+// moved by a few frames they would differ by their phase, not by their timing
+static int bench_grid(double seconds) {
+    const double sampleRate = 48000;
+    const uint32_t blockSize = 512;
+    const uint32_t numGrids = 5; // PARAM_EVENT_GRID values
+    // At least one block, so a short run still has output to compare
+    const uint64_t blocks =
+        (uint64_t)(seconds / numGrids * sampleRate) / blockSize;
+    const uint64_t numSamples = (blocks ? blocks : 1) * blockSize;
+    int failed = 0;
+
+    BenchScript notes, dense;
+    memset(&notes, 0, sizeof(notes));
+    memset(&dense, 0, sizeof(dense));
+    bench_script_build(&notes, numSamples, sampleRate, 16);
+    bench_script_dense(&dense, &notes, numSamples, 64);
+
+    float *reference = (float *)malloc(sizeof(float) * numSamples);
+    double referenceNs = 0, referencePower = 0;
+
+    cplug_libraryLoad();
+    printf("%u events over %.1f s, %u frame blocks\n", dense.numEvents,
+           numSamples / sampleRate, blockSize);
+    printf("%16s %10s %8s %15s %10s\n", "grid", "ns/sample", "speedup",
+           "max early (us)", "error (dB)");
+    for (uint32_t g = 0; g < numGrids; g++) {
+        BenchContext bench;
+        bench_context_init(&bench, &dense, blockSize);
+        void *plugin = bench_create_plugin();
+        cplug_setSampleRateAndBlockSize(plugin, sampleRate, blockSize);
+        cplug_setParameterValue(plugin, 'grid', g);
+
+        uint64_t totalNs = 0;
+        double errorPower = 0;
+        for (uint64_t pos = 0; pos < numSamples; pos += blockSize) {
+            bench.blockStart = pos;
+            bench.proc.numFrames = blockSize;
+            const uint64_t start = bench_now_ns();
+            cplug_process(plugin, &bench.proc);
+            totalNs += bench_now_ns() - start;
+
+            const float *out = bench.outputs[0][0];
+            for (uint32_t i = 0; i < blockSize; i++) {
+                if (g == 0) {
+                    reference[pos + i] = out[i];
+                    referencePower += (double)out[i] * out[i];
+                } else {
+                    const double d = out[i] - reference[pos + i];
+                    errorPower += d * d;
+                }
+            }
+        }
+        const double nsPerSample = (double)totalNs / numSamples;
+        if (g == 0)
+            referenceNs = nsPerSample;
+
+        char name[32];
+        cplug_parameterValueToString(plugin, 'grid', name, sizeof(name), g);
+        const uint32_t grid = g ? 4u << g : 1;
+        printf("%16s %10.2f %7.2fx %15.1f", name, nsPerSample,
+               referenceNs / nsPerSample, 1e6 * (grid - 1) / sampleRate);
+        if (g == 0)
+            printf(" %10s", "-");
+        else
+            printf(" %10.1f", 10 * log10(errorPower / referencePower + 1e-30));
+
+        // Every event must have been handled, whatever the grid
+        if (bench.cursor != dense.numEvents || referencePower == 0) {
+            printf("  FAILED");
+            failed = 1;
+        }
+        printf("\n");
+
+        cplug_destroyPlugin(plugin);
+        bench_context_free(&bench);
+    }
+
+    cplug_libraryUnload();
+    free(reference);
+    free(notes.events);
+    free(dense.events);
+    return failed;
+}
+
+// Lets every voice finish its glide
+static void bench_midi_settle(VoicePool *pool) {
+    float scratch[VOICE_CONTROL_FRAMES * VOICE_GLIDE_STEPS];
+    memset(scratch, 0, sizeof(scratch));
+    voice_pool_render(pool, scratch, ARRLEN(scratch));
+}
+
+static bool bench_midi_check(const char *name, bool ok) {
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Checks the decoder against the cases it handles, then measures what
+// expression costs the renderer: a pool of held voices, steady, then all
+// gliding because a bend arrives every block
+static int bench_midi(double seconds) {
+    static MidiDecoder midi;
+    static VoicePool pool;
+    const float sampleRate = 48000;
+    bool ok = true;
+
+    midi_decoder_init(&midi);
+    voice_pool_init(&pool, MAX_VOICES);
+    voice_pool_set_sample_rate(&pool, sampleRate);
+
+    midi_decode(&midi, &pool, 0x90, 60, 100);
+    midi_decode(&midi, &pool, 0x90, 60, 0);
+    ok &= bench_midi_check("velocity 0 is a note off", pool.numActive == 0);
+
+    midi_decode(&midi, &pool, 0xb0, 64, 127);
+    midi_decode(&midi, &pool, 0x90, 60, 100);
+    midi_decode(&midi, &pool, 0x80, 60, 0);
+    const bool sustained = pool.numActive == 1;
+    midi_decode(&midi, &pool, 0xb0, 64, 0);
+    ok &= bench_midi_check("sustain holds released notes",
+                           sustained && pool.numActive == 0);
+
+    midi_decode(&midi, &pool, 0x90, 60, 100);
+    midi_decode(&midi, &pool, 0xb0, 66, 127);
+    midi_decode(&midi, &pool, 0x90, 64, 100);
+    midi_decode(&midi, &pool, 0x80, 60, 0);
+    midi_decode(&midi, &pool, 0x80, 64, 0);
+    const bool latched = pool.numActive == 1 &&
+                         voice_pool_find(&pool, 0, 60) != VOICE_NONE;
+    midi_decode(&midi, &pool, 0xb0, 66, 0);
+    ok &= bench_midi_check("sostenuto holds only the keys it latched",
+                           latched && pool.numActive == 0);
+
+    // Bend range of 12 semitones, through RPN 0, then the bend all the way up
+    midi_decode(&midi, &pool, 0xb0, 101, 0);
+    midi_decode(&midi, &pool, 0xb0, 100, 0);
+    midi_decode(&midi, &pool, 0xb0, 6, 12);
+    midi_decode(&midi, &pool, 0xb0, 38, 0);
+    midi_decode(&midi, &pool, 0x90, 57, 100);
+    midi_decode(&midi, &pool, 0xe0, 0x7f, 0x7f);
+    const uint32_t v = voice_pool_find(&pool, 0, 57);
+    bench_midi_settle(&pool);
+    const float bentHz = pool.inc[v] * sampleRate;
+    const float expectedHz = 220.0f * exp2f(8191.0f / 8192.0f);
+    ok &= bench_midi_check("RPN 0 sets the bend range",
+                           fabsf(bentHz - expectedHz) < 0.05f);
+    midi_decode(&midi, &pool, 0xb0, 123, 0);
+    midi_decode(&midi, &pool, 0xb0, 121, 0);
+
+    midi_decode(&midi, &pool, 0xb0, 7, 64);
+    midi_decode(&midi, &pool, 0xb0, 39, 64);
+    ok &= bench_midi_check("14 bit controllers",
+                           midi_cc14(&midi.channels[0], 7) == (64 << 7 | 64));
+    midi_decode(&midi, &pool, 0xb0, 7, 127);
+
+    // Lower MPE zone over every channel: RPN 6 on the master
+    midi_decode(&midi, &pool, 0xb0, 101, 0);
+    midi_decode(&midi, &pool, 0xb0, 100, 6);
+    midi_decode(&midi, &pool, 0xb0, 6, 15);
+    midi_decode(&midi, &pool, 0x91, 60, 100);
+    midi_decode(&midi, &pool, 0x92, 64, 100);
+    const uint32_t a = voice_pool_find(&pool, 1, 60);
+    const uint32_t b = voice_pool_find(&pool, 2, 64);
+    // Half of the 48 semitone member range
+    midi_decode(&midi, &pool, 0xe1, 0, 0x60);
+    bench_midi_settle(&pool);
+    const bool perNote = fabsf(pool.inc[a] / pool.baseInc[a] - 4.0f) < 1e-3f &&
+                         pool.inc[b] == pool.baseInc[b];
+    midi_decode(&midi, &pool, 0xe0, 0, 0x60); // master, 2 semitones range
+    bench_midi_settle(&pool);
+    const float up = exp2f(1.0f / 12.0f);
+    const bool zoneWide =
+        fabsf(pool.inc[a] / pool.baseInc[a] - 4.0f * up) < 1e-3f &&
+        fabsf(pool.inc[b] / pool.baseInc[b] - up) < 1e-3f;
+    ok &= bench_midi_check("MPE bend on a member moves its note only",
+                           midi.lowerMembers == 15 && perNote);
+    ok &= bench_midi_check("MPE bend on the master moves the zone",
+                           zoneWide);
+    midi_decode(&midi, &pool, 0xd2, 127, 0);
+    bench_midi_settle(&pool);
+    const bool pressed = fabsf(pool.gain[b] / pool.baseGain[b] - 2.0f) < 1e-3f;
+    ok &= bench_midi_check("MPE pressure is per note",
+                           pressed && pool.gain[a] == pool.baseGain[a]);
+
+    // CC 74 all the way down on a member: its note plays a table with fewer
+    // harmonics, the other one the table its pitch needs. Picking a level only
+    // reads the sample rate of the set
+    static WavetableSet tables;
+    tables.sampleRate = sampleRate;
+    pool.wavetables = &tables;
+    midi_decode(&midi, &pool, 0xb1, 74, 0);
+    const uint32_t darkLevel = voice_pool_table_level(&pool, a);
+    const uint32_t pitchLevel = wavetable_level(&tables, pool.inc[a]);
+    ok &= bench_midi_check(
+        "low timbre plays fewer harmonics",
+        darkLevel == pitchLevel + VOICE_TIMBRE_LEVELS &&
+            wavetable_max_harmonic(darkLevel, sampleRate) <
+                wavetable_max_harmonic(pitchLevel, sampleRate) &&
+            voice_pool_table_level(&pool, b) ==
+                wavetable_level(&tables, pool.inc[b]));
+    pool.wavetables = NULL;
+
+    // Expression cost: 64 voices, steady or gliding all the time
+    const uint32_t numVoices = 64, blockSize = 64;
+    float out[64];
+    printf("%10s %14s\n", "voices", "ns/voice/smp");
+    for (int gliding = 0; gliding < 2; gliding++) {
+        midi_decoder_init(&midi);
+        voice_pool_init(&pool, MAX_VOICES);
+        voice_pool_set_sample_rate(&pool, sampleRate);
+        for (uint32_t n = 0; n < numVoices; n++)
+            midi_decode(&midi, &pool, 0x90 | (n % 16), 24 + n, 100);
+
+        uint64_t numBlocks = 0, elapsed;
+        uint32_t bend = 0;
+        const uint64_t start = bench_now_ns();
+        do {
+            for (int i = 0; i < 64; i++, numBlocks++) {
+                if (gliding) {
+                    // One bend per channel, so every voice glides
+                    bend = (bend + 97) & 0x3fff;
+                    for (uint8_t c = 0; c < 16; c++)
+                        midi_decode(&midi, &pool, 0xe0 | c, bend & 0x7f,
+                                        (uint8_t)(bend >> 7));
+                }
+                voice_pool_render(&pool, out, blockSize);
+            }
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / 2);
+        g_benchSink += (uint64_t)(out[0] * 1000);
+        printf("%10s %14.3f\n", gliding ? "gliding" : "steady",
+               (double)elapsed / ((double)numBlocks * blockSize * numVoices));
+    }
+    return ok ? 0 : 1;
+}
+
+// Pops everything due before 'end' from 'wheel', checking it comes out in time
+// order, after 'from', and due when it was scheduled for. 'times' holds the
+// time each event was scheduled for, indexed by its parameter ID. Returns the
+// number popped, or -1 on a mistake
+static int64_t bench_wheel_drain(TimerWheel *wheel, uint64_t from,
+                                 uint64_t end, const uint64_t *times,
+                                 uint32_t *lastId) {
+    CplugEvent event;
+    uint64_t time, previous = from;
+    int64_t numPopped = 0;
+    while (timer_wheel_pop(wheel, end, &event, &time)) {
+        const uint32_t id = event.parameter.id;
+        if (time < previous || time >= end || times[id] != time)
+            return -1;
+        // Ties come out in the order they were scheduled
+        if (time == previous && numPopped > 0 && id < *lastId)
+            return -1;
+        previous = time;
+        *lastId = id;
+        numPopped++;
+    }
+    return numPopped;
+}
+
+// Plays a chord into the plugin with the arpeggiator on, and keeps the MIDI it
+// sends during the first 'numSamples' in 'captured'
+static void bench_arp_run(BenchScript *captured, uint32_t blockSize,
+                          uint32_t grid, uint64_t numSamples) {
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    static const uint8_t chord[] = {64, 60, 67};
+    for (uint32_t i = 0; i < ARRLEN(chord); i++) {
+        CplugEvent event;
+        event.midi.type = CPLUG_EVENT_MIDI;
+        event.midi.status = 0x90;
+        event.midi.data1 = chord[i];
+        event.midi.data2 = 100;
+        bench_script_push(&script, 1000, &event);
+    }
+
+    BenchContext bench;
+    bench_context_init(&bench, &script, blockSize);
+    bench.captured = captured;
+    void *plugin = bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, 48000, blockSize);
+    cplug_setParameterValue(plugin, 'arpg', 3); // 1/16
+    cplug_setParameterValue(plugin, 'grid', grid);
+    for (uint64_t pos = 0; pos < numSamples; pos += blockSize) {
+        bench.blockStart = pos;
+        bench.proc.numFrames = blockSize;
+        cplug_process(plugin, &bench.proc);
+    }
+    // The last block may have run past the end
+    while (captured->numEvents > 0 &&
+           captured->events[captured->numEvents - 1].time >= numSamples)
+        captured->numEvents--;
+    cplug_destroyPlugin(plugin);
+    bench_context_free(&bench);
+    free(script.events);
+}
+
+// Checks the timer wheel pops thousands of events spread over several turns
+// exactly once, in order, whatever the block size, and that the arpeggiator's
+// notes reach the host at the frames they are due. Then times scheduling and
+// popping with few and with thousands of events pending
+static int bench_midiout(double seconds) {
+    static TimerWheel wheel;
+    static uint64_t times[TIMER_WHEEL_CAPACITY];
+    bool ok = true;
+
+    // Every block size, from a frame to more than a turn of the wheel
+    uint32_t seed = 0x2468ace;
+    bool inOrder = true;
+    for (uint32_t round = 0; round < 8 && inOrder; round++) {
+        timer_wheel_init(&wheel, 12345);
+        for (uint32_t i = 0; i < TIMER_WHEEL_CAPACITY; i++) {
+            CplugEvent event;
+            event.parameter.type = CPLUG_EVENT_PARAM_CHANGE_UPDATE;
+            event.parameter.id = i;
+            // Bunched up, so many share a time
+            times[i] =
+                12345 + bench_rand(&seed) % (5 * TIMER_WHEEL_SLOTS) / 8 * 8;
+            timer_wheel_schedule(&wheel, times[i], &event);
+        }
+        const uint32_t maxBlock =
+            round == 7 ? 3 * TIMER_WHEEL_SLOTS : 1u << round;
+        uint64_t pos = 12345;
+        int64_t numPopped = 0;
+        uint32_t lastId = 0;
+        while (numPopped >= 0 && wheel.numPending > 0) {
+            const uint64_t end = pos + 1 + bench_rand(&seed) % maxBlock;
+            const int64_t n =
+                bench_wheel_drain(&wheel, pos, end, times, &lastId);
+            numPopped = n < 0 ? -1 : numPopped + n;
+            pos = end;
+        }
+        inOrder = numPopped == TIMER_WHEEL_CAPACITY;
+    }
+    ok &= bench_midi_check("wheel pops every event in order", inOrder);
+
+    CplugEvent event;
+    memset(&event, 0, sizeof(event));
+    event.parameter.id = 0;
+    times[0] = 100;
+    timer_wheel_init(&wheel, 100);
+    for (uint32_t i = 0; i < TIMER_WHEEL_CAPACITY; i++)
+        timer_wheel_schedule(&wheel, 100, &event);
+    const bool full = !timer_wheel_schedule(&wheel, 100, &event) &&
+                      wheel.numDropped == 1;
+    uint32_t lastId = 0;
+    ok &= bench_midi_check("a full wheel drops the event",
+                           full && bench_wheel_drain(&wheel, 100, 101, times,
+                                                     &lastId) ==
+                                       TIMER_WHEEL_CAPACITY);
+
+    // A 1/16 step at 120 BPM and 48 kHz is 6000 frames. The chord goes down at
+    // frame 1000 and is held
+    const uint32_t stepFrames = 6000, numSteps = 9;
+    // Stops between two steps, so snapping to the grid can't add one
+    const uint64_t numSamples =
+        1000 + (uint64_t)stepFrames * numSteps - stepFrames / 4;
+    static const uint8_t upwards[] = {60, 64, 67};
+    static const uint32_t blockSizes[] = {1, 64, 1000, 4096};
+    bool onTime = true, sameEverywhere = true;
+    BenchScript reference;
+    memset(&reference, 0, sizeof(reference));
+    cplug_libraryLoad();
+    for (uint32_t b = 0; b < ARRLEN(blockSizes); b++) {
+        for (uint32_t grid = 0; grid < 2; grid++) {
+            BenchScript captured;
+            memset(&captured, 0, sizeof(captured));
+            bench_arp_run(&captured, blockSizes[b], grid * 3, numSamples);
+            if (b == 0 && grid == 0) {
+                onTime = captured.numEvents == 2 * numSteps;
+                for (uint32_t i = 0; i < captured.numEvents && onTime; i++) {
+                    const BenchEvent *e = &captured.events[i];
+                    const uint32_t step = i / 2;
+                    const bool on = i % 2 == 0;
+                    const uint64_t due = 1000 + (uint64_t)step * stepFrames +
+                                         (on ? 0 : stepFrames / 2);
+                    onTime = e->time == due &&
+                             (e->event.midi.status & 0xf0) ==
+                                 (on ? 0x90 : 0x80) &&
+                             e->event.midi.data1 == upwards[step % 3];
+                }
+                reference = captured;
+                continue;
+            }
+            // The grid moves the chord, and so the pattern, to the start of
+            // its sub-block of 32 frames
+            const uint64_t early = grid ? 31 : 0;
+            bool same = captured.numEvents == reference.numEvents;
+            for (uint32_t i = 0; i < captured.numEvents && same; i++)
+                same = captured.events[i].time <= reference.events[i].time &&
+                       captured.events[i].time + early >=
+                           reference.events[i].time &&
+                       memcmp(captured.events[i].event.midi.bytes,
+                              reference.events[i].event.midi.bytes, 3) == 0;
+            sameEverywhere &= same;
+            free(captured.events);
+        }
+    }
+    cplug_libraryUnload();
+    free(reference.events);
+    ok &= bench_midi_check("arpeggiator steps are sample accurate", onTime);
+    ok &= bench_midi_check("same MIDI for every block size and grid",
+                           sameEverywhere);
+
+    // Cost of an event, going through the wheel once: a block's worth pending,
+    // then the wheel nearly full
+    static const uint32_t pendings[] = {16, TIMER_WHEEL_CAPACITY - 64};
+    printf("%10s %12s %12s\n", "pending", "ns/event", "ns/block");
+    for (uint32_t p = 0; p < ARRLEN(pendings); p++) {
+        const uint32_t numPending = pendings[p];
+        // Spread over 8 turns of the wheel, so most are skipped in their slot
+        const uint64_t horizon = 8 * TIMER_WHEEL_SLOTS;
+        const uint64_t spacing = horizon / numPending;
+        timer_wheel_init(&wheel, 0);
+        memset(&event, 0, sizeof(event));
+        uint64_t next = 0, pos = 0, numEvents = 0, numBlocks = 0, elapsed;
+        for (uint32_t i = 0; i < numPending; i++, next += spacing)
+            timer_wheel_schedule(&wheel, next, &event);
+
+        const uint64_t start = bench_now_ns();
+        do {
+            // One block of 64 frames: pop what is due, schedule as much again
+            // at the far end
+            for (int i = 0; i < 1024; i++) {
+                uint64_t time;
+                while (timer_wheel_pop(&wheel, pos + 64, &event, &time)) {
+                    timer_wheel_schedule(&wheel, next, &event);
+                    next += spacing;
+                    numEvents++;
+                }
+                pos += 64;
+                numBlocks++;
+            }
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / 2);
+        g_benchSink += wheel.numPending;
+        printf("%10u %12.2f %12.2f\n", numPending,
+               (double)elapsed / (double)numEvents,
+               (double)elapsed / (double)numBlocks);
+        ok &= wheel.numPending == numPending && wheel.numDropped == 0;
+    }
+    return ok ? 0 : 1;
+}
+
+// Output of the plugin playing one held note for 'numSamples', with 'paramId'
+// set to 'value' beforehand, as an RMS level in dB
+static double bench_mod_level(uint32_t paramId, double value,
+                              uint64_t numSamples) {
+    const uint32_t blockSize = 256;
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    CplugEvent event;
+    event.midi.type = CPLUG_EVENT_MIDI;
+    event.midi.status = 0x90;
+    event.midi.data1 = 69;
+    event.midi.data2 = 127;
+    bench_script_push(&script, 0, &event);
+
+    BenchContext bench;
+    bench_context_init(&bench, &script, blockSize);
+    void *plugin = bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, 48000, blockSize);
+    cplug_setParameterValue(plugin, 'm1sr', MOD_SOURCE_MACRO1);
+    cplug_setParameterValue(plugin, 'm1ds', MOD_DEST_GAIN);
+    cplug_setParameterValue(plugin, 'm1am', -0.5);
+    cplug_setParameterValue(plugin, paramId, value);
+    double power = 0;
+    for (uint64_t pos = 0; pos < numSamples; pos += blockSize) {
+        bench.blockStart = pos;
+        bench.proc.numFrames = blockSize;
+        cplug_process(plugin, &bench.proc);
+        for (uint32_t i = 0; i < blockSize; i++)
+            power += (double)bench.outputs[0][0][i] * bench.outputs[0][0][i];
+    }
+    cplug_destroyPlugin(plugin);
+    bench_context_free(&bench);
+    free(script.events);
+    return 10 * log10(power / (double)numSamples + 1e-30);
+}
+
+// Checks the matrix on the cases it handles, then times a control step of a
+// patch of MOD_MAX_ROUTINGS routings over 64 voices, against the length of a
+// block
+static int bench_mod(double seconds) {
+    static ModMatrix mod;
+    static VoicePool pool;
+    float params[NUM_PARAMS];
+    for (uint32_t p = 0; p < NUM_PARAMS; p++)
+        params[p] = PARAM_INFO[p].defaultValue;
+    const float sampleRate = 48000;
+    bool ok = true;
+
+    // An LFO on the output gain: every step starts where the last one ended
+    mod_matrix_init(&mod, 32);
+    voice_pool_init(&pool, MAX_VOICES);
+    voice_pool_set_sample_rate(&pool, sampleRate);
+    mod_matrix_add(&mod, MOD_SOURCE_LFO1, MOD_DEST_GAIN, 0.5f);
+    mod_matrix_step(&mod, &pool, params, &params[PARAM_LFO1_RATE], 0,
+                    sampleRate);
+    bool continuous = mod.start[PARAM_GAIN] == mod.end[PARAM_GAIN];
+    float previousEnd = mod.end[PARAM_GAIN], swing = 0;
+    for (int step = 0; step < 2000; step++) {
+        mod.countdown = 0;
+        mod_matrix_step(&mod, &pool, params, &params[PARAM_LFO1_RATE], 0,
+                    sampleRate);
+        continuous &= mod_matrix_offset(&mod, PARAM_GAIN, 0) == previousEnd;
+        const float middle = mod_matrix_offset(&mod, PARAM_GAIN, 16);
+        continuous &= fabsf(middle - (previousEnd + mod.end[PARAM_GAIN]) /
+                                         2) < 1e-6f;
+        previousEnd = mod.end[PARAM_GAIN];
+        swing = fabsf(previousEnd) > swing ? fabsf(previousEnd) : swing;
+    }
+    ok &= bench_midi_check("global destinations move linearly",
+                           continuous && fabsf(swing - 0.5f) < 1e-3f);
+    ok &= bench_midi_check("per voice sources only reach voices",
+                           !mod_matrix_add(&mod, MOD_SOURCE_VELOCITY,
+                                           MOD_DEST_GAIN, 1.0f) &&
+                               !mod_matrix_add(&mod, MOD_SOURCE_LFO1,
+                                               MOD_DEST_COUNT, 1.0f));
+
+    // Velocity onto the voice level: a quarter of its 36 dB range per unit
+    mod_matrix_init(&mod, 32);
+    mod_matrix_add(&mod, MOD_SOURCE_VELOCITY, MOD_DEST_LEVEL, 0.25f);
+    const uint32_t soft = voice_pool_note_on(&pool, 0, 60, 0.25f);
+    const uint32_t loud = voice_pool_note_on(&pool, 0, 64, 1.0f);
+    mod_matrix_step(&mod, &pool, params, &params[PARAM_LFO1_RATE], 0,
+                    sampleRate);
+    const float levelDB = 20 * log10f((pool.gain[loud] / pool.baseGain[loud]) /
+                                      (pool.gain[soft] / pool.baseGain[soft]));
+    ok &= bench_midi_check("velocity sets the voice level",
+                           fabsf(levelDB - 0.75f * 9.0f) < 1e-3f);
+
+    // A note started between steps takes the pitch at once, no glide
+    params[PARAM_PITCH] = 12;
+    mod_matrix_step(&mod, &pool, params, &params[PARAM_LFO1_RATE], 0,
+                    sampleRate);
+    const uint32_t fresh = voice_pool_note_on(&pool, 0, 67, 1.0f);
+    mod_matrix_start_voices(&mod, &pool, params);
+    ok &= bench_midi_check(
+        "new notes start modulated",
+        pool.glideSteps[fresh] == 0 &&
+            fabsf(pool.inc[fresh] / pool.baseInc[fresh] - 2.0f) < 1e-5f &&
+            pool.glideSteps[soft] > 0);
+    params[PARAM_PITCH] = 0;
+
+    // Through the parameters: macro 1 at full turns the output gain down by
+    // half its 66 dB range
+    cplug_libraryLoad();
+    const double dry = bench_mod_level('mac1', 0, 48000);
+    const double wet = bench_mod_level('mac1', 1, 48000);
+    cplug_libraryUnload();
+    ok &= bench_midi_check("macro routed to the output gain",
+                           fabs(wet - dry + 33) < 0.5);
+
+    // Cost of a control step: MOD_MAX_ROUTINGS routings, most onto the voices
+    // from every kind of source, over 64 voices with their pitch and level
+    // changing every step
+    uint32_t seed = 0x13579b;
+    mod_matrix_init(&mod, PLUGIN_MOD_CONTROL_FRAMES);
+    voice_pool_init(&pool, MAX_VOICES);
+    voice_pool_set_sample_rate(&pool, sampleRate);
+    const uint32_t numVoices = 64;
+    for (uint32_t n = 0; n < numVoices; n++)
+        voice_pool_note_on(&pool, n % 16, 24 + n,
+                           (float)(1 + bench_rand(&seed) % 127) / 127.0f);
+    static const uint32_t globalDests[] = {MOD_DEST_GAIN, MOD_DEST_DRIVE,
+                                           MOD_DEST_ATTACK};
+    while (mod.global.numRoutings + mod.voice.numRoutings < MOD_MAX_ROUTINGS) {
+        const bool voice = mod.voice.numRoutings < MOD_MAX_ROUTINGS * 3 / 4;
+        const uint32_t source =
+            1 + bench_rand(&seed) %
+                    (voice ? MOD_SOURCE_COUNT - 1 : MOD_FIRST_VOICE_SOURCE - 1);
+        const uint32_t dest =
+            voice ? (bench_rand(&seed) & 1 ? MOD_DEST_PITCH : MOD_DEST_LEVEL)
+                  : globalDests[bench_rand(&seed) % ARRLEN(globalDests)];
+        mod_matrix_add(&mod, source, dest, 0.01f);
+    }
+    params[PARAM_LFO1_RATE] = 7;
+    params[PARAM_LFO2_RATE] = 3;
+
+    const uint32_t blockSize = 512;
+    float out[512];
+    uint64_t numSteps = 0, stepNs = 0, renderNs = 0, numBlocks = 0;
+    const uint64_t start = bench_now_ns();
+    do {
+        for (uint32_t frame = 0; frame < blockSize;
+             frame += mod.controlFrames) {
+            const uint64_t t0 = bench_now_ns();
+            mod_matrix_step(&mod, &pool, params, &params[PARAM_LFO1_RATE],
+                            0.5f, sampleRate);
+            const uint64_t t1 = bench_now_ns();
+            voice_pool_render(&pool, out, mod.controlFrames);
+            renderNs += bench_now_ns() - t1;
+            stepNs += t1 - t0;
+            numSteps++;
+        }
+        numBlocks++;
+    } while (bench_now_ns() - start < seconds * 1e9);
+    g_benchSink += (uint64_t)(out[0] * 1000);
+
+    const double blockNs = 1e9 * blockSize / sampleRate;
+    printf("%u routings x %u voices, a step every %u samples\n",
+           mod.global.numRoutings + mod.voice.numRoutings, numVoices,
+           mod.controlFrames);
+    printf("%16s %12s %14s\n", "", "ns/step", "% of a block");
+    printf("%16s %12.1f %13.3f%%\n", "matrix", (double)stepNs / numSteps,
+           100.0 * stepNs / numBlocks / blockNs);
+    printf("%16s %12.1f %13.3f%%\n", "voices", (double)renderNs / numSteps,
+           100.0 * renderNs / numBlocks / blockNs);
+    return ok ? 0 : 1;
+}
+
+// Largest step from one sample to the next of 'numFrames' of 'pool' rendered
+// in blocks of 'blockSize', after note on, past a note off at 'offAt'
+static float bench_envelope_max_step(VoicePool *pool, uint32_t numFrames,
+                                     uint32_t blockSize, uint32_t offAt) {
+    float out[256], previous = 0, maxStep = 0;
+    for (uint32_t pos = 0; pos < numFrames; pos += blockSize) {
+        if (pos == offAt)
+            voice_pool_note_off(pool, 0, 69);
+        voice_pool_render(pool, out, blockSize);
+        for (uint32_t i = 0; i < blockSize; i++) {
+            maxStep = fmaxf(maxStep, fabsf(out[i] - previous));
+            previous = out[i];
+        }
+    }
+    return maxStep;
+}
+
+// Envelope segments against their closed form, clicks at note on and off and
+// voices freed once their release is over. Then the cost per voice of each
+// kind of segment, against a plain gate
+static int bench_envelope(double seconds) {
+    static VoicePool pool;
+    const float sampleRate = 48000;
+    float out[256];
+    bool ok = true;
+
+    // 10 ms attack, 50 ms decay to half, 100 ms release: 480, 2400 and 4800
+    // frames. Blocks of 100 frames end nowhere near the segments
+    voice_pool_init(&pool, MAX_VOICES);
+    voice_pool_set_sample_rate(&pool, sampleRate);
+    voice_pool_set_envelope(&pool, 10, 50, 0.5f, 100);
+    uint32_t v = voice_pool_note_on(&pool, 0, 69, 1.0f);
+    bool segments = true;
+    for (uint32_t pos = 0; pos < 3000; pos += 100) {
+        voice_pool_render(&pool, out, 100);
+        const float level = voice_pool_env_level(&pool, v);
+        const uint32_t n = pos + 100;
+        if (n <= 480)
+            segments &= fabsf(level - (float)n / 480) < 1e-5f;
+        else if (n < 2880)
+            segments &= pool.envStage[v] == VOICE_ENV_DECAY &&
+                        level > 0.5f && level < 1.0f;
+        else
+            segments &= pool.envStage[v] == VOICE_ENV_SUSTAIN &&
+                        fabsf(level - 0.5f) < 1e-5f;
+    }
+    ok &= bench_midi_check("attack and decay land on their levels", segments);
+
+    // The release is freed after 4800 frames, not before
+    voice_pool_note_off(&pool, 0, 69);
+    bool sounding = true;
+    for (uint32_t pos = 0; pos < 4800 - 64; pos += 64) {
+        voice_pool_render(&pool, out, 64);
+        sounding &= pool.numActive == 1;
+    }
+    voice_pool_render(&pool, out, 64);
+    ok &= bench_midi_check("released voices are freed at the end",
+                           sounding && pool.numActive == 0);
+
+    // A sine 'inc' per sample moves by at most 2*pi*inc*gain. Enveloped, a
+    // note adds no more than its attack slope; as a gate, letting go at the
+    // trough of a cycle, 13.75 cycles in, jumps
+    const float inc = 440.0f / sampleRate;
+    const float gain = powf(10.0f, -6.0f / 20.0f);
+    const float sineStep = 2 * 3.14159265f * inc * gain;
+    voice_pool_note_on(&pool, 0, 69, 1.0f);
+    const float maxStep = bench_envelope_max_step(&pool, 9600, 100, 1500);
+    voice_pool_set_envelope(&pool, 0, 0, 1.0f, 0);
+    voice_pool_note_on(&pool, 0, 69, 1.0f);
+    const float gateStep = bench_envelope_max_step(&pool, 9600, 100, 1500);
+    printf("largest step: %.4f enveloped, %.4f gated, sine %.4f\n", maxStep,
+           gateStep, sineStep);
+    ok &= bench_midi_check("no clicks at note on and off",
+                           maxStep < sineStep + gain / 480 + 1e-4f &&
+                               gateStep > 2 * sineStep);
+
+    // Retriggering a note in its decay attacks from where the decay was
+    pool.stealMode = VOICE_STEAL_SAME_NOTE;
+    voice_pool_set_envelope(&pool, 10, 50, 0.5f, 100);
+    v = voice_pool_note_on(&pool, 0, 69, 1.0f);
+    for (uint32_t pos = 0; pos < 1000; pos += 250)
+        voice_pool_render(&pool, out, 250);
+    const float before = voice_pool_env_level(&pool, v);
+    const bool same = voice_pool_note_on(&pool, 0, 69, 1.0f) == v;
+    ok &= bench_midi_check("retriggered notes attack from their level",
+                           same && pool.envStage[v] == VOICE_ENV_ATTACK &&
+                               voice_pool_env_level(&pool, v) == before);
+
+    // The plugin's tail is its release plus the filters' ringing, from
+    // activation on and then as the audio thread sees the release
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    BenchContext bench;
+    bench_context_init(&bench, &script, 256);
+    cplug_libraryLoad();
+    void *plugin = bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, 256);
+    const uint32_t ringing = oversampler_tail(0);
+    const bool activated = cplug_getTailInSamples(plugin) == 9600 + ringing;
+    cplug_setParameterValue(plugin, 'rels', 1000);
+    bench.proc.numFrames = 256;
+    cplug_process(plugin, &bench.proc);
+    ok &= bench_midi_check("tail follows the release",
+                           activated && cplug_getTailInSamples(plugin) ==
+                                            48000 + ringing);
+    cplug_destroyPlugin(plugin);
+    cplug_libraryUnload();
+    bench_context_free(&bench);
+    free(script.events);
+
+    // Cost: 64 voices held in one long segment of each kind, with segments
+    // long enough to last the whole run
+    static const struct {
+        const char *name;
+        float attackMs, decayMs, sustain;
+    } kinds[] = {
+        {"gate", 0, 0, 1.0f},
+        {"attack", 1e9f, 0, 1.0f},
+        {"decay", 0, 1e9f, 0.0f},
+        {"sustain", 0, 0, 0.5f},
+    };
+    const uint32_t numVoices = 64, blockSize = 256;
+    printf("%16s %20s\n", "", "ns/voice/sample");
+    for (uint32_t k = 0; k < ARRLEN(kinds); k++) {
+        voice_pool_init(&pool, MAX_VOICES);
+        voice_pool_set_sample_rate(&pool, sampleRate);
+        voice_pool_set_envelope(&pool, kinds[k].attackMs, kinds[k].decayMs,
+                                kinds[k].sustain, 0);
+        for (uint32_t n = 0; n < numVoices; n++)
+            voice_pool_note_on(&pool, n % 16, 24 + n, 1.0f);
+        uint64_t numSamples = 0;
+        const uint64_t start = bench_now_ns();
+        do {
+            voice_pool_render(&pool, out, blockSize);
+            numSamples += blockSize;
+        } while (bench_now_ns() - start < seconds * 1e9 / ARRLEN(kinds));
+        const uint64_t elapsed = bench_now_ns() - start;
+        g_benchSink += (uint64_t)(out[0] * 1000);
+        printf("%16s %20.3f\n", kinds[k].name,
+               (double)elapsed / (double)(numSamples * numVoices));
+    }
+    return ok ? 0 : 1;
+}
+
+typedef struct BenchWorkersRun {
+    volatile uint32_t counts[WORKER_POOL_MAX_TASKS];
+    uint32_t spin;
+} BenchWorkersRun;
+
+static void bench_workers_task(void *ctx, uint32_t task) {
+    BenchWorkersRun *run = (BenchWorkersRun *)ctx;
+    atomic_fetch_add_relaxed_u32(&run->counts[task], 1);
+    volatile uint32_t sink = 0;
+    for (uint32_t i = 0; i < run->spin; i++)
+        sink += i;
+}
+
+// Plays the same notes into 'pool' for 'numBlocks' blocks, some of them
+// finishing on the way, rendered with 'numThreads' threads of 'workers', or
+// by voice_pool_render_buses() without them. 'out' gets every block of every
+// bus
+static void bench_workers_play(VoicePool *pool, VoiceGroups *groups,
+                               WorkerPool *workers, uint32_t numThreads,
+                               uint32_t numBlocks, uint32_t blockSize,
+                               float *out) {
+    voice_pool_init(pool, MAX_VOICES);
+    voice_pool_set_sample_rate(pool, 48000);
+    voice_pool_set_envelope(pool, 5, 50, 0.5f, 20);
+    pool->numBuses = 4;
+    for (uint32_t n = 0; n < 200; n++)
+        voice_pool_note_on(pool, n % 16, 20 + n % 100, 0.5f + 0.002f * n);
+    for (uint32_t block = 0; block < numBlocks; block++) {
+        float *outs[VOICE_MAX_BUSES];
+        for (uint32_t b = 0; b < VOICE_MAX_BUSES; b++)
+            outs[b] = out + (size_t)(block * 4 + b % 4) * blockSize;
+        memset(outs[0], 0, sizeof(float) * 4 * blockSize);
+        if (block % 8 == 7)
+            for (uint32_t n = block * 2; n < block * 2 + 16; n++)
+                voice_pool_note_off(pool, n % 16, 20 + n % 100);
+        if (workers == NULL)
+            voice_pool_render_buses(pool, outs, blockSize);
+        else
+            voice_groups_render(groups, workers, numThreads, pool, outs,
+                                blockSize);
+    }
+}
+
+// Checks that every task of a run runs once and that the voices mix the same
+// whatever the threads, then times the voices on 1 thread up to one per core
+static int bench_workers(double seconds) {
+    enum { NUM_BLOCKS = 64, BLOCK_SIZE = 256 };
+    static VoicePool pool;
+    static VoiceGroups groups;
+    static BenchWorkersRun run;
+    bool ok = true;
+
+    // Three workers whatever the cores, so stealing happens even here
+    WorkerPool *workers = worker_pool_create(3);
+    if (workers == NULL) {
+        printf("Couldn't start any worker\n");
+        return 1;
+    }
+    uint32_t seed = 0x2468ac;
+    bool once = true;
+    for (uint32_t r = 0; r < 400; r++) {
+        const uint32_t numTasks = 1 + bench_rand(&seed) % WORKER_POOL_MAX_TASKS;
+        memset((void *)run.counts, 0, sizeof(run.counts));
+        run.spin = bench_rand(&seed) % 2000;
+        worker_pool_run(workers, 1 + r % 4, numTasks, bench_workers_task, &run);
+        for (uint32_t t = 0; t < WORKER_POOL_MAX_TASKS; t++)
+            once &= run.counts[t] == (t < numTasks ? 1u : 0u);
+    }
+    printf("%u tasks stolen\n", workers->numStolen);
+    ok &= bench_midi_check("every task runs once", once);
+
+    const size_t numSamples = (size_t)NUM_BLOCKS * 4 * BLOCK_SIZE;
+    float *alone = (float *)malloc(sizeof(float) * numSamples);
+    float *expected = (float *)malloc(sizeof(float) * numSamples);
+    float *out = (float *)malloc(sizeof(float) * numSamples);
+    voice_groups_prepare(&groups, 4, BLOCK_SIZE);
+    bench_workers_play(&pool, &groups, NULL, 1, NUM_BLOCKS, BLOCK_SIZE,
+                       alone);
+    bench_workers_play(&pool, &groups, workers, 1, NUM_BLOCKS, BLOCK_SIZE,
+                       expected);
+    bool same = pool.numActive < 200;
+    for (uint32_t threads = 2; threads <= 4; threads++) {
+        bench_workers_play(&pool, &groups, workers, threads, NUM_BLOCKS,
+                           BLOCK_SIZE, out);
+        same &= memcmp(out, expected, sizeof(float) * numSamples) == 0;
+    }
+    float maxErr = 0;
+    for (size_t i = 0; i < numSamples; i++)
+        maxErr = fmaxf(maxErr, fabsf(out[i] - alone[i]));
+    printf("against the audio thread alone: max error %.2g\n", maxErr);
+    ok &= bench_midi_check("same mix whatever the threads", same);
+    ok &= bench_midi_check("same mix as without groups", maxErr < 1e-5f);
+    worker_pool_destroy(workers);
+
+    // A plugin only starts its threads once activated asking for more than 1
+    cplug_libraryLoad();
+    void *plugin = bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, 48000, BLOCK_SIZE);
+    const bool idle = ((const Plugin *)plugin)->workers == NULL;
+    cplug_setParameterValue(plugin, 'thrd', 2);
+    cplug_setSampleRateAndBlockSize(plugin, 48000, BLOCK_SIZE);
+    const bool started = (((const Plugin *)plugin)->workers != NULL) ==
+                         (worker_pool_num_cpus() > 1);
+    cplug_destroyPlugin(plugin);
+    cplug_libraryUnload();
+    ok &= bench_midi_check("plugins start threads only when asked",
+                           idle && started);
+
+    // Scaling, with one worker per spare core
+    const uint32_t numCpus = worker_pool_num_cpus();
+    workers = numCpus > 1 ? worker_pool_create(numCpus - 1) : NULL;
+    const uint32_t maxThreads = workers ? workers->numWorkers + 1 : 1;
+    printf("%u cores, 200 voices, %u frame blocks\n", numCpus, BLOCK_SIZE);
+    printf("%16s %12s %10s\n", "threads", "us/block", "speedup");
+    double aloneNs = 0;
+    for (uint32_t threads = 0; threads <= maxThreads; threads++) {
+        uint64_t numBlocks = 0;
+        const uint64_t start = bench_now_ns();
+        do {
+            bench_workers_play(&pool, &groups, threads ? workers : NULL,
+                               threads, NUM_BLOCKS, BLOCK_SIZE, out);
+            numBlocks += NUM_BLOCKS;
+        } while (bench_now_ns() - start <
+                 seconds * 1e9 / (maxThreads + 1));
+        const double ns =
+            (double)(bench_now_ns() - start) / (double)numBlocks;
+        if (threads == 0)
+            aloneNs = ns;
+        char name[16];
+        snprintf(name, sizeof(name), "%u", threads);
+        printf("%16s %12.2f %9.2fx\n", threads ? name : "no groups",
+               ns / 1000, aloneNs / ns);
+        if (threads > 0 && workers == NULL)
+            break;
+    }
+    g_benchSink += (uint64_t)(out[0] * 1000);
+
+    if (workers)
+        worker_pool_destroy(workers);
+    voice_groups_free(&groups);
+    free(alone);
+    free(expected);
+    free(out);
+    return ok ? 0 : 1;
+}
+
+typedef struct BenchOfflineResult {
+    double nsPerSample;
+    double levelDb;
+    uint32_t latency;
+    // Whether the last block rendered offline
+    bool offline;
+} BenchOfflineResult;
+
+// Plays 'polyphony' held notes for 'seconds' in render mode 'renderMode',
+// timing every block and measuring the level of the main bus
+static BenchOfflineResult bench_offline_run(uint32_t renderMode, int polyphony,
+                                            double seconds) {
+    const uint32_t blockSize = 512;
+    const double sampleRate = 48000;
+    const uint64_t numSamples = (uint64_t)(seconds * sampleRate);
+    BenchScript script;
+    memset(&script, 0, sizeof(script));
+    bench_script_build(&script, numSamples, sampleRate, polyphony);
+    BenchContext bench;
+    bench_context_init(&bench, &script, blockSize);
+
+    BenchOfflineResult result;
+    memset(&result, 0, sizeof(result));
+    void *plugin = cplug_createPlugin(NULL);
+    cplug_setParameterValue(plugin, 'rmod', renderMode);
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, blockSize);
+    result.latency = cplug_getLatencyInSamples(plugin);
+    uint64_t totalNs = 0;
+    double power = 0;
+    for (uint64_t pos = 0; pos < numSamples; pos += blockSize) {
+        bench.blockStart = pos;
+        bench.proc.numFrames = blockSize;
+        const uint64_t start = bench_now_ns();
+        cplug_process(plugin, &bench.proc);
+        totalNs += bench_now_ns() - start;
+        for (uint32_t i = 0; i < blockSize; i++)
+            power += (double)bench.outputs[0][0][i] * bench.outputs[0][0][i];
+    }
+    result.offline = ((const Plugin *)plugin)->offline;
+    cplug_destroyPlugin(plugin);
+    bench_context_free(&bench);
+    free(script.events);
+
+    result.nsPerSample = (double)totalNs / (double)numSamples;
+    result.levelDb = 10 * log10(power / (double)numSamples + 1e-30);
+    return result;
+}
+
+// Checks the detector on a made up clock, the offline oscillators against the
+// realtime ones, and the plugin in each render mode, then times the realtime
+// paths against the offline ones
+static int bench_offline(double seconds) {
+    bool ok = true;
+
+    // Blocks of 512 at 48 kHz, at the pace of playback, then 10 times faster,
+    // then back
+    RenderModeDetector detector;
+    render_mode_detector_reset(&detector);
+    const double blockSeconds = 512.0 / 48000;
+    double now = 1;
+    bool live = true, bounced = false, back = true;
+    for (uint32_t b = 0; b < 600; b++) {
+        const double speed = b >= 200 && b < 400 ? 10 : 1;
+        const bool offline = render_mode_detect(&detector, now, 512, 48000);
+        now += blockSeconds / speed;
+        if (b < 200)
+            live &= !offline;
+        else if (b == 399)
+            bounced = offline;
+        else if (b >= 500)
+            back &= !offline;
+    }
+    ok &= bench_midi_check("live pace is realtime", live);
+    ok &= bench_midi_check("faster than live is offline", bounced);
+    ok &= bench_midi_check("live pace again is realtime", back);
+
+    // A 440 Hz sine at 48 kHz, under a decaying gain
+    enum { NUM_FRAMES = 4800 };
+    static float kernel[NUM_FRAMES], exact[NUM_FRAMES];
+    const double twoPi = 6.283185307179586;
+    const double inc = 440.0 / 48000;
+    osc_sine_add(kernel, NUM_FRAMES, 0.1f, (float)inc, 1.0f, 0.9999f, 0);
+    osc_sine_add_exact(exact, NUM_FRAMES, 0.1f, (float)inc, 1.0f, 0.9999f, 0);
+    double kernelErr = 0, exactErr = 0;
+    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+        const double x = 0.1f + i * (double)(float)inc;
+        const double want = pow(0.9999f, i) * sin(twoPi * x);
+        kernelErr = fmax(kernelErr, fabs(kernel[i] - want));
+        exactErr = fmax(exactErr, fabs(exact[i] - want));
+    }
+    printf("sine: max error %.2g with the kernel, %.2g exact\n", kernelErr,
+           exactErr);
+    ok &= bench_midi_check("exact sine beats the kernel",
+                           exactErr < kernelErr && exactErr < 1e-6);
+
+    // A cycle of the fundamental and its 64th harmonic, read 1.37 samples
+    // at a time
+    static float table[WAVETABLE_SIZE + 1];
+    for (uint32_t i = 0; i <= WAVETABLE_SIZE; i++) {
+        const double x = (double)i / WAVETABLE_SIZE;
+        table[i] = (float)(sin(twoPi * x) + 0.5 * sin(twoPi * 64 * x));
+    }
+    memset(kernel, 0, sizeof(kernel));
+    memset(exact, 0, sizeof(exact));
+    const float tableInc = 1.37f / WAVETABLE_SIZE;
+    wavetable_add(kernel, NUM_FRAMES, table, 0, tableInc, 1, 1, 0);
+    wavetable_add_hermite(exact, NUM_FRAMES, table, 0, tableInc, 1, 1, 0);
+    double linearErr = 0, hermiteErr = 0;
+    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
+        double x = i * (double)tableInc;
+        x -= floor(x);
+        const double want = sin(twoPi * x) + 0.5 * sin(twoPi * 64 * x);
+        linearErr = fmax(linearErr, fabs(kernel[i] - want));
+        hermiteErr = fmax(hermiteErr, fabs(exact[i] - want));
+    }
+    printf("wavetable: max error %.2g linear, %.2g Hermite\n", linearErr,
+           hermiteErr);
+    ok &= bench_midi_check("Hermite beats linear", hermiteErr < linearErr / 4);
+
+    cplug_libraryLoad();
+    const BenchOfflineResult realtime =
+        bench_offline_run(RENDER_MODE_REALTIME, 8, 0.5);
+    const BenchOfflineResult offline =
+        bench_offline_run(RENDER_MODE_OFFLINE, 8, 0.5);
+    printf("level: %.2f dB realtime, %.2f dB offline\n", realtime.levelDb,
+           offline.levelDb);
+    ok &= bench_midi_check("Realtime keeps to the settings",
+                           !realtime.offline && realtime.latency == 0);
+    ok &= bench_midi_check("Offline reports its oversampling",
+                           offline.offline &&
+                               offline.latency ==
+                                   oversampler_latency(
+                                       PLUGIN_OFFLINE_OVERSAMPLING));
+    ok &= bench_midi_check("same level in both modes",
+                           fabs(offline.levelDb - realtime.levelDb) < 0.1);
+    // The bench runs far faster than real time, as a bounce does
+    const BenchOfflineResult detected =
+        bench_offline_run(RENDER_MODE_AUTO, 8, 2.5);
+    ok &= bench_midi_check("Auto detects the bounce",
+                           detected.offline && detected.latency == 0);
+
+    printf("%10s %12s %12s %8s\n", "voices", "realtime", "offline", "cost");
+    const int polyphonies[] = {1, 8, 32};
+    for (int p = 0; p < ARRLEN(polyphonies); p++) {
+        const double each = seconds / (2 * ARRLEN(polyphonies));
+        const BenchOfflineResult r =
+            bench_offline_run(RENDER_MODE_REALTIME, polyphonies[p], each);
+        const BenchOfflineResult o =
+            bench_offline_run(RENDER_MODE_OFFLINE, polyphonies[p], each);
+        printf("%10d %9.2f ns %9.2f ns %7.2fx\n", polyphonies[p],
+               r.nsPerSample, o.nsPerSample, o.nsPerSample / r.nsPerSample);
+    }
+    cplug_libraryUnload();
+    return ok ? 0 : 1;
+}
+
+// Power of everything below 20 kHz that isn't a harmonic of 'bin', relative to
+// the harmonics, in dB. 'capture' holds 'size' samples at 'sampleRate', a
+// whole number of cycles of a tone on DFT bin 'bin', so no window is needed
+static double bench_alias_db(const float *capture, uint32_t size, uint32_t bin,
+                             double sampleRate) {
+    const double pi = 3.14159265358979323846;
+    const uint32_t maxBin = (uint32_t)(20000.0 / sampleRate * size);
+    double signal = 0, alias = 0;
+    for (uint32_t k = 1; k <= maxBin; k++) {
+        double re = 0, im = 0;
+        for (uint32_t i = 0; i < size; i++) {
+            const double angle = 2 * pi * (double)((uint64_t)k * i % size) /
+                                 (double)size;
+            re += capture[i] * cos(angle);
+            im -= capture[i] * sin(angle);
+        }
+        const double power = re * re + im * im;
+        if (k % bin == 0)
+            signal += power;
+        else
+            alias += power;
+    }
+    return 10 * log10(alias / signal + 1e-30);
+}
+
+// Runs the drive stage the way render() does: up, clip, down
+static void bench_drive(Oversampler *os, float *buf, uint32_t numFrames,
+                        float gain) {
+    float *top = oversampler_up(os, buf, numFrames);
+    if (gain > 0.0f)
+        saturator_process(top, numFrames << os->numStages, gain, gain);
+    oversampler_down(os, buf, numFrames);
+}
+
+// Quality against cost of every oversampling factor. A sine on an exact DFT
+// bin is driven hard into the saturator; its odd harmonics that stay below
+// 20 kHz are signal, everything else in that band is aliasing (or filter
+// leakage). Also checks the FIR kernels against scalar and that the reported
+// latency matches the measured delay of an impulse
+static int bench_oversample(double seconds) {
+    enum { BLOCK_SIZE = 64, DFT_SIZE = 4096, SINE_BIN = 443 };
+    const double sampleRate = 48000;
+    const double pi = 3.14159265358979323846;
+    const float driveGain = 4.0f; // +12 dB
+    int failed = 0;
+
+    // Kernels
+    {
+        float x[BLOCK_SIZE + OVERSAMPLER_BRANCH_TAPS];
+        float expected[BLOCK_SIZE], out[BLOCK_SIZE];
+        Oversampler os;
+        oversampler_init(&os);
+        uint32_t seed = 1;
+        for (uint32_t i = 0; i < ARRLEN(x); i++)
+            x[i] = (float)(bench_rand(&seed) % 2001) / 1000.0f - 1.0f;
+        oversampler_fir_scalar(x, os.downTaps, expected, BLOCK_SIZE);
+        for (int level = OSC_KERNEL_SSE2; level < OSC_KERNEL_COUNT; level++) {
+            OversamplerFirFn fir = oversampler_get_fir(level);
+            if (fir == NULL)
+                continue;
+            // Odd length to cover the scalar tail
+            fir(x, os.downTaps, out, BLOCK_SIZE - 1);
+            float maxErr = 0;
+            for (uint32_t i = 0; i < BLOCK_SIZE - 1; i++)
+                maxErr = fmaxf(maxErr, fabsf(out[i] - expected[i]));
+            printf("%s FIR: max error %.2g\n", osc_kernel_name(level),
+                   maxErr);
+            if (maxErr > 1e-5f)
+                failed = 1;
+        }
+    }
+
+    float *buf = (float *)malloc(sizeof(float) * BLOCK_SIZE);
+    float *capture = (float *)malloc(sizeof(float) * DFT_SIZE);
+
+    printf("%8s %8s %12s %14s %10s\n", "factor", "latency", "measured",
+           "alias (dB)", "ns/sample");
+    for (uint32_t stages = 0; stages <= OVERSAMPLER_MAX_STAGES; stages++) {
+        Oversampler os;
+        oversampler_init(&os);
+        oversampler_prepare(&os, BLOCK_SIZE);
+        oversampler_set_stages(&os, stages);
+
+        // Delay of an impulse through the filters alone
+        const uint32_t latency = oversampler_latency(stages);
+        uint32_t peakAt = 0;
+        float peak = 0;
+        for (uint32_t pos = 0; pos < 4 * BLOCK_SIZE; pos += BLOCK_SIZE) {
+            memset(buf, 0, sizeof(float) * BLOCK_SIZE);
+            if (pos == 0)
+                buf[0] = 1.0f;
+            bench_drive(&os, buf, BLOCK_SIZE, 0.0f);
+            for (uint32_t i = 0; i < BLOCK_SIZE; i++) {
+                if (fabsf(buf[i]) > peak) {
+                    peak = fabsf(buf[i]);
+                    peakAt = pos + i;
+                }
+            }
+        }
+        if (peakAt != latency)
+            failed = 1;
+
+        // Settle, then capture one DFT frame
+        oversampler_set_stages(&os, stages);
+        const double inc = (double)SINE_BIN / DFT_SIZE;
+        uint64_t n = 0;
+        for (uint32_t pos = 0; pos < 2 * DFT_SIZE; pos += BLOCK_SIZE) {
+            for (uint32_t i = 0; i < BLOCK_SIZE; i++, n++)
+                buf[i] = 0.9f * (float)sin(2 * pi * inc * (double)n);
+            bench_drive(&os, buf, BLOCK_SIZE, driveGain);
+            if (pos >= DFT_SIZE)
+                memcpy(capture + pos - DFT_SIZE, buf,
+                       sizeof(float) * BLOCK_SIZE);
+        }
+
+        const double aliasDB =
+            bench_alias_db(capture, DFT_SIZE, SINE_BIN, sampleRate);
+
+        // Cost of the whole drive stage per host sample
+        uint64_t numBlocks = 0, start = bench_now_ns(), elapsed;
+        do {
+            for (int b = 0; b < 64; b++, numBlocks++)
+                bench_drive(&os, buf, BLOCK_SIZE, driveGain);
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / (OVERSAMPLER_MAX_STAGES + 1));
+        g_benchSink += (uint64_t)(buf[0] * 1000);
+
+        char factor[8];
+        snprintf(factor, sizeof(factor), stages ? "%ux" : "off", 1u << stages);
+        printf("%8s %8u %12u %14.1f %10.2f\n", factor, latency, peakAt,
+               aliasDB, (double)elapsed / (numBlocks * BLOCK_SIZE));
+        oversampler_free(&os);
+    }
+
+    free(buf);
+    free(capture);
+
+    // The plugin reports a new latency only once reactivated
+    {
+        BenchScript script;
+        memset(&script, 0, sizeof(script));
+        BenchContext bench;
+        bench_context_init(&bench, &script, BLOCK_SIZE);
+        bench.proc.numFrames = BLOCK_SIZE;
+        cplug_libraryLoad();
+        void *plugin = bench_create_plugin();
+        cplug_setSampleRateAndBlockSize(plugin, sampleRate, BLOCK_SIZE);
+        cplug_setParameterValue(plugin, 'ovsm', 2);
+        cplug_process(plugin, &bench.proc);
+        const uint32_t before = cplug_getLatencyInSamples(plugin);
+        cplug_setSampleRateAndBlockSize(plugin, sampleRate, BLOCK_SIZE);
+        const uint32_t after = cplug_getLatencyInSamples(plugin);
+        printf("plugin latency: %u, %u once reactivated\n", before, after);
+        if (before != 0 || after != oversampler_latency(2))
+            failed = 1;
+        cplug_destroyPlugin(plugin);
+        cplug_libraryUnload();
+        bench_context_free(&bench);
+    }
+
+    if (failed)
+        printf("FAILED: kernel mismatch or wrong latency\n");
+    return failed;
+}
+
+// Cost of the shared wavetable cache, and aliasing and render cost of every
+// waveform against a naive, non band-limited version of it
+static int bench_wavetable(double seconds) {
+    enum { NUM_INSTANCES = 50, DFT_SIZE = 4096, TONE_BIN = 225 };
+    const double sampleRate = 48000;
+    int failed = 0;
+
+    cplug_libraryLoad();
+
+    // Instances at the same rate share one set, built by the first
+    Plugin *plugins[NUM_INSTANCES];
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < NUM_INSTANCES; i++) {
+        plugins[i] = (Plugin *)bench_create_plugin();
+        cplug_setSampleRateAndBlockSize(plugins[i], sampleRate, 512);
+        if (i == 0)
+            printf("First instance:     %8.2f ms\n",
+                   (bench_now_ns() - start) / 1e6);
+    }
+    printf("%d instances:       %8.2f ms\n", NUM_INSTANCES,
+           (bench_now_ns() - start) / 1e6);
+    for (int i = 1; i < NUM_INSTANCES; i++)
+        if (plugins[i]->voices.wavetables != plugins[0]->voices.wavetables)
+            failed = 1;
+    printf("Distinct sets:      %8d\n", failed ? NUM_INSTANCES : 1);
+
+    // Reacquiring the same rate must not rebuild
+    start = bench_now_ns();
+    cplug_setSampleRateAndBlockSize(plugins[0], sampleRate, 512);
+    printf("Same rate again:    %8.2f ms\n", (bench_now_ns() - start) / 1e6);
+    const WavetableSet *set = plugins[0]->voices.wavetables;
+    for (int i = 0; i < NUM_INSTANCES; i++)
+        cplug_destroyPlugin(plugins[i]);
+
+    // A tone on an exact DFT bin: 2637 Hz, so every harmonic and every
+    // alias lands on a bin too
+    Plugin *plugin = (Plugin *)bench_create_plugin();
+    cplug_setSampleRateAndBlockSize(plugin, sampleRate, 512);
+    set = plugin->voices.wavetables;
+    const float inc = (float)TONE_BIN / DFT_SIZE;
+    float *capture = (float *)malloc(sizeof(float) * DFT_SIZE);
+    float *naive = (float *)malloc(sizeof(float) * DFT_SIZE);
+
+    static const char *names[] = {"sine", "saw", "square", "triangle"};
+    printf("\n%10s %14s %14s %10s\n", "waveform", "naive (dB)",
+           "mipmap (dB)", "ns/voice");
+    for (uint32_t waveform = 0; waveform < WAVE_COUNT; waveform++) {
+        VoicePool *pool = &plugin->voices;
+        voice_pool_init(pool, MAX_VOICES);
+        voice_pool_set_sample_rate(pool, (float)sampleRate);
+        pool->wavetables = set;
+        pool->waveform = waveform;
+        voice_pool_note_on(pool, 0, 60, 1.0f);
+        pool->inc[pool->active[0]] = inc;
+        pool->gain[pool->active[0]] = 1.0f;
+        voice_pool_render(pool, capture, DFT_SIZE);
+
+        // Sampling the ideal shape directly
+        for (uint32_t i = 0; i < DFT_SIZE; i++) {
+            const float phase = (float)((uint64_t)TONE_BIN * i % DFT_SIZE) /
+                                DFT_SIZE;
+            switch (waveform) {
+            case WAVE_SAW:
+                naive[i] = phase < 0.5f ? 2 * phase : 2 * phase - 2;
+                break;
+            case WAVE_SQUARE:
+                naive[i] = phase < 0.5f ? 1.0f : -1.0f;
+                break;
+            case WAVE_TRIANGLE:
+                naive[i] = phase < 0.25f   ? 4 * phase
+                           : phase < 0.75f ? 2 - 4 * phase
+                                           : 4 * phase - 4;
+                break;
+            default:
+                naive[i] = sinf(2 * 3.14159265f * phase);
+            }
+        }
+        const double naiveDB =
+            bench_alias_db(naive, DFT_SIZE, TONE_BIN, sampleRate);
+        const double aliasDB =
+            bench_alias_db(capture, DFT_SIZE, TONE_BIN, sampleRate);
+        if (aliasDB > -60.0)
+            failed = 1;
+
+        // Render cost with a full pool spread over the keyboard
+        voice_pool_init(pool, MAX_VOICES);
+        voice_pool_set_sample_rate(pool, (float)sampleRate);
+        pool->wavetables = set;
+        pool->waveform = waveform;
+        for (uint32_t v = 0; v < 64; v++)
+            voice_pool_note_on(pool, v / 32, 24 + v, 1.0f);
+        uint64_t numBlocks = 0, elapsed;
+        start = bench_now_ns();
+        do {
+            for (int b = 0; b < 64; b++, numBlocks++)
+                voice_pool_render(pool, capture, 64);
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / WAVE_COUNT);
+        g_benchSink += (uint64_t)(capture[0] * 1000);
+
+        printf("%10s %14.1f %14.1f %10.2f\n", names[waveform], naiveDB,
+               aliasDB, (double)elapsed / (numBlocks * 64 * 64));
+    }
+
+    free(capture);
+    free(naive);
+    cplug_destroyPlugin(plugin);
+    cplug_libraryUnload();
+    if (failed)
+        printf("FAILED: instances don't share tables or aliasing above "
+               "-60 dB\n");
+    return failed;
+}
+
+typedef struct BenchScopeThread {
+    ScopeRing *ring;
+    uint64_t numFrames;
+    volatile uint32_t done;
+} BenchScopeThread;
+
+// Audio side: every frame of block 'n' holds n % 4096, so a reader can tell
+// whether a block it accepted mixes two of them
+static void *bench_scope_audio(void *arg) {
+    BenchScopeThread *t = (BenchScopeThread *)arg;
+    float buf[96]; // not a divisor of SCOPE_BLOCK_FRAMES, so calls straddle
+    for (uint64_t frame = 0; frame < t->numFrames; frame += ARRLEN(buf)) {
+        for (uint32_t i = 0; i < ARRLEN(buf); i++)
+            buf[i] = (float)((frame + i) / SCOPE_BLOCK_FRAMES % 4096);
+        scope_write(t->ring, buf, ARRLEN(buf));
+    }
+    atomic_store_release_u32(&t->done, 1);
+    return NULL;
+}
+
+// Audio thread cost of publishing the scope against a whole process call, a
+// concurrent check that no torn block is ever accepted, and the spectrum's
+// level and frequency on a full scale sine
+static int bench_scope(double seconds) {
+    static const uint32_t blockSizes[] = {16, 64, 256, 1024};
+    static ScopeRing ring;
+    static ScopeView view;
+    const double sampleRate = 48000;
+    int failed = 0;
+
+    cplug_libraryLoad();
+    printf("%10s %14s %14s %12s\n", "block", "scope ns/smp", "process ns/smp",
+           "share");
+    float *buf = (float *)malloc(sizeof(float) * 1024);
+    uint32_t seed = 0x5c0e;
+    for (uint32_t i = 0; i < 1024; i++)
+        buf[i] = (float)(bench_rand(&seed) % 2000) / 1000.0f - 1.0f;
+    for (int b = 0; b < ARRLEN(blockSizes); b++) {
+        const uint32_t blockSize = blockSizes[b];
+        scope_ring_init(&ring);
+        uint64_t numBlocks = 0, elapsed;
+        const uint64_t start = bench_now_ns();
+        do {
+            for (int i = 0; i < 256; i++, numBlocks++)
+                scope_write(&ring, buf, blockSize);
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / 8);
+        const double scopeNs =
+            (double)elapsed / ((double)numBlocks * blockSize);
+        const BenchResult process =
+            bench_run(blockSize, sampleRate, seconds / 8, 8);
+        printf("%10u %14.3f %14.3f %11.1f%%\n", blockSize, scopeNs,
+               process.nsPerSample, 100.0 * scopeNs / process.nsPerSample);
+    }
+    free(buf);
+    cplug_libraryUnload();
+
+    // The GUI reads as fast as it can while the audio thread laps it
+    BenchScopeThread t;
+    scope_ring_init(&ring);
+    t.ring = &ring;
+    t.numFrames = (uint64_t)(seconds * 5e7);
+    t.done = 0;
+    pthread_t audio;
+    pthread_create(&audio, NULL, bench_scope_audio, &t);
+    uint64_t numRead = 0, numTorn = 0, numCorrupt = 0;
+    for (;;) {
+        const uint32_t done = atomic_load_acquire_u32(&t.done);
+        const uint32_t head = scope_head(&ring);
+        for (uint32_t n = head - 8; n != head; n++) {
+            const ScopeBlock *block = scope_read_begin(&ring, n);
+            if (block == NULL)
+                continue;
+            const float expected = (float)(n % 4096);
+            bool same = true;
+            for (int i = 0; i < SCOPE_NUM_SAMPLES; i++)
+                same &= block->samples[i] == expected;
+            for (int i = 0; i < SCOPE_NUM_PEAKS; i++)
+                same &= block->min[i] == expected && block->max[i] == expected;
+            if (!scope_read_end(&ring, n))
+                numTorn++;
+            else if (!same)
+                numCorrupt++;
+            else
+                numRead++;
+        }
+        if (done)
+            break;
+    }
+    pthread_join(audio, NULL);
+    if (numCorrupt > 0 || numRead == 0)
+        failed = 1;
+    printf("concurrent: %llu blocks read, %llu discarded as torn, "
+           "%llu corrupt %s\n",
+           (unsigned long long)numRead, (unsigned long long)numTorn,
+           (unsigned long long)numCorrupt, failed ? "FAILED" : "ok");
+
+    // A full scale 1 kHz sine must read 0 dB at 1 kHz
+    scope_ring_init(&ring);
+    scope_view_init(&view, 30);
+    float sine[SCOPE_BLOCK_FRAMES];
+    for (uint32_t n = 0; n < 16; n++) {
+        for (uint32_t i = 0; i < SCOPE_BLOCK_FRAMES; i++)
+            sine[i] = sinf(2 * 3.14159265f * 1000.0f *
+                           (float)(n * SCOPE_BLOCK_FRAMES + i) /
+                           (float)sampleRate);
+        scope_write(&ring, sine, SCOPE_BLOCK_FRAMES);
+    }
+    const uint64_t start = bench_now_ns();
+    scope_view_update(&view, &ring, (float)sampleRate, 0);
+    const double updateUs = (bench_now_ns() - start) / 1e3;
+    uint32_t peak = 0;
+    for (uint32_t p = 1; p < SCOPE_SPECTRUM_POINTS; p++)
+        if (view.spectrumDb[p] > view.spectrumDb[peak])
+            peak = p;
+    const double ratio = (SCOPE_FFT_SIZE / 2 - 1) * sampleRate /
+                         SCOPE_DECIMATION / SCOPE_FFT_SIZE /
+                         SCOPE_SPECTRUM_MIN_HZ;
+    const double peakHz = SCOPE_SPECTRUM_MIN_HZ *
+                          pow(ratio, (peak + 0.5) / SCOPE_SPECTRUM_POINTS);
+    const bool spectrumOk = fabs(view.spectrumDb[peak]) < 1.5 &&
+                            peakHz > 900 && peakHz < 1100;
+    printf("spectrum: %.1f dB at %.0f Hz, GUI update %.1f us %s\n",
+           view.spectrumDb[peak], peakHz, updateUs,
+           spectrumOk ? "ok" : "FAILED");
+    if (!spectrumOk)
+        failed = 1;
+    return failed;
+}
+
+// A frame shaped like the editor's draw lists at 'scale': a window, widget
+// frames with anti-aliased fringes and a gradient, and lines of text sampled
+// from an alpha atlas of 'atlasSize' texels square
+typedef struct BenchMesh {
+    SoftVertex vertices[16384];
+    SoftIndex indices[24576];
+    uint32_t numVertices;
+    uint32_t numIndices;
+} BenchMesh;
+
+static void bench_mesh_quad(BenchMesh *mesh, float x0, float y0, float x1,
+                            float y1, float u0, float v0, float u1, float v1,
+                            uint32_t colTop, uint32_t colBottom) {
+    const SoftIndex base = (SoftIndex)mesh->numVertices;
+    SoftVertex *v = &mesh->vertices[mesh->numVertices];
+    v[0] = (SoftVertex){x0, y0, u0, v0, colTop};
+    v[1] = (SoftVertex){x1, y0, u1, v0, colTop};
+    v[2] = (SoftVertex){x1, y1, u1, v1, colBottom};
+    v[3] = (SoftVertex){x0, y1, u0, v1, colBottom};
+    mesh->numVertices += 4;
+    static const SoftIndex QUAD[] = {0, 1, 2, 0, 2, 3};
+    for (int i = 0; i < 6; i++)
+        mesh->indices[mesh->numIndices++] = base + QUAD[i];
+}
+
+static void bench_mesh_build(BenchMesh *mesh, float scale, int atlasSize) {
+    mesh->numVertices = mesh->numIndices = 0;
+    // The atlas' top left texel is opaque white, for untextured shapes
+    const float white = 0.5f / (float)atlasSize;
+    bench_mesh_quad(mesh, 0, 0, 1024 * scale, 500 * scale, white, white,
+                    white, white, 0xf0241f1f, 0xf0241f1f);
+
+    for (int w = 0; w < 12; w++) {
+        const float x0 = 20 * scale, x1 = 420 * scale;
+        const float y0 = (20 + 34 * w) * scale, y1 = y0 + 28 * scale;
+        bench_mesh_quad(mesh, x0, y0, x1, y1, white, white, white, white,
+                        0xff7a4a29, 0xff3d2514);
+        // One pixel fringe fading out on every side, as ImGui anti-aliases
+        const uint32_t in = 0xff7a4a29, out = 0x007a4a29;
+        bench_mesh_quad(mesh, x0, y0 - 1, x1, y0, white, white, white, white,
+                        out, in);
+        bench_mesh_quad(mesh, x0, y1, x1, y1 + 1, white, white, white, white,
+                        in, out);
+
+        // A label after each frame
+        const float glyphW = 9 * scale, glyphH = 18 * scale;
+        const float texel = 1.0f / (float)atlasSize;
+        for (int g = 0; g < 40; g++) {
+            const float gx = x1 + 10 * scale + g * glyphW;
+            const float u0 = (float)(1 + (g % 20) * (int)glyphW) * texel;
+            const float v0 = (float)(1 + (g / 20) * (int)glyphH) * texel;
+            bench_mesh_quad(mesh, gx, y0 + 5 * scale, gx + glyphW,
+                            y0 + 5 * scale + glyphH, u0, v0,
+                            u0 + glyphW * texel, v0 + glyphH * texel,
+                            0xffffffff, 0xffffffff);
+        }
+    }
+}
+
+// Rasterizes frames shaped like the editor's at 1x and 2x, and compares the
+// SSE2 span shader with the scalar one
+static int bench_raster(double seconds) {
+    int failed = 0;
+    for (int s = 1; s <= 2; s++) {
+        const float scale = (float)s;
+        const int width = 1024 * s, height = 500 * s, atlasSize = 512;
+        uint32_t *pixels =
+            (uint32_t *)malloc(sizeof(uint32_t) * width * height);
+        uint8_t *atlas = (uint8_t *)malloc((size_t)atlasSize * atlasSize);
+        BenchMesh *mesh = (BenchMesh *)malloc(sizeof(BenchMesh));
+        uint32_t seed = 1;
+        for (int i = 0; i < atlasSize * atlasSize; i++)
+            atlas[i] = bench_rand(&seed) & 1 ? 0 : (uint8_t)bench_rand(&seed);
+        atlas[0] = 0xff;
+        bench_mesh_build(mesh, scale, atlasSize);
+
+        SoftImage image = {pixels, width, height};
+        const SoftClip clip = {0, 0, width, height};
+        const SoftTexture tex = {atlas, atlasSize, atlasSize, 1};
+        uint64_t numFrames = 0, elapsed;
+        const uint64_t start = bench_now_ns();
+        do {
+            soft_raster_clear(&image, 0xff997360);
+            soft_raster_triangles(&image, &clip, &tex, mesh->vertices,
+                                  mesh->indices, mesh->numIndices, 0, 0);
+            numFrames++;
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / 4);
+        g_benchSink += pixels[width * 30 + 30];
+        printf("%4dx%-4d %6u triangles: %8.3f ms/frame\n", width, height,
+               mesh->numIndices / 3, (double)elapsed / numFrames / 1e6);
+        free(pixels);
+        free(atlas);
+        free(mesh);
+    }
+
+    // One interpolated, textured span across a 2x editor, SIMD vs scalar
+    enum { SPAN = 2048 };
+    uint8_t texels[64 * 64];
+    uint32_t seed = 7;
+    for (int i = 0; i < 64 * 64; i++)
+        texels[i] = (uint8_t)bench_rand(&seed);
+    const SoftTexture tex = {texels, 64, 64, 1};
+    const float p[3][2] = {{0, 0}, {SPAN, 0}, {0, 64}};
+    const float invArea = 1.0f / (SPAN * 64.0f);
+    SoftShade shade = {0};
+    shade.tex = &tex;
+    shade.planes[0] = soft_plane(p, invArea, 255, 40, 255);
+    shade.planes[1] = soft_plane(p, invArea, 128, 255, 0);
+    shade.planes[2] = soft_plane(p, invArea, 0, 90, 255);
+    shade.planes[3] = soft_plane(p, invArea, 255, 20, 200);
+    shade.planes[4] = soft_plane(p, invArea, 0, 1, 0);
+    shade.planes[5] = soft_plane(p, invArea, 0, 0, 1);
+    uint32_t simd[SPAN], scalar[SPAN];
+    for (int i = 0; i < SPAN; i++)
+        simd[i] = scalar[i] = bench_rand(&seed);
+    soft_shade_span(simd, 3, SPAN - 1, 10.5f, &shade);
+    soft_shade_span_scalar(scalar, 3, SPAN - 1, 10.5f, &shade);
+    if (memcmp(simd, scalar, sizeof(simd)) != 0)
+        failed = 1;
+
+    double nsPerPixel[2];
+    for (int k = 0; k < 2; k++) {
+        uint64_t numSpans = 0, elapsed;
+        const uint64_t start = bench_now_ns();
+        do {
+            for (int i = 0; i < 64; i++, numSpans++) {
+                if (k == 0)
+                    soft_shade_span(simd, 0, SPAN, 10.5f, &shade);
+                else
+                    soft_shade_span_scalar(simd, 0, SPAN, 10.5f, &shade);
+            }
+            elapsed = bench_now_ns() - start;
+        } while (elapsed < seconds * 1e9 / 4);
+        nsPerPixel[k] = (double)elapsed / ((double)numSpans * SPAN);
+    }
+    g_benchSink += simd[5];
+    printf("Textured span: %.2f ns/pixel, scalar %.2f ns/pixel (%.1fx)\n",
+           nsPerPixel[0], nsPerPixel[1], nsPerPixel[1] / nsPerPixel[0]);
+
+    if (failed)
+        printf("FAILED: SIMD and scalar spans differ\n");
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    double seconds = 2;
+    int polyphony = 8;
+    uint32_t onlyBlockSize = 0;
+    double onlySampleRate = 0;
+    const char *mode = "process";
+
+    int firstOption = 1;
+    if (argc > 1 && argv[1][0] != '-') {
+        mode = argv[1];
+        firstOption = 2;
+    }
+
+    for (int i = firstOption; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            seconds = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-p") == 0)
+            polyphony = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-b") == 0)
+            onlyBlockSize = (uint32_t)atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+            onlySampleRate = atof(argv[++i]);
+        else {
+            fprintf(stderr,
+                    "Usage: %s "
+                    "[process|osc|params|smooth|ring|notify|state|presets|"
+                    "meter|oversample|wavetable|raster|scope|buses|grid|midi|"
+                    "midiout|mod|envelope|workers|offline] "
+                    "[-s seconds] "
+                    "[-p polyphony] [-b blocksize] [-r samplerate]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (strcmp(mode, "osc") == 0)
+        return bench_osc(seconds);
+    if (strcmp(mode, "params") == 0)
+        return bench_params(seconds);
+    if (strcmp(mode, "smooth") == 0)
+        return bench_smooth(seconds);
+    if (strcmp(mode, "ring") == 0)
+        return bench_ring(seconds);
+    if (strcmp(mode, "notify") == 0)
+        return bench_notify(seconds);
+    if (strcmp(mode, "state") == 0)
+        return bench_state(seconds);
+    if (strcmp(mode, "presets") == 0)
+        return bench_presets(seconds);
+    if (strcmp(mode, "oversample") == 0)
+        return bench_oversample(seconds);
+    if (strcmp(mode, "wavetable") == 0)
+        return bench_wavetable(seconds);
+    if (strcmp(mode, "raster") == 0)
+        return bench_raster(seconds);
+    if (strcmp(mode, "scope") == 0)
+        return bench_scope(seconds);
+    if (strcmp(mode, "buses") == 0)
+        return bench_buses(seconds);
+    if (strcmp(mode, "grid") == 0)
+        return bench_grid(seconds);
+    if (strcmp(mode, "midi") == 0)
+        return bench_midi(seconds);
+    if (strcmp(mode, "midiout") == 0)
+        return bench_midiout(seconds);
+    if (strcmp(mode, "mod") == 0)
+        return bench_mod(seconds);
+    if (strcmp(mode, "envelope") == 0)
+        return bench_envelope(seconds);
+    if (strcmp(mode, "workers") == 0)
+        return bench_workers(seconds);
+    if (strcmp(mode, "offline") == 0)
+        return bench_offline(seconds);
+#if PLUGIN_WANT_LOAD_METER
+    if (strcmp(mode, "meter") == 0)
+        return bench_meter(seconds, polyphony,
+                           onlyBlockSize ? onlyBlockSize : 64);
+#endif
+    if (strcmp(mode, "process") != 0) {
+        fprintf(stderr, "Unknown mode '%s'\n", mode);
+        return 1;
+    }
+    if (polyphony < 0)
+        polyphony = 0;
+    if (polyphony > 128)
+        polyphony = 128;
+
+    cplug_libraryLoad();
+
+    printf("%d held notes, %.1f seconds per configuration\n", polyphony,
+           seconds);
+    printf("%6s %8s %10s %12s %13s %8s %9s %16s\n", "block", "rate",
+           "ns/sample", "worst (us)", "deadline (us)", "worst %", "overruns",
+           "voices*samples/s");
+
+    for (int r = 0; r < ARRLEN(BENCH_SAMPLE_RATES); r++) {
+        double sampleRate = BENCH_SAMPLE_RATES[r];
+        if (onlySampleRate != 0)
+            sampleRate = onlySampleRate;
+
+        for (int b = 0; b < ARRLEN(BENCH_BLOCK_SIZES); b++) {
+            uint32_t blockSize =
+                onlyBlockSize ? onlyBlockSize : BENCH_BLOCK_SIZES[b];
+
+            BenchResult res =
+                bench_run(blockSize, sampleRate, seconds, polyphony);
+            printf("%6u %8.0f %10.2f %12.2f %13.2f %7.1f%% %9llu %16.4g\n",
+                   blockSize, sampleRate, res.nsPerSample,
+                   res.worstBlockNs / 1000.0, res.deadlineNs / 1000.0,
+                   100.0 * res.worstBlockNs / res.deadlineNs,
+                   (unsigned long long)res.numOverruns,
+                   res.voiceSamplesPerSecond);
+
+            if (onlyBlockSize)
+                break;
+        }
+        if (onlySampleRate != 0)
+            break;
+    }
+
+    cplug_libraryUnload();
+    return 0;
+}
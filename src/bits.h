@@ -0,0 +1,23 @@
+#ifndef BITS_H
+#define BITS_H
+
+// Bit scanning shared by the bitmaps that are walked one set bit at a time
+
+#include <stdint.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit. 'bits' must not be 0
+static inline uint32_t bits_lowest_set(uint32_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, bits);
+    return (uint32_t)idx;
+#else
+    return (uint32_t)__builtin_ctz(bits);
+#endif
+}
+
+#endif // BITS_H
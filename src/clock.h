@@ -0,0 +1,32 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+// Monotonic clock
+// Times frames, editor redraws and the host's pace. Unlike the wall clock it
+// never jumps when the system time is set, so an interval measured with it is
+// always the time that passed.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Milliseconds since an arbitrary point, the same for the whole process
+static inline double clock_now_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e3 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e3 + (double)now.tv_nsec * 1e-6;
+#endif
+}
+
+#endif // CLOCK_H
@@ -28,4 +28,42 @@
 #define CPLUG_CLAP_FEATURES                                                    \
     CLAP_PLUGIN_FEATURE_INSTRUMENT, CLAP_PLUGIN_FEATURE_STEREO
 
+// Stereo outputs, up to 16. Notes on MIDI channel 'c' (0 based) play through
+// output c % PLUGIN_NUM_OUTPUT_BUSES, the first one being the main output.
+// Outputs the host leaves disconnected play through the main one
+#ifndef PLUGIN_NUM_OUTPUT_BUSES
+#define PLUGIN_NUM_OUTPUT_BUSES 4
+#endif
+
+// Samples per control step of the modulation matrix, a multiple of 16 (see
+// VOICE_CONTROL_FRAMES). Modulated parameters move linearly within a step
+#ifndef PLUGIN_MOD_CONTROL_FRAMES
+#define PLUGIN_MOD_CONTROL_FRAMES 32
+#endif
+
+// Worker threads that may help the audio thread render the voices, see
+// worker_pool.h, one less than the cores at most. The "Render Threads"
+// parameter sets how many threads take part, 1 leaving the audio thread alone
+#ifndef PLUGIN_MAX_WORKERS
+#define PLUGIN_MAX_WORKERS 7
+#endif
+
+// Voices times frames in a chunk below which the audio thread renders alone,
+// as handing the voices out would cost more than it saves
+#ifndef PLUGIN_PARALLEL_MIN_WORK
+#define PLUGIN_PARALLEL_MIN_WORK 8192
+#endif
+
+// Oversampling stages, 0-3, the Offline render mode raises PARAM_OVERSAMPLING
+// to. See RenderMode
+#ifndef PLUGIN_OFFLINE_OVERSAMPLING
+#define PLUGIN_OFFLINE_OVERSAMPLING 3
+#endif
+
+// Times every process call and shows the audio thread's load in the editor.
+// Build with -DPLUGIN_WANT_LOAD_METER=0 to compile it out entirely
+#ifndef PLUGIN_WANT_LOAD_METER
+#define PLUGIN_WANT_LOAD_METER 1
+#endif
+
 #endif // PLUGIN_CONFIG_H
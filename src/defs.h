@@ -9,36 +9,65 @@ extern "C" {
 #include <cplug.h>
 #include <cplug_extensions/window.h>
 
+#include "arpeggiator.h"
+#include "load_meter.h"
+#include "midi.h"
+#include "mod_matrix.h"
+#include "oversampler.h"
+#include "param_notify.h"
+#include "params.h"
+#include "render_mode.h"
+#include "scope.h"
+#include "smoother.h"
+#include "spsc_ring.h"
+#include "timer_wheel.h"
+#include "voices.h"
+
 #define ARRLEN(a) (sizeof(a) / sizeof((a)[0]))
 
-static const uint32_t PARAM_IDS[] = {
-    'pf32',
-    'pi32',
-    'bool',
-    'utf8',
-};
-enum { NUM_PARAMS = ARRLEN(PARAM_IDS) };
-
-typedef struct ParamInfo {
-  float min;
-  float max;
-  float defaultValue;
-  int flags;
-} ParamInfo;
+#define PRESET_NONE 0xffffffff
+
+struct PresetBank;
+struct VoiceGroups;
+struct WorkerPool;
 
 typedef struct Plugin {
   CplugHostContext *hostContext;
 
-  ParamInfo paramInfo[NUM_PARAMS];
-
   float sampleRate;
   uint32_t maxBufferSize;
 
   float paramValuesAudio[NUM_PARAMS];
-
-  float oscPhase; // 0-1
-  int midiNote;   // -1 == not playing, 0-127+ playing
-  float velocity; // 0-1
+  SmootherBank smoothers;
+
+  // Sample time of the start of the block being processed
+  uint64_t sampleTime;
+
+  MidiDecoder midi;
+  VoicePool voices;
+  // Routings set by the PARAM_MOD* parameters, rebuilt every block
+  ModMatrix mod;
+  // Takes the keys while PARAM_ARPEGGIATOR is on. Its notes are sent to the
+  // host and played through 'midi' at the frame 'midiOut' pops them
+  Arpeggiator arp;
+  TimerWheel midiOut;
+  // Run the drive stage of every output bus at 2^PARAM_OVERSAMPLING times the
+  // host rate
+  Oversampler oversamplers[PLUGIN_NUM_OUTPUT_BUSES];
+  // Host samples left before the filters of a bus have rung out after its last
+  // voice
+  uint32_t oversamplerTails[PLUGIN_NUM_OUTPUT_BUSES];
+  // Threads helping render the voices, started by the first
+  // cplug_setSampleRateAndBlockSize that asks for more than one. NULL until
+  // then, or with no core to spare
+  struct WorkerPool *workers;
+  struct VoiceGroups *voiceGroups;
+  // Samples a voice lasts after its note off, filters ringing included.
+  // Published by every process call for cplug_getTailInSamples
+  volatile uint32_t tailFrames;
+  // Whether the block being processed renders offline, see RenderMode
+  bool offline;
+  RenderModeDetector renderMode;
 
   // GUI zone
   // void* gui;
@@ -48,15 +77,41 @@ typedef struct Plugin {
 
   float paramValuesMain[NUM_PARAMS];
 
-  // Single reader writer queue. Pretty sure atomics aren't required, but here
-  // anyway
-  cplug_atomic_i32 mainToAudioHead;
-  cplug_atomic_i32 mainToAudioTail;
-  CplugEvent mainToAudioQueue[CPLUG_EVENT_QUEUE_SIZE];
+  // Parameter changes made on the main thread (GUI, state loading), drained at
+  // the start of every process call
+  SpscRing mainToAudio;
+  CplugEvent mainToAudioStorage[CPLUG_EVENT_QUEUE_SIZE];
+
+  // Latest parameter values set by the host on the audio thread, collected by
+  // the GUI once per frame
+  ParamNotify audioToMain;
+
+  // Snapshot published by cplug_loadState, picked up by the next process call
+  ParamSnapshot *volatile pendingSnapshot;
+  // Its values, written by the main thread before publishing it. What
+  // cplug_getParameterValue reports until the audio thread takes it
+  float paramValuesLoaded[NUM_PARAMS];
+  // Snapshots the audio thread is done with, freed on the main thread
+  SpscRing retiredSnapshots;
+  ParamSnapshot *retiredSnapshotsStorage[4];
+
+  // Open preset bank, also read by the audio thread for program changes.
+  // Replaced banks wait in 'retiredBanks' until the audio thread has finished
+  // a process call, counted by 'processCount'
+  struct PresetBank *volatile presetBank;
+  struct PresetBank *retiredBanks;
+  volatile uint32_t processCount;
+  // Preset selected on the main thread, picked up by the next process call
+  const ParamSnapshot *volatile pendingPreset;
+  // Last selected preset, or PRESET_NONE
+  volatile uint32_t currentPreset;
+
+#if PLUGIN_WANT_LOAD_METER
+  LoadMeter loadMeter;
+#endif
 
-  cplug_atomic_i32 audioToMainHead;
-  cplug_atomic_i32 audioToMainTail;
-  CplugEvent audioToMainQueue[CPLUG_EVENT_QUEUE_SIZE];
+  // Output published for the editor's scope and spectrum
+  ScopeRing scope;
 
 } Plugin;
 
@@ -71,7 +126,10 @@ typedef struct GUI {
   char uniqueClassName[64];
 #endif
 
+  // Editor pixels when it is drawn on the CPU, see gui_headless.cpp
   uint32_t *img;
+  uint32_t imgWidth;
+  uint32_t imgHeight;
   float scale;
 
   bool mouseDragging;
@@ -82,12 +140,36 @@ typedef struct GUI {
   double dragCurrentParamNormalised;
 
   ImGuiState *imgui_state;
+  // Time taken by pw_create_gui to set up the editor, and by the last
+  // PW_EVENT_DPI_CHANGED
+  float openMs;
+  float rescaleMs;
+
+  // Redraw tracking, see pw_tick
+  uint32_t framesToDraw;
+  uint32_t extraFramesDrawn; // asked for by ImGui since the last change
+  double lastDrawMs;
+  float drawMs; // time taken by the previous imgui_tick
+
+  ScopeView scope;
 } GUI;
 
+bool plugin_load_preset_bank(Plugin *plugin, const char *path);
+void plugin_select_preset(Plugin *plugin, uint32_t index);
+uint32_t plugin_get_num_presets(Plugin *plugin);
+const char *plugin_get_preset_name(Plugin *plugin, uint32_t index);
+
+// Keep process-wide GUI resources alive between cplug_libraryLoad and
+// cplug_libraryUnload
+void imgui_library_load(void);
+void imgui_library_unload(void);
 void imgui_init(GUI *gui);
 void imgui_deinit(GUI *gui);
 void imgui_start(GUI *gui);
-void imgui_tick(GUI *gui);
+// Draws a frame. Returns true when ImGui wants another one even if nothing
+// changes, e.g. while an item is active
+bool imgui_tick(GUI *gui);
+void imgui_set_scale(GUI *gui, float scale);
 void imgui_handle_event(GUI *gui, const PWEvent *event);
 
 extern const unsigned int Iosevka_compressed_size;
@@ -0,0 +1,277 @@
+#include "gui_editor.h"
+
+#include <cplug_extensions/window.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Font data shared by every editor in the process
+// Iosevka is a 3.7 MB compressed blob. Decompressing it is the slowest part of
+// opening an editor, so the first editor does it once and every later one
+// loads the TTF it left behind. cplug_libraryLoad holds a reference too, so
+// closing the last editor keeps the data for the next one.
+// Each context still has its own atlas: the atlas owns its texture, and every
+// editor's renderer creates that on its own D3D11 device
+static struct {
+    int refCount;
+    void *ttf;
+    int ttfSize;
+} g_fonts;
+
+static void fonts_retain() { g_fonts.refCount++; }
+
+static void fonts_release() {
+    if (--g_fonts.refCount > 0)
+        return;
+    IM_FREE(g_fonts.ttf);
+    g_fonts.ttf = NULL;
+    g_fonts.ttfSize = 0;
+}
+
+// Decompresses Iosevka into g_fonts, through an atlas of its own that never
+// draws
+static void fonts_decompress() {
+    ImFontAtlas *atlas = IM_NEW(ImFontAtlas)();
+    if (atlas->AddFontFromMemoryCompressedTTF(Iosevka_compressed_data,
+                                              Iosevka_compressed_size, 36)) {
+        const ImFontConfig &source = atlas->Sources[0];
+        g_fonts.ttf = IM_ALLOC(source.FontDataSize);
+        memcpy(g_fonts.ttf, source.FontData, source.FontDataSize);
+        g_fonts.ttfSize = source.FontDataSize;
+    }
+    IM_DELETE(atlas);
+}
+
+void imgui_library_load() { fonts_retain(); }
+void imgui_library_unload() { fonts_release(); }
+
+ImGuiState *imgui_editor_create(GUI *gui) {
+    ImGuiState *state = (ImGuiState *)calloc(1, sizeof(*state));
+
+    state->clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+
+    gui->imgui_state = state;
+
+    IMGUI_CHECKVERSION();
+
+    fonts_retain();
+    if (g_fonts.ttf == NULL)
+        fonts_decompress();
+
+    auto *imgui_context = ImGui::CreateContext();
+    ImGui::SetCurrentContext(imgui_context);
+    state->imgui_context = imgui_context;
+
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = NULL;
+    // The data stays with g_fonts, the atlas and its texture with the context
+    ImFontConfig config;
+    config.FontDataOwnedByAtlas = false;
+    state->font = g_fonts.ttf ? io.Fonts->AddFontFromMemoryTTF(
+                                    g_fonts.ttf, g_fonts.ttfSize, 36, &config)
+                              : io.Fonts->AddFontDefault();
+
+    // Setup Dear ImGui style
+    ImGui::StyleColorsDark();
+    ImGuiStyle &style = ImGui::GetStyle();
+    style.WindowPadding = {20.0f, 20.0f};
+    style.FrameRounding = 10.0f;
+    style.FramePadding = {10.0f, 5.0f};
+    style.GrabRounding = 10.0f;
+    style.PopupRounding = 10.0f;
+    style.ScrollbarRounding = 10.0f;
+    style.TabRounding = 10.0f;
+    style.ChildRounding = 10.0f;
+    state->baseStyle = style;
+
+    imgui_set_scale(gui, gui->scale);
+    return state;
+}
+
+void imgui_editor_destroy(GUI *gui) {
+    ImGuiState *state = gui->imgui_state;
+    ImGui::SetCurrentContext(state->imgui_context);
+    // Takes its atlas along, but leaves the shared font data alone
+    ImGui::DestroyContext();
+    fonts_release();
+
+    free(gui->imgui_state);
+    gui->imgui_state = NULL;
+}
+
+// Applies a new DPI scale to the running context. Sizes in the style are
+// rescaled from the unscaled copy, so repeated changes don't accumulate
+// rounding. Fonts are sized at draw time and their glyphs baked per size in the
+// context's atlas, so a scale seen before costs nothing and a new one only
+// bakes the glyphs it draws
+void imgui_set_scale(GUI *gui, float scale) {
+    ImGuiState *state = gui->imgui_state;
+    ImGui::SetCurrentContext(state->imgui_context);
+    ImGuiStyle &style = ImGui::GetStyle();
+    style = state->baseStyle;
+    style.ScaleAllSizes(scale);
+    style.FontScaleDpi = scale;
+}
+
+// Output waveform, one line from min to max per point with the newest on the
+// right, and its spectrum. Both are refreshed by pw_tick
+static void draw_scope(GUI *gui) {
+    ScopeView *scope = &gui->scope;
+    ImGui::SliderFloat("Scope refresh (Hz)", &scope->refreshHz, 0.0f, 60.0f,
+                       "%.0f");
+
+    const ImVec2 pos = ImGui::GetCursorScreenPos();
+    const float width = ImGui::GetContentRegionAvail().x;
+    const float height = 80 * gui->scale;
+    ImGui::Dummy(ImVec2(width, height));
+    ImDrawList *draw = ImGui::GetWindowDrawList();
+    draw->AddRectFilled(pos, ImVec2(pos.x + width, pos.y + height),
+                        ImGui::GetColorU32(ImGuiCol_FrameBg));
+    const ImU32 col = ImGui::GetColorU32(ImGuiCol_PlotLines);
+    const float mid = pos.y + height * 0.5f;
+    for (int i = 0; i < SCOPE_WAVE_POINTS; i++) {
+        const float x = pos.x + width * ((float)i + 0.5f) / SCOPE_WAVE_POINTS;
+        float lo = scope->waveMin[i], hi = scope->waveMax[i];
+        lo = lo < -1.0f ? -1.0f : lo > 1.0f ? 1.0f : lo;
+        hi = hi < -1.0f ? -1.0f : hi > 1.0f ? 1.0f : hi;
+        draw->AddLine(ImVec2(x, mid - hi * height * 0.5f),
+                      ImVec2(x, mid - lo * height * 0.5f + 1.0f), col);
+    }
+
+    ImGui::PlotLines("Spectrum (dB)", scope->spectrumDb, SCOPE_SPECTRUM_POINTS,
+                     0, NULL, SCOPE_FLOOR_DB, 0.0f, ImVec2(0, height));
+    if (scope->numTorn)
+        ImGui::Text("%u scope blocks were overwritten while being read",
+                    scope->numTorn);
+}
+
+void imgui_editor_draw(GUI *gui) {
+    ImGuiState *state = gui->imgui_state;
+    ImGui::PushFont(state->font, 18);
+
+    ImGui::SetNextWindowPos({0, 0});
+    ImGui::SetNextWindowSize({static_cast<float>(gui->plugin->width),
+                              static_cast<float>(gui->plugin->height)});
+    ImGui::Begin("Demo Plugin", 0,
+                 ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
+
+    ImGui::Text("This is some useful text.");
+    ImGui::SliderFloat("float", &state->f, 0.0f, 1.0f);
+    ImGui::ColorEdit3("clear color", (float *)&gui->imgui_state->clear_color);
+
+    if (ImGui::Button("Button"))
+        state->counter++;
+
+    ImGui::SameLine();
+    ImGui::Text("counter = %d", state->counter);
+    ImGui::Text("f = %f, mouse X = %4d, mouse Y = %4d, button = %d", state->f,
+                state->mouse_x, state->mouse_y, state->mouse_button_pressed);
+
+    ImGuiIO &io = ImGui::GetIO();
+    state->frameMs[state->frameIndex] = gui->drawMs;
+    state->frameIndex = (state->frameIndex + 1) % IM_ARRAYSIZE(state->frameMs);
+    float worstMs = 0.0f;
+    for (float ms : state->frameMs)
+        worstMs = ms > worstMs ? ms : worstMs;
+    ImGui::Text("Application average %.3f ms/frame (%.1f FPS), worst %.1f ms",
+                1000.0f / io.Framerate, io.Framerate, worstMs);
+    ImGui::Text("width: %.3d, height: %.3d, scale: %.3f", gui->plugin->width,
+                gui->plugin->height, gui->scale);
+    ImGui::Text("Editor opened in %.2f ms, last DPI change took %.2f ms",
+                gui->openMs, gui->rescaleMs);
+
+    Plugin *plugin = gui->plugin;
+    ImGui::InputText("##bank", state->presetBankPath,
+                     sizeof(state->presetBankPath));
+    ImGui::SameLine();
+    if (ImGui::Button("Load bank"))
+        state->presetBankFailed =
+            !plugin_load_preset_bank(plugin, state->presetBankPath);
+    if (state->presetBankFailed) {
+        ImGui::SameLine();
+        ImGui::Text("Not a preset bank");
+    }
+
+    const uint32_t current = plugin->currentPreset;
+    const char *currentName = plugin_get_preset_name(plugin, current);
+    if (ImGui::BeginCombo("Preset", currentName ? currentName : "-")) {
+        const uint32_t numPresets = plugin_get_num_presets(plugin);
+        for (uint32_t i = 0; i < numPresets; i++) {
+            ImGui::PushID((int)i);
+            if (ImGui::Selectable(plugin_get_preset_name(plugin, i),
+                                  i == current))
+                plugin_select_preset(plugin, i);
+            ImGui::PopID();
+        }
+        ImGui::EndCombo();
+    }
+
+#if PLUGIN_WANT_LOAD_METER
+    LoadMeterSummary load;
+    uint32_t bins[LOAD_METER_NUM_BINS];
+    load_meter_summarize(&plugin->loadMeter, &load, bins);
+    ImGui::Text("Audio load: mean %.1f%%, p99 %.1f%%, max %.1f%%",
+                load.meanPercent, load.p99Percent, load.maxPercent);
+    ImGui::Text("Block time: min %.1f us, mean %.1f us, max %.1f us",
+                load.minUs, load.meanUs, load.maxUs);
+    ImGui::Text("%llu blocks, %llu overruns",
+                (unsigned long long)load.numBlocks,
+                (unsigned long long)load.numOverruns);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+        load_meter_request_reset(&plugin->loadMeter);
+
+    // Histogram up to the slowest bin in use, at least 0-100%
+    uint32_t numShown = 100 * LOAD_METER_BINS_PER_PERCENT;
+    for (uint32_t i = numShown; i < LOAD_METER_NUM_BINS; i++)
+        if (bins[i])
+            numShown = i + 1;
+    float counts[LOAD_METER_NUM_BINS];
+    for (uint32_t i = 0; i < numShown; i++)
+        counts[i] = (float)bins[i];
+    ImGui::PlotHistogram("% of deadline", counts, (int)numShown, 0, NULL, 0.0f,
+                         FLT_MAX, ImVec2(0, 80));
+#endif
+
+    draw_scope(gui);
+    ImGui::End();
+    ImGui::PopFont();
+}
+
+bool imgui_editor_wants_frame() {
+    return ImGui::IsAnyItemActive() || ImGui::GetIO().WantTextInput;
+}
+
+void imgui_handle_event(GUI *gui, const PWEvent *event) {
+    ImGuiState *state = gui->imgui_state;
+    ImGui::SetCurrentContext(state->imgui_context);
+    ImGuiIO &io = ImGui::GetIO();
+    switch (event->type) {
+    // case PW_EVENT_RESIZE_UPDATE:
+    //   // imgui_deinit(gui);
+    //   // imgui_init(gui);
+    //   break;
+    case PW_EVENT_MOUSE_MOVE:
+        io.AddMousePosEvent(event->mouse.x, event->mouse.y);
+        state->mouse_x = (int)event->mouse.x;
+        state->mouse_y = (int)event->mouse.y;
+        break;
+    case PW_EVENT_MOUSE_LEFT_DOWN:
+        io.AddMouseButtonEvent(0, true);
+        state->mouse_button_pressed = 1;
+        break;
+    case PW_EVENT_MOUSE_LEFT_UP:
+        io.AddMouseButtonEvent(0, false);
+        state->mouse_button_pressed = 0;
+        break;
+    case PW_EVENT_MOUSE_RIGHT_DOWN:
+        io.AddMouseButtonEvent(1, true);
+        state->mouse_button_pressed = 1;
+        break;
+    case PW_EVENT_MOUSE_RIGHT_UP:
+        io.AddMouseButtonEvent(1, false);
+        state->mouse_button_pressed = 0;
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef GUI_EDITOR_H
+#define GUI_EDITOR_H
+
+// Platform independent half of the editor: the ImGui context, its fonts,
+// styling and widgets. gui.cpp runs it in a Win32 window with DX11,
+// gui_GL.cpp with OpenGL, and gui_headless.cpp draws it on the CPU with
+// gui_soft.cpp
+
+#include "defs.h"
+
+#include <imgui.h>
+
+struct ImGuiState {
+    ImGuiContext *imgui_context;
+
+    ImFont *font;
+    // Style at a scale of 1. Every DPI change rescales a copy of it
+    ImGuiStyle baseStyle;
+
+    // Time spent drawing recent frames, for the worst one shown next to the
+    // average. Idle gaps between frames are not counted
+    float frameMs[120];
+    int frameIndex;
+
+    // Our state
+    ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+    int counter = 0;
+    float f = 0.0f;
+    int mouse_x = 0;
+    int mouse_y = 0;
+    int mouse_button_pressed = 0;
+
+    char presetBankPath[512];
+    bool presetBankFailed;
+};
+
+// Creates the editor's context with the shared font data, styled at
+// gui->scale, and makes it current
+ImGuiState *imgui_editor_create(GUI *gui);
+// Destroys the context. Renderer and platform backends must be shut down first
+void imgui_editor_destroy(GUI *gui);
+// Submits the editor's widgets. Call between ImGui::NewFrame and ImGui::Render
+void imgui_editor_draw(GUI *gui);
+// True while ImGui wants frames even if nothing changes, see imgui_tick
+bool imgui_editor_wants_frame();
+
+// CPU renderer backend, see gui_soft.cpp
+void imgui_soft_init();
+void imgui_soft_shutdown();
+// Draws 'drawData' into 'pixels', 'width' x 'height' RGBA with R in the low
+// byte, after clearing it to 'clearColor'
+void imgui_soft_render(ImDrawData *drawData, uint32_t *pixels, int width,
+                       int height, uint32_t clearColor);
+
+#endif // GUI_EDITOR_H
@@ -0,0 +1,221 @@
+// Headless editor host
+// Opens the editor without a window or GPU, drawing it on the CPU with
+// gui_soft.cpp into GUI::img. A scripted session of mouse events is rendered
+// at a scale of 1 and 2, every frame of it written to a PPM image, then the
+// editor is redrawn for a while to time the frames. Builds on machines with no
+// display (eg. Linux CI), where it checks the editor still draws something.
+//
+// Usage: cplug_example_gui_headless [-o directory] [-n frames]
+
+#include "clock.h"
+#include "gui_editor.h"
+
+#include <cplug.h>
+#include <cplug_extensions/window.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADLESS_WIDTH  1024
+#define HEADLESS_HEIGHT 500
+
+// Time spent in the last imgui_tick building the frame with ImGui, and
+// rasterising it
+static double g_buildMs;
+static double g_rasterMs;
+
+void imgui_init(GUI *gui) { ; }
+
+void imgui_start(GUI *gui) {
+    imgui_editor_create(gui);
+    imgui_soft_init();
+}
+
+void imgui_deinit(GUI *gui) {
+    ImGuiState *state = gui->imgui_state;
+    ImGui::SetCurrentContext(state->imgui_context);
+    imgui_soft_shutdown();
+    imgui_editor_destroy(gui);
+    free(gui->img);
+    gui->img = NULL;
+}
+
+bool imgui_tick(GUI *gui) {
+    ImGuiState *state = gui->imgui_state;
+    ImGui::SetCurrentContext(state->imgui_context);
+
+    const uint32_t width = gui->plugin->width;
+    const uint32_t height = gui->plugin->height;
+    if (width != gui->imgWidth || height != gui->imgHeight) {
+        free(gui->img);
+        gui->img = (uint32_t *)malloc(sizeof(uint32_t) * width * height);
+        gui->imgWidth = gui->img ? width : 0;
+        gui->imgHeight = gui->img ? height : 0;
+        if (gui->img == NULL)
+            return false;
+    }
+
+    const double start = clock_now_ms();
+    ImGuiIO &io = ImGui::GetIO();
+    io.DisplaySize = ImVec2((float)width, (float)height);
+    // Fixed, so the same events always give the same pixels
+    io.DeltaTime = 1.0f / 60.0f;
+    ImGui::NewFrame();
+    imgui_editor_draw(gui);
+    ImGui::Render();
+
+    const double built = clock_now_ms();
+    const ImVec4 c = state->clear_color;
+    const ImVec4 clear = ImVec4(c.x * c.w, c.y * c.w, c.z * c.w, c.w);
+    imgui_soft_render(ImGui::GetDrawData(), gui->img, (int)width, (int)height,
+                      ImGui::ColorConvertFloat4ToU32(clear));
+    g_buildMs = built - start;
+    g_rasterMs = clock_now_ms() - built;
+
+    return imgui_editor_wants_frame();
+}
+
+// Writes GUI::img as a binary PPM, dropping alpha
+static bool headless_write_ppm(const GUI *gui, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+    fprintf(file, "P6\n%u %u\n255\n", gui->imgWidth, gui->imgHeight);
+    const uint32_t numPixels = gui->imgWidth * gui->imgHeight;
+    bool ok = true;
+    for (uint32_t i = 0; i < numPixels && ok; i++) {
+        const uint32_t p = gui->img[i];
+        const uint8_t rgb[3] = {(uint8_t)p, (uint8_t)(p >> 8),
+                                (uint8_t)(p >> 16)};
+        ok = fwrite(rgb, 1, 3, file) == 3;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// A frame with fewer pixels than this away from the background colour has lost
+// its widgets
+static bool headless_is_blank(const GUI *gui) {
+    const uint32_t numPixels = gui->imgWidth * gui->imgHeight;
+    uint32_t numDrawn = 0;
+    for (uint32_t i = 0; i < numPixels; i++)
+        numDrawn += gui->img[i] != gui->img[0];
+    return numDrawn < numPixels / 100;
+}
+
+static void headless_mouse(GUI *gui, int type, float x, float y) {
+    PWEvent event = {};
+    event.type = type;
+    event.gui = gui;
+    event.mouse.x = x * gui->scale;
+    event.mouse.y = y * gui->scale;
+    pw_event(&event);
+}
+
+typedef struct HeadlessStep {
+    int type;
+    float x, y; // at a scale of 1
+} HeadlessStep;
+
+// Hovers the editor, drags the "float" slider and clicks "Button"
+static const HeadlessStep HEADLESS_SCRIPT[] = {
+    {PW_EVENT_MOUSE_MOVE, 10, 10},
+    {PW_EVENT_MOUSE_MOVE, 100, 56},
+    {PW_EVENT_MOUSE_LEFT_DOWN, 100, 56},
+    {PW_EVENT_MOUSE_MOVE, 250, 56},
+    {PW_EVENT_MOUSE_MOVE, 400, 56},
+    {PW_EVENT_MOUSE_LEFT_UP, 400, 56},
+    {PW_EVENT_MOUSE_MOVE, 50, 124},
+    {PW_EVENT_MOUSE_LEFT_DOWN, 50, 124},
+    {PW_EVENT_MOUSE_LEFT_UP, 50, 124},
+    {PW_EVENT_MOUSE_MOVE, 900, 450},
+};
+
+// Renders the script at 'scale', then times 'numFrames' more frames. Returns
+// false if a frame couldn't be drawn or written
+static bool headless_run(void *plugin, float scale, const char *outDir,
+                         int numFrames) {
+    GUI *gui = (GUI *)pw_create_gui(plugin, NULL);
+    if (scale != 1.0f) {
+        PWEvent event = {};
+        event.type = PW_EVENT_DPI_CHANGED;
+        event.gui = gui;
+        event.dpi = scale;
+        pw_event(&event);
+        event.type = PW_EVENT_RESIZE_UPDATE;
+        event.resize.width = (uint32_t)(HEADLESS_WIDTH * scale);
+        event.resize.height = (uint32_t)(HEADLESS_HEIGHT * scale);
+        pw_event(&event);
+    }
+    printf("%ux%u at %gx: editor opened in %.1f ms\n",
+           gui->plugin->width, gui->plugin->height, scale, gui->openMs);
+
+    bool ok = true;
+    const int numSteps = (int)(sizeof(HEADLESS_SCRIPT) /
+                               sizeof(HEADLESS_SCRIPT[0]));
+    for (int i = 0; i < numSteps && ok; i++) {
+        const HeadlessStep *step = &HEADLESS_SCRIPT[i];
+        headless_mouse(gui, step->type, step->x, step->y);
+        // Drawn directly: pw_tick would skip frames to stay under GUI_MAX_FPS
+        imgui_tick(gui);
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/editor_%gx_%02d.ppm", outDir, scale,
+                 i);
+        if (gui->img == NULL || headless_is_blank(gui)) {
+            fprintf(stderr, "%s: nothing was drawn\n", path);
+            ok = false;
+        } else if (!headless_write_ppm(gui, path)) {
+            fprintf(stderr, "%s: can't write\n", path);
+            ok = false;
+        }
+    }
+
+    // The mouse circles the editor so hover states keep changing, like a user
+    // would make them
+    double buildMs = 0, rasterMs = 0, worstMs = 0;
+    for (int i = 0; i < numFrames && ok; i++) {
+        const float angle = 6.2831853f * (float)i / 120.0f;
+        headless_mouse(gui, PW_EVENT_MOUSE_MOVE, 512 + 400 * cosf(angle),
+                       250 + 200 * sinf(angle));
+        imgui_tick(gui);
+        buildMs += g_buildMs;
+        rasterMs += g_rasterMs;
+        if (g_buildMs + g_rasterMs > worstMs)
+            worstMs = g_buildMs + g_rasterMs;
+    }
+    if (ok && numFrames > 0)
+        printf("  %d frames: mean %.3f ms (build %.3f, raster %.3f), "
+               "worst %.3f ms\n",
+               numFrames, (buildMs + rasterMs) / numFrames,
+               buildMs / numFrames, rasterMs / numFrames, worstMs);
+
+    pw_destroy_gui(gui);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *outDir = ".";
+    int numFrames = 600;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+            outDir = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+            numFrames = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Usage: %s [-o directory] [-n frames]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    cplug_libraryLoad();
+    void *plugin = cplug_createPlugin(NULL);
+    cplug_setSampleRateAndBlockSize(plugin, 48000, 512);
+
+    bool ok = headless_run(plugin, 1.0f, outDir, numFrames);
+    ok = headless_run(plugin, 2.0f, outDir, numFrames) && ok;
+
+    cplug_destroyPlugin(plugin);
+    cplug_libraryUnload();
+    return ok ? 0 : 1;
+}
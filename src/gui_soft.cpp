@@ -0,0 +1,94 @@
+// ImGui renderer backend drawing on the CPU with soft_raster.h
+// Textures stay where ImGui keeps their pixels, so creating or updating one
+// only acknowledges it. Used by gui_headless.cpp to render the editor on
+// machines without a GPU.
+
+#include "gui_editor.h"
+
+#include <stddef.h>
+
+extern "C" {
+#include "soft_raster.h"
+}
+
+static_assert(sizeof(ImDrawVert) == sizeof(SoftVertex), "Layout mismatch");
+static_assert(offsetof(ImDrawVert, pos) == offsetof(SoftVertex, x),
+              "Layout mismatch");
+static_assert(offsetof(ImDrawVert, uv) == offsetof(SoftVertex, u),
+              "Layout mismatch");
+static_assert(offsetof(ImDrawVert, col) == offsetof(SoftVertex, col),
+              "Layout mismatch");
+static_assert(sizeof(ImDrawIdx) == sizeof(SoftIndex), "Index size mismatch");
+
+void imgui_soft_init() {
+    ImGuiIO &io = ImGui::GetIO();
+    io.BackendRendererName = "imgui_soft";
+    io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset |
+                       ImGuiBackendFlags_RendererHasTextures;
+}
+
+void imgui_soft_shutdown() {
+    ImGuiIO &io = ImGui::GetIO();
+    io.BackendRendererName = NULL;
+    io.BackendFlags &= ~(ImGuiBackendFlags_RendererHasVtxOffset |
+                         ImGuiBackendFlags_RendererHasTextures);
+}
+
+static void update_texture(ImTextureData *tex) {
+    if (tex->Status == ImTextureStatus_WantCreate) {
+        tex->SetTexID((ImTextureID)(intptr_t)tex);
+        tex->SetStatus(ImTextureStatus_OK);
+    } else if (tex->Status == ImTextureStatus_WantUpdates) {
+        tex->SetStatus(ImTextureStatus_OK);
+    } else if (tex->Status == ImTextureStatus_WantDestroy &&
+               tex->UnusedFrames > 0) {
+        tex->SetTexID(ImTextureID_Invalid);
+        tex->SetStatus(ImTextureStatus_Destroyed);
+    }
+}
+
+void imgui_soft_render(ImDrawData *drawData, uint32_t *pixels, int width,
+                       int height, uint32_t clearColor) {
+    if (drawData->Textures != NULL)
+        for (ImTextureData *tex : *drawData->Textures)
+            if (tex->Status != ImTextureStatus_OK)
+                update_texture(tex);
+
+    SoftImage image = {pixels, width, height};
+    soft_raster_clear(&image, clearColor);
+
+    // Editors draw in pixels, so the framebuffer scale is always 1
+    IM_ASSERT(drawData->FramebufferScale.x == 1.0f &&
+              drawData->FramebufferScale.y == 1.0f);
+    const ImVec2 origin = drawData->DisplayPos;
+
+    for (const ImDrawList *list : drawData->CmdLists) {
+        const SoftVertex *vertices = (const SoftVertex *)list->VtxBuffer.Data;
+        const SoftIndex *indices = (const SoftIndex *)list->IdxBuffer.Data;
+        for (const ImDrawCmd &cmd : list->CmdBuffer) {
+            if (cmd.UserCallback != NULL) {
+                if (cmd.UserCallback != ImDrawCallback_ResetRenderState)
+                    cmd.UserCallback(list, &cmd);
+                continue;
+            }
+
+            const SoftClip clip = {(int)(cmd.ClipRect.x - origin.x),
+                                   (int)(cmd.ClipRect.y - origin.y),
+                                   (int)(cmd.ClipRect.z - origin.x),
+                                   (int)(cmd.ClipRect.w - origin.y)};
+            const ImTextureData *tex =
+                (const ImTextureData *)(intptr_t)cmd.GetTexID();
+            SoftTexture texture = {};
+            if (tex != NULL) {
+                texture.pixels = (const uint8_t *)tex->Pixels;
+                texture.width = tex->Width;
+                texture.height = tex->Height;
+                texture.bytesPerPixel = tex->BytesPerPixel;
+            }
+            soft_raster_triangles(&image, &clip, tex ? &texture : NULL,
+                                  vertices + cmd.VtxOffset,
+                                  indices + cmd.IdxOffset, cmd.ElemCount,
+                                  origin.x, origin.y);
+        }
+    }
+}
@@ -0,0 +1,219 @@
+#ifndef LOAD_METER_H
+#define LOAD_METER_H
+
+// Audio thread load meter
+// Every cplug_process call is timed with the CPU's cycle counter and counted in
+// a histogram by the share of its deadline (numFrames / sampleRate) it used.
+// The audio thread is the only writer and publishes every field with a relaxed
+// store, so the GUI reads whenever it likes without locks. A reader may see a
+// block counted in some fields and not yet in others, which is harmless for a
+// display.
+//
+// Compiled only when PLUGIN_WANT_LOAD_METER is set, see config.h
+
+#if PLUGIN_WANT_LOAD_METER
+
+#include <stdint.h>
+#include <string.h>
+
+#include "atomics.h"
+#include "clock.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||             \
+    defined(_M_IX86)
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define LOAD_METER_TSC 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LOAD_METER_CNTVCT 1
+#endif
+
+#define LOAD_METER_BINS_PER_PERCENT 2
+// The last bin counts every block that took twice its deadline or more
+#define LOAD_METER_NUM_BINS (200 * LOAD_METER_BINS_PER_PERCENT + 1)
+
+typedef struct LoadMeter {
+    // Set in cplug_setSampleRateAndBlockSize, while the audio thread is idle
+    double ticksPerSecond;
+    float ticksPerFrame;
+
+    // Written by the audio thread, read by anyone
+    volatile uint32_t bins[LOAD_METER_NUM_BINS];
+    volatile uint64_t numBlocks;
+    volatile uint64_t numFrames;
+    volatile uint64_t numOverruns;
+    volatile uint64_t sumTicks;
+    volatile uint64_t minTicks;
+    volatile uint64_t maxTicks;
+
+    // Set by the GUI, cleared by the audio thread when it has reset the above
+    volatile uint32_t resetRequested;
+} LoadMeter;
+
+static inline uint64_t load_meter_now() {
+#if defined(LOAD_METER_TSC)
+    return __rdtsc();
+#elif defined(LOAD_METER_CNTVCT) && defined(_MSC_VER) && !defined(__clang__)
+    return (uint64_t)_ReadStatusReg(ARM64_CNTVCT);
+#elif defined(LOAD_METER_CNTVCT)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return (uint64_t)(clock_now_ms() * 1e6);
+#endif
+}
+
+// Rate of load_meter_now(). On x86 the TSC rate is measured against
+// clock_now_ms(), which spins for a few milliseconds, so call it once and keep
+// the result
+static inline double load_meter_calibrate() {
+#if defined(LOAD_METER_TSC)
+    const double start = clock_now_ms();
+    const uint64_t startTicks = load_meter_now();
+    double elapsedMs;
+    do {
+        elapsedMs = clock_now_ms() - start;
+    } while (elapsedMs < 5);
+    return (double)(load_meter_now() - startTicks) * 1e3 / elapsedMs;
+#elif defined(LOAD_METER_CNTVCT) && defined(_MSC_VER) && !defined(__clang__)
+    return (double)_ReadStatusReg(ARM64_CNTFRQ);
+#elif defined(LOAD_METER_CNTVCT)
+    uint64_t frequency;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    return (double)frequency;
+#else
+    return 1e9;
+#endif
+}
+
+static inline void load_meter_reset(LoadMeter *meter) {
+    for (uint32_t i = 0; i < LOAD_METER_NUM_BINS; i++)
+        atomic_store_relaxed_u32(&meter->bins[i], 0);
+    atomic_store_relaxed_u64(&meter->numBlocks, 0);
+    atomic_store_relaxed_u64(&meter->numFrames, 0);
+    atomic_store_relaxed_u64(&meter->numOverruns, 0);
+    atomic_store_relaxed_u64(&meter->sumTicks, 0);
+    atomic_store_relaxed_u64(&meter->minTicks, UINT64_MAX);
+    atomic_store_relaxed_u64(&meter->maxTicks, 0);
+}
+
+static inline void load_meter_init(LoadMeter *meter, double ticksPerSecond) {
+    memset(meter, 0, sizeof(*meter));
+    meter->ticksPerSecond = ticksPerSecond;
+    load_meter_reset(meter);
+}
+
+static inline void load_meter_set_sample_rate(LoadMeter *meter,
+                                              float sampleRate) {
+    meter->ticksPerFrame = (float)(meter->ticksPerSecond / sampleRate);
+}
+
+// Audio thread only. Counts one block of 'numFrames' that took 'ticks'
+static inline void load_meter_record(LoadMeter *meter, uint64_t ticks,
+                                     uint32_t numFrames) {
+    if (atomic_load_relaxed_u32(&meter->resetRequested)) {
+        load_meter_reset(meter);
+        atomic_store_release_u32(&meter->resetRequested, 0);
+    }
+    if (numFrames == 0)
+        return;
+
+    const float deadline = meter->ticksPerFrame * (float)numFrames;
+    float bin =
+        (float)ticks * (100.0f * LOAD_METER_BINS_PER_PERCENT) / deadline;
+    if (bin > LOAD_METER_NUM_BINS - 1)
+        bin = LOAD_METER_NUM_BINS - 1;
+    const uint32_t b = (uint32_t)bin;
+
+    // Single writer: plain read-modify-write, published with relaxed stores
+    atomic_store_relaxed_u32(&meter->bins[b], meter->bins[b] + 1);
+    atomic_store_relaxed_u64(&meter->numBlocks, meter->numBlocks + 1);
+    atomic_store_relaxed_u64(&meter->numFrames, meter->numFrames + numFrames);
+    atomic_store_relaxed_u64(&meter->sumTicks, meter->sumTicks + ticks);
+    if ((float)ticks > deadline)
+        atomic_store_relaxed_u64(&meter->numOverruns, meter->numOverruns + 1);
+    if (ticks < meter->minTicks)
+        atomic_store_relaxed_u64(&meter->minTicks, ticks);
+    if (ticks > meter->maxTicks)
+        atomic_store_relaxed_u64(&meter->maxTicks, ticks);
+}
+
+// Any thread. Clears the statistics before the next block is counted
+static inline void load_meter_request_reset(LoadMeter *meter) {
+    atomic_store_release_u32(&meter->resetRequested, 1);
+}
+
+typedef struct LoadMeterSummary {
+    uint64_t numBlocks;
+    uint64_t numOverruns;
+    double minUs;
+    double meanUs;
+    double maxUs;
+    // Share of the deadline used, in percent. 'mean' is the total time spent
+    // processing over the total duration of the audio produced
+    float meanPercent;
+    float p99Percent;
+    float maxPercent;
+} LoadMeterSummary;
+
+// Any thread. Percentiles are resolved to 1 / LOAD_METER_BINS_PER_PERCENT of a
+// percent. 'bins' receives a copy of the histogram when not NULL
+static inline void load_meter_summarize(const LoadMeter *meter,
+                                        LoadMeterSummary *summary,
+                                        uint32_t *bins) {
+    memset(summary, 0, sizeof(*summary));
+    uint32_t localBins[LOAD_METER_NUM_BINS];
+    if (bins == NULL)
+        bins = localBins;
+
+    uint64_t numCounted = 0;
+    for (uint32_t i = 0; i < LOAD_METER_NUM_BINS; i++) {
+        bins[i] = atomic_load_relaxed_u32(&meter->bins[i]);
+        numCounted += bins[i];
+    }
+    if (numCounted == 0)
+        return;
+
+    const uint64_t numFrames = atomic_load_relaxed_u64(&meter->numFrames);
+    const uint64_t sumTicks = atomic_load_relaxed_u64(&meter->sumTicks);
+    const double usPerTick = 1e6 / meter->ticksPerSecond;
+    summary->numBlocks = atomic_load_relaxed_u64(&meter->numBlocks);
+    summary->numOverruns = atomic_load_relaxed_u64(&meter->numOverruns);
+    summary->minUs = atomic_load_relaxed_u64(&meter->minTicks) * usPerTick;
+    summary->maxUs = atomic_load_relaxed_u64(&meter->maxTicks) * usPerTick;
+    summary->meanUs = summary->numBlocks
+                          ? sumTicks * usPerTick / summary->numBlocks
+                          : 0.0;
+    summary->meanPercent =
+        numFrames ? (float)(100.0 * sumTicks /
+                            (numFrames * (double)meter->ticksPerFrame))
+                  : 0.0f;
+
+    // Upper edge of the bin holding the 99th percentile, so p99 is never
+    // under reported
+    const uint64_t p99Rank = numCounted - numCounted / 100;
+    uint64_t cumulative = 0;
+    for (uint32_t i = 0; i < LOAD_METER_NUM_BINS; i++) {
+        cumulative += bins[i];
+        if (cumulative >= p99Rank) {
+            summary->p99Percent =
+                (float)(i + 1) / (float)LOAD_METER_BINS_PER_PERCENT;
+            break;
+        }
+    }
+    for (uint32_t i = LOAD_METER_NUM_BINS; i-- > 0;) {
+        if (bins[i]) {
+            summary->maxPercent =
+                (float)(i + 1) / (float)LOAD_METER_BINS_PER_PERCENT;
+            break;
+        }
+    }
+}
+
+#endif // PLUGIN_WANT_LOAD_METER
+
+#endif // LOAD_METER_H
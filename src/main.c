@@ -1,4 +1,11 @@
+#include "clock.h"
 #include "defs.h"
+#include "perfect_hash.h"
+#include "preset_bank.h"
+#include "saturator.h"
+#include "state.h"
+#include "voice_groups.h"
+#include "worker_pool.h"
 #include <cplug.h>
 #include <cplug_extensions/window.h>
 #include <math.h>
@@ -7,8 +14,10 @@
 
 #ifdef _WIN32
 #define my_assert(cond) (cond) ? (void)0 : __debugbreak()
-#else
+#elif defined(__clang__)
 #define my_assert(cond) (cond) ? (void)0 : __builtin_debugtrap()
+#else
+#define my_assert(cond) (cond) ? (void)0 : __builtin_trap()
 #endif
 
 // #if defined(_WIN32) && defined(__x86_64__)
@@ -33,72 +42,206 @@
 // #define RESTORE_DENORMALS fesetenv(&_fenv);
 // #endif
 
-#define CPLUG_EVENT_QUEUE_MASK (CPLUG_EVENT_QUEUE_SIZE - 1)
+#if PLUGIN_WANT_LOAD_METER
+#define LOAD_METER_BEGIN const uint64_t loadMeterStart = load_meter_now();
+#define LOAD_METER_END                                                         \
+    load_meter_record(&plugin->loadMeter, load_meter_now() - loadMeterStart,   \
+                      ctx->numFrames);
+#else
+#define LOAD_METER_BEGIN
+#define LOAD_METER_END
+#endif
+
+// Longest stretch rendered with constant parameters while they ramp
+#define CONTROL_RATE_FRAMES 32
+
+// Frames per sub-block of the quantised process loop for a PARAM_EVENT_GRID
+// value, 8 to 64. 0 for the sample accurate loop
+static uint32_t event_grid_frames(float value) {
+    const uint32_t grid = (uint32_t)value;
+    return grid > 0 ? 4u << grid : 0;
+}
+
+// PARAM_OVERSAMPLING, raised to PLUGIN_OFFLINE_OVERSAMPLING when
+// PARAM_RENDER_MODE asks for Offline. Read as the plugin is activated, so
+// choosing Offline raises it from the next activation. Not by Auto, as the
+// host has the latency by the time it starts bouncing
+static uint32_t oversampling_stages(const float *params) {
+    const uint32_t numStages = (uint32_t)params[PARAM_OVERSAMPLING];
+    if ((uint32_t)params[PARAM_RENDER_MODE] == RENDER_MODE_OFFLINE &&
+        numStages < PLUGIN_OFFLINE_OVERSAMPLING)
+        return PLUGIN_OFFLINE_OVERSAMPLING;
+    return numStages;
+}
 
 #define GUI_DEFAULT_WIDTH  1024
 #define GUI_DEFAULT_HEIGHT 500
 // #define GUI_RATIO_X 16
 // #define GUI_RATIO_Y 9
 
-// returns 'CPLUG_NUM_PARAMS' on failure
+// Editor redraw policy, see pw_tick
+#define GUI_MAX_FPS 60
+// Frames drawn after every change. ImGui needs a few to settle hover states and
+// layout
+#define GUI_SETTLE_FRAMES 3
+// Frames ImGui may ask for on its own after a change, e.g. for a blinking
+// text cursor
+#define GUI_MAX_EXTRA_FRAMES 120
+// Readouts that change without any event, like the load meter, refresh at this
+// interval
+#define GUI_LIVE_REFRESH_MS 250
+// Default rate of the scope and spectrum, changed in the editor
+#define GUI_SCOPE_REFRESH_HZ 30
+
+static_assert(ARRLEN(PARAM_IDS) == NUM_PARAMS, "Invalid length");
+static_assert(ARRLEN(PARAM_INFO) == NUM_PARAMS, "Invalid length");
+static_assert(PLUGIN_NUM_OUTPUT_BUSES >= 1 &&
+                  PLUGIN_NUM_OUTPUT_BUSES <= VOICE_MAX_BUSES,
+              "Invalid number of output buses");
+static_assert(PLUGIN_MAX_WORKERS >= 1 &&
+                  PLUGIN_MAX_WORKERS < WORKER_POOL_MAX_THREADS,
+              "Invalid number of workers");
+static_assert(VOICE_MAX_GROUPS <= WORKER_POOL_MAX_TASKS,
+              "Too many voice groups");
+static_assert(PLUGIN_MOD_CONTROL_FRAMES % VOICE_CONTROL_FRAMES == 0 &&
+                  PLUGIN_MOD_CONTROL_FRAMES / VOICE_CONTROL_FRAMES <= 255,
+              "Invalid modulation control step");
+
+// mod_matrix_step() reads the smoothed LFO rates as an array
+static_assert(PARAM_LFO2_RATE == PARAM_LFO1_RATE + MOD_NUM_LFOS - 1,
+              "Invalid LFO rates");
+
+// Routings of the modulation matrix set by parameters: source, destination and
+// amount of each
+#define MOD_NUM_SLOTS 4
+static_assert(PARAM_MOD1_DEST == PARAM_MOD1_SOURCE + 1 &&
+                  PARAM_MOD1_AMOUNT == PARAM_MOD1_SOURCE + 2 &&
+                  PARAM_MOD2_SOURCE == PARAM_MOD1_SOURCE + 3 &&
+                  PARAM_MOD4_AMOUNT ==
+                      PARAM_MOD1_SOURCE + MOD_NUM_SLOTS * 3 - 1,
+              "Modulation slot parameters must follow each other");
+static_assert(ARRLEN(MOD_DEST_PARAMS) == MOD_DEST_COUNT, "Invalid length");
+
+// Shared by all instances, built once in cplug_libraryLoad
+static PerfectHash g_paramHash;
+static WavetableCache g_wavetableCache;
+static int g_libraryRefCount = 0;
+#if PLUGIN_WANT_LOAD_METER
+static double g_loadMeterTicksPerSecond;
+#endif
+
+// returns 'NUM_PARAMS' on failure
 uint32_t get_param_index(void *ptr, uint32_t paramId) {
-    uint32_t i = 0;
-    for (; i < ARRLEN(PARAM_IDS); i++)
-        if (paramId == PARAM_IDS[i])
-            break;
-    return i;
+    return perfect_hash_find(&g_paramHash, PARAM_IDS, paramId);
 }
 
 void sendParamEventFromMain(Plugin *plugin, uint32_t type, uint32_t paramIdx,
                             double value);
 
-void cplug_libraryLoad() {};
-void cplug_libraryUnload() {};
+void cplug_libraryLoad() {
+    if (g_libraryRefCount++ > 0)
+        return;
+    bool ok = perfect_hash_build(&g_paramHash, PARAM_IDS, NUM_PARAMS);
+    // Fails if two parameters in PARAM_TABLE share an ID
+    my_assert(ok);
+    // On failure every instance falls back to plain sines
+    wavetable_cache_init(&g_wavetableCache);
+    imgui_library_load();
+#if PLUGIN_WANT_LOAD_METER
+    g_loadMeterTicksPerSecond = load_meter_calibrate();
+#endif
+}
+
+void cplug_libraryUnload() {
+    if (--g_libraryRefCount > 0)
+        return;
+    perfect_hash_free(&g_paramHash);
+    wavetable_cache_free(&g_wavetableCache);
+    imgui_library_unload();
+}
 
 void *cplug_createPlugin(CplugHostContext *ctx) {
     Plugin *plugin = (Plugin *)calloc(1, sizeof(Plugin));
     plugin->hostContext = ctx;
 
-    uint32_t idx;
-    // Init params
-    // 'pf32'
-    idx = get_param_index(plugin, 'pf32');
-    plugin->paramInfo[idx].flags = CPLUG_FLAG_PARAMETER_IS_AUTOMATABLE;
-    plugin->paramInfo[idx].max = 100.0f;
-    plugin->paramInfo[idx].defaultValue = 50.0f;
-
-    // 'pi32'
-    idx = get_param_index(plugin, 'pi32');
-    plugin->paramValuesAudio[idx] = 2.0f;
-    plugin->paramInfo[idx].flags =
-        CPLUG_FLAG_PARAMETER_IS_AUTOMATABLE | CPLUG_FLAG_PARAMETER_IS_INTEGER;
-    plugin->paramInfo[idx].min = 2.0f;
-    plugin->paramInfo[idx].max = 5.0f;
-    plugin->paramInfo[idx].defaultValue = 2.0f;
-
-    // 'bool'
-    idx = get_param_index(plugin, 'bool');
-    plugin->paramValuesAudio[idx] = 0.0f;
-    plugin->paramInfo[idx].flags = CPLUG_FLAG_PARAMETER_IS_BOOL;
-    plugin->paramInfo[idx].max = 1.0f;
-
-    // 'utf8'
-    idx = get_param_index(plugin, 'utf8');
-    plugin->paramValuesAudio[idx] = 0.0f;
-    plugin->paramInfo[idx].flags = CPLUG_FLAG_PARAMETER_IS_AUTOMATABLE;
-    plugin->paramInfo[idx].min = 0.0f;
-    plugin->paramInfo[idx].max = 1.0f;
-    plugin->paramInfo[idx].defaultValue = 0.0f;
-
-    plugin->midiNote = -1;
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        plugin->paramValuesAudio[i] = PARAM_INFO[i].defaultValue;
+        plugin->paramValuesMain[i] = PARAM_INFO[i].defaultValue;
+    }
+
+    smoother_bank_init(&plugin->smoothers, plugin->paramValuesAudio);
+    spsc_ring_init(&plugin->mainToAudio, plugin->mainToAudioStorage,
+                   sizeof(CplugEvent), ARRLEN(plugin->mainToAudioStorage));
+    spsc_ring_init(&plugin->retiredSnapshots, plugin->retiredSnapshotsStorage,
+                   sizeof(ParamSnapshot *),
+                   ARRLEN(plugin->retiredSnapshotsStorage));
+    voice_pool_init(&plugin->voices,
+                    (uint32_t)PARAM_INFO[PARAM_VOICES].defaultValue);
+    plugin->voices.numBuses = PLUGIN_NUM_OUTPUT_BUSES;
+    midi_decoder_init(&plugin->midi);
+    mod_matrix_init(&plugin->mod, PLUGIN_MOD_CONTROL_FRAMES);
+    arp_init(&plugin->arp);
+    timer_wheel_init(&plugin->midiOut, 0);
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++) {
+        oversampler_init(&plugin->oversamplers[b]);
+        oversampler_set_stages(
+            &plugin->oversamplers[b],
+            (uint32_t)PARAM_INFO[PARAM_OVERSAMPLING].defaultValue);
+    }
+
+    plugin->currentPreset = PRESET_NONE;
+    scope_ring_init(&plugin->scope);
+#if PLUGIN_WANT_LOAD_METER
+    load_meter_init(&plugin->loadMeter, g_loadMeterTicksPerSecond);
+#endif
 
     plugin->width = GUI_DEFAULT_WIDTH;
     plugin->height = GUI_DEFAULT_HEIGHT;
 
     return plugin;
 }
+
+static void free_retired_snapshots(Plugin *plugin) {
+    ParamSnapshot *snapshot;
+    while (spsc_ring_pop(&plugin->retiredSnapshots, &snapshot, 1))
+        free(snapshot);
+}
+
+// Frees the banks the audio thread can no longer be reading, or all of them
+static void free_retired_banks(Plugin *plugin, bool all) {
+    const uint32_t processCount =
+        atomic_load_acquire_u32(&plugin->processCount);
+    PresetBank **link = &plugin->retiredBanks;
+    while (*link) {
+        PresetBank *bank = *link;
+        if (all ||
+            (int32_t)(processCount - bank->freeAfterProcessCount) >= 0) {
+            *link = bank->nextRetired;
+            preset_bank_close(bank);
+        } else {
+            link = &bank->nextRetired;
+        }
+    }
+}
+
 void cplug_destroyPlugin(void *ptr) {
     // Free any allocated resources in your plugin here
+    Plugin *plugin = (Plugin *)ptr;
+    free_retired_snapshots(plugin);
+    free(plugin->pendingSnapshot);
+    free_retired_banks(plugin, true);
+    if (plugin->presetBank)
+        preset_bank_close(plugin->presetBank);
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+        oversampler_free(&plugin->oversamplers[b]);
+    if (plugin->voices.wavetables)
+        wavetable_cache_release(&g_wavetableCache, plugin->voices.wavetables);
+    if (plugin->workers)
+        worker_pool_destroy(plugin->workers);
+    if (plugin->voiceGroups) {
+        voice_groups_free(plugin->voiceGroups);
+        free(plugin->voiceGroups);
+    }
     free(ptr);
 }
 
@@ -106,7 +249,9 @@ void cplug_destroyPlugin(void *ptr) {
  * Busses */
 
 uint32_t cplug_getNumInputBusses(void *ptr) { return 1; }
-uint32_t cplug_getNumOutputBusses(void *ptr) { return 1; }
+uint32_t cplug_getNumOutputBusses(void *ptr) {
+    return PLUGIN_NUM_OUTPUT_BUSES;
+}
 uint32_t cplug_getInputBusChannelCount(void *ptr, uint32_t idx) { return 2; }
 uint32_t cplug_getOutputBusChannelCount(void *ptr, uint32_t idx) { return 2; }
 
@@ -115,83 +260,73 @@ void cplug_getInputBusName(void *ptr, uint32_t idx, char *buf, size_t buflen) {
 }
 
 void cplug_getOutputBusName(void *ptr, uint32_t idx, char *buf, size_t buflen) {
-    snprintf(buf, buflen, "Stereo Output");
+    if (idx == 0)
+        snprintf(buf, buflen, "Stereo Output");
+    else
+        snprintf(buf, buflen, "Output %u", idx + 1);
 }
 
 /* --------------------------------------------------------------------------------------------------------
  * Parameters */
 
-uint32_t cplug_getNumParameters(void *ptr) { return ARRLEN(PARAM_IDS); }
+uint32_t cplug_getNumParameters(void *ptr) { return NUM_PARAMS; }
 uint32_t cplug_getParameterID(void *ptr, uint32_t paramIndex) {
     return PARAM_IDS[paramIndex];
 }
 
 void cplug_getParameterName(void *ptr, uint32_t paramId, char *buf,
                             size_t buflen) {
-    static const char *param_names[] = {"Parameter Float", "Parameter Int",
-                                        "Parameter Bool",
-                                        // https://utf8everywhere.org/
-                                        // UTF8    = 1 byte per character
-                                        // Приве́т  = 2 bytes
-                                        // नमस्ते     = 3 bytes
-                                        // שלום = 3 בייטים
-                                        // 🐨       = 4 bytes
-                                        "UTF8 Приве́т नमस्ते שָׁלוֹם 🐨"};
-    static_assert(ARRLEN(param_names) == ARRLEN(PARAM_IDS), "Invalid length");
-
     uint32_t index = get_param_index(ptr, paramId);
-    snprintf(buf, buflen, "%s", param_names[index]);
+    snprintf(buf, buflen, "%s", PARAM_INFO[index].name);
+}
+
+// Parameter values as the host sees them. A state just loaded is current,
+// processed or not
+static const float *host_param_values(const Plugin *plugin) {
+    const bool loading =
+        atomic_load_acquire_ptr(
+            (void *const volatile *)&plugin->pendingSnapshot) != NULL;
+    return loading ? plugin->paramValuesLoaded : plugin->paramValuesAudio;
 }
 
 double cplug_getParameterValue(void *ptr, uint32_t paramId) {
     const Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
 
-    double val = plugin->paramValuesAudio[index];
-    if (plugin->paramInfo[index].flags & CPLUG_FLAG_PARAMETER_IS_INTEGER)
+    double val = host_param_values(plugin)[index];
+    if (PARAM_INFO[index].flags & CPLUG_FLAG_PARAMETER_IS_INTEGER)
         val = round(val);
     return val;
 }
 
 double cplug_getDefaultParameterValue(void *ptr, uint32_t paramId) {
-    Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
-    return plugin->paramInfo[index].defaultValue;
+    return PARAM_INFO[index].defaultValue;
 }
 
 void cplug_setParameterValue(void *ptr, uint32_t paramId, double value) {
     Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
+    if (index >= NUM_PARAMS)
+        return;
 
-    ParamInfo *info = &plugin->paramInfo[index];
+    const ParamInfo *info = &PARAM_INFO[index];
     if (value < info->min)
         value = info->min;
     if (value > info->max)
         value = info->max;
     plugin->paramValuesAudio[index] = (float)value;
 
-    // Send incoming param update to GUI
-    if (plugin->gui) {
-        int queueWritePos = cplug_atomic_load_i32(&plugin->audioToMainHead) &
-                            CPLUG_EVENT_QUEUE_MASK;
-
-        plugin->audioToMainQueue[queueWritePos].parameter.type =
-            CPLUG_EVENT_PARAM_CHANGE_UPDATE;
-        plugin->audioToMainQueue[queueWritePos].parameter.id = paramId;
-        plugin->audioToMainQueue[queueWritePos].parameter.value = value;
-
-        cplug_atomic_fetch_add_i32(&plugin->audioToMainHead, 1);
-        cplug_atomic_fetch_and_i32(&plugin->audioToMainHead,
-                                   CPLUG_EVENT_QUEUE_MASK);
-    }
+    // Send incoming param update to GUI. Also done while the GUI is closed,
+    // so it opens with the latest values
+    param_notify_set(&plugin->audioToMain, index, (float)value);
 }
 
 double cplug_denormaliseParameterValue(void *ptr, uint32_t paramId,
                                        double normalised) {
-    const Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
 
-    const ParamInfo *info = &plugin->paramInfo[index];
+    const ParamInfo *info = &PARAM_INFO[index];
 
     double denormalised = normalised * (info->max - info->min) + info->min;
 
@@ -204,10 +339,9 @@ double cplug_denormaliseParameterValue(void *ptr, uint32_t paramId,
 
 double cplug_normaliseParameterValue(void *ptr, uint32_t paramId,
                                      double denormalised) {
-    const Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
 
-    const ParamInfo *info = &plugin->paramInfo[index];
+    const ParamInfo *info = &PARAM_INFO[index];
 
     // If this fails, your param range is likely not initialised, causing a
     // division by zero and producing infinity
@@ -224,10 +358,9 @@ double cplug_normaliseParameterValue(void *ptr, uint32_t paramId,
 double cplug_parameterStringToValue(void *ptr, uint32_t paramId,
                                     const char *str) {
     double value;
-    const Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
 
-    const unsigned flags = plugin->paramInfo[index].flags;
+    const unsigned flags = PARAM_INFO[index].flags;
 
     if (flags & CPLUG_FLAG_PARAMETER_IS_INTEGER)
         value = (double)atoi(str);
@@ -239,18 +372,95 @@ double cplug_parameterStringToValue(void *ptr, uint32_t paramId,
 
 void cplug_parameterValueToString(void *ptr, uint32_t paramId, char *buf,
                                   size_t bufsize, double value) {
-    const Plugin *plugin = (Plugin *)ptr;
-
     uint32_t index = get_param_index(ptr, paramId);
 
-    const uint32_t flags = plugin->paramInfo[index].flags;
+    const uint32_t flags = PARAM_INFO[index].flags;
 
     if (flags & CPLUG_FLAG_PARAMETER_IS_BOOL)
         value = value >= 0.5 ? 1 : 0;
 
     if (paramId == 'utf8')
         snprintf(buf, bufsize, "%.2f Приве́т नमस्ते שָׁלוֹם 🐨", value);
-    else if (flags &
+    else if (paramId == 'gain' || paramId == 'drve' || paramId == 'levl')
+        snprintf(buf, bufsize, "%.1f dB", value);
+    else if (paramId == 'ptch')
+        snprintf(buf, bufsize, "%.2f semitones", value);
+    else if (paramId == 'lfo1' || paramId == 'lfo2')
+        snprintf(buf, bufsize, "%.2f Hz", value);
+    else if (paramId == 'attk' || paramId == 'decy' || paramId == 'rels')
+        snprintf(buf, bufsize, "%.1f ms", value);
+    else if (paramId == 'sust')
+        snprintf(buf, bufsize, "%.0f%%", value);
+    else if (index >= PARAM_MOD1_SOURCE &&
+             index < PARAM_MOD1_SOURCE + MOD_NUM_SLOTS * 3 &&
+             (index - PARAM_MOD1_SOURCE) % 3 != 2) {
+        static const char *source_names[] = {
+            "None",    "LFO 1",     "LFO 2",    "Macro 1", "Macro 2", "Macro 3",
+            "Macro 4", "Mod Wheel", "Velocity", "Key",     "Pressure"};
+        static_assert(ARRLEN(source_names) == MOD_SOURCE_COUNT,
+                      "Invalid length");
+        const bool isSource = (index - PARAM_MOD1_SOURCE) % 3 == 0;
+        const int count = isSource ? MOD_SOURCE_COUNT : MOD_DEST_COUNT;
+        int choice = (int)round(value);
+        if (choice < 0)
+            choice = 0;
+        if (choice >= count)
+            choice = count - 1;
+        snprintf(buf, bufsize, "%s",
+                 isSource ? source_names[choice]
+                          : PARAM_INFO[MOD_DEST_PARAMS[choice]].name);
+    } else if (paramId == 'ovsm') {
+        int stages = (int)round(value);
+        if (stages == 0)
+            snprintf(buf, bufsize, "Off");
+        else
+            snprintf(buf, bufsize, "%dx", 1 << stages);
+    } else if (paramId == 'grid') {
+        const uint32_t grid = event_grid_frames((float)round(value));
+        if (grid == 0)
+            snprintf(buf, bufsize, "Sample accurate");
+        else
+            snprintf(buf, bufsize, "%u samples", grid);
+    } else if (paramId == 'rmod') {
+        static const char *mode_names[] = {"Auto", "Realtime", "Offline"};
+        static_assert(ARRLEN(mode_names) == RENDER_MODE_COUNT,
+                      "Invalid length");
+        int mode = (int)round(value);
+        if (mode < 0)
+            mode = 0;
+        if (mode >= RENDER_MODE_COUNT)
+            mode = RENDER_MODE_COUNT - 1;
+        snprintf(buf, bufsize, "%s", mode_names[mode]);
+    } else if (paramId == 'arpg') {
+        static const char *rate_names[] = {"Off", "1/4", "1/8", "1/16",
+                                           "1/32"};
+        int rate = (int)round(value);
+        if (rate < 0)
+            rate = 0;
+        if (rate >= (int)ARRLEN(rate_names))
+            rate = (int)ARRLEN(rate_names) - 1;
+        snprintf(buf, bufsize, "%s", rate_names[rate]);
+    } else if (paramId == 'wave') {
+        static const char *wave_names[] = {"Sine", "Saw", "Square",
+                                           "Triangle"};
+        static_assert(ARRLEN(wave_names) == WAVE_COUNT, "Invalid length");
+        int waveform = (int)round(value);
+        if (waveform < 0)
+            waveform = 0;
+        if (waveform >= WAVE_COUNT)
+            waveform = WAVE_COUNT - 1;
+        snprintf(buf, bufsize, "%s", wave_names[waveform]);
+    } else if (paramId == 'stel') {
+        static const char *steal_names[] = {"Oldest", "Quietest", "Same note"};
+        static_assert(ARRLEN(steal_names) == VOICE_STEAL_COUNT,
+                      "Invalid length");
+        int mode = (int)round(value);
+        if (mode < 0)
+            mode = 0;
+        if (mode >= VOICE_STEAL_COUNT)
+            mode = VOICE_STEAL_COUNT - 1;
+        snprintf(buf, bufsize, "%s", steal_names[mode]);
+    } else if (flags &
              (CPLUG_FLAG_PARAMETER_IS_INTEGER | CPLUG_FLAG_PARAMETER_IS_BOOL))
         snprintf(buf, bufsize, "%d", (int)value);
     else
@@ -259,195 +469,689 @@ void cplug_parameterValueToString(void *ptr, uint32_t paramId, char *buf,
 
 void cplug_getParameterRange(void *ptr, uint32_t paramId, double *min,
                              double *max) {
-    const Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
 
-    *min = plugin->paramInfo[index].min;
-    *max = plugin->paramInfo[index].max;
+    *min = PARAM_INFO[index].min;
+    *max = PARAM_INFO[index].max;
 }
 
 uint32_t cplug_getParameterFlags(void *ptr, uint32_t paramId) {
-    const Plugin *plugin = (Plugin *)ptr;
     uint32_t index = get_param_index(ptr, paramId);
-    return plugin->paramInfo[index].flags;
+    return PARAM_INFO[index].flags;
 }
 
 /* --------------------------------------------------------------------------------------------------------
  * Audio/MIDI Processing */
 
-uint32_t cplug_getLatencyInSamples(void *ptr) { return 0; }
-uint32_t cplug_getTailInSamples(void *ptr) { return 0; }
+uint32_t cplug_getLatencyInSamples(void *ptr) {
+    const Plugin *plugin = (Plugin *)ptr;
+    return oversampler_latency(plugin->oversamplers[0].numStages);
+}
+
+// Whether the plugin, activated with 'params', starts its worker threads. Only
+// once it is: with the default of 1 thread and the Auto render mode, most
+// instances never need them
+static bool wants_workers(const float *params) {
+    return (uint32_t)params[PARAM_THREADS] > 1 ||
+           (uint32_t)params[PARAM_RENDER_MODE] == RENDER_MODE_OFFLINE;
+}
+
+// Publishes Plugin::tailFrames for a release of 'releaseMs'
+static void publish_tail(Plugin *plugin, float releaseMs) {
+    const uint32_t release =
+        (uint32_t)(releaseMs * 0.001f * plugin->sampleRate);
+    atomic_store_relaxed_u32(
+        &plugin->tailFrames,
+        release + oversampler_tail(plugin->oversamplers[0].numStages));
+}
+
+uint32_t cplug_getTailInSamples(void *ptr) {
+    const Plugin *plugin = (Plugin *)ptr;
+    return atomic_load_relaxed_u32(&plugin->tailFrames);
+}
 
 void cplug_setSampleRateAndBlockSize(void *ptr, double sampleRate,
                                      uint32_t maxBlockSize) {
     Plugin *plugin = (Plugin *)ptr;
     plugin->sampleRate = (float)sampleRate;
     plugin->maxBufferSize = maxBlockSize;
+    smoother_bank_set_sample_rate(&plugin->smoothers, (float)sampleRate);
+    voice_pool_set_sample_rate(&plugin->voices, (float)sampleRate);
+    // Acquired before the old set is released, so a host repeating the same
+    // rate never rebuilds it
+    const WavetableSet *wavetables =
+        wavetable_cache_acquire(&g_wavetableCache, (float)sampleRate);
+    if (plugin->voices.wavetables)
+        wavetable_cache_release(&g_wavetableCache, plugin->voices.wavetables);
+    plugin->voices.wavetables = wavetables;
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+        oversampler_prepare(&plugin->oversamplers[b], maxBlockSize);
+    // Only here, so the latency changes when the host expects it to
+    const uint32_t numStages = oversampling_stages(host_param_values(plugin));
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+        oversampler_set_stages(&plugin->oversamplers[b], numStages);
+    publish_tail(plugin, host_param_values(plugin)[PARAM_RELEASE]);
+    render_mode_detector_reset(&plugin->renderMode);
+    if (plugin->workers == NULL && wants_workers(host_param_values(plugin))) {
+        const uint32_t numCpus = worker_pool_num_cpus();
+        if (numCpus > 1)
+            plugin->workers = worker_pool_create(
+                numCpus - 1 < PLUGIN_MAX_WORKERS ? numCpus - 1
+                                                 : PLUGIN_MAX_WORKERS);
+        if (plugin->workers)
+            plugin->voiceGroups =
+                (VoiceGroups *)calloc(1, sizeof(VoiceGroups));
+    }
+    if (plugin->voiceGroups)
+        voice_groups_prepare(plugin->voiceGroups, PLUGIN_NUM_OUTPUT_BUSES,
+                             maxBlockSize);
+#if PLUGIN_WANT_LOAD_METER
+    load_meter_set_sample_rate(&plugin->loadMeter, (float)sampleRate);
+#endif
 }
 
-void cplug_process(void *ptr, CplugProcessContext *ctx) {
-    DISABLE_DENORMALS
+// Runs the drive stage on 'out' at the oversampled rate
+static void drive(Oversampler *os, float *out, uint32_t numFrames,
+                  float startDB, float endDB) {
+    float startGain = powf(10.0f, startDB / 20.0f);
+    const float endGain = powf(10.0f, endDB / 20.0f);
 
-    Plugin *plugin = (Plugin *)ptr;
+    // Not prepared yet. Nothing to oversample with
+    if (os->work == NULL) {
+        saturator_process(out, numFrames, startGain, endGain);
+        return;
+    }
 
-    // Audio thread has chance to respond to incoming GUI events before being
-    // sent to the host
-    int head = cplug_atomic_load_i32(&plugin->mainToAudioHead) &
-               CPLUG_EVENT_QUEUE_MASK;
-    int tail = cplug_atomic_load_i32(&plugin->mainToAudioTail);
+    const float step = (endGain - startGain) / (float)numFrames;
+    while (numFrames > 0) {
+        uint32_t n = numFrames < os->maxFrames ? numFrames : os->maxFrames;
+        float *top = oversampler_up(os, out, n);
+        saturator_process(top, n << os->numStages, startGain,
+                          startGain + step * (float)n);
+        oversampler_down(os, out, n);
+        startGain += step * (float)n;
+        out += n;
+        numFrames -= n;
+    }
+}
 
-    while (tail != head) {
-        CplugEvent *event = &plugin->mainToAudioQueue[tail];
+// Writes 'left' times a gain ramping from 'startGain' to 'endGain' to both
+// channels of a bus, in one pass
+static void store_stereo(float *left, float *right, uint32_t numFrames,
+                         float startGain, float endGain) {
+    if (startGain == 1.0f && endGain == 1.0f) {
+        memcpy(right, left, sizeof(float) * numFrames);
+        return;
+    }
+    const float step = (endGain - startGain) / (float)numFrames;
+    uint32_t i = 0;
+#if OSC_X86
+    const __m128 vstep = _mm_set1_ps(step * 4);
+    __m128 gain = _mm_add_ps(_mm_set1_ps(startGain),
+                             _mm_mul_ps(_mm_set1_ps(step),
+                                        _mm_setr_ps(0, 1, 2, 3)));
+    for (; i + 4 <= numFrames; i += 4) {
+        const __m128 x = _mm_mul_ps(_mm_loadu_ps(left + i), gain);
+        _mm_storeu_ps(left + i, x);
+        _mm_storeu_ps(right + i, x);
+        gain = _mm_add_ps(gain, vstep);
+    }
+#endif
+    for (; i < numFrames; i++) {
+        left[i] *= startGain + step * (float)i;
+        right[i] = left[i];
+    }
+}
 
-        if (event->type == CPLUG_EVENT_PARAM_CHANGE_UPDATE) {
-            uint32_t idx = get_param_index(ptr, event->parameter.id);
-            plugin->paramValuesAudio[idx] = (float)event->parameter.value;
-        }
+// Adds the voices into 'outs', helped by the workers when PARAM_THREADS asks
+// for them, or rendering offline, and there are enough voices and frames to be
+// worth handing out. Only once the workers have been started, see
+// wants_workers()
+static void render_voices(Plugin *plugin, float *const *outs,
+                          uint32_t numFrames) {
+    VoicePool *voices = &plugin->voices;
+    const uint32_t numThreads =
+        plugin->offline ? WORKER_POOL_MAX_THREADS
+                        : (uint32_t)plugin->paramValuesAudio[PARAM_THREADS];
+    if (numThreads > 1 && plugin->voiceGroups != NULL &&
+        voices->numActive * numFrames >= PLUGIN_PARALLEL_MIN_WORK &&
+        voice_groups_render(plugin->voiceGroups, plugin->workers, numThreads,
+                            voices, outs, numFrames))
+        return;
+    voice_pool_render_buses(voices, outs, numFrames);
+}
 
-        ctx->enqueueEvent(ctx, event, 0);
+// Moves 'value' of 'param' by 'offset' units of its range, staying in it
+static float modulate_param(uint32_t param, float value, float offset) {
+    const ParamInfo *info = &PARAM_INFO[param];
+    value += offset * (info->max - info->min);
+    value = value < info->min ? info->min : value;
+    return value > info->max ? info->max : value;
+}
 
-        tail++;
-        tail &= CPLUG_EVENT_QUEUE_MASK;
+// Renders the voices into the output buses through their drive stage and the
+// output gain. 'left' and 'right' hold the channels of every bus, NULL when
+// the host didn't connect it: its voices play through the main bus then, and
+// nothing else is done for it. While a parameter the DSP reads is ramping,
+// the range is split into CONTROL_RATE_FRAMES chunks and the smoothers are
+// stepped once per chunk. While the modulation matrix has routings, chunks
+// also end with its control steps, and a step is evaluated at every start
+static void render(Plugin *plugin, float *const *left, float *const *right,
+                   uint32_t numFrames) {
+    SmootherBank *smoothers = &plugin->smoothers;
+    ModMatrix *mod = &plugin->mod;
+    const float *params = plugin->paramValuesAudio;
+    const bool modulating = mod_matrix_active(mod);
+    // Notes started since the last call get their modulation before they play
+    if (plugin->voices.noteCounter != mod->noteCounter)
+        mod_matrix_start_voices(mod, &plugin->voices, params);
+    uint32_t *tails = plugin->oversamplerTails;
+    const uint32_t tail = oversampler_tail(plugin->oversamplers[0].numStages);
+
+    // Where the voices of every bus go, and how many each buffer gets
+    float *outs[PLUGIN_NUM_OUTPUT_BUSES];
+    float *rights[PLUGIN_NUM_OUTPUT_BUSES];
+    uint32_t numActive[PLUGIN_NUM_OUTPUT_BUSES];
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++) {
+        outs[b] = left[b] ? left[b] : left[0];
+        rights[b] = right[b];
+        numActive[b] = 0;
     }
-    cplug_atomic_exchange_i32(&plugin->mainToAudioTail, tail);
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+        numActive[left[b] ? b : 0] += plugin->voices.numOnBus[b];
+
+    while (numFrames > 0) {
+        uint32_t chunk = numFrames;
+        if ((smoother_bank_is_ramping(smoothers, PARAM_GAIN) ||
+             smoother_bank_is_ramping(smoothers, PARAM_DRIVE)) &&
+            chunk > CONTROL_RATE_FRAMES)
+            chunk = CONTROL_RATE_FRAMES;
+        if (modulating) {
+            if (mod->countdown == 0) {
+                const float modWheel =
+                    (float)midi_cc14(&plugin->midi.channels[0],
+                                     MIDI_CC_MODULATION) *
+                    (1.0f / 16383.0f);
+                mod_matrix_step(mod, &plugin->voices, params,
+                                &smoothers->value[PARAM_LFO1_RATE], modWheel,
+                                plugin->sampleRate);
+            }
+            if (chunk > mod->countdown)
+                chunk = mod->countdown;
+        }
 
-    // "Sample accurate" process loop
-    CplugEvent event;
-    uint32_t frame = 0;
-    while (ctx->dequeueEvent(ctx, &event, frame)) {
-        switch (event.type) {
-        case CPLUG_EVENT_UNHANDLED_EVENT:
-            break;
-        case CPLUG_EVENT_PARAM_CHANGE_UPDATE: {
-            cplug_setParameterValue(plugin, event.parameter.id,
-                                    event.parameter.value);
-            break;
+        float startDB = smoothers->value[PARAM_GAIN];
+        float startDriveDB = smoothers->value[PARAM_DRIVE];
+        smoother_bank_advance(smoothers, chunk);
+        float endDB = smoothers->value[PARAM_GAIN];
+        float endDriveDB = smoothers->value[PARAM_DRIVE];
+        if (modulating) {
+            // Linear from the start of the chunk to its end, like the ramps
+            startDB = modulate_param(PARAM_GAIN, startDB,
+                                     mod_matrix_offset(mod, PARAM_GAIN, 0));
+            endDB = modulate_param(PARAM_GAIN, endDB,
+                                   mod_matrix_offset(mod, PARAM_GAIN, chunk));
+            startDriveDB =
+                modulate_param(PARAM_DRIVE, startDriveDB,
+                               mod_matrix_offset(mod, PARAM_DRIVE, 0));
+            endDriveDB =
+                modulate_param(PARAM_DRIVE, endDriveDB,
+                               mod_matrix_offset(mod, PARAM_DRIVE, chunk));
+            mod->countdown -= chunk;
         }
-        case CPLUG_EVENT_MIDI: {
-            static const uint8_t MIDI_NOTE_OFF = 0x80;
-            static const uint8_t MIDI_NOTE_ON = 0x90;
-            static const uint8_t MIDI_NOTE_PITCH_WHEEL = 0xe0;
-
-            if ((event.midi.status & 0xf0) == MIDI_NOTE_ON) {
-                plugin->midiNote = event.midi.data1;
-                plugin->velocity = (float)event.midi.data2 / 127.0f;
-            }
-            if ((event.midi.status & 0xf0) == MIDI_NOTE_OFF) {
-                int note = event.midi.data1;
-                if (note == plugin->midiNote)
-                    plugin->midiNote = -1;
-                plugin->velocity = (float)event.midi.data2 / 127.0f;
-            }
-            if ((event.midi.status & 0xf0) == MIDI_NOTE_PITCH_WHEEL) {
-                // int pb = (int)event.midi.data1 | ((int)event.midi.data2 <<
-                // 7);
+
+        // Buses are cleared before any voice is added, as several may share
+        // the main one
+        for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++) {
+            if (left[b] == NULL)
+                continue;
+            if (numActive[b] > 0)
+                tails[b] = tail;
+            if (tails[b] > 0)
+                memset(outs[b], 0, sizeof(float) * chunk);
+        }
+        if (plugin->voices.numActive > 0)
+            render_voices(plugin, outs, chunk);
+
+        // Interpolating the amplitude within the chunk keeps gain changes
+        // free of zipper noise
+        const float startGain = powf(10.0f, startDB / 20.0f);
+        const float endGain = powf(10.0f, endDB / 20.0f);
+        for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++) {
+            if (left[b] == NULL)
+                continue;
+            if (tails[b] == 0) {
+                // Silence
+                memset(outs[b], 0, sizeof(float) * chunk);
+                memset(rights[b], 0, sizeof(float) * chunk);
+            } else {
+                // Lets the oversampling filters ring out after the last voice
+                if (numActive[b] == 0)
+                    tails[b] -= chunk < tails[b] ? chunk : tails[b];
+                drive(&plugin->oversamplers[b], outs[b], chunk, startDriveDB,
+                      endDriveDB);
+                store_stereo(outs[b], rights[b], chunk, startGain, endGain);
             }
+            outs[b] += chunk;
+            rights[b] += chunk;
+        }
+        // Disconnected buses follow the main one
+        for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++)
+            if (left[b] == NULL)
+                outs[b] = outs[0];
+
+        numFrames -= chunk;
+    }
+}
+
+// Replaces every parameter at 'frame'. Changed values ramp from their current
+// value and are reported to the host and the GUI
+static void apply_snapshot(Plugin *plugin, CplugProcessContext *ctx,
+                           const ParamSnapshot *snapshot, uint32_t frame) {
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        if (plugin->paramValuesAudio[i] == snapshot->values[i])
+            continue;
+        plugin->paramValuesAudio[i] = snapshot->values[i];
+        smoother_bank_set_target(&plugin->smoothers, i, snapshot->values[i]);
+        param_notify_set(&plugin->audioToMain, i, snapshot->values[i]);
+
+        CplugEvent event;
+        event.parameter.type = CPLUG_EVENT_PARAM_CHANGE_UPDATE;
+        event.parameter.id = PARAM_IDS[i];
+        event.parameter.value = snapshot->values[i];
+        ctx->enqueueEvent(ctx, &event, frame);
+    }
+}
+
+// Hands the keys of a MIDI event due at 'frame' to the arpeggiator. Returns
+// true when nothing is left for the decoder: note offs and "all notes off" go
+// to both, so keys held since before the arpeggiator was switched on still
+// come up
+static bool arp_take(Plugin *plugin, const CplugEvent *event, uint32_t frame) {
+    const uint32_t channel = event->midi.status & 0x0f;
+    const uint32_t note = event->midi.data1 & 0x7f;
+    const uint32_t velocity = event->midi.data2 & 0x7f;
+    switch (event->midi.status & 0xf0) {
+    case MIDI_NOTE_ON:
+        if (velocity != 0) {
+            arp_note_on(&plugin->arp, channel, note, velocity,
+                        plugin->sampleTime + frame);
+            return true;
+        }
+        // fallthrough
+    case MIDI_NOTE_OFF:
+        arp_note_off(&plugin->arp, channel, note);
+        return false;
+    case MIDI_CONTROL_CHANGE:
+        if (note == MIDI_CC_ALL_SOUND_OFF || note == MIDI_CC_ALL_NOTES_OFF)
+            arp_clear(&plugin->arp);
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Handles an event the host scheduled for 'frame', other than audio
+static void process_event(Plugin *plugin, CplugProcessContext *ctx,
+                          const CplugEvent *event, const PresetBank *bank,
+                          uint32_t frame) {
+    switch (event->type) {
+    case CPLUG_EVENT_UNHANDLED_EVENT:
+        break;
+    case CPLUG_EVENT_PARAM_CHANGE_UPDATE: {
+        uint32_t idx = get_param_index(plugin, event->parameter.id);
+        if (idx >= NUM_PARAMS)
             break;
+        cplug_setParameterValue(plugin, event->parameter.id,
+                                event->parameter.value);
+        // Ramps start at the frame the host scheduled the change for
+        smoother_bank_set_target(&plugin->smoothers, idx,
+                                 plugin->paramValuesAudio[idx]);
+        break;
+    }
+    case CPLUG_EVENT_MIDI: {
+        if (plugin->arp.stepFrames > 0 && arp_take(plugin, event, frame))
+            break;
+        midi_decode(&plugin->midi, &plugin->voices, event->midi.status,
+                    event->midi.data1, event->midi.data2);
+        if ((event->midi.status & 0xf0) == MIDI_PROGRAM_CHANGE && bank &&
+            event->midi.data1 < bank->numPresets) {
+            apply_snapshot(plugin, ctx, &bank->snapshots[event->midi.data1],
+                           frame);
+            atomic_store_relaxed_u32(&plugin->currentPreset,
+                                     event->midi.data1);
         }
-        case CPLUG_EVENT_PROCESS_AUDIO: {
-            // If your plugin does not require sample accurate processing, use
-            // this line below to break the loop frame =
-            // event.processAudio.endFrame;
+        break;
+    }
+    default:
+        break;
+    }
+}
 
-            float **output = ctx->getAudioOutput(ctx, 0);
-            CPLUG_LOG_ASSERT(output != NULL)
-            CPLUG_LOG_ASSERT(output[0] != NULL);
-            CPLUG_LOG_ASSERT(output[1] != NULL);
+// Renders frames 'frame' to 'endFrame' of every output bus, see render().
+// 'busOutputs' holds the channels of every bus, NULL when disconnected
+static void process_audio(Plugin *plugin, float **const *busOutputs,
+                          uint32_t frame, uint32_t endFrame) {
+    CPLUG_LOG_ASSERT(busOutputs[0] != NULL);
+
+    float *left[PLUGIN_NUM_OUTPUT_BUSES];
+    float *right[PLUGIN_NUM_OUTPUT_BUSES];
+    for (int b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++) {
+        left[b] = busOutputs[b] ? &busOutputs[b][0][frame] : NULL;
+        right[b] = busOutputs[b] ? &busOutputs[b][1][frame] : NULL;
+    }
+    render(plugin, left, right, endFrame - frame);
+    // The scope shows the main output
+    scope_write(&plugin->scope, left[0], endFrame - frame);
+}
 
-            if (plugin->midiNote == -1) {
-                // Silence
-                memset(&output[0][frame], 0,
-                       sizeof(float) * (event.processAudio.endFrame - frame));
-                memset(&output[1][frame], 0,
-                       sizeof(float) * (event.processAudio.endFrame - frame));
-                frame = event.processAudio.endFrame;
-            } else {
-                float phase = plugin->oscPhase;
+// Pops the next MIDI event the plugin scheduled before 'endFrame' of this
+// block, and the frame it is due at. Arpeggiator steps are scheduled as late as
+// this, so keys taken earlier in the block are in them
+static bool pop_scheduled(Plugin *plugin, uint32_t endFrame, CplugEvent *event,
+                          uint32_t *frame) {
+    const uint64_t end = plugin->sampleTime + endFrame;
+    arp_schedule(&plugin->arp, &plugin->midiOut, end);
+    uint64_t time;
+    if (!timer_wheel_pop(&plugin->midiOut, end, event, &time))
+        return false;
+    *frame = (uint32_t)(time - plugin->sampleTime);
+    return true;
+}
 
-                float Hz = 440.0f * exp2f(((float)plugin->midiNote - 69.0f) *
-                                          0.0833333f);
-                float inc = Hz / plugin->sampleRate;
-                float dB = -60.0f + plugin->velocity * 54; // -6dB max
-                float vol = powf(10.0f, dB / 20.0f);
+// Sends a scheduled MIDI event to the host at 'frame' and plays it
+static void play_scheduled(Plugin *plugin, CplugProcessContext *ctx,
+                           const CplugEvent *event, uint32_t frame) {
+    ctx->enqueueEvent(ctx, event, frame);
+    midi_decode(&plugin->midi, &plugin->voices, event->midi.status,
+                event->midi.data1, event->midi.data2);
+}
 
-                for (; frame < event.processAudio.endFrame; frame++) {
-                    static const float mypi = 3.141592653589793f;
+void cplug_process(void *ptr, CplugProcessContext *ctx) {
+    DISABLE_DENORMALS
 
-                    float sample = vol * sinf(2 * mypi * phase);
+    Plugin *plugin = (Plugin *)ptr;
+    LOAD_METER_BEGIN
+
+    // A loaded state replaces every parameter at once
+    void *volatile *pending = (void *volatile *)&plugin->pendingSnapshot;
+    if (atomic_load_acquire_ptr(pending)) {
+        ParamSnapshot *snapshot =
+            (ParamSnapshot *)atomic_exchange_acq_rel_ptr(pending, NULL);
+        apply_snapshot(plugin, ctx, snapshot, 0);
+        // Can't fail: at most one snapshot is retired per load, and every load
+        // frees the retired ones first
+        spsc_ring_push_one(&plugin->retiredSnapshots, &snapshot);
+    }
 
-                    for (int ch = 0; ch < 2; ch++)
-                        output[ch][frame] = sample;
+    // Bank presets are immutable and owned by the bank, nothing to hand back
+    void *volatile *pendingPreset = (void *volatile *)&plugin->pendingPreset;
+    if (atomic_load_acquire_ptr(pendingPreset))
+        apply_snapshot(
+            plugin, ctx,
+            (const ParamSnapshot *)atomic_exchange_acq_rel_ptr(pendingPreset,
+                                                               NULL),
+            0);
+    // Stays valid until this call returns, see free_retired_banks
+    const PresetBank *bank = (const PresetBank *)atomic_load_acquire_ptr(
+        (void *volatile *)&plugin->presetBank);
 
-                    phase += inc;
-                    phase -= (int)phase;
-                }
+    // Audio thread has chance to respond to incoming GUI events before being
+    // sent to the host
+    CplugEvent guiEvents[32];
+    uint32_t numGuiEvents;
+    while ((numGuiEvents = spsc_ring_pop(&plugin->mainToAudio, guiEvents,
+                                         ARRLEN(guiEvents))) > 0) {
+        for (uint32_t i = 0; i < numGuiEvents; i++) {
+            const CplugEvent *event = &guiEvents[i];
+
+            if (event->type == CPLUG_EVENT_PARAM_CHANGE_UPDATE) {
+                uint32_t idx = get_param_index(ptr, event->parameter.id);
+                if (idx >= NUM_PARAMS)
+                    continue;
+                plugin->paramValuesAudio[idx] = (float)event->parameter.value;
+                smoother_bank_set_target(&plugin->smoothers, idx,
+                                         plugin->paramValuesAudio[idx]);
+            }
+
+            ctx->enqueueEvent(ctx, event, 0);
+        }
+    }
 
-                plugin->oscPhase = phase;
+    // Cheap enough to redo every block: the slots hold a handful of routings
+    const float *params = plugin->paramValuesAudio;
+    ModMatrix *mod = &plugin->mod;
+    mod_matrix_clear(mod);
+    for (uint32_t s = 0; s < MOD_NUM_SLOTS; s++) {
+        const uint32_t slot = PARAM_MOD1_SOURCE + s * 3;
+        mod_matrix_add(mod, (uint32_t)params[slot], (uint32_t)params[slot + 1],
+                       params[slot + 2]);
+    }
+    if (!mod_matrix_active(mod))
+        mod_matrix_idle(mod, &plugin->voices, params);
+
+    // Read once per block, so they follow the modulation as it was at the end
+    // of the last control step
+    plugin->voices.voiceLimit =
+        (uint32_t)mod_matrix_value(mod, PARAM_VOICES, params[PARAM_VOICES]);
+    plugin->voices.stealMode = (uint32_t)params[PARAM_VOICE_STEALING];
+    plugin->voices.waveform = (uint32_t)mod_matrix_value(
+        mod, PARAM_WAVEFORM, params[PARAM_WAVEFORM]);
+    const float releaseMs =
+        mod_matrix_value(mod, PARAM_RELEASE, params[PARAM_RELEASE]);
+    voice_pool_set_envelope(
+        &plugin->voices,
+        mod_matrix_value(mod, PARAM_ATTACK, params[PARAM_ATTACK]),
+        mod_matrix_value(mod, PARAM_DECAY, params[PARAM_DECAY]),
+        mod_matrix_value(mod, PARAM_SUSTAIN, params[PARAM_SUSTAIN]) * 0.01f,
+        releaseMs);
+    publish_tail(plugin, releaseMs);
+    voice_pool_enforce_limit(&plugin->voices);
+
+    // Counted every block, so Auto knows the host's pace as soon as it's chosen
+    const bool bouncing =
+        render_mode_detect(&plugin->renderMode, clock_now_ms() * 1e-3,
+                           ctx->numFrames, plugin->sampleRate);
+    const uint32_t renderMode = (uint32_t)params[PARAM_RENDER_MODE];
+    plugin->offline = renderMode == RENDER_MODE_OFFLINE ||
+                      (renderMode == RENDER_MODE_AUTO && bouncing);
+    plugin->voices.exact = plugin->offline;
+
+    // Steps follow the host's tempo, or 120 BPM without one
+    const double beats = arp_step_beats(
+        mod_matrix_value(mod, PARAM_ARPEGGIATOR, params[PARAM_ARPEGGIATOR]));
+    const double bpm =
+        (ctx->flags & CPLUG_FLAG_TRANSPORT_HAS_BPM) && ctx->bpm > 0 ? ctx->bpm
+                                                                    : 120;
+    if (beats == 0)
+        arp_clear(&plugin->arp);
+    plugin->arp.stepFrames = beats * 60 * plugin->sampleRate / bpm;
+
+    // Buses the host didn't connect are skipped, see render()
+    float **busOutputs[PLUGIN_NUM_OUTPUT_BUSES];
+    for (uint32_t b = 0; b < PLUGIN_NUM_OUTPUT_BUSES; b++) {
+        float **output = ctx->getAudioOutput(ctx, b);
+        busOutputs[b] = output && output[0] && output[1] ? output : NULL;
+    }
+
+    const uint32_t grid =
+        plugin->offline
+            ? 0
+            : event_grid_frames(plugin->paramValuesAudio[PARAM_EVENT_GRID]);
+    CplugEvent event, scheduled;
+    uint32_t frame = 0, scheduledFrame;
+    if (grid == 0) {
+        // "Sample accurate" process loop
+        while (ctx->dequeueEvent(ctx, &event, frame)) {
+            if (event.type != CPLUG_EVENT_PROCESS_AUDIO) {
+                process_event(plugin, ctx, &event, bank, frame);
+                continue;
             }
-            break;
+            // The plugin's own MIDI splits the range further
+            const uint32_t endFrame = event.processAudio.endFrame;
+            while (pop_scheduled(plugin, endFrame, &scheduled,
+                                 &scheduledFrame)) {
+                if (scheduledFrame > frame) {
+                    process_audio(plugin, busOutputs, frame, scheduledFrame);
+                    frame = scheduledFrame;
+                }
+                play_scheduled(plugin, ctx, &scheduled, scheduledFrame);
+            }
+            // If your plugin does not require sample accurate processing, use
+            // the event grid below
+            if (endFrame > frame)
+                process_audio(plugin, busOutputs, frame, endFrame);
+            frame = endFrame;
         }
-        default:
-            break;
+    } else {
+        // Quantised process loop: the events due within a sub-block of 'grid'
+        // frames are handled together at its start, then it is rendered whole.
+        // The host still gets the plugin's MIDI at the exact frames
+        while (frame < ctx->numFrames) {
+            const uint32_t endFrame =
+                frame + grid < ctx->numFrames ? frame + grid : ctx->numFrames;
+            while (ctx->dequeueEvent(ctx, &event, endFrame - 1) &&
+                   event.type != CPLUG_EVENT_PROCESS_AUDIO)
+                process_event(plugin, ctx, &event, bank, frame);
+            while (pop_scheduled(plugin, endFrame, &scheduled,
+                                 &scheduledFrame))
+                play_scheduled(plugin, ctx, &scheduled, scheduledFrame);
+            process_audio(plugin, busOutputs, frame, endFrame);
+            frame = endFrame;
         }
     }
+    plugin->sampleTime += ctx->numFrames;
+
+    // Lets the main thread free banks 'bank' may have pointed to
+    atomic_store_release_u32(&plugin->processCount, plugin->processCount + 1);
+    LOAD_METER_END
     RESTORE_DENORMALS
 }
 
 /* --------------------------------------------------------------------------------------------------------
  * State */
 
-// In these methods we will use a very basic binary preset format: a flat array
-// of param values
-struct ParamState {
-    uint32_t paramId;
-    float value;
-};
+// See state.h for the format
 
 void cplug_saveState(void *userPlugin, const void *stateCtx,
                      cplug_writeProc writeProc) {
     Plugin *plugin = (Plugin *)userPlugin;
 
-    struct ParamState state[NUM_PARAMS];
-    for (int i = 0; i < NUM_PARAMS; i++) {
-        state[i].paramId = PARAM_IDS[i];
-        state[i].value = plugin->paramValuesAudio[i];
+    // With the changes the host made on the audio thread. Only peeked at, so
+    // the editor still redraws for them
+    float values[NUM_PARAMS];
+    memcpy(values, plugin->paramValuesMain, sizeof(values));
+    param_notify_peek(&plugin->audioToMain, values);
+
+    state_write_all(stateCtx, writeProc, PARAM_IDS, values, NUM_PARAMS);
+}
+
+static void load_state_param(void *user, uint32_t paramId, float value) {
+    ParamSnapshot *snapshot = (ParamSnapshot *)user;
+    uint32_t index = get_param_index(NULL, paramId);
+    // Parameters this version doesn't have are ignored
+    if (index < NUM_PARAMS) {
+        if (value < PARAM_INFO[index].min)
+            value = PARAM_INFO[index].min;
+        if (value > PARAM_INFO[index].max)
+            value = PARAM_INFO[index].max;
+        snapshot->values[index] = value;
     }
-    writeProc(stateCtx, state, sizeof(state));
 }
 
 void cplug_loadState(void *userPlugin, const void *stateCtx,
                      cplug_readProc readProc) {
     Plugin *plugin = (Plugin *)userPlugin;
 
-    struct ParamState state[NUM_PARAMS * 2];
+    free_retired_snapshots(plugin);
 
-    // If your plugin has added/removed parameters, requesting for more data
-    // then you actually expect may be a good idea
-    int64_t bytesRead = readProc(stateCtx, state, sizeof(state));
+    ParamSnapshot *snapshot = (ParamSnapshot *)malloc(sizeof(ParamSnapshot));
+    if (snapshot == NULL)
+        return;
+    // Parameters missing from the state keep their current value
+    memcpy(snapshot->values, plugin->paramValuesMain, sizeof(snapshot->values));
+    param_notify_peek(&plugin->audioToMain, snapshot->values);
 
-    for (int i = 0; i < bytesRead / sizeof(state[0]); i++) {
-        uint32_t paramIdx = get_param_index(userPlugin, state[i].paramId);
-        if (paramIdx < NUM_PARAMS) {
-            plugin->paramValuesAudio[paramIdx] = state[i].value;
-            plugin->paramValuesMain[paramIdx] = state[i].value;
-            sendParamEventFromMain(plugin, CPLUG_EVENT_PARAM_CHANGE_UPDATE,
-                                   state[i].paramId, state[i].value);
-        }
+    StateResult result =
+        state_read_all(stateCtx, readProc, load_state_param, snapshot);
+    if (result != STATE_OK && result != STATE_LEGACY_OK) {
+        free(snapshot);
+        return;
     }
+
+    memcpy(plugin->paramValuesMain, snapshot->values, sizeof(snapshot->values));
+    memcpy(plugin->paramValuesLoaded, snapshot->values,
+           sizeof(snapshot->values));
+    // A snapshot still pending was never seen by the audio thread and is
+    // superseded by this one
+    void *volatile *pending = (void *volatile *)&plugin->pendingSnapshot;
+    free(atomic_exchange_acq_rel_ptr(pending, snapshot));
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Presets */
+
+// Replaces the open bank with the one at 'path'. Main thread only
+bool plugin_load_preset_bank(Plugin *plugin, const char *path) {
+    PresetBank *bank = preset_bank_open(path, load_state_param);
+    if (bank == NULL)
+        return false;
+
+    // Only the main thread publishes presets, so once this is cleared nothing
+    // new can point into the old bank
+    atomic_exchange_acq_rel_ptr((void *volatile *)&plugin->pendingPreset,
+                                NULL);
+    PresetBank *old = (PresetBank *)atomic_exchange_acq_rel_ptr(
+        (void *volatile *)&plugin->presetBank, bank);
+    atomic_store_relaxed_u32(&plugin->currentPreset, PRESET_NONE);
+
+    // A process call already running may have loaded 'old' before the swap.
+    // Every call after it loads the new bank
+    if (old) {
+        old->freeAfterProcessCount =
+            atomic_load_acquire_u32(&plugin->processCount) + 1;
+        old->nextRetired = plugin->retiredBanks;
+        plugin->retiredBanks = old;
+    }
+    free_retired_banks(plugin, false);
+    return true;
+}
+
+// Switches every parameter to preset 'index' of the open bank at the start of
+// the next process call. Main thread only
+void plugin_select_preset(Plugin *plugin, uint32_t index) {
+    const PresetBank *bank = plugin->presetBank;
+    if (bank == NULL || index >= bank->numPresets)
+        return;
+
+    const ParamSnapshot *snapshot = &bank->snapshots[index];
+    memcpy(plugin->paramValuesMain, snapshot->values,
+           sizeof(snapshot->values));
+    atomic_store_relaxed_u32(&plugin->currentPreset, index);
+    atomic_exchange_acq_rel_ptr((void *volatile *)&plugin->pendingPreset,
+                                (void *)snapshot);
+}
+
+uint32_t plugin_get_num_presets(Plugin *plugin) {
+    return plugin->presetBank ? plugin->presetBank->numPresets : 0;
+}
+
+const char *plugin_get_preset_name(Plugin *plugin, uint32_t index) {
+    if (index >= plugin_get_num_presets(plugin))
+        return NULL;
+    return preset_bank_name(plugin->presetBank, index);
 }
 
 void sendParamEventFromMain(Plugin *plugin, uint32_t type, uint32_t paramId,
                             double value) {
-    int mainToAudioHead = cplug_atomic_load_i32(&plugin->mainToAudioHead) &
-                          CPLUG_EVENT_QUEUE_MASK;
-    CplugEvent *paramEvent = &plugin->mainToAudioQueue[mainToAudioHead];
-    paramEvent->parameter.type = type;
-    paramEvent->parameter.id = paramId;
-    paramEvent->parameter.value = value;
-
-    cplug_atomic_fetch_add_i32(&plugin->mainToAudioHead, 1);
-    cplug_atomic_fetch_and_i32(&plugin->mainToAudioHead,
-                               CPLUG_EVENT_QUEUE_MASK);
+    CplugEvent event;
+    event.parameter.type = type;
+    event.parameter.id = paramId;
+    event.parameter.value = value;
+    // If the audio thread isn't running the ring can fill up. The change is
+    // already in paramValuesAudio, only the host notification is lost, and
+    // the drop is counted in mainToAudio.numDropped
+    spsc_ring_push_one(&plugin->mainToAudio, &event);
 }
 
 //
@@ -467,8 +1171,15 @@ void pw_get_info(PWGetInfo *info) {
     }
 }
 
+// Something on screen changed. The next few ticks redraw the editor
+static void gui_invalidate(GUI *gui) {
+    gui->framesToDraw = GUI_SETTLE_FRAMES;
+    gui->extraFramesDrawn = 0;
+}
+
 void *pw_create_gui(void *_plugin, void *pw) {
     Plugin *plugin = _plugin;
+    const double start = clock_now_ms();
     GUI *gui = calloc(1, sizeof(*gui));
     // gui->scale = pw_get_dpi(pw);
     gui->scale = 1.0f;
@@ -476,6 +1187,7 @@ void *pw_create_gui(void *_plugin, void *pw) {
     plugin->gui = gui;
     gui->plugin = plugin;
     gui->pw = pw;
+    scope_view_init(&gui->scope, GUI_SCOPE_REFRESH_HZ);
 
     const struct PWEvent ev = {
         .type = PW_EVENT_RESIZE_UPDATE,
@@ -485,6 +1197,8 @@ void *pw_create_gui(void *_plugin, void *pw) {
     imgui_start(gui);
     pw_event(&ev);
 
+    gui_invalidate(gui);
+    gui->openMs = (float)(clock_now_ms() - start);
     return gui;
 }
 
@@ -496,9 +1210,45 @@ void pw_destroy_gui(void *_gui) {
     free(gui);
 }
 
+// Draws only when something changed: input, parameters set by the host,
+// resizes, DPI changes, new audio for the scope, and readouts that update on
+// their own. An idle editor costs a parameter poll per tick. Drawing is capped
+// at GUI_MAX_FPS
 void pw_tick(void *_gui) {
     GUI *gui = (GUI *)_gui;
-    imgui_tick(gui);
+    Plugin *plugin = gui->plugin;
+
+    if (param_notify_collect(&plugin->audioToMain, plugin->paramValuesMain))
+        gui_invalidate(gui);
+    free_retired_banks(plugin, false);
+
+    const double now = clock_now_ms();
+    const double sinceDraw = now - gui->lastDrawMs;
+#if PLUGIN_WANT_LOAD_METER
+    if (gui->framesToDraw == 0 && sinceDraw >= GUI_LIVE_REFRESH_MS)
+        gui->framesToDraw = 1;
+#endif
+    // New audio for the scope, at most at the rate picked in the editor
+    const bool scopeDue = scope_view_due(&gui->scope, &plugin->scope, now);
+    if (scopeDue && gui->framesToDraw == 0)
+        gui->framesToDraw = 1;
+    if (gui->framesToDraw == 0)
+        return;
+    if (sinceDraw < 1000.0 / GUI_MAX_FPS)
+        return;
+    if (scopeDue)
+        scope_view_update(&gui->scope, &plugin->scope, plugin->sampleRate,
+                          now);
+
+    gui->lastDrawMs = now;
+    gui->framesToDraw--;
+    const bool wantsMore = imgui_tick(gui);
+    gui->drawMs = (float)(clock_now_ms() - now);
+    if (wantsMore && gui->framesToDraw == 0 &&
+        gui->extraFramesDrawn < GUI_MAX_EXTRA_FRAMES) {
+        gui->framesToDraw = 1;
+        gui->extraFramesDrawn++;
+    }
 }
 
 bool pw_event(const PWEvent *event) {
@@ -507,6 +1257,7 @@ bool pw_event(const PWEvent *event) {
     case PW_EVENT_RESIZE_UPDATE:
         gui->plugin->width = event->resize.width;
         gui->plugin->height = event->resize.height;
+        gui_invalidate(gui);
         break;
     case PW_EVENT_MOUSE_MOVE:
     case PW_EVENT_MOUSE_LEFT_DOWN:
@@ -514,12 +1265,18 @@ bool pw_event(const PWEvent *event) {
     case PW_EVENT_MOUSE_RIGHT_DOWN:
     case PW_EVENT_MOUSE_RIGHT_UP:
         imgui_handle_event(gui, event);
+        gui_invalidate(gui);
         break;
-    case PW_EVENT_DPI_CHANGED:
+    case PW_EVENT_DPI_CHANGED: {
+        // Rescales in place. Recreating the context stalled the host's UI
+        // thread whenever the window crossed to another monitor
+        const double start = clock_now_ms();
         gui->scale = event->dpi;
-        imgui_deinit(gui);
-        imgui_init(gui);
-        imgui_start(gui);
+        imgui_set_scale(gui, event->dpi);
+        gui->rescaleMs = (float)(clock_now_ms() - start);
+        gui_invalidate(gui);
+        break;
+    }
     default:
         break;
     }
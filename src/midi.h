@@ -0,0 +1,394 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+// MIDI 1.0 and MPE input decoder
+// Turns channel voice messages into notes and expression on a VoicePool:
+// - note on/off, polyphonic and channel pressure, pitch bend. Program changes
+//   are left to the caller
+// - controllers, with 14 bit values for the MSB/LSB pairs 0-31 / 32-63
+// - RPNs through data entry: pitch bend range (RPN 0) and the MPE
+//   configuration message (RPN 6)
+// - sustain (CC 64) and sostenuto (CC 66) pedals, all sound/notes off and
+//   reset all controllers
+// - MPE lower and upper zones: every note gets its own member channel, so
+//   pitch bend, channel pressure and CC 74 on it are the pitch, pressure and
+//   timbre of that note alone. The master channel's bend, pedals and
+//   volume apply to the whole zone.
+//
+// Expression is sent to the voices as targets, which they glide to at control
+// rate, see voice_pool_express(). The decoder owns no memory; everything fits
+// in MidiDecoder.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "voices.h"
+
+#define MIDI_NOTE_OFF          0x80
+#define MIDI_NOTE_ON           0x90
+#define MIDI_POLY_PRESSURE     0xa0
+#define MIDI_CONTROL_CHANGE    0xb0
+#define MIDI_PROGRAM_CHANGE    0xc0
+#define MIDI_CHANNEL_PRESSURE  0xd0
+#define MIDI_PITCH_BEND        0xe0
+
+#define MIDI_CC_MODULATION     1
+#define MIDI_CC_DATA_ENTRY     6
+#define MIDI_CC_VOLUME         7
+#define MIDI_CC_EXPRESSION     11
+#define MIDI_CC_DATA_ENTRY_LSB 38
+#define MIDI_CC_SUSTAIN        64
+#define MIDI_CC_SOSTENUTO      66
+#define MIDI_CC_TIMBRE         74
+#define MIDI_CC_NRPN_LSB       98
+#define MIDI_CC_NRPN_MSB       99
+#define MIDI_CC_RPN_LSB        100
+#define MIDI_CC_RPN_MSB        101
+#define MIDI_CC_ALL_SOUND_OFF  120
+#define MIDI_CC_RESET_ALL      121
+#define MIDI_CC_ALL_NOTES_OFF  123
+
+#define MIDI_RPN_BEND_RANGE 0
+#define MIDI_RPN_MPE_CONFIG 6
+#define MIDI_RPN_NONE       0x3fff
+
+// Default pitch bend ranges, in semitones
+#define MIDI_BEND_RANGE       2.0f
+#define MIDI_MPE_MEMBER_RANGE 48.0f
+
+typedef struct MidiChannel {
+    uint8_t cc[128];
+    uint16_t bend;    // 14 bit, 0x2000 is the centre
+    uint8_t pressure; // channel pressure
+    uint16_t rpn;     // selected by CC 101/100, or MIDI_RPN_NONE
+    float bendRange;  // semitones
+} MidiChannel;
+
+typedef struct MidiDecoder {
+    MidiChannel channels[16];
+    // Member channels of the MPE zones, 0 when a zone is off. The lower zone's
+    // master is channel 0 and its members follow it, the upper zone's master
+    // is channel 15 and its members come before it
+    uint32_t lowerMembers;
+    uint32_t upperMembers;
+} MidiDecoder;
+
+static inline void midi_channel_reset_controllers(MidiChannel *ch) {
+    // What "Reset All Controllers" leaves alone
+    const uint8_t volume = ch->cc[MIDI_CC_VOLUME];
+    const uint8_t volumeLsb = ch->cc[MIDI_CC_VOLUME + 32];
+
+    memset(ch->cc, 0, sizeof(ch->cc));
+    ch->cc[MIDI_CC_VOLUME] = volume;
+    ch->cc[MIDI_CC_VOLUME + 32] = volumeLsb;
+    ch->cc[MIDI_CC_EXPRESSION] = 127;
+    ch->cc[MIDI_CC_TIMBRE] = 64;
+    ch->bend = 0x2000;
+    ch->pressure = 0;
+    ch->rpn = MIDI_RPN_NONE;
+}
+
+static inline void midi_decoder_init(MidiDecoder *midi) {
+    memset(midi, 0, sizeof(*midi));
+    for (int c = 0; c < 16; c++) {
+        MidiChannel *ch = &midi->channels[c];
+        // Full volume keeps the level the same as without the decoder until a
+        // host sends CC 7
+        ch->cc[MIDI_CC_VOLUME] = 127;
+        midi_channel_reset_controllers(ch);
+        ch->bendRange = MIDI_BEND_RANGE;
+    }
+}
+
+// 14 bit value of controller pair 'msb' (0-31) and 'msb' + 32
+static inline uint32_t midi_cc14(const MidiChannel *ch, uint32_t msb) {
+    return (uint32_t)ch->cc[msb] << 7 | ch->cc[msb + 32];
+}
+
+// Master channel of the MPE zone 'channel' belongs to, or -1 outside of a zone
+static inline int midi_zone_master(const MidiDecoder *midi, uint32_t channel) {
+    if (midi->lowerMembers > 0 && channel <= midi->lowerMembers)
+        return 0;
+    if (midi->upperMembers > 0 && channel >= 15 - midi->upperMembers)
+        return 15;
+    return -1;
+}
+
+// True when 'voice' plays on 'channel' or, for a master channel, anywhere in
+// its zone
+static inline bool midi_voice_on(const MidiDecoder *midi, const VoicePool *pool,
+                                 uint32_t voice, uint32_t channel) {
+    const uint32_t c = pool->key[voice] / 128;
+    return c == channel || midi_zone_master(midi, c) == (int)channel;
+}
+
+// True when the pedal 'cc' holds notes on 'channel'. In a zone, the master's
+// pedal holds every note
+static inline bool midi_pedal_down(const MidiDecoder *midi, uint32_t channel,
+                                   uint32_t cc) {
+    const int master = midi_zone_master(midi, channel);
+    if (master >= 0 && midi->channels[master].cc[cc] >= 64)
+        return true;
+    return midi->channels[channel].cc[cc] >= 64;
+}
+
+static inline float midi_bend_semitones(const MidiChannel *ch) {
+    return ((float)ch->bend - 8192.0f) * (1.0f / 8192.0f) * ch->bendRange;
+}
+
+// Volume and expression, squared like most synths do for a smoother taper
+static inline float midi_channel_gain(const MidiChannel *ch) {
+    const float volume =
+        (float)midi_cc14(ch, MIDI_CC_VOLUME) * (1.0f / (127 << 7));
+    const float expression =
+        (float)midi_cc14(ch, MIDI_CC_EXPRESSION) * (1.0f / (127 << 7));
+    const float g = volume * expression;
+    // 127 without an LSB must be unity
+    return g >= 1.0f ? 1.0f : g * g;
+}
+
+// Recomputes the expression of 'voice' from its channel, its zone's master
+// channel and its own pressure
+static inline void midi_express(const MidiDecoder *midi, VoicePool *pool,
+                                uint32_t voice, bool jump) {
+    const uint32_t channel = pool->key[voice] / 128;
+    const MidiChannel *ch = &midi->channels[channel];
+    float semitones = midi_bend_semitones(ch);
+    float gain = midi_channel_gain(ch);
+    const int master = midi_zone_master(midi, channel);
+    if (master >= 0 && master != (int)channel) {
+        semitones += midi_bend_semitones(&midi->channels[master]);
+        gain *= midi_channel_gain(&midi->channels[master]);
+    }
+    // Pressure adds up to 6 dB
+    gain *= 1.0f + pool->pressure[voice];
+    voice_pool_express(pool, voice, semitones, gain,
+                       (float)ch->cc[MIDI_CC_TIMBRE] * (1.0f / 127.0f), jump);
+}
+
+// Re-expresses every voice of 'channel', or of its whole zone for a master
+// channel
+static inline void midi_express_channel(const MidiDecoder *midi,
+                                        VoicePool *pool, uint32_t channel) {
+    for (uint32_t i = 0; i < pool->numActive; i++)
+        if (midi_voice_on(midi, pool, pool->active[i], channel))
+            midi_express(midi, pool, pool->active[i], false);
+}
+
+/* --------------------------------------------------------------------------
+ * Pedals and notes */
+
+// Releases the key of 'voice', unless a pedal holds it
+static inline void midi_release(const MidiDecoder *midi, VoicePool *pool,
+                                uint32_t voice) {
+    const uint32_t channel = pool->key[voice] / 128;
+    if (midi_pedal_down(midi, channel, MIDI_CC_SUSTAIN) ||
+        pool->sostenuto[voice])
+        pool->state[voice] = VOICE_SUSTAINED;
+    else
+        voice_pool_release(pool, voice);
+}
+
+// Releases the sustained voices of 'channel' (or of its zone, for a master)
+// that no pedal holds any more
+static inline void midi_release_pedalled(const MidiDecoder *midi,
+                                         VoicePool *pool, uint32_t channel) {
+    // Backwards, as freeing moves the last voice into the freed slot
+    for (uint32_t i = pool->numActive; i-- > 0;) {
+        const uint32_t v = pool->active[i];
+        if (midi_voice_on(midi, pool, v, channel) &&
+            pool->state[v] == VOICE_SUSTAINED && !pool->sostenuto[v] &&
+            !midi_pedal_down(midi, pool->key[v] / 128, MIDI_CC_SUSTAIN))
+            voice_pool_release(pool, v);
+    }
+}
+
+// Releases every held voice of 'channel' (or of its zone), pedals permitting,
+// or silences every voice when 'immediately' is set
+static inline void midi_all_off(const MidiDecoder *midi, VoicePool *pool,
+                                uint32_t channel, bool immediately) {
+    for (uint32_t i = pool->numActive; i-- > 0;) {
+        const uint32_t v = pool->active[i];
+        if (!midi_voice_on(midi, pool, v, channel))
+            continue;
+        if (immediately)
+            voice_pool_free_voice(pool, v);
+        else if (pool->state[v] == VOICE_HELD)
+            midi_release(midi, pool, v);
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Controllers */
+
+// Called once both bytes of a data entry may have changed
+static inline void midi_data_entry(MidiDecoder *midi, VoicePool *pool,
+                                   uint32_t channel) {
+    MidiChannel *ch = &midi->channels[channel];
+    switch (ch->rpn) {
+    case MIDI_RPN_BEND_RANGE:
+        ch->bendRange = (float)ch->cc[MIDI_CC_DATA_ENTRY] +
+                        (float)ch->cc[MIDI_CC_DATA_ENTRY_LSB] * 0.01f;
+        midi_express_channel(midi, pool, channel);
+        break;
+    case MIDI_RPN_MPE_CONFIG: {
+        if (channel != 0 && channel != 15)
+            break;
+        uint32_t members = ch->cc[MIDI_CC_DATA_ENTRY];
+        members = members < 15 ? members : 15;
+        // A zone that grows over the other shrinks it
+        if (channel == 0) {
+            midi->lowerMembers = members;
+            if (midi->upperMembers + members > 14)
+                midi->upperMembers = members >= 14 ? 0 : 14 - members;
+        } else {
+            midi->upperMembers = members;
+            if (midi->lowerMembers + members > 14)
+                midi->lowerMembers = members >= 14 ? 0 : 14 - members;
+        }
+        // Bend ranges go back to the defaults of the new layout
+        for (uint32_t c = 0; c < 16; c++) {
+            const int master = midi_zone_master(midi, c);
+            midi->channels[c].bendRange =
+                master >= 0 && master != (int)c ? MIDI_MPE_MEMBER_RANGE
+                                                : MIDI_BEND_RANGE;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static inline void midi_control_change(MidiDecoder *midi, VoicePool *pool,
+                                       uint32_t channel, uint32_t cc,
+                                       uint32_t value) {
+    MidiChannel *ch = &midi->channels[channel];
+    const uint8_t previous = ch->cc[cc];
+    ch->cc[cc] = (uint8_t)value;
+    // A new MSB starts a new 14 bit value
+    if (cc < 32)
+        ch->cc[cc + 32] = 0;
+
+    switch (cc) {
+    case MIDI_CC_VOLUME:
+    case MIDI_CC_VOLUME + 32:
+    case MIDI_CC_EXPRESSION:
+    case MIDI_CC_EXPRESSION + 32:
+    case MIDI_CC_TIMBRE:
+        midi_express_channel(midi, pool, channel);
+        break;
+    case MIDI_CC_DATA_ENTRY:
+    case MIDI_CC_DATA_ENTRY_LSB:
+        midi_data_entry(midi, pool, channel);
+        break;
+    case MIDI_CC_RPN_LSB:
+    case MIDI_CC_RPN_MSB:
+        ch->rpn = (uint16_t)(ch->cc[MIDI_CC_RPN_MSB] << 7 |
+                             ch->cc[MIDI_CC_RPN_LSB]);
+        break;
+    case MIDI_CC_NRPN_LSB:
+    case MIDI_CC_NRPN_MSB:
+        // Data entry goes to an NRPN now, none of which are supported
+        ch->rpn = MIDI_RPN_NONE;
+        break;
+    case MIDI_CC_SUSTAIN:
+        if (previous >= 64 && value < 64)
+            midi_release_pedalled(midi, pool, channel);
+        break;
+    case MIDI_CC_SOSTENUTO:
+        if (previous < 64 && value >= 64) {
+            // Latches the keys down right now
+            for (uint32_t i = 0; i < pool->numActive; i++) {
+                const uint32_t v = pool->active[i];
+                if (midi_voice_on(midi, pool, v, channel) &&
+                    pool->state[v] == VOICE_HELD)
+                    pool->sostenuto[v] = 1;
+            }
+        } else if (previous >= 64 && value < 64) {
+            for (uint32_t i = 0; i < pool->numActive; i++)
+                if (midi_voice_on(midi, pool, pool->active[i], channel))
+                    pool->sostenuto[pool->active[i]] = 0;
+            midi_release_pedalled(midi, pool, channel);
+        }
+        break;
+    case MIDI_CC_ALL_SOUND_OFF:
+        midi_all_off(midi, pool, channel, true);
+        break;
+    case MIDI_CC_RESET_ALL:
+        midi_channel_reset_controllers(ch);
+        midi_release_pedalled(midi, pool, channel);
+        midi_express_channel(midi, pool, channel);
+        break;
+    case MIDI_CC_ALL_NOTES_OFF:
+        midi_all_off(midi, pool, channel, false);
+        break;
+    default:
+        break;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Messages */
+
+// Decodes one channel voice message. Program changes and system messages are
+// ignored
+static inline void midi_decode(MidiDecoder *midi, VoicePool *pool,
+                               uint8_t status, uint8_t data1, uint8_t data2) {
+    const uint32_t channel = status & 0x0f;
+    MidiChannel *ch = &midi->channels[channel];
+    data1 &= 0x7f;
+    data2 &= 0x7f;
+
+    switch (status & 0xf0) {
+    case MIDI_NOTE_ON:
+        if (data2 != 0) {
+            const uint32_t voice = voice_pool_note_on(
+                pool, channel, data1, (float)data2 / 127.0f);
+            // MPE sends the note's channel state before its note on
+            const int master = midi_zone_master(midi, channel);
+            if (master >= 0)
+                voice_pool_route(pool, voice, (uint32_t)master);
+            pool->pressure[voice] = (float)ch->pressure * (1.0f / 127.0f);
+            midi_express(midi, pool, voice, true);
+            break;
+        }
+        // Note on with a velocity of 0 is a note off
+        // fallthrough
+    case MIDI_NOTE_OFF: {
+        const uint32_t voice = voice_pool_find(pool, channel, data1);
+        if (voice != VOICE_NONE && pool->state[voice] == VOICE_HELD)
+            midi_release(midi, pool, voice);
+        break;
+    }
+    case MIDI_POLY_PRESSURE: {
+        const uint32_t voice = voice_pool_find(pool, channel, data1);
+        if (voice != VOICE_NONE) {
+            pool->pressure[voice] = (float)data2 * (1.0f / 127.0f);
+            midi_express(midi, pool, voice, false);
+        }
+        break;
+    }
+    case MIDI_CONTROL_CHANGE:
+        midi_control_change(midi, pool, channel, data1, data2);
+        break;
+    case MIDI_CHANNEL_PRESSURE:
+        ch->pressure = data1;
+        for (uint32_t i = 0; i < pool->numActive; i++) {
+            const uint32_t v = pool->active[i];
+            if (pool->key[v] / 128 == channel)
+                pool->pressure[v] = (float)data1 * (1.0f / 127.0f);
+        }
+        midi_express_channel(midi, pool, channel);
+        break;
+    case MIDI_PITCH_BEND:
+        ch->bend = (uint16_t)(data2 << 7 | data1);
+        midi_express_channel(midi, pool, channel);
+        break;
+    default:
+        break;
+    }
+}
+
+#endif // MIDI_H
@@ -0,0 +1,275 @@
+#ifndef MOD_MATRIX_H
+#define MOD_MATRIX_H
+
+// Modulation matrix
+// Routes the sources of ModSource onto the parameters of ModDest, each routing
+// adding 'amount * source' in units of the parameter's range. It is evaluated
+// once per control step of 'controlFrames' samples, giving every destination
+// its value at the end of the step; the caller interpolates linearly from the
+// value at its start, see mod_matrix_offset().
+//
+// Routings are kept as structure-of-arrays in two lanes:
+// - global: onto parameters that apply to the whole plugin, like the output
+//   gain. Only the global sources (LFOs, macros, mod wheel) reach them
+// - voice: onto PARAM_PITCH and PARAM_LEVEL, evaluated for every active voice
+//   at once. Each source is a row of values, one per voice, in the order of
+//   VoicePool::active, so every routing is one multiply-add loop over the
+//   voices. Global sources are read as a constant
+// Voices glide to their new pitch and level over the step, see
+// voice_pool_modulate().
+//
+// Nothing allocates; the matrix lives inside the Plugin.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "params.h"
+#include "voices.h"
+
+#define MOD_MAX_ROUTINGS 64
+#define MOD_NUM_LFOS     2
+#define MOD_FIRST_VOICE_SOURCE MOD_SOURCE_VELOCITY
+#define MOD_NUM_VOICE_SOURCES  (MOD_SOURCE_COUNT - MOD_FIRST_VOICE_SOURCE)
+// PARAM_PITCH and PARAM_LEVEL
+#define MOD_NUM_VOICE_DESTS 2
+
+typedef struct ModLane {
+    uint8_t source[MOD_MAX_ROUTINGS]; // ModSource
+    uint8_t dest[MOD_MAX_ROUTINGS];   // ParamIndex, or voice destination
+    float amount[MOD_MAX_ROUTINGS];
+    uint32_t numRoutings;
+} ModLane;
+
+typedef struct ModMatrix {
+    ModLane global;
+    ModLane voice;
+
+    // Samples per control step, a multiple of VOICE_CONTROL_FRAMES
+    uint32_t controlFrames;
+    // Samples left in the current step. 0 before the first one
+    uint32_t countdown;
+    // False until a step has been evaluated since the matrix was last idle
+    bool running;
+    // VoicePool::noteCounter when voices were last given their modulation
+    uint32_t noteCounter;
+
+    float lfoPhase[MOD_NUM_LFOS];
+    // Global sources at the end of the current step. Per voice ones read 0
+    float sources[MOD_SOURCE_COUNT];
+    // Per voice sources, by position in VoicePool::active
+    float voiceSources[MOD_NUM_VOICE_SOURCES][MAX_VOICES];
+
+    // Offsets of the global destinations at the start and end of the step
+    float start[NUM_PARAMS];
+    float end[NUM_PARAMS];
+    // Offsets of the voice destinations at the end of the step, by position
+    float voiceDests[MOD_NUM_VOICE_DESTS][MAX_VOICES];
+} ModMatrix;
+
+// Parameter of each ModDest. Every one of them reads mod_matrix_value(),
+// mod_matrix_offset() or, for the voice destinations, the voice lane
+static const uint8_t MOD_DEST_PARAMS[] = {
+    PARAM_PITCH,   PARAM_LEVEL,    PARAM_GAIN,        PARAM_DRIVE,
+    PARAM_VOICES,  PARAM_WAVEFORM, PARAM_ATTACK,      PARAM_DECAY,
+    PARAM_SUSTAIN, PARAM_RELEASE,  PARAM_ARPEGGIATOR,
+};
+
+static inline void mod_matrix_init(ModMatrix *mod, uint32_t controlFrames) {
+    memset(mod, 0, sizeof(*mod));
+    mod->controlFrames = controlFrames;
+}
+
+// Voice destination of 'param', or -1 if it applies to the whole plugin
+static inline int mod_voice_dest(uint32_t param) {
+    if (param == PARAM_PITCH)
+        return 0;
+    if (param == PARAM_LEVEL)
+        return 1;
+    return -1;
+}
+
+static inline void mod_matrix_clear(ModMatrix *mod) {
+    mod->global.numRoutings = 0;
+    mod->voice.numRoutings = 0;
+}
+
+static inline bool mod_matrix_active(const ModMatrix *mod) {
+    return mod->global.numRoutings + mod->voice.numRoutings > 0;
+}
+
+// Adds a routing onto ModDest 'modDest'. Returns false, ignoring it, when it
+// does nothing: no source, no such destination, a per voice source onto a
+// global parameter, or no amount. Also when the matrix is full
+static inline bool mod_matrix_add(ModMatrix *mod, uint32_t source,
+                                  uint32_t modDest, float amount) {
+    if (source == MOD_SOURCE_NONE || source >= MOD_SOURCE_COUNT ||
+        modDest >= MOD_DEST_COUNT || amount == 0.0f)
+        return false;
+    const uint32_t dest = MOD_DEST_PARAMS[modDest];
+    const int voiceDest = mod_voice_dest(dest);
+    if (voiceDest < 0 && source >= MOD_FIRST_VOICE_SOURCE)
+        return false;
+    ModLane *lane = voiceDest >= 0 ? &mod->voice : &mod->global;
+    if (lane->numRoutings + (voiceDest >= 0 ? mod->global.numRoutings
+                                             : mod->voice.numRoutings) >=
+        MOD_MAX_ROUTINGS)
+        return false;
+    const uint32_t r = lane->numRoutings++;
+    lane->source[r] = (uint8_t)source;
+    lane->dest[r] = (uint8_t)(voiceDest >= 0 ? voiceDest : dest);
+    lane->amount[r] = amount;
+    return true;
+}
+
+// Evaluates the voice lane for every active voice of 'pool'
+static inline void mod_matrix_eval_voices(ModMatrix *mod,
+                                          const VoicePool *pool) {
+    const uint32_t numVoices = pool->numActive;
+    float *velocity = mod->voiceSources[MOD_SOURCE_VELOCITY -
+                                        MOD_FIRST_VOICE_SOURCE];
+    float *key = mod->voiceSources[MOD_SOURCE_KEY - MOD_FIRST_VOICE_SOURCE];
+    float *pressure =
+        mod->voiceSources[MOD_SOURCE_PRESSURE - MOD_FIRST_VOICE_SOURCE];
+    for (uint32_t i = 0; i < numVoices; i++) {
+        const uint32_t v = pool->active[i];
+        velocity[i] = pool->velocity[v];
+        key[i] = (float)(pool->key[v] & 127) * (1.0f / 127.0f);
+        pressure[i] = pool->pressure[v];
+    }
+
+    for (uint32_t d = 0; d < MOD_NUM_VOICE_DESTS; d++)
+        memset(mod->voiceDests[d], 0, sizeof(float) * numVoices);
+    const ModLane *lane = &mod->voice;
+    for (uint32_t r = 0; r < lane->numRoutings; r++) {
+        float *out = mod->voiceDests[lane->dest[r]];
+        const float amount = lane->amount[r];
+        const uint32_t source = lane->source[r];
+        if (source < MOD_FIRST_VOICE_SOURCE) {
+            const float offset = amount * mod->sources[source];
+            for (uint32_t i = 0; i < numVoices; i++)
+                out[i] += offset;
+        } else {
+            const float *in =
+                mod->voiceSources[source - MOD_FIRST_VOICE_SOURCE];
+            for (uint32_t i = 0; i < numVoices; i++)
+                out[i] += amount * in[i];
+        }
+    }
+}
+
+// Gives the voices of 'pool' their pitch and level: 'params' plus the voice
+// lane's offsets, evaluated with mod_matrix_eval_voices(). Voices glide there
+// over a control step. With 'onlyNew', only the voices started since the last
+// call are set
+static inline void mod_matrix_apply_voices(ModMatrix *mod, VoicePool *pool,
+                                           const float *params, bool onlyNew) {
+    const ParamInfo *pitch = &PARAM_INFO[PARAM_PITCH];
+    const ParamInfo *level = &PARAM_INFO[PARAM_LEVEL];
+    const float pitchRange = pitch->max - pitch->min;
+    const float levelRange = level->max - level->min;
+    const uint32_t numSteps = mod->controlFrames / VOICE_CONTROL_FRAMES;
+    for (uint32_t i = 0; i < pool->numActive; i++) {
+        const uint32_t v = pool->active[i];
+        if (onlyNew && pool->modulated[v])
+            continue;
+        float semitones = params[PARAM_PITCH] + mod->voiceDests[0][i] *
+                                                    pitchRange;
+        float dB = params[PARAM_LEVEL] + mod->voiceDests[1][i] * levelRange;
+        semitones = semitones < pitch->min ? pitch->min : semitones;
+        semitones = semitones > pitch->max ? pitch->max : semitones;
+        dB = dB < level->min ? level->min : dB;
+        dB = dB > level->max ? level->max : dB;
+        // 10^(dB / 20)
+        const float gain = exp2f(dB * 0.16609640474f);
+        voice_pool_modulate(pool, v, semitones, gain, numSteps);
+    }
+    mod->noteCounter = pool->noteCounter;
+}
+
+// Gives the voices started since the last step or call their modulation at
+// once, so notes don't glide in from no modulation
+static inline void mod_matrix_start_voices(ModMatrix *mod, VoicePool *pool,
+                                           const float *params) {
+    if (mod->running) {
+        mod_matrix_eval_voices(mod, pool);
+    } else {
+        for (uint32_t d = 0; d < MOD_NUM_VOICE_DESTS; d++)
+            memset(mod->voiceDests[d], 0, sizeof(float) * pool->numActive);
+    }
+    mod_matrix_apply_voices(mod, pool, params, true);
+}
+
+// Starts the next control step: moves the LFOs on, evaluates both lanes at
+// the end of the step and sends the voices on their way there. 'params' holds
+// the plain parameter values, 'lfoRates' the rate of each LFO in Hz, as
+// smoothed, and 'modWheel' is 0-1
+static inline void mod_matrix_step(ModMatrix *mod, VoicePool *pool,
+                                   const float *params, const float *lfoRates,
+                                   float modWheel, float sampleRate) {
+    const float seconds = (float)mod->controlFrames / sampleRate;
+    for (uint32_t l = 0; l < MOD_NUM_LFOS; l++) {
+        float phase = mod->lfoPhase[l] + lfoRates[l] * seconds;
+        mod->lfoPhase[l] = phase - (float)(int)phase;
+    }
+    mod->sources[MOD_SOURCE_LFO1] = osc_sin2pi(mod->lfoPhase[0]);
+    mod->sources[MOD_SOURCE_LFO2] = 1.0f - 4.0f * fabsf(mod->lfoPhase[1] -
+                                                        0.5f);
+    for (uint32_t m = 0; m < 4; m++)
+        mod->sources[MOD_SOURCE_MACRO1 + m] = params[PARAM_MACRO1 + m];
+    mod->sources[MOD_SOURCE_MOD_WHEEL] = modWheel;
+
+    memcpy(mod->start, mod->end, sizeof(mod->start));
+    memset(mod->end, 0, sizeof(mod->end));
+    const ModLane *lane = &mod->global;
+    for (uint32_t r = 0; r < lane->numRoutings; r++)
+        mod->end[lane->dest[r]] +=
+            lane->amount[r] * mod->sources[lane->source[r]];
+    // Coming out of idle, there's nothing to ramp from
+    if (!mod->running)
+        memcpy(mod->start, mod->end, sizeof(mod->start));
+    mod->running = true;
+
+    mod_matrix_eval_voices(mod, pool);
+    mod_matrix_apply_voices(mod, pool, params, false);
+    mod->countdown = mod->controlFrames;
+}
+
+// Stops modulating, as the matrix has no routings left: every offset goes
+// back to 0, and the voices back to 'params'
+static inline void mod_matrix_idle(ModMatrix *mod, VoicePool *pool,
+                                   const float *params) {
+    if (mod->running) {
+        memset(mod->start, 0, sizeof(mod->start));
+        memset(mod->end, 0, sizeof(mod->end));
+        mod->running = false;
+        mod->countdown = 0;
+    }
+    for (uint32_t d = 0; d < MOD_NUM_VOICE_DESTS; d++)
+        memset(mod->voiceDests[d], 0, sizeof(float) * pool->numActive);
+    mod_matrix_apply_voices(mod, pool, params, false);
+}
+
+// Offset of global destination 'param' 'frames' samples after the point the
+// current step has reached, in units of its range
+static inline float mod_matrix_offset(const ModMatrix *mod, uint32_t param,
+                                      uint32_t frames) {
+    const float t = (float)(mod->controlFrames - mod->countdown + frames) /
+                    (float)mod->controlFrames;
+    return mod->start[param] + (mod->end[param] - mod->start[param]) * t;
+}
+
+// 'value' of global destination 'param' moved by its offset at the end of the
+// step, within the parameter's range
+static inline float mod_matrix_value(const ModMatrix *mod, uint32_t param,
+                                     float value) {
+    const ParamInfo *info = &PARAM_INFO[param];
+    value += mod->end[param] * (info->max - info->min);
+    if (info->flags & PARAM_INTEGER)
+        value = floorf(value + 0.5f);
+    value = value < info->min ? info->min : value;
+    return value > info->max ? info->max : value;
+}
+
+#endif // MOD_MATRIX_H
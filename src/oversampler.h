@@ -0,0 +1,353 @@
+#ifndef OVERSAMPLER_H
+#define OVERSAMPLER_H
+
+// 2x/4x/8x oversampling for nonlinear stages
+// The signal is taken up and back down by cascaded half-band stages, one per
+// doubling. Each stage is a linear phase FIR of OVERSAMPLER_LENGTH taps
+// (Kaiser windowed sinc), split into its two polyphase branches: in a
+// half-band filter every other tap is zero except the centre one, so one
+// branch is a plain delay and only OVERSAMPLER_BRANCH_TAPS multiplies are
+// needed per output pair, whichever direction.
+//
+// The FIR branch is computed several outputs at a time (scalar, SSE2 or AVX2,
+// chosen at runtime like the oscillator kernels in osc.h). Buffers are
+// allocated by oversampler_prepare on the main thread, nothing allocates while
+// processing.
+//
+// Latency: each stage delays by OVERSAMPLER_LENGTH - 1 samples at its high
+// rate. Summed over the stages that is rarely a whole number of host samples,
+// so a short delay at the top rate rounds it up to one and the latency
+// reported to the host is exact.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "osc.h"
+
+#define OVERSAMPLER_MAX_STAGES  3 // 8x
+#define OVERSAMPLER_BRANCH_TAPS 32
+#define OVERSAMPLER_LENGTH      (2 * OVERSAMPLER_BRANCH_TAPS - 1)
+#define OVERSAMPLER_KAISER_BETA 8.0
+
+typedef struct OversamplerStage {
+    // Input history followed by the current block. The FIR branch of both
+    // directions reads from the start, so no wrapping is needed
+    float *up;        // OVERSAMPLER_BRANCH_TAPS - 1 history
+    float *downFir;   // OVERSAMPLER_BRANCH_TAPS - 1 history, even samples
+    float *downDelay; // OVERSAMPLER_BRANCH_TAPS / 2 history, odd samples
+} OversamplerStage;
+
+typedef struct Oversampler {
+    uint32_t numStages; // 0 = off
+    uint32_t maxFrames;
+
+    // Taps of the FIR branch, doubled for the up direction to make up for the
+    // zeros inserted between samples
+    float upTaps[OVERSAMPLER_BRANCH_TAPS];
+    float downTaps[OVERSAMPLER_BRANCH_TAPS];
+
+    OversamplerStage stages[OVERSAMPLER_MAX_STAGES];
+    // Signal at the top rate, with room for the rounding delay
+    float *work;
+    uint32_t padFrames;
+    float padHistory[1 << OVERSAMPLER_MAX_STAGES];
+
+    void *memory;
+} Oversampler;
+
+static inline double oversampler_bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Host samples of delay for 2^numStages oversampling
+static inline uint32_t oversampler_latency(uint32_t numStages) {
+    const uint32_t factor = 1u << numStages;
+    const uint32_t perStage = OVERSAMPLER_LENGTH - 1;
+    const uint32_t topRate = perStage * (factor - 1);
+    return (topRate + (factor - topRate % factor) % factor) / factor;
+}
+
+// Host samples the filters of 2^numStages oversampling keep ringing for once
+// their input goes silent
+static inline uint32_t oversampler_tail(uint32_t numStages) {
+    return 2 * oversampler_latency(numStages) + 1;
+}
+
+static inline void oversampler_init(Oversampler *os) {
+    memset(os, 0, sizeof(*os));
+
+    // Odd taps of a half-band sinc around the centre, which sits between the
+    // two halves of the FIR branch. The branch is symmetric, so it doesn't
+    // matter which end is applied to the newest sample
+    const double pi = 3.14159265358979323846;
+    const int centre = OVERSAMPLER_LENGTH / 2;
+    const double i0Beta = oversampler_bessel_i0(OVERSAMPLER_KAISER_BETA);
+    double sum = 0.0;
+    double taps[OVERSAMPLER_BRANCH_TAPS];
+    for (int j = 0; j < OVERSAMPLER_BRANCH_TAPS; j++) {
+        const int n = 2 * j - centre; // odd
+        const double r = (double)n / centre;
+        const double window =
+            oversampler_bessel_i0(OVERSAMPLER_KAISER_BETA * sqrt(1.0 - r * r)) /
+            i0Beta;
+        taps[j] = sin(pi * n / 2.0) / (pi * n) * window;
+        sum += taps[j];
+    }
+    // The branch sums to 0.5 and the centre tap is 0.5, giving unity DC gain
+    for (int j = 0; j < OVERSAMPLER_BRANCH_TAPS; j++) {
+        os->downTaps[j] = (float)(taps[j] * 0.5 / sum);
+        os->upTaps[j] = 2.0f * os->downTaps[j];
+    }
+}
+
+static inline void oversampler_reset(Oversampler *os) {
+    const uint32_t history = OVERSAMPLER_BRANCH_TAPS - 1;
+    for (uint32_t s = 0; s < OVERSAMPLER_MAX_STAGES; s++) {
+        if (os->stages[s].up == NULL)
+            continue;
+        memset(os->stages[s].up, 0, sizeof(float) * history);
+        memset(os->stages[s].downFir, 0, sizeof(float) * history);
+        memset(os->stages[s].downDelay, 0,
+               sizeof(float) * OVERSAMPLER_BRANCH_TAPS / 2);
+    }
+    memset(os->padHistory, 0, sizeof(os->padHistory));
+}
+
+// Allocates for blocks of up to 'maxFrames' at every factor. Main thread only,
+// while the audio thread is idle
+static inline void oversampler_prepare(Oversampler *os, uint32_t maxFrames) {
+    const uint32_t history = OVERSAMPLER_BRANCH_TAPS - 1;
+    const uint32_t delayHistory = OVERSAMPLER_BRANCH_TAPS / 2;
+    const uint32_t maxFactor = 1u << OVERSAMPLER_MAX_STAGES;
+
+    size_t total = maxFrames * maxFactor + maxFactor;
+    for (uint32_t s = 0; s < OVERSAMPLER_MAX_STAGES; s++) {
+        const size_t stageFrames = (size_t)maxFrames << s;
+        total += history + stageFrames;      // up
+        total += history + stageFrames;      // downFir
+        total += delayHistory + stageFrames; // downDelay
+    }
+
+    free(os->memory);
+    os->memory = calloc(total, sizeof(float));
+    os->maxFrames = os->memory ? maxFrames : 0;
+    if (os->memory == NULL) {
+        memset(os->stages, 0, sizeof(os->stages));
+        os->work = NULL;
+        return;
+    }
+
+    float *p = (float *)os->memory;
+    os->work = p;
+    p += maxFrames * maxFactor + maxFactor;
+    for (uint32_t s = 0; s < OVERSAMPLER_MAX_STAGES; s++) {
+        const size_t stageFrames = (size_t)maxFrames << s;
+        os->stages[s].up = p;
+        p += history + stageFrames;
+        os->stages[s].downFir = p;
+        p += history + stageFrames;
+        os->stages[s].downDelay = p;
+        p += delayHistory + stageFrames;
+    }
+    oversampler_reset(os);
+}
+
+static inline void oversampler_free(Oversampler *os) {
+    free(os->memory);
+    memset(os->stages, 0, sizeof(os->stages));
+    os->memory = NULL;
+    os->work = NULL;
+    os->maxFrames = 0;
+}
+
+// Changes the factor to 2^numStages, clearing the filters
+static inline void oversampler_set_stages(Oversampler *os,
+                                          uint32_t numStages) {
+    const uint32_t factor = 1u << numStages;
+    const uint32_t topRate = (OVERSAMPLER_LENGTH - 1) * (factor - 1);
+    os->numStages = numStages;
+    os->padFrames = (factor - topRate % factor) % factor;
+    oversampler_reset(os);
+}
+
+/* --------------------------------------------------------------------------
+ * FIR branch kernels
+ * out[n] = sum(taps[j] * x[n + j]) for n < numOut, j < OVERSAMPLER_BRANCH_TAPS
+ */
+
+typedef void (*OversamplerFirFn)(const float *x, const float *taps, float *out,
+                                 uint32_t numOut);
+
+static inline void oversampler_fir_scalar(const float *x, const float *taps,
+                                          float *out, uint32_t numOut) {
+    for (uint32_t n = 0; n < numOut; n++) {
+        float sum = 0.0f;
+        for (uint32_t j = 0; j < OVERSAMPLER_BRANCH_TAPS; j++)
+            sum += taps[j] * x[n + j];
+        out[n] = sum;
+    }
+}
+
+#if OSC_X86
+
+static inline void oversampler_fir_sse2(const float *x, const float *taps,
+                                        float *out, uint32_t numOut) {
+    uint32_t n = 0;
+    for (; n + 8 <= numOut; n += 8) {
+        __m128 a = _mm_setzero_ps();
+        __m128 b = _mm_setzero_ps();
+        for (uint32_t j = 0; j < OVERSAMPLER_BRANCH_TAPS; j++) {
+            const __m128 t = _mm_set1_ps(taps[j]);
+            a = _mm_add_ps(a, _mm_mul_ps(t, _mm_loadu_ps(x + n + j)));
+            b = _mm_add_ps(b, _mm_mul_ps(t, _mm_loadu_ps(x + n + j + 4)));
+        }
+        _mm_storeu_ps(out + n, a);
+        _mm_storeu_ps(out + n + 4, b);
+    }
+    oversampler_fir_scalar(x + n, taps, out + n, numOut - n);
+}
+
+OSC_TARGET("avx2,fma")
+static inline void oversampler_fir_avx2(const float *x, const float *taps,
+                                        float *out, uint32_t numOut) {
+    uint32_t n = 0;
+    for (; n + 16 <= numOut; n += 16) {
+        __m256 a = _mm256_setzero_ps();
+        __m256 b = _mm256_setzero_ps();
+        for (uint32_t j = 0; j < OVERSAMPLER_BRANCH_TAPS; j++) {
+            const __m256 t = _mm256_set1_ps(taps[j]);
+            a = _mm256_fmadd_ps(t, _mm256_loadu_ps(x + n + j), a);
+            b = _mm256_fmadd_ps(t, _mm256_loadu_ps(x + n + j + 8), b);
+        }
+        _mm256_storeu_ps(out + n, a);
+        _mm256_storeu_ps(out + n + 8, b);
+    }
+    oversampler_fir_sse2(x + n, taps, out + n, numOut - n);
+}
+
+#endif // OSC_X86
+
+// Returns the kernel for an OscKernelLevel, or NULL if this build or CPU can't
+// run it. AVX-512 machines use the AVX2 kernel
+static inline OversamplerFirFn oversampler_get_fir(int level) {
+    if (level > osc_detect_level())
+        return NULL;
+    switch (level) {
+    case OSC_KERNEL_SCALAR:
+        return oversampler_fir_scalar;
+#if OSC_X86
+    case OSC_KERNEL_SSE2:
+        return oversampler_fir_sse2;
+    case OSC_KERNEL_AVX2:
+    case OSC_KERNEL_AVX512:
+        return oversampler_fir_avx2;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+// Kernel chosen for this CPU on first use, like osc_sine_add()
+static inline void oversampler_fir(const float *x, const float *taps,
+                                   float *out, uint32_t numOut) {
+    static void *volatile cached = NULL;
+    OversamplerFirFn kernel =
+        (OversamplerFirFn)atomic_load_acquire_ptr(&cached);
+    if (kernel == NULL) {
+        kernel = oversampler_get_fir(osc_detect_level());
+        atomic_store_release_ptr(&cached, (void *)kernel);
+    }
+    kernel(x, taps, out, numOut);
+}
+
+/* --------------------------------------------------------------------------
+ * Processing */
+
+// 'numIn' samples of 'in' become 2 * numIn samples in 'out'
+static inline void oversampler_stage_up(const Oversampler *os,
+                                        OversamplerStage *stage,
+                                        const float *in, float *out,
+                                        uint32_t numIn) {
+    const uint32_t history = OVERSAMPLER_BRANCH_TAPS - 1;
+    float *buf = stage->up;
+    memcpy(buf + history, in, sizeof(float) * numIn);
+
+    // Even outputs come from the FIR branch, written to the back half of 'out'
+    // first so interleaving can run forwards without overwriting them
+    float *fir = out + numIn;
+    oversampler_fir(buf, os->upTaps, fir, numIn);
+    for (uint32_t n = 0; n < numIn; n++) {
+        out[2 * n] = fir[n];
+        out[2 * n + 1] = buf[n + OVERSAMPLER_BRANCH_TAPS / 2];
+    }
+    memmove(buf, buf + numIn, sizeof(float) * history);
+}
+
+// 'numOut' * 2 samples of 'in' become 'numOut' samples in 'out'
+static inline void oversampler_stage_down(const Oversampler *os,
+                                          OversamplerStage *stage,
+                                          const float *in, float *out,
+                                          uint32_t numOut) {
+    const uint32_t history = OVERSAMPLER_BRANCH_TAPS - 1;
+    const uint32_t delayHistory = OVERSAMPLER_BRANCH_TAPS / 2;
+    float *even = stage->downFir;
+    float *odd = stage->downDelay;
+    for (uint32_t n = 0; n < numOut; n++) {
+        even[history + n] = in[2 * n];
+        odd[delayHistory + n] = in[2 * n + 1];
+    }
+
+    oversampler_fir(even, os->downTaps, out, numOut);
+    for (uint32_t n = 0; n < numOut; n++)
+        out[n] += 0.5f * odd[n];
+
+    memmove(even, even + numOut, sizeof(float) * history);
+    memmove(odd, odd + numOut, sizeof(float) * delayHistory);
+}
+
+// Takes 'numFrames' of 'in' up to the top rate and returns the buffer holding
+// them, numFrames << numStages samples long. Process it in place, then pass it
+// to oversampler_down
+static inline float *oversampler_up(Oversampler *os, const float *in,
+                                    uint32_t numFrames) {
+    float *work = os->work;
+    const float *src = in;
+    for (uint32_t s = 0; s < os->numStages; s++) {
+        oversampler_stage_up(os, &os->stages[s], src, work, numFrames << s);
+        src = work;
+    }
+    if (os->numStages == 0)
+        memcpy(work, in, sizeof(float) * numFrames);
+    return work;
+}
+
+// Takes the top rate buffer from oversampler_up back to 'numFrames' of 'out'
+static inline void oversampler_down(Oversampler *os, float *out,
+                                    uint32_t numFrames) {
+    float *work = os->work;
+    const uint32_t numTop = numFrames << os->numStages;
+
+    // Rounds the latency up to whole host samples
+    const uint32_t pad = os->padFrames;
+    if (pad > 0) {
+        memmove(work + pad, work, sizeof(float) * numTop);
+        memcpy(work, os->padHistory, sizeof(float) * pad);
+        memcpy(os->padHistory, work + numTop, sizeof(float) * pad);
+    }
+
+    for (uint32_t s = os->numStages; s-- > 0;) {
+        float *dst = s == 0 ? out : work;
+        oversampler_stage_down(os, &os->stages[s], work, dst, numFrames << s);
+    }
+    if (os->numStages == 0)
+        memcpy(out, work, sizeof(float) * numFrames);
+}
+
+#endif // OVERSAMPLER_H
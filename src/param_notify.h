@@ -0,0 +1,76 @@
+#ifndef PARAM_NOTIFY_H
+#define PARAM_NOTIFY_H
+
+// Coalesced audio -> GUI parameter notifications
+// The audio thread stores the latest value of a parameter and marks it dirty.
+// The GUI collects every dirty parameter once per frame. However many times a
+// parameter changes between two frames, the GUI sees one change with the
+// latest value, and the audio thread never queues anything, so its cost per
+// change is constant and nothing can overflow.
+//
+// Ordering: the value is stored before its dirty bit is set (release), and
+// read after the bit is cleared (acquire). A change that lands between the two
+// is either read right away or flagged again for the next frame, never lost.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "atomics.h"
+#include "bits.h"
+#include "params.h"
+
+#define PARAM_NOTIFY_WORDS ((NUM_PARAMS + 31) / 32)
+
+typedef struct ParamNotify {
+    volatile uint32_t dirty[PARAM_NOTIFY_WORDS];
+    volatile uint32_t latest[NUM_PARAMS]; // bits of a float
+} ParamNotify;
+
+// Audio thread
+static inline void param_notify_set(ParamNotify *notify, uint32_t param,
+                                    float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    atomic_store_relaxed_u32(&notify->latest[param], bits);
+    // Always a read-modify-write, even when the bit looks set already: the GUI
+    // may be clearing it right now and must see this value afterwards
+    atomic_fetch_or_release_u32(&notify->dirty[param >> 5],
+                                1u << (param & 31));
+}
+
+// GUI thread. Copies the latest value of every parameter that changed since
+// the last call into 'values' and returns how many did
+static inline uint32_t param_notify_collect(ParamNotify *notify,
+                                            float *values) {
+    uint32_t numChanged = 0;
+    for (uint32_t w = 0; w < PARAM_NOTIFY_WORDS; w++) {
+        if (atomic_load_relaxed_u32(&notify->dirty[w]) == 0)
+            continue;
+        uint32_t bits = atomic_exchange_acquire_u32(&notify->dirty[w], 0);
+        while (bits) {
+            const uint32_t param = w * 32 + bits_lowest_set(bits);
+            bits &= bits - 1;
+            uint32_t v = atomic_load_acquire_u32(&notify->latest[param]);
+            memcpy(&values[param], &v, sizeof(v));
+            numChanged++;
+        }
+    }
+    return numChanged;
+}
+
+// Any thread. Copies the latest value of every parameter changed since the
+// GUI last collected into 'values', leaving them for the GUI to collect too
+static inline void param_notify_peek(const ParamNotify *notify,
+                                     float *values) {
+    for (uint32_t w = 0; w < PARAM_NOTIFY_WORDS; w++) {
+        uint32_t bits = atomic_load_acquire_u32(&notify->dirty[w]);
+        while (bits) {
+            const uint32_t param = w * 32 + bits_lowest_set(bits);
+            bits &= bits - 1;
+            uint32_t v = atomic_load_relaxed_u32(&notify->latest[param]);
+            memcpy(&values[param], &v, sizeof(v));
+        }
+    }
+}
+
+#endif // PARAM_NOTIFY_H
@@ -0,0 +1,213 @@
+#ifndef PARAMS_H
+#define PARAMS_H
+
+// Parameter table
+// Every parameter is declared once below. The index enum, the host facing IDs
+// and the ranges, defaults, flags and names are all generated from it, so
+// adding a parameter is a one line change.
+//
+// X(index, ID, name, min, max, default, flags, smoothing, smoothingMs)
+// - index: enum constant the DSP uses to read its values without any lookup
+// - ID: stable ID seen by hosts and stored in presets. Never change or reuse it
+// - smoothing: SmoothMode applied to changes on the audio thread, see
+//   smoother.h
+// - smoothingMs: length of the ramp
+
+#include <cplug.h>
+
+#include "voices.h"
+
+#define PARAM_AUTOMATABLE CPLUG_FLAG_PARAMETER_IS_AUTOMATABLE
+#define PARAM_INTEGER     CPLUG_FLAG_PARAMETER_IS_INTEGER
+#define PARAM_BOOL        CPLUG_FLAG_PARAMETER_IS_BOOL
+
+enum SmoothMode {
+    SMOOTH_NONE = 0,
+    SMOOTH_LINEAR,
+    SMOOTH_ONE_POLE,
+    // For frequencies and other values that are perceived logarithmically
+    SMOOTH_MULTIPLICATIVE,
+};
+
+// Modulation sources, see mod_matrix.h. LFOs are bipolar, the others go from 0
+// to 1
+enum ModSource {
+    MOD_SOURCE_NONE = 0,
+    MOD_SOURCE_LFO1, // sine
+    MOD_SOURCE_LFO2, // triangle
+    MOD_SOURCE_MACRO1,
+    MOD_SOURCE_MACRO2,
+    MOD_SOURCE_MACRO3,
+    MOD_SOURCE_MACRO4,
+    MOD_SOURCE_MOD_WHEEL,
+    // Per voice from here on
+    MOD_SOURCE_VELOCITY,
+    MOD_SOURCE_KEY, // 0 at the lowest MIDI note, 1 at the highest
+    MOD_SOURCE_PRESSURE,
+    MOD_SOURCE_COUNT,
+};
+
+// Modulation destinations, the parameters that read their modulation, see
+// mod_matrix.h. The value of PARAM_MOD*_DEST, so it's kept in presets: only
+// ever append
+enum ModDest {
+    MOD_DEST_PITCH = 0,
+    MOD_DEST_LEVEL,
+    MOD_DEST_GAIN,
+    MOD_DEST_DRIVE,
+    MOD_DEST_VOICES,
+    MOD_DEST_WAVEFORM,
+    MOD_DEST_ATTACK,
+    MOD_DEST_DECAY,
+    MOD_DEST_SUSTAIN,
+    MOD_DEST_RELEASE,
+    MOD_DEST_ARPEGGIATOR,
+    MOD_DEST_COUNT,
+};
+
+// Offline renders at the highest quality, whatever it costs: exact
+// oscillators, sample accurate events, every worker thread and at least
+// PLUGIN_OFFLINE_OVERSAMPLING. The threads and the oversampling, which changes
+// the latency, follow the mode the host last activated the plugin with.
+// Realtime keeps to the settings. Auto is Realtime until the host is seen
+// rendering faster than real time, see render_mode.h, then Offline but for
+// those two: the oversampling stays as the host read its latency, and there
+// are only the threads PARAM_THREADS started
+enum RenderMode {
+    RENDER_MODE_AUTO = 0,
+    RENDER_MODE_REALTIME,
+    RENDER_MODE_OFFLINE,
+    RENDER_MODE_COUNT,
+};
+
+// https://utf8everywhere.org/
+// UTF8    = 1 byte per character
+// Приве́т  = 2 bytes
+// नमस्ते     = 3 bytes
+// שלום = 3 בייטים
+// 🐨       = 4 bytes
+#define PARAM_TABLE(X)                                                         \
+    X(PARAM_FLOAT, 'pf32', "Parameter Float", 0.0f, 100.0f, 50.0f,             \
+      PARAM_AUTOMATABLE, SMOOTH_ONE_POLE, 50)                                  \
+    X(PARAM_INT, 'pi32', "Parameter Int", 2.0f, 5.0f, 2.0f,                    \
+      PARAM_AUTOMATABLE | PARAM_INTEGER, SMOOTH_NONE, 0)                       \
+    X(PARAM_BOOL_DEMO, 'bool', "Parameter Bool", 0.0f, 1.0f, 0.0f, PARAM_BOOL, \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_UTF8, 'utf8', "UTF8 Приве́т नमस्ते שָׁלוֹם 🐨", 0.0f, 1.0f, 0.0f,   \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    X(PARAM_VOICES, 'poly', "Voices", 1.0f, MAX_VOICES, 64.0f,                 \
+      PARAM_AUTOMATABLE | PARAM_INTEGER, SMOOTH_NONE, 0)                       \
+    X(PARAM_VOICE_STEALING, 'stel', "Voice Stealing", 0.0f,                    \
+      VOICE_STEAL_COUNT - 1, VOICE_STEAL_OLDEST, PARAM_INTEGER,                \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_WAVEFORM, 'wave', "Waveform", 0.0f, WAVE_COUNT - 1, WAVE_SINE,     \
+      PARAM_AUTOMATABLE | PARAM_INTEGER, SMOOTH_NONE, 0)                       \
+    X(PARAM_GAIN, 'gain', "Output Gain", -60.0f, 6.0f, 0.0f,                   \
+      PARAM_AUTOMATABLE, SMOOTH_LINEAR, 20)                                    \
+    X(PARAM_DRIVE, 'drve', "Drive", 0.0f, 24.0f, 0.0f, PARAM_AUTOMATABLE,      \
+      SMOOTH_LINEAR, 20)                                                       \
+    /* Changes the latency: applied when the host next activates the plugin */ \
+    X(PARAM_OVERSAMPLING, 'ovsm', "Oversampling", 0.0f, 3.0f, 0.0f,            \
+      PARAM_INTEGER, SMOOTH_NONE, 0)                                           \
+    /* Sub-block events are snapped to: sample accurate, or 8 to 64 frames */  \
+    X(PARAM_EVENT_GRID, 'grid', "Event Grid", 0.0f, 4.0f, 0.0f, PARAM_INTEGER, \
+      SMOOTH_NONE, 0)                                                          \
+    /* Off, or a step every 1/4 to 1/32 note */                                \
+    X(PARAM_ARPEGGIATOR, 'arpg', "Arpeggiator", 0.0f, 4.0f, 0.0f,              \
+      PARAM_AUTOMATABLE | PARAM_INTEGER, SMOOTH_NONE, 0)                       \
+    /* Played by every voice, on top of expression and modulation */           \
+    X(PARAM_PITCH, 'ptch', "Pitch", -24.0f, 24.0f, 0.0f, PARAM_AUTOMATABLE,    \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_LEVEL, 'levl', "Voice Level", -24.0f, 12.0f, 0.0f,                 \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    /* Modulation sources and the routings of the matrix, see mod_matrix.h */  \
+    X(PARAM_LFO1_RATE, 'lfo1', "LFO 1 Rate", 0.05f, 20.0f, 5.0f,               \
+      PARAM_AUTOMATABLE, SMOOTH_MULTIPLICATIVE, 50)                            \
+    X(PARAM_LFO2_RATE, 'lfo2', "LFO 2 Rate", 0.05f, 20.0f, 0.5f,               \
+      PARAM_AUTOMATABLE, SMOOTH_MULTIPLICATIVE, 50)                            \
+    X(PARAM_MACRO1, 'mac1', "Macro 1", 0.0f, 1.0f, 0.0f, PARAM_AUTOMATABLE,    \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_MACRO2, 'mac2', "Macro 2", 0.0f, 1.0f, 0.0f, PARAM_AUTOMATABLE,    \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_MACRO3, 'mac3', "Macro 3", 0.0f, 1.0f, 0.0f, PARAM_AUTOMATABLE,    \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_MACRO4, 'mac4', "Macro 4", 0.0f, 1.0f, 0.0f, PARAM_AUTOMATABLE,    \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_MOD1_SOURCE, 'm1sr', "Mod 1 Source", 0.0f,                         \
+      MOD_SOURCE_COUNT - 1, MOD_SOURCE_NONE, PARAM_INTEGER, SMOOTH_NONE, 0)    \
+    X(PARAM_MOD1_DEST, 'm1ds', "Mod 1 Destination", 0.0f,                      \
+      MOD_DEST_COUNT - 1, MOD_DEST_PITCH, PARAM_INTEGER, SMOOTH_NONE, 0)       \
+    X(PARAM_MOD1_AMOUNT, 'm1am', "Mod 1 Amount", -1.0f, 1.0f, 0.0f,            \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    X(PARAM_MOD2_SOURCE, 'm2sr', "Mod 2 Source", 0.0f,                         \
+      MOD_SOURCE_COUNT - 1, MOD_SOURCE_NONE, PARAM_INTEGER, SMOOTH_NONE, 0)    \
+    X(PARAM_MOD2_DEST, 'm2ds', "Mod 2 Destination", 0.0f,                      \
+      MOD_DEST_COUNT - 1, MOD_DEST_PITCH, PARAM_INTEGER, SMOOTH_NONE, 0)       \
+    X(PARAM_MOD2_AMOUNT, 'm2am', "Mod 2 Amount", -1.0f, 1.0f, 0.0f,            \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    X(PARAM_MOD3_SOURCE, 'm3sr', "Mod 3 Source", 0.0f,                         \
+      MOD_SOURCE_COUNT - 1, MOD_SOURCE_NONE, PARAM_INTEGER, SMOOTH_NONE, 0)    \
+    X(PARAM_MOD3_DEST, 'm3ds', "Mod 3 Destination", 0.0f,                      \
+      MOD_DEST_COUNT - 1, MOD_DEST_PITCH, PARAM_INTEGER, SMOOTH_NONE, 0)       \
+    X(PARAM_MOD3_AMOUNT, 'm3am', "Mod 3 Amount", -1.0f, 1.0f, 0.0f,            \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    X(PARAM_MOD4_SOURCE, 'm4sr', "Mod 4 Source", 0.0f,                         \
+      MOD_SOURCE_COUNT - 1, MOD_SOURCE_NONE, PARAM_INTEGER, SMOOTH_NONE, 0)    \
+    X(PARAM_MOD4_DEST, 'm4ds', "Mod 4 Destination", 0.0f,                      \
+      MOD_DEST_COUNT - 1, MOD_DEST_PITCH, PARAM_INTEGER, SMOOTH_NONE, 0)       \
+    X(PARAM_MOD4_AMOUNT, 'm4am', "Mod 4 Amount", -1.0f, 1.0f, 0.0f,            \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    /* Envelope of every voice, times in ms. Read as each segment starts */    \
+    X(PARAM_ATTACK, 'attk', "Attack", 0.0f, 5000.0f, 2.0f, PARAM_AUTOMATABLE,  \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_DECAY, 'decy', "Decay", 0.0f, 10000.0f, 300.0f, PARAM_AUTOMATABLE, \
+      SMOOTH_NONE, 0)                                                          \
+    X(PARAM_SUSTAIN, 'sust', "Sustain", 0.0f, 100.0f, 70.0f,                   \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    X(PARAM_RELEASE, 'rels', "Release", 0.0f, 10000.0f, 200.0f,                \
+      PARAM_AUTOMATABLE, SMOOTH_NONE, 0)                                       \
+    /* Threads rendering the voices, the audio thread's included. Started      \
+       when the host next activates the plugin */                              \
+    X(PARAM_THREADS, 'thrd', "Render Threads", 1.0f, PLUGIN_MAX_WORKERS + 1,   \
+      1.0f, PARAM_INTEGER, SMOOTH_NONE, 0)                                     \
+    /* Quality of the DSP, see RenderMode */                                   \
+    X(PARAM_RENDER_MODE, 'rmod', "Render Mode", 0.0f, RENDER_MODE_COUNT - 1,   \
+      RENDER_MODE_AUTO, PARAM_INTEGER, SMOOTH_NONE, 0)
+
+enum ParamIndex {
+#define X(index, id, name, min, max, def, flags, smoothing, smoothingMs) index,
+    PARAM_TABLE(X)
+#undef X
+        NUM_PARAMS
+};
+
+static const uint32_t PARAM_IDS[] = {
+#define X(index, id, name, min, max, def, flags, smoothing, smoothingMs) id,
+    PARAM_TABLE(X)
+#undef X
+};
+
+typedef struct ParamInfo {
+    float min;
+    float max;
+    float defaultValue;
+    int flags;
+    const char *name;
+    int smoothing;
+    float smoothingMs;
+} ParamInfo;
+
+static const ParamInfo PARAM_INFO[] = {
+#define X(index, id, name, min, max, def, flags, smoothing, smoothingMs)       \
+    {min, max, def, flags, name, smoothing, smoothingMs},
+    PARAM_TABLE(X)
+#undef X
+};
+
+// Complete set of parameter values, handed from the main thread to the audio
+// thread in one go when a state or preset is loaded
+typedef struct ParamSnapshot {
+    float values[NUM_PARAMS];
+} ParamSnapshot;
+
+#endif // PARAMS_H
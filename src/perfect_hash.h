@@ -0,0 +1,138 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+// Minimal perfect hash for a fixed set of 32bit keys ("hash and displace")
+// Keys are first split into small buckets. Each bucket is then given a seed
+// under which all of its keys land in unused slots. A lookup costs two hashes,
+// two loads and one compare, independent of the number of keys, and never
+// probes. Building allocates and belongs on the main thread; lookups are safe
+// anywhere.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct PerfectHash {
+    uint32_t numKeys;
+    uint32_t bucketMask;
+    uint32_t slotMask;
+    uint32_t *seeds; // per bucket
+    uint32_t *slots; // key index, or numKeys for an empty slot
+} PerfectHash;
+
+static inline uint32_t perfect_hash_mix(uint32_t x, uint32_t seed) {
+    x ^= seed;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint32_t perfect_hash_next_pow2(uint32_t x) {
+    uint32_t p = 1;
+    while (p < x)
+        p <<= 1;
+    return p;
+}
+
+// Returns the index of 'key' in 'keys', or 'numKeys' when it isn't one of them
+static inline uint32_t perfect_hash_find(const PerfectHash *hash,
+                                         const uint32_t *keys, uint32_t key) {
+    uint32_t bucket = perfect_hash_mix(key, 0) & hash->bucketMask;
+    uint32_t slot = perfect_hash_mix(key, hash->seeds[bucket]) & hash->slotMask;
+    uint32_t idx = hash->slots[slot];
+    return idx < hash->numKeys && keys[idx] == key ? idx : hash->numKeys;
+}
+
+static inline void perfect_hash_free(PerfectHash *hash) {
+    free(hash->seeds);
+    free(hash->slots);
+    memset(hash, 0, sizeof(*hash));
+}
+
+// Returns false if 'keys' contains duplicates
+static inline bool perfect_hash_build(PerfectHash *hash, const uint32_t *keys,
+                                      uint32_t numKeys) {
+    enum { MAX_SEED_ATTEMPTS = 1 << 20 };
+
+    memset(hash, 0, sizeof(*hash));
+    const uint32_t numBuckets = perfect_hash_next_pow2(numKeys / 4 + 1);
+    const uint32_t numSlots = perfect_hash_next_pow2(numKeys + numKeys / 4 + 1);
+    hash->numKeys = numKeys;
+    hash->bucketMask = numBuckets - 1;
+    hash->slotMask = numSlots - 1;
+    hash->seeds = (uint32_t *)calloc(numBuckets, sizeof(uint32_t));
+    hash->slots = (uint32_t *)malloc(sizeof(uint32_t) * numSlots);
+    for (uint32_t i = 0; i < numSlots; i++)
+        hash->slots[i] = numKeys;
+
+    // Group key indices by bucket (counting sort)
+    uint32_t *bucketStart =
+        (uint32_t *)calloc(numBuckets + 1, sizeof(uint32_t));
+    uint32_t *bucketKeys = (uint32_t *)malloc(sizeof(uint32_t) * (numKeys + 1));
+    uint32_t *order = (uint32_t *)malloc(sizeof(uint32_t) * numBuckets);
+    uint32_t *tried = (uint32_t *)malloc(sizeof(uint32_t) * (numKeys + 1));
+    for (uint32_t i = 0; i < numKeys; i++)
+        bucketStart[(perfect_hash_mix(keys[i], 0) & hash->bucketMask) + 1]++;
+    uint32_t maxBucketSize = 0;
+    for (uint32_t b = 0; b < numBuckets; b++) {
+        if (bucketStart[b + 1] > maxBucketSize)
+            maxBucketSize = bucketStart[b + 1];
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    {
+        uint32_t *fill = (uint32_t *)malloc(sizeof(uint32_t) * numBuckets);
+        memcpy(fill, bucketStart, sizeof(uint32_t) * numBuckets);
+        for (uint32_t i = 0; i < numKeys; i++) {
+            uint32_t b = perfect_hash_mix(keys[i], 0) & hash->bucketMask;
+            bucketKeys[fill[b]++] = i;
+        }
+        free(fill);
+    }
+
+    // Place the largest buckets first, while the table is still empty
+    uint32_t numOrdered = 0;
+    for (uint32_t size = maxBucketSize; size > 0; size--)
+        for (uint32_t b = 0; b < numBuckets; b++)
+            if (bucketStart[b + 1] - bucketStart[b] == size)
+                order[numOrdered++] = b;
+
+    bool ok = true;
+    for (uint32_t o = 0; o < numOrdered && ok; o++) {
+        const uint32_t b = order[o];
+        const uint32_t first = bucketStart[b];
+        const uint32_t size = bucketStart[b + 1] - first;
+
+        ok = false;
+        for (uint32_t seed = 1; seed < MAX_SEED_ATTEMPTS && !ok; seed++) {
+            ok = true;
+            for (uint32_t k = 0; k < size && ok; k++) {
+                uint32_t slot =
+                    perfect_hash_mix(keys[bucketKeys[first + k]], seed) &
+                    hash->slotMask;
+                ok = hash->slots[slot] == numKeys;
+                for (uint32_t j = 0; j < k && ok; j++)
+                    ok = tried[j] != slot;
+                tried[k] = slot;
+            }
+            if (ok) {
+                hash->seeds[b] = seed;
+                for (uint32_t k = 0; k < size; k++)
+                    hash->slots[tried[k]] = bucketKeys[first + k];
+            }
+        }
+    }
+
+    free(bucketStart);
+    free(bucketKeys);
+    free(order);
+    free(tried);
+    if (!ok)
+        perfect_hash_free(hash);
+    return ok;
+}
+
+#endif // PERFECT_HASH_H
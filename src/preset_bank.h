@@ -0,0 +1,246 @@
+#ifndef PRESET_BANK_H
+#define PRESET_BANK_H
+
+// Preset bank
+// A single file holding many presets, memory mapped and decoded once when it's
+// opened. Every preset becomes an immutable ParamSnapshot, so selecting one
+// later costs nothing but publishing a pointer to it.
+//
+//   u32 magic 'CPBK'
+//   u32 version
+//   u32 count
+//   'count' times {char name[PRESET_NAME_SIZE], u32 offset, u32 size}
+//   payloads: each one a complete state as written by cplug_saveState, see
+//   state.h
+//
+// Offsets are from the start of the file. Names are NUL terminated and read in
+// place from the mapping. A preset that fails to decode, or is missing
+// parameters, gets their default values.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "params.h"
+#include "state.h"
+
+#define PRESET_BANK_MAGIC   'CPBK'
+#define PRESET_BANK_VERSION 1
+#define PRESET_NAME_SIZE    32
+#define PRESET_ENTRY_SIZE   (PRESET_NAME_SIZE + 8)
+#define PRESET_HEADER_SIZE  12
+
+typedef struct PresetBank {
+    const uint8_t *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+
+    uint32_t numPresets;
+    ParamSnapshot *snapshots; // immutable once opened
+
+    // Owned by the plugin: banks replaced while the audio thread may still be
+    // reading them wait here until it has finished a process call
+    struct PresetBank *nextRetired;
+    uint32_t freeAfterProcessCount;
+} PresetBank;
+
+static inline const char *preset_bank_name(const PresetBank *bank,
+                                           uint32_t index) {
+    return (const char *)bank->data + PRESET_HEADER_SIZE +
+           index * PRESET_ENTRY_SIZE;
+}
+
+static inline bool preset_bank_map(PresetBank *bank, const char *path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    bank->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (bank->mapping == NULL)
+        return false;
+    bank->data =
+        (const uint8_t *)MapViewOfFile(bank->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (bank->data == NULL) {
+        CloseHandle(bank->mapping);
+        return false;
+    }
+    bank->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    bank->data = (const uint8_t *)data;
+    bank->size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+static inline void preset_bank_unmap(PresetBank *bank) {
+#ifdef _WIN32
+    UnmapViewOfFile(bank->data);
+    CloseHandle(bank->mapping);
+#else
+    munmap((void *)bank->data, bank->size);
+#endif
+}
+
+// Serves one payload of the mapping to state_read_all
+typedef struct PresetBankStream {
+    const uint8_t *pos;
+    const uint8_t *end;
+} PresetBankStream;
+
+static inline int64_t preset_bank_stream_read(const void *stateCtx,
+                                              void *readPos,
+                                              size_t maxBytesToRead) {
+    PresetBankStream *stream = (PresetBankStream *)stateCtx;
+    size_t n = (size_t)(stream->end - stream->pos);
+    if (n > maxBytesToRead)
+        n = maxBytesToRead;
+    memcpy(readPos, stream->pos, n);
+    stream->pos += n;
+    return (int64_t)n;
+}
+
+static inline void preset_bank_close(PresetBank *bank) {
+    preset_bank_unmap(bank);
+    free(bank->snapshots);
+    free(bank);
+}
+
+// Maps 'path' and decodes every preset, reporting each parameter to
+// 'paramProc' with the preset's ParamSnapshot as 'user'. Main thread only.
+// Returns NULL if the file can't be mapped or isn't a bank
+static inline PresetBank *preset_bank_open(const char *path,
+                                           StateParamProc paramProc) {
+    PresetBank *bank = (PresetBank *)calloc(1, sizeof(PresetBank));
+    if (bank == NULL)
+        return NULL;
+    if (!preset_bank_map(bank, path)) {
+        free(bank);
+        return NULL;
+    }
+
+    uint32_t count = 0;
+    if (bank->size >= PRESET_HEADER_SIZE &&
+        state_get_u32(bank->data) == PRESET_BANK_MAGIC &&
+        state_get_u32(bank->data + 4) <= PRESET_BANK_VERSION)
+        count = state_get_u32(bank->data + 8);
+    if (count == 0 || count > (bank->size - PRESET_HEADER_SIZE) /
+                                  PRESET_ENTRY_SIZE) {
+        preset_bank_unmap(bank);
+        free(bank);
+        return NULL;
+    }
+
+    bank->snapshots = (ParamSnapshot *)malloc(sizeof(ParamSnapshot) * count);
+    if (bank->snapshots == NULL) {
+        preset_bank_close(bank);
+        return NULL;
+    }
+    bank->numPresets = count;
+
+    ParamSnapshot defaults;
+    for (uint32_t p = 0; p < NUM_PARAMS; p++)
+        defaults.values[p] = PARAM_INFO[p].defaultValue;
+
+    for (uint32_t i = 0; i < count; i++) {
+        ParamSnapshot *snapshot = &bank->snapshots[i];
+        *snapshot = defaults;
+
+        const uint8_t *entry =
+            bank->data + PRESET_HEADER_SIZE + i * PRESET_ENTRY_SIZE;
+        if (memchr(entry, 0, PRESET_NAME_SIZE) == NULL) {
+            // Names are used in place, so they must be terminated
+            preset_bank_close(bank);
+            return NULL;
+        }
+        const uint32_t offset = state_get_u32(entry + PRESET_NAME_SIZE);
+        const uint32_t size = state_get_u32(entry + PRESET_NAME_SIZE + 4);
+        if (offset > bank->size || size > bank->size - offset)
+            continue;
+
+        PresetBankStream stream = {bank->data + offset,
+                                   bank->data + offset + size};
+        StateResult result = state_read_all(&stream, preset_bank_stream_read,
+                                            paramProc, snapshot);
+        if (result != STATE_OK && result != STATE_LEGACY_OK)
+            *snapshot = defaults;
+    }
+    return bank;
+}
+
+static inline int64_t preset_bank_file_write(const void *stateCtx,
+                                             void *writePos,
+                                             size_t numBytesToWrite) {
+    return (int64_t)fwrite(writePos, 1, numBytesToWrite, (FILE *)stateCtx);
+}
+
+// Writes 'count' presets to a new bank file at 'path'. Every preset stores
+// all parameters
+static inline bool preset_bank_write(const char *path, const char *const *names,
+                                     const ParamSnapshot *snapshots,
+                                     uint32_t count) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+
+    uint8_t bytes[PRESET_ENTRY_SIZE];
+    const uint32_t payloadSize = state_size(NUM_PARAMS);
+    uint32_t offset = PRESET_HEADER_SIZE + count * PRESET_ENTRY_SIZE;
+    bool ok = true;
+
+    state_put_u32(bytes, PRESET_BANK_MAGIC);
+    state_put_u32(bytes + 4, PRESET_BANK_VERSION);
+    state_put_u32(bytes + 8, count);
+    ok &= fwrite(bytes, 1, PRESET_HEADER_SIZE, file) == PRESET_HEADER_SIZE;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        memset(bytes, 0, sizeof(bytes));
+        strncpy((char *)bytes, names[i], PRESET_NAME_SIZE - 1);
+        state_put_u32(bytes + PRESET_NAME_SIZE, offset);
+        state_put_u32(bytes + PRESET_NAME_SIZE + 4, payloadSize);
+        ok &= fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+        offset += payloadSize;
+    }
+
+    for (uint32_t i = 0; i < count && ok; i++)
+        ok &= state_write_all(file, preset_bank_file_write, PARAM_IDS,
+                              snapshots[i].values, NUM_PARAMS);
+
+    ok &= fclose(file) == 0;
+    return ok;
+}
+
+#endif // PRESET_BANK_H
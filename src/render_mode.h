@@ -0,0 +1,58 @@
+#ifndef RENDER_MODE_H
+#define RENDER_MODE_H
+
+// Offline rendering detection
+// CPLUG doesn't pass on whether the host is playing live or bouncing, so the
+// Auto render mode, see RenderMode, tells from the host's clock. Live, blocks
+// come at the rate they play, give or take what the host renders ahead.
+// Bouncing, they come as fast as they can be rendered. Over every window of
+// RENDER_MODE_WINDOW_SECONDS of audio, the host is taken to be offline when
+// the window took less than 1 / RENDER_MODE_OFFLINE_SPEED of that on the
+// monotonic clock of clock.h. A bounce slower than that is taken for live
+// playback, which only keeps it to the realtime settings.
+//
+// Audio thread only, but for render_mode_detector_reset().
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RENDER_MODE_WINDOW_SECONDS 1.0
+#define RENDER_MODE_OFFLINE_SPEED  2.0
+
+typedef struct RenderModeDetector {
+    // Time the window started at, in seconds. 0 before any block
+    double windowStart;
+    // Frames processed since
+    uint64_t windowFrames;
+    bool offline;
+} RenderModeDetector;
+
+// Starts over, taking the host to be live. Whenever the audio thread is idle,
+// as for a new sample rate
+static inline void render_mode_detector_reset(RenderModeDetector *detector) {
+    detector->windowStart = 0;
+    detector->windowFrames = 0;
+    detector->offline = false;
+}
+
+// Counts a block of 'numFrames' starting at time 'now', in seconds of
+// clock_now_ms(), and returns whether the host renders offline
+static inline bool render_mode_detect(RenderModeDetector *detector,
+                                      double now, uint32_t numFrames,
+                                      float sampleRate) {
+    if (detector->windowStart == 0) {
+        detector->windowStart = now;
+        detector->windowFrames = 0;
+    } else if ((double)detector->windowFrames >=
+               RENDER_MODE_WINDOW_SECONDS * sampleRate) {
+        const double audio = (double)detector->windowFrames / sampleRate;
+        detector->offline = audio > (now - detector->windowStart) *
+                                        RENDER_MODE_OFFLINE_SPEED;
+        detector->windowStart = now;
+        detector->windowFrames = 0;
+    }
+    detector->windowFrames += numFrames;
+    return detector->offline;
+}
+
+#endif // RENDER_MODE_H
@@ -0,0 +1,50 @@
+#ifndef SATURATOR_H
+#define SATURATOR_H
+
+// Soft clipper for the drive stage
+// tanh approximated by a rational function that meets +-1 with zero slope at
+// +-3, so it is smooth everywhere. Being nonlinear it creates harmonics above
+// the input, which is why it runs inside the oversampler.
+
+#include <stdint.h>
+
+#include "osc.h"
+
+static inline float saturator_sample(float x) {
+    x = x < -3.0f ? -3.0f : x;
+    x = x > 3.0f ? 3.0f : x;
+    const float x2 = x * x;
+    return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+}
+
+// Clips 'buf' in place after a gain ramping from 'startGain' to 'endGain'
+static inline void saturator_process(float *buf, uint32_t numFrames,
+                                     float startGain, float endGain) {
+    const float step = (endGain - startGain) / (float)numFrames;
+    uint32_t i = 0;
+#if OSC_X86
+    // Compilers won't vectorise the clamps in the scalar version without
+    // fast math
+    const __m128 lo = _mm_set1_ps(-3.0f);
+    const __m128 hi = _mm_set1_ps(3.0f);
+    const __m128 c27 = _mm_set1_ps(27.0f);
+    const __m128 c9 = _mm_set1_ps(9.0f);
+    const __m128 vstep = _mm_set1_ps(step * 4);
+    __m128 gain = _mm_add_ps(_mm_set1_ps(startGain),
+                             _mm_mul_ps(_mm_set1_ps(step),
+                                        _mm_setr_ps(0, 1, 2, 3)));
+    for (; i + 4 <= numFrames; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(buf + i), gain);
+        x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+        const __m128 x2 = _mm_mul_ps(x, x);
+        const __m128 num = _mm_mul_ps(x, _mm_add_ps(c27, x2));
+        const __m128 den = _mm_add_ps(c27, _mm_mul_ps(c9, x2));
+        _mm_storeu_ps(buf + i, _mm_div_ps(num, den));
+        gain = _mm_add_ps(gain, vstep);
+    }
+#endif
+    for (; i < numFrames; i++)
+        buf[i] = saturator_sample(buf[i] * (startGain + step * (float)i));
+}
+
+#endif // SATURATOR_H
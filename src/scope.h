@@ -0,0 +1,313 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+// Audio -> GUI scope and spectrum streaming
+// The audio thread cuts its output into blocks of SCOPE_BLOCK_FRAMES frames.
+// Each block holds the min and max of every SCOPE_PEAK_FRAMES frames, for the
+// waveform view, and the audio averaged over pairs of frames, for the
+// spectrum. Blocks go round a ring of SCOPE_NUM_BLOCKS, always overwriting the
+// oldest: the audio thread never waits for the GUI, never fails and never
+// allocates, and a GUI that falls behind simply skips to the newest blocks.
+//
+// Every slot of the ring is guarded by a sequence number, a seqlock: 2n + 1
+// while block 'n' is being written, 2n + 2 once it's complete. The GUI reads
+// blocks in place, without copying them first, and checks the sequence number
+// again afterwards. A block the audio thread started overwriting meanwhile is
+// discarded, see scope_read_begin().
+//
+// The spectrum is computed on the GUI thread by ScopeView, at a rate the user
+// picks. Run 'cplug_example_bench scope' to measure the audio thread's cost.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "atomics.h"
+
+#define SCOPE_BLOCK_FRAMES 512
+#define SCOPE_PEAK_FRAMES  64
+#define SCOPE_DECIMATION   2
+#define SCOPE_NUM_PEAKS    (SCOPE_BLOCK_FRAMES / SCOPE_PEAK_FRAMES)
+#define SCOPE_NUM_SAMPLES  (SCOPE_BLOCK_FRAMES / SCOPE_DECIMATION)
+// About 0.7 s at 48 kHz. Power of 2
+#define SCOPE_NUM_BLOCKS 64
+
+typedef struct ScopeBlock {
+    volatile uint32_t seq;
+    float min[SCOPE_NUM_PEAKS];
+    float max[SCOPE_NUM_PEAKS];
+    // At the host rate / SCOPE_DECIMATION
+    float samples[SCOPE_NUM_SAMPLES];
+} ScopeBlock;
+
+typedef struct ScopeRing {
+    ScopeBlock blocks[SCOPE_NUM_BLOCKS];
+    // Blocks completed so far. Written by the audio thread, read by anyone
+    volatile uint32_t head;
+    char pad0[CACHE_LINE_SIZE - sizeof(uint32_t)];
+
+    // Audio thread only: the block being filled
+    uint32_t fill; // frames
+    float peakMin, peakMax;
+    float previous; // first frame of an unfinished pair
+} ScopeRing;
+
+static inline void scope_ring_init(ScopeRing *ring) {
+    memset(ring, 0, sizeof(*ring));
+    // Odd, as if being written: a 0 would pass for a complete block -1
+    for (uint32_t i = 0; i < SCOPE_NUM_BLOCKS; i++)
+        ring->blocks[i].seq = 1;
+}
+
+/* --------------------------------------------------------------------------
+ * Audio thread */
+
+// Publishes 'numFrames' frames of 'in'. Wait-free, touches only the ring
+static inline void scope_write(ScopeRing *ring, const float *in,
+                               uint32_t numFrames) {
+    while (numFrames > 0) {
+        const uint32_t n = atomic_load_relaxed_u32(&ring->head);
+        ScopeBlock *block = &ring->blocks[n & (SCOPE_NUM_BLOCKS - 1)];
+        if (ring->fill == 0) {
+            // Readers of the block this slot held stop trusting it before any
+            // of it changes
+            atomic_store_relaxed_u32(&block->seq, 2 * n + 1);
+            atomic_fence_release();
+        }
+
+        // Up to the end of the current peak
+        uint32_t count = SCOPE_PEAK_FRAMES - ring->fill % SCOPE_PEAK_FRAMES;
+        count = count < numFrames ? count : numFrames;
+        float lo = ring->fill % SCOPE_PEAK_FRAMES ? ring->peakMin : in[0];
+        float hi = ring->fill % SCOPE_PEAK_FRAMES ? ring->peakMax : in[0];
+        for (uint32_t i = 0; i < count; i++) {
+            lo = in[i] < lo ? in[i] : lo;
+            hi = in[i] > hi ? in[i] : hi;
+        }
+        // SCOPE_PEAK_FRAMES is even, so pairs never straddle two peaks
+        uint32_t i = 0;
+        if (ring->fill & 1) {
+            block->samples[ring->fill / 2] = 0.5f * (ring->previous + in[0]);
+            ring->fill++;
+            i++;
+        }
+        for (; i + 2 <= count; i += 2, ring->fill += 2)
+            block->samples[ring->fill / 2] = 0.5f * (in[i] + in[i + 1]);
+        if (i < count) {
+            ring->previous = in[i];
+            ring->fill++;
+        }
+        ring->peakMin = lo;
+        ring->peakMax = hi;
+        if (ring->fill % SCOPE_PEAK_FRAMES == 0) {
+            block->min[ring->fill / SCOPE_PEAK_FRAMES - 1] = lo;
+            block->max[ring->fill / SCOPE_PEAK_FRAMES - 1] = hi;
+        }
+
+        if (ring->fill == SCOPE_BLOCK_FRAMES) {
+            atomic_store_release_u32(&block->seq, 2 * n + 2);
+            atomic_store_release_u32(&ring->head, n + 1);
+            ring->fill = 0;
+        }
+        in += count;
+        numFrames -= count;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Reading, from any thread */
+
+// Number of blocks completed. The newest is block 'head - 1'
+static inline uint32_t scope_head(const ScopeRing *ring) {
+    return atomic_load_acquire_u32(&ring->head);
+}
+
+// Block 'n' to be read in place, or NULL when it was already overwritten or
+// isn't complete yet. The audio thread may overwrite it at any point while it
+// is being read, so what was read can only be used once scope_read_end()
+// returned true
+static inline const ScopeBlock *scope_read_begin(const ScopeRing *ring,
+                                                 uint32_t n) {
+    const ScopeBlock *block = &ring->blocks[n & (SCOPE_NUM_BLOCKS - 1)];
+    return atomic_load_acquire_u32(&block->seq) == 2 * n + 2 ? block : NULL;
+}
+
+static inline bool scope_read_end(const ScopeRing *ring, uint32_t n) {
+    atomic_fence_acquire();
+    const ScopeBlock *block = &ring->blocks[n & (SCOPE_NUM_BLOCKS - 1)];
+    return atomic_load_relaxed_u32(&block->seq) == 2 * n + 2;
+}
+
+/* --------------------------------------------------------------------------
+ * GUI analysis */
+
+// Spectrum of the newest SCOPE_FFT_SIZE samples, 8 blocks
+#define SCOPE_FFT_SIZE        2048
+#define SCOPE_WAVE_BLOCKS     32
+#define SCOPE_WAVE_POINTS     (SCOPE_WAVE_BLOCKS * SCOPE_NUM_PEAKS)
+#define SCOPE_SPECTRUM_POINTS 256
+#define SCOPE_SPECTRUM_MIN_HZ 20.0
+#define SCOPE_FLOOR_DB        -120.0f
+
+typedef struct ScopeView {
+    // Analyses per second. 0 freezes the view
+    float refreshHz;
+    double lastUpdateMs;
+    uint32_t lastHead;
+
+    // Newest last. Points whose block couldn't be read are 0
+    float waveMin[SCOPE_WAVE_POINTS];
+    float waveMax[SCOPE_WAVE_POINTS];
+    // dB relative to a full scale sine, log spaced from SCOPE_SPECTRUM_MIN_HZ
+    // to Nyquist
+    float spectrumDb[SCOPE_SPECTRUM_POINTS];
+    // Blocks the audio thread overwrote while they were being read
+    uint32_t numTorn;
+
+    float re[SCOPE_FFT_SIZE];
+    float im[SCOPE_FFT_SIZE];
+    float window[SCOPE_FFT_SIZE];
+    float cosTable[SCOPE_FFT_SIZE / 2];
+    float sinTable[SCOPE_FFT_SIZE / 2];
+} ScopeView;
+
+static inline void scope_view_init(ScopeView *view, float refreshHz) {
+    const double pi = 3.14159265358979323846;
+    memset(view, 0, sizeof(*view));
+    view->refreshHz = refreshHz;
+    for (uint32_t i = 0; i < SCOPE_FFT_SIZE; i++)
+        view->window[i] = (float)(0.5 - 0.5 * cos(2 * pi * i / SCOPE_FFT_SIZE));
+    for (uint32_t i = 0; i < SCOPE_FFT_SIZE / 2; i++) {
+        view->cosTable[i] = (float)cos(2 * pi * i / SCOPE_FFT_SIZE);
+        view->sinTable[i] = (float)-sin(2 * pi * i / SCOPE_FFT_SIZE);
+    }
+    for (uint32_t i = 0; i < SCOPE_SPECTRUM_POINTS; i++)
+        view->spectrumDb[i] = SCOPE_FLOOR_DB;
+}
+
+// In place radix-2 FFT of view->re and view->im
+static inline void scope_fft(ScopeView *view) {
+    float *re = view->re, *im = view->im;
+    for (uint32_t i = 1, j = 0; i < SCOPE_FFT_SIZE; i++) {
+        uint32_t bit = SCOPE_FFT_SIZE >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+        if (i < j) {
+            float t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+    for (uint32_t size = 2; size <= SCOPE_FFT_SIZE; size <<= 1) {
+        const uint32_t half = size / 2, stride = SCOPE_FFT_SIZE / size;
+        for (uint32_t start = 0; start < SCOPE_FFT_SIZE; start += size) {
+            for (uint32_t k = 0; k < half; k++) {
+                const float wr = view->cosTable[k * stride];
+                const float wi = view->sinTable[k * stride];
+                const uint32_t a = start + k, b = a + half;
+                const float tr = re[b] * wr - im[b] * wi;
+                const float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// True when the view should be updated: it's time to refresh and the audio
+// thread published something since the last update. Times are from
+// clock_now_ms()
+static inline bool scope_view_due(const ScopeView *view, const ScopeRing *ring,
+                                  double nowMs) {
+    if (view->refreshHz <= 0.0f || scope_head(ring) == view->lastHead)
+        return false;
+    return nowMs - view->lastUpdateMs >= 1000.0 / view->refreshHz;
+}
+
+// Reads the newest blocks straight from the ring into the waveform and the FFT
+// input, then computes the spectrum. 'sampleRate' is the host rate
+static inline void scope_view_update(ScopeView *view, const ScopeRing *ring,
+                                     float sampleRate, double nowMs) {
+    const uint32_t head = scope_head(ring);
+    view->lastHead = head;
+    view->lastUpdateMs = nowMs;
+
+    for (uint32_t b = 0; b < SCOPE_WAVE_BLOCKS; b++) {
+        const uint32_t n = head - SCOPE_WAVE_BLOCKS + b;
+        float *min = &view->waveMin[b * SCOPE_NUM_PEAKS];
+        float *max = &view->waveMax[b * SCOPE_NUM_PEAKS];
+        const ScopeBlock *block = head >= SCOPE_WAVE_BLOCKS - b
+                                      ? scope_read_begin(ring, n)
+                                      : NULL;
+        if (block) {
+            memcpy(min, block->min, sizeof(block->min));
+            memcpy(max, block->max, sizeof(block->max));
+            if (scope_read_end(ring, n))
+                continue;
+            view->numTorn++;
+        }
+        memset(min, 0, sizeof(float) * SCOPE_NUM_PEAKS);
+        memset(max, 0, sizeof(float) * SCOPE_NUM_PEAKS);
+    }
+
+    // The previous spectrum stays up if any block is missing or torn
+    const uint32_t numBlocks = SCOPE_FFT_SIZE / SCOPE_NUM_SAMPLES;
+    if (head < numBlocks)
+        return;
+    for (uint32_t b = 0; b < numBlocks; b++) {
+        const uint32_t n = head - numBlocks + b;
+        const ScopeBlock *block = scope_read_begin(ring, n);
+        if (block == NULL)
+            return;
+        const uint32_t offset = b * SCOPE_NUM_SAMPLES;
+        for (uint32_t i = 0; i < SCOPE_NUM_SAMPLES; i++) {
+            view->re[offset + i] =
+                block->samples[i] * view->window[offset + i];
+            view->im[offset + i] = 0.0f;
+        }
+        if (!scope_read_end(ring, n)) {
+            view->numTorn++;
+            return;
+        }
+    }
+    scope_fft(view);
+
+    // A full scale sine peaks at 1/4 of the size with a Hann window
+    const float norm = 4.0f / SCOPE_FFT_SIZE;
+    for (uint32_t k = 0; k < SCOPE_FFT_SIZE / 2; k++) {
+        const float re = view->re[k], im = view->im[k];
+        view->re[k] = sqrtf(re * re + im * im) * norm; // reusing the buffer
+    }
+    const double binHz = sampleRate / SCOPE_DECIMATION / SCOPE_FFT_SIZE;
+    const double ratio =
+        (SCOPE_FFT_SIZE / 2 - 1) * binHz / SCOPE_SPECTRUM_MIN_HZ;
+    for (uint32_t p = 0; p < SCOPE_SPECTRUM_POINTS; p++) {
+        // Points where bins are sparse interpolate, the others take the
+        // loudest bin they cover
+        const double lo = SCOPE_SPECTRUM_MIN_HZ / binHz *
+                          pow(ratio, (double)p / SCOPE_SPECTRUM_POINTS);
+        const double hi = SCOPE_SPECTRUM_MIN_HZ / binHz *
+                          pow(ratio, (double)(p + 1) / SCOPE_SPECTRUM_POINTS);
+        float magnitude;
+        if (hi - lo < 1.0) {
+            const uint32_t k = (uint32_t)lo;
+            const float frac = (float)(lo - k);
+            magnitude = view->re[k] + (view->re[k + 1] - view->re[k]) * frac;
+        } else {
+            magnitude = 0.0f;
+            for (uint32_t k = (uint32_t)ceil(lo); k <= (uint32_t)hi; k++)
+                magnitude = view->re[k] > magnitude ? view->re[k] : magnitude;
+        }
+        const float db = 20.0f * log10f(magnitude + 1e-9f);
+        view->spectrumDb[p] = db > SCOPE_FLOOR_DB ? db : SCOPE_FLOOR_DB;
+    }
+}
+
+#endif // SCOPE_H
@@ -0,0 +1,152 @@
+#ifndef SMOOTHER_H
+#define SMOOTHER_H
+
+// Parameter smoothing
+// One smoother per parameter, configured by the 'smoothing' and 'smoothingMs'
+// columns of PARAM_TABLE. Only parameters that are still ramping cost
+// anything: they are packed into dense lanes and advanced together by a single
+// branch-free loop, while settled parameters are never touched.
+//
+// Every ramp is expressed as: value(n) = offset + slope*n + scale*2^(rate*n)
+// - SMOOTH_LINEAR: offset = start, slope = (target - start) / rampSamples
+// - SMOOTH_ONE_POLE: offset = target, scale = start - target, decaying to
+//   SMOOTH_ONE_POLE_SETTLE of the distance in rampSamples
+// - SMOOTH_MULTIPLICATIVE: scale = start, growing by a constant ratio per
+//   sample. Falls back to linear if the start or target is <= 0
+// so advancing any ramp by n samples is closed form, and all lanes share one
+// loop regardless of mode.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "osc.h"
+#include "params.h"
+
+#define SMOOTH_NO_LANE 0xffff
+// Remaining fraction of the distance at which a one pole ramp snaps to target
+#define SMOOTH_ONE_POLE_SETTLE 1e-4f
+
+typedef struct SmootherBank {
+    // Smoothed value of every parameter at the audio thread's current frame
+    float value[NUM_PARAMS];
+    float target[NUM_PARAMS];
+    float rampSamples[NUM_PARAMS];
+    uint16_t lane[NUM_PARAMS];
+
+    // Ramping parameters, packed
+    uint32_t numLanes;
+    uint16_t laneParam[NUM_PARAMS];
+    float laneOffset[NUM_PARAMS];
+    float laneSlope[NUM_PARAMS];
+    float laneScale[NUM_PARAMS];
+    float laneLog2Rate[NUM_PARAMS];
+    float laneRemaining[NUM_PARAMS];
+} SmootherBank;
+
+static inline void smoother_bank_init(SmootherBank *bank, const float *values) {
+    memset(bank, 0, sizeof(*bank));
+    for (uint32_t i = 0; i < NUM_PARAMS; i++) {
+        bank->value[i] = values[i];
+        bank->target[i] = values[i];
+        bank->lane[i] = SMOOTH_NO_LANE;
+    }
+}
+
+static inline void smoother_bank_set_sample_rate(SmootherBank *bank,
+                                                 float sampleRate) {
+    for (uint32_t i = 0; i < NUM_PARAMS; i++)
+        bank->rampSamples[i] = PARAM_INFO[i].smoothingMs * 0.001f * sampleRate;
+}
+
+static inline void smoother_bank_remove_lane(SmootherBank *bank,
+                                             uint32_t lane) {
+    bank->lane[bank->laneParam[lane]] = SMOOTH_NO_LANE;
+    uint32_t last = --bank->numLanes;
+    if (lane != last) {
+        bank->laneParam[lane] = bank->laneParam[last];
+        bank->laneOffset[lane] = bank->laneOffset[last];
+        bank->laneSlope[lane] = bank->laneSlope[last];
+        bank->laneScale[lane] = bank->laneScale[last];
+        bank->laneLog2Rate[lane] = bank->laneLog2Rate[last];
+        bank->laneRemaining[lane] = bank->laneRemaining[last];
+        bank->lane[bank->laneParam[lane]] = (uint16_t)lane;
+    }
+}
+
+// Starts a ramp from the current value towards 'target'. Call from the audio
+// thread at the frame the change happens
+static inline void smoother_bank_set_target(SmootherBank *bank, uint32_t param,
+                                            float target) {
+    const int mode = PARAM_INFO[param].smoothing;
+    const float rampSamples = bank->rampSamples[param];
+    const float start = bank->value[param];
+    bank->target[param] = target;
+
+    if (mode == SMOOTH_NONE || rampSamples < 1.0f || start == target) {
+        bank->value[param] = target;
+        if (bank->lane[param] != SMOOTH_NO_LANE)
+            smoother_bank_remove_lane(bank, bank->lane[param]);
+        return;
+    }
+
+    uint32_t lane = bank->lane[param];
+    if (lane == SMOOTH_NO_LANE) {
+        lane = bank->numLanes++;
+        bank->lane[param] = (uint16_t)lane;
+        bank->laneParam[lane] = (uint16_t)param;
+    }
+    bank->laneRemaining[lane] = rampSamples;
+
+    if (mode == SMOOTH_ONE_POLE) {
+        bank->laneOffset[lane] = target;
+        bank->laneSlope[lane] = 0.0f;
+        bank->laneScale[lane] = start - target;
+        bank->laneLog2Rate[lane] = log2f(SMOOTH_ONE_POLE_SETTLE) / rampSamples;
+    } else if (mode == SMOOTH_MULTIPLICATIVE && start > 0.0f && target > 0.0f) {
+        bank->laneOffset[lane] = 0.0f;
+        bank->laneSlope[lane] = 0.0f;
+        bank->laneScale[lane] = start;
+        bank->laneLog2Rate[lane] = log2f(target / start) / rampSamples;
+    } else {
+        bank->laneOffset[lane] = start;
+        bank->laneSlope[lane] = (target - start) / rampSamples;
+        bank->laneScale[lane] = 0.0f;
+        bank->laneLog2Rate[lane] = 0.0f;
+    }
+}
+
+static inline bool smoother_bank_is_ramping(const SmootherBank *bank,
+                                            uint32_t param) {
+    return bank->lane[param] != SMOOTH_NO_LANE;
+}
+
+// Moves every ramping parameter 'numFrames' samples forward
+static inline void smoother_bank_advance(SmootherBank *bank,
+                                         uint32_t numFrames) {
+    const uint32_t numLanes = bank->numLanes;
+    if (numLanes == 0)
+        return;
+
+    const float n = (float)numFrames;
+    for (uint32_t i = 0; i < numLanes; i++) {
+        float step = n < bank->laneRemaining[i] ? n : bank->laneRemaining[i];
+        bank->laneOffset[i] += bank->laneSlope[i] * step;
+        bank->laneScale[i] *= osc_exp2(bank->laneLog2Rate[i] * step);
+        bank->laneRemaining[i] -= step;
+    }
+
+    for (uint32_t i = 0; i < bank->numLanes;) {
+        const uint32_t param = bank->laneParam[i];
+        if (bank->laneRemaining[i] <= 0.0f) {
+            bank->value[param] = bank->target[param];
+            smoother_bank_remove_lane(bank, i);
+        } else {
+            bank->value[param] = bank->laneOffset[i] + bank->laneScale[i];
+            i++;
+        }
+    }
+}
+
+#endif // SMOOTHER_H
@@ -0,0 +1,469 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+// CPU rasterizer for ImGui draw lists
+// Draws indexed triangles with per vertex colours and an optional texture into
+// a 32 bit image, blending like ImGui's GPU backends do:
+//   rgb = src.rgb * src.a + dst.rgb * (1 - src.a)
+//   a   = src.a + dst.a * (1 - src.a)
+// Vertices are snapped to 1/16 of a pixel and a pixel is covered when its
+// centre is inside the triangle, ties going to top and left edges. Triangles
+// sharing an edge, like the two halves of every ImGui rectangle, therefore
+// never blend a pixel twice, and the same input always gives the same pixels.
+//
+// Each row of a triangle is solved exactly for the span of covered pixels, then
+// the span is shaded 4 pixels at a time with SSE2, blending in 8 bit integers.
+// Triangles with one colour and one texel, which is most of what ImGui draws,
+// skip the interpolation and texture fetches, and opaque ones are plain fills.
+// Textures are sampled at the nearest texel; ImGui bakes its glyphs at the size
+// they are drawn, so they map 1:1 to pixels.
+//
+// Plain C with no ImGui dependency, see gui_soft.cpp for the ImGui side.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "osc.h" // OSC_X86
+
+// Same layout as ImDrawVert
+typedef struct SoftVertex {
+    float x, y;
+    float u, v;
+    uint32_t col; // R in the low byte, like IM_COL32
+} SoftVertex;
+
+typedef uint16_t SoftIndex; // ImDrawIdx
+
+typedef struct SoftTexture {
+    const uint8_t *pixels;
+    int width;
+    int height;
+    int bytesPerPixel; // 4: RGBA, 1: alpha only, the colour being white
+} SoftTexture;
+
+// Pixels are packed like SoftVertex::col
+typedef struct SoftImage {
+    uint32_t *pixels;
+    int width;
+    int height;
+} SoftImage;
+
+// In pixels, max exclusive
+typedef struct SoftClip {
+    int x0, y0;
+    int x1, y1;
+} SoftClip;
+
+#define SOFT_SUBPIXEL_BITS 4
+#define SOFT_SUBPIXEL      (1 << SOFT_SUBPIXEL_BITS)
+// Vertices are clamped to this many pixels from the origin, which keeps the
+// edge equations in 64 bits
+#define SOFT_MAX_COORD 65536.0f
+
+static inline void soft_raster_clear(SoftImage *image, uint32_t col) {
+    const size_t n = (size_t)image->width * (size_t)image->height;
+    for (size_t i = 0; i < n; i++)
+        image->pixels[i] = col;
+}
+
+static inline int64_t soft_floor_div(int64_t a, int64_t b) { // b > 0
+    int64_t q = a / b;
+    return q * b > a ? q - 1 : q;
+}
+
+static inline int64_t soft_ceil_div(int64_t a, int64_t b) { // b > 0
+    int64_t q = a / b;
+    return q * b < a ? q + 1 : q;
+}
+
+static inline int32_t soft_snap(float v) {
+    if (!(v > -SOFT_MAX_COORD)) // also catches NaN
+        v = -SOFT_MAX_COORD;
+    if (v > SOFT_MAX_COORD)
+        v = SOFT_MAX_COORD;
+    return (int32_t)lrintf(v * SOFT_SUBPIXEL);
+}
+
+static inline uint32_t soft_texel_at(const SoftTexture *tex, size_t i) {
+    if (tex->bytesPerPixel == 1)
+        return 0x00ffffffu | (uint32_t)tex->pixels[i] << 24;
+    uint32_t texel;
+    memcpy(&texel, tex->pixels + i * 4, 4);
+    return texel;
+}
+
+// Nearest texel. Coordinates are clamped before truncating, which floors them
+// and keeps NaN and huge values in range
+static inline uint32_t soft_texel(const SoftTexture *tex, float u, float v) {
+    if (tex == NULL || tex->pixels == NULL)
+        return 0xffffffff;
+    float fx = u * (float)tex->width, fy = v * (float)tex->height;
+    fx = fx > 0.0f ? fx : 0.0f;
+    fy = fy > 0.0f ? fy : 0.0f;
+    const int x = fx < (float)tex->width ? (int)fx : tex->width - 1;
+    const int y = fy < (float)tex->height ? (int)fy : tex->height - 1;
+    return soft_texel_at(tex, (size_t)y * (size_t)tex->width + (size_t)x);
+}
+
+// t / 255, rounded, for t up to 255 * 255
+static inline uint32_t soft_div255(uint32_t t) {
+    t += 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Clamps 'v' to 0-255 and rounds it half up, like the SIMD path
+static inline uint32_t soft_to_byte(float v) {
+    v = v > 0.0f ? v : 0.0f;
+    v = v < 255.0f ? v : 255.0f;
+    return (uint32_t)(v + 0.5f);
+}
+
+// One pixel, shared by the scalar path and the tails of the SIMD one so both
+// give the same bytes. 'src' is opaque and covers 'a' / 255 of the pixel
+static inline uint32_t soft_blend(uint32_t dst, uint32_t src, uint32_t a) {
+    const uint32_t inv = 255 - a;
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t d = (dst >> shift) & 0xff, c = (src >> shift) & 0xff;
+        out |= soft_div255(c * a + d * inv) << shift;
+    }
+    return out;
+}
+
+// Attribute planes of a triangle: value = base + dx * px + dy * py, with px and
+// py pixel centres
+typedef struct SoftPlane {
+    float base, dx, dy;
+} SoftPlane;
+
+static inline SoftPlane soft_plane(const float p[3][2], float invArea,
+                                   float f0, float f1, float f2) {
+    SoftPlane plane;
+    const float ex1 = p[1][0] - p[0][0], ey1 = p[1][1] - p[0][1];
+    const float ex2 = p[2][0] - p[0][0], ey2 = p[2][1] - p[0][1];
+    plane.dx = ((f1 - f0) * ey2 - (f2 - f0) * ey1) * invArea;
+    plane.dy = ((f2 - f0) * ex1 - (f1 - f0) * ex2) * invArea;
+    plane.base = f0 - plane.dx * p[0][0] - plane.dy * p[0][1];
+    return plane;
+}
+
+typedef struct SoftShade {
+    int flat;
+    // Flat: opaque source colour and its coverage, 0-255
+    uint32_t src, a;
+    // Otherwise: r, g, b, a (0-255), u, v
+    SoftPlane planes[6];
+    // Sampled per pixel, or 'texel' everywhere when the UVs are constant, like
+    // on gradients
+    const SoftTexture *tex;
+    uint32_t texel;
+} SoftShade;
+
+static inline void soft_shade_span_scalar(uint32_t *row, int x0, int x1,
+                                          float py, const SoftShade *s) {
+    for (int x = x0; x < x1; x++) {
+        if (s->flat) {
+            row[x] = soft_blend(row[x], s->src, s->a);
+            continue;
+        }
+        const float px = (float)x + 0.5f;
+        float attr[6];
+        for (int i = 0; i < 6; i++)
+            attr[i] = (s->planes[i].base + s->planes[i].dy * py) +
+                      s->planes[i].dx * px;
+        const uint32_t texel =
+            s->tex ? soft_texel(s->tex, attr[4], attr[5]) : s->texel;
+        const float k = 1.0f / 255.0f;
+        const uint32_t r = soft_to_byte(attr[0] * (texel & 0xff) * k);
+        const uint32_t g = soft_to_byte(attr[1] * ((texel >> 8) & 0xff) * k);
+        const uint32_t b = soft_to_byte(attr[2] * ((texel >> 16) & 0xff) * k);
+        const uint32_t a = soft_to_byte(attr[3] * (texel >> 24) * k);
+        row[x] = soft_blend(row[x], r | g << 8 | b << 16 | 0xff000000u, a);
+    }
+}
+
+#if OSC_X86
+
+static inline __m128 soft_channel(__m128i pixels, int shift) {
+    return _mm_cvtepi32_ps(
+        _mm_and_si128(_mm_srli_epi32(pixels, shift), _mm_set1_epi32(0xff)));
+}
+
+static inline __m128i soft_to_byte4(__m128 v) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+}
+
+// One channel of 4 pixels: its attribute at 'px' times the texel channel at
+// 'shift', as a byte
+static inline __m128i soft_shade4(__m128 rowBase, __m128 dx, __m128 px,
+                                  __m128i texels, int shift) {
+    const __m128 attr = _mm_add_ps(rowBase, _mm_mul_ps(dx, px));
+    const __m128 channel = soft_channel(texels, shift);
+    return soft_to_byte4(_mm_mul_ps(_mm_mul_ps(attr, channel),
+                                    _mm_set1_ps(1.0f / 255.0f)));
+}
+
+// soft_blend() on two pixels unpacked to 16 bits per channel. The products fit
+// in 16 bits, so the whole blend stays in 8 lanes
+static inline __m128i soft_blend2(__m128i dst, __m128i src, __m128i a) {
+    const __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    __m128i t =
+        _mm_add_epi16(_mm_mullo_epi16(src, a), _mm_mullo_epi16(dst, inv));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// soft_blend() on 4 pixels, 'a' holding one coverage per 32 bit lane
+static inline __m128i soft_blend4(__m128i dst, __m128i src, __m128i a) {
+    const __m128i zero = _mm_setzero_si128();
+    // Each coverage repeated over its pixel's 4 channels
+    __m128i a16 = _mm_packs_epi32(a, a);
+    a16 = _mm_unpacklo_epi16(a16, a16);
+    const __m128i lo =
+        soft_blend2(_mm_unpacklo_epi8(dst, zero),
+                    _mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi32(a16, a16));
+    const __m128i hi =
+        soft_blend2(_mm_unpackhi_epi8(dst, zero),
+                    _mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi32(a16, a16));
+    return _mm_packus_epi16(lo, hi);
+}
+
+static inline void soft_shade_span(uint32_t *row, int x0, int x1, float py,
+                                   const SoftShade *s) {
+    int x = x0;
+    if (s->flat) {
+        if (s->a == 255) {
+            // Opaque, which most window and frame backgrounds are
+            for (; x < x1; x++)
+                row[x] = s->src;
+            return;
+        }
+        const __m128i src = _mm_set1_epi32((int)s->src);
+        const __m128i a = _mm_set1_epi32((int)s->a);
+        for (; x + 4 <= x1; x += 4) {
+            __m128i *p = (__m128i *)(row + x);
+            _mm_storeu_si128(p, soft_blend4(_mm_loadu_si128(p), src, a));
+        }
+        soft_shade_span_scalar(row, x, x1, py, s);
+        return;
+    }
+
+    // Attributes along the row: rowBase + dx * px, in the scalar path's
+    // order
+    __m128 rowBase[6], dx[6];
+    for (int i = 0; i < 6; i++) {
+        const SoftPlane *plane = &s->planes[i];
+        rowBase[i] = _mm_set1_ps(plane->base + plane->dy * py);
+        dx[i] = _mm_set1_ps(plane->dx);
+    }
+    const __m128 ramp = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    for (; x + 4 <= x1; x += 4) {
+        const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), ramp);
+        __m128i texels = _mm_set1_epi32((int)s->texel);
+        if (s->tex) {
+            // Texel indices as in soft_texel(). Exact in float for textures
+            // up to 4096 x 4096
+            const __m128 width = _mm_set1_ps((float)s->tex->width);
+            const __m128 height = _mm_set1_ps((float)s->tex->height);
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 u = _mm_add_ps(rowBase[4], _mm_mul_ps(dx[4], px));
+            const __m128 v = _mm_add_ps(rowBase[5], _mm_mul_ps(dx[5], px));
+            __m128 fx = _mm_max_ps(_mm_mul_ps(u, width), _mm_setzero_ps());
+            __m128 fy = _mm_max_ps(_mm_mul_ps(v, height), _mm_setzero_ps());
+            fx = _mm_cvtepi32_ps(
+                _mm_cvttps_epi32(_mm_min_ps(fx, _mm_sub_ps(width, one))));
+            fy = _mm_cvtepi32_ps(
+                _mm_cvttps_epi32(_mm_min_ps(fy, _mm_sub_ps(height, one))));
+            int32_t index[4];
+            _mm_storeu_si128((__m128i *)index,
+                             _mm_cvttps_epi32(_mm_add_ps(
+                                 _mm_mul_ps(fy, width), fx)));
+            texels = _mm_setr_epi32((int)soft_texel_at(s->tex, index[0]),
+                                    (int)soft_texel_at(s->tex, index[1]),
+                                    (int)soft_texel_at(s->tex, index[2]),
+                                    (int)soft_texel_at(s->tex, index[3]));
+        }
+
+        // Written out, so the shifts stay immediates
+        const __m128i r = soft_shade4(rowBase[0], dx[0], px, texels, 0);
+        const __m128i g = soft_shade4(rowBase[1], dx[1], px, texels, 8);
+        const __m128i b = soft_shade4(rowBase[2], dx[2], px, texels, 16);
+        const __m128i a = soft_shade4(rowBase[3], dx[3], px, texels, 24);
+        const __m128i src = _mm_or_si128(
+            _mm_or_si128(r, _mm_slli_epi32(g, 8)),
+            _mm_or_si128(_mm_slli_epi32(b, 16),
+                         _mm_set1_epi32((int)0xff000000u)));
+
+        __m128i *p = (__m128i *)(row + x);
+        _mm_storeu_si128(p, soft_blend4(_mm_loadu_si128(p), src, a));
+    }
+    soft_shade_span_scalar(row, x, x1, py, s);
+}
+
+#else
+
+static inline void soft_shade_span(uint32_t *row, int x0, int x1, float py,
+                                   const SoftShade *s) {
+    soft_shade_span_scalar(row, x0, x1, py, s);
+}
+
+#endif // OSC_X86
+
+static inline void soft_raster_triangle(SoftImage *image, const SoftClip *clip,
+                                        const SoftTexture *tex,
+                                        const SoftVertex *v0,
+                                        const SoftVertex *v1,
+                                        const SoftVertex *v2, float originX,
+                                        float originY) {
+    const SoftVertex *v[3] = {v0, v1, v2};
+    int64_t X[3], Y[3];
+    for (int i = 0; i < 3; i++) {
+        X[i] = soft_snap(v[i]->x - originX);
+        Y[i] = soft_snap(v[i]->y - originY);
+    }
+    int64_t area =
+        (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+    if (area == 0)
+        return;
+    if (area < 0) {
+        // Counter-clockwise on screen. Flipped so inside is always positive
+        const SoftVertex *tv = v[1];
+        v[1] = v[2];
+        v[2] = tv;
+        int64_t t = X[1];
+        X[1] = X[2];
+        X[2] = t;
+        t = Y[1];
+        Y[1] = Y[2];
+        Y[2] = t;
+        area = -area;
+    }
+
+    // Rows whose centre (16 * y + 8) lies within the triangle's extent
+    int64_t minY = Y[0], maxY = Y[0];
+    for (int i = 1; i < 3; i++) {
+        minY = Y[i] < minY ? Y[i] : minY;
+        maxY = Y[i] > maxY ? Y[i] : maxY;
+    }
+    int64_t y0 = soft_ceil_div(minY - SOFT_SUBPIXEL / 2, SOFT_SUBPIXEL);
+    int64_t y1 = soft_floor_div(maxY - SOFT_SUBPIXEL / 2, SOFT_SUBPIXEL) + 1;
+    int clipX0 = clip->x0 > 0 ? clip->x0 : 0;
+    int clipY0 = clip->y0 > 0 ? clip->y0 : 0;
+    int clipX1 = clip->x1 < image->width ? clip->x1 : image->width;
+    int clipY1 = clip->y1 < image->height ? clip->y1 : image->height;
+    y0 = y0 > clipY0 ? y0 : clipY0;
+    y1 = y1 < clipY1 ? y1 : clipY1;
+    if (y0 >= y1 || clipX0 >= clipX1)
+        return;
+
+    // Edge i runs from vertex i to the next one. A pixel centre (PX, PY) is
+    // inside when E = dx * (PY - Ya) - dy * (PX - Xa) >= bias for all three,
+    // where the bias is 0 on top and left edges and 1 on the others
+    int64_t dx[3], dy[3], bias[3], c[3];
+    for (int i = 0; i < 3; i++) {
+        const int j = i == 2 ? 0 : i + 1;
+        dx[i] = X[j] - X[i];
+        dy[i] = Y[j] - Y[i];
+        const int topLeft = dy[i] < 0 || (dy[i] == 0 && dx[i] > 0);
+        bias[i] = topLeft ? 0 : 1;
+        // E = c - dy * PX, for the first row
+        const int64_t py = y0 * SOFT_SUBPIXEL + SOFT_SUBPIXEL / 2;
+        c[i] = dx[i] * (py - Y[i]) + dy[i] * X[i];
+    }
+
+    // With PX = 16 * x + 8, a sloped edge limits a row to x <= floor(n / d)
+    // when dy > 0 and to x >= -floor(n / d) when dy < 0, where
+    // n = c - 8 * dy - bias and d = 16 * |dy|. n grows by 16 * dx per row, so
+    // the quotient and remainder are stepped rather than divided each row
+    int64_t q[3], r[3], d[3], stepQ[3], stepR[3];
+    for (int i = 0; i < 3; i++) {
+        if (dy[i] == 0)
+            continue;
+        d[i] = SOFT_SUBPIXEL * (dy[i] > 0 ? dy[i] : -dy[i]);
+        const int64_t n = c[i] - dy[i] * (SOFT_SUBPIXEL / 2) - bias[i];
+        q[i] = soft_floor_div(n, d[i]);
+        r[i] = n - q[i] * d[i];
+        stepQ[i] = soft_floor_div(dx[i] * SOFT_SUBPIXEL, d[i]);
+        stepR[i] = dx[i] * SOFT_SUBPIXEL - stepQ[i] * d[i];
+    }
+
+    SoftShade shade;
+    const uint32_t col = v[0]->col;
+    const int flatUV =
+        tex == NULL || (v[0]->u == v[1]->u && v[0]->u == v[2]->u &&
+                        v[0]->v == v[1]->v && v[0]->v == v[2]->v);
+    shade.flat = flatUV && col == v[1]->col && col == v[2]->col;
+    shade.tex = flatUV || tex->pixels == NULL ? NULL : tex;
+    shade.texel = soft_texel(tex, v[0]->u, v[0]->v);
+    if (shade.flat) {
+        const uint32_t texel = shade.texel;
+        shade.a = soft_div255((col >> 24) * (texel >> 24));
+        if (shade.a == 0)
+            return;
+        shade.src = 0xff000000u;
+        for (int shift = 0; shift < 24; shift += 8)
+            shade.src |= soft_div255(((col >> shift) & 0xff) *
+                                     ((texel >> shift) & 0xff))
+                         << shift;
+    } else {
+        float p[3][2], f[6][3];
+        for (int i = 0; i < 3; i++) {
+            p[i][0] = (float)X[i] * (1.0f / SOFT_SUBPIXEL);
+            p[i][1] = (float)Y[i] * (1.0f / SOFT_SUBPIXEL);
+            const uint32_t vc = v[i]->col;
+            f[0][i] = (float)(vc & 0xff);
+            f[1][i] = (float)((vc >> 8) & 0xff);
+            f[2][i] = (float)((vc >> 16) & 0xff);
+            f[3][i] = (float)(vc >> 24);
+            f[4][i] = v[i]->u;
+            f[5][i] = v[i]->v;
+        }
+        const float invArea =
+            (float)(SOFT_SUBPIXEL * SOFT_SUBPIXEL) / (float)area;
+        for (int i = 0; i < 6; i++)
+            shade.planes[i] = soft_plane(p, invArea, f[i][0], f[i][1], f[i][2]);
+    }
+
+    for (int64_t y = y0; y < y1; y++) {
+        int64_t x0 = clipX0, x1 = clipX1 - 1; // inclusive
+        for (int i = 0; i < 3; i++) {
+            if (dy[i] == 0) {
+                if (c[i] < bias[i])
+                    x1 = x0 - 1; // outside a horizontal edge
+                c[i] += dx[i] * SOFT_SUBPIXEL;
+                continue;
+            }
+            if (dy[i] > 0)
+                x1 = q[i] < x1 ? q[i] : x1;
+            else
+                x0 = -q[i] > x0 ? -q[i] : x0;
+            q[i] += stepQ[i];
+            r[i] += stepR[i];
+            if (r[i] >= d[i]) {
+                q[i]++;
+                r[i] -= d[i];
+            }
+        }
+        if (x0 <= x1)
+            soft_shade_span(image->pixels + (size_t)y * (size_t)image->width,
+                            (int)x0, (int)x1 + 1, (float)y + 0.5f, &shade);
+    }
+}
+
+// Draws 'numIndices / 3' triangles. Vertex positions are offset by -origin.
+// 'tex' may be NULL for untextured geometry
+static inline void soft_raster_triangles(SoftImage *image, const SoftClip *clip,
+                                         const SoftTexture *tex,
+                                         const SoftVertex *vertices,
+                                         const SoftIndex *indices,
+                                         uint32_t numIndices, float originX,
+                                         float originY) {
+    for (uint32_t i = 0; i + 3 <= numIndices; i += 3)
+        soft_raster_triangle(image, clip, tex, &vertices[indices[i]],
+                             &vertices[indices[i + 1]],
+                             &vertices[indices[i + 2]], originX, originY);
+}
+
+#endif // SOFT_RASTER_H
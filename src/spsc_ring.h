@@ -0,0 +1,140 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+// Lock-free single producer, single consumer ring buffer
+// Exactly one thread may push and exactly one other thread may pop. 'head' and
+// 'tail' count every element ever pushed and popped, so they never need
+// masking on write and 'head - tail' is the number of queued elements even
+// after they wrap. Each side keeps a cached copy of the other side's index and
+// only reloads it when the cached value says the ring is full/empty, so a batch
+// costs one acquire and one release regardless of its size.
+//
+// Overflow policy: a push that doesn't fit is truncated, never blocks and never
+// overwrites unread elements. The number of rejected elements is counted in
+// 'numDropped', and the highest occupancy seen by the producer in 'highWater'.
+// Either side can read both at any time.
+//
+// Storage is supplied by the caller, so rings can live inside the Plugin struct
+// and nothing allocates.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "atomics.h"
+
+typedef struct SpscRing {
+    // Producer
+    volatile uint32_t head;
+    uint32_t cachedTail;
+    char pad0[CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+
+    // Consumer
+    volatile uint32_t tail;
+    uint32_t cachedHead;
+    char pad1[CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+
+    // Written by the producer, read by anyone
+    volatile uint32_t numDropped;
+    volatile uint32_t highWater;
+    char pad2[CACHE_LINE_SIZE - 2 * sizeof(uint32_t)];
+
+    // Constant after spsc_ring_init
+    uint8_t *data;
+    uint32_t elemSize;
+    uint32_t capacity; // power of 2
+} SpscRing;
+
+// 'capacity' must be a power of 2
+static inline void spsc_ring_init(SpscRing *ring, void *storage,
+                                  uint32_t elemSize, uint32_t capacity) {
+    memset(ring, 0, sizeof(*ring));
+    ring->data = (uint8_t *)storage;
+    ring->elemSize = elemSize;
+    ring->capacity = capacity;
+}
+
+// Copies 'count' elements in or out of the ring starting at index 'pos',
+// wrapping around the end of the storage
+static inline void spsc_ring_copy_in(SpscRing *ring, uint32_t pos,
+                                     const void *elems, uint32_t count) {
+    const uint32_t start = pos & (ring->capacity - 1);
+    const uint32_t first = count < ring->capacity - start
+                               ? count
+                               : ring->capacity - start;
+    const uint8_t *src = (const uint8_t *)elems;
+    memcpy(ring->data + start * ring->elemSize, src, first * ring->elemSize);
+    memcpy(ring->data, src + first * ring->elemSize,
+           (count - first) * ring->elemSize);
+}
+
+static inline void spsc_ring_copy_out(const SpscRing *ring, uint32_t pos,
+                                      void *elems, uint32_t count) {
+    const uint32_t start = pos & (ring->capacity - 1);
+    const uint32_t first = count < ring->capacity - start
+                               ? count
+                               : ring->capacity - start;
+    uint8_t *dst = (uint8_t *)elems;
+    memcpy(dst, ring->data + start * ring->elemSize, first * ring->elemSize);
+    memcpy(dst + first * ring->elemSize, ring->data,
+           (count - first) * ring->elemSize);
+}
+
+// Producer only. Pushes as many of 'count' elements as fit and returns that
+// number. The rest are counted as dropped
+static inline uint32_t spsc_ring_push(SpscRing *ring, const void *elems,
+                                      uint32_t count) {
+    const uint32_t head = ring->head;
+    uint32_t space = ring->capacity - (head - ring->cachedTail);
+    if (space < count) {
+        ring->cachedTail = atomic_load_acquire_u32(&ring->tail);
+        space = ring->capacity - (head - ring->cachedTail);
+    }
+
+    const uint32_t numPushed = count < space ? count : space;
+    if (numPushed > 0) {
+        spsc_ring_copy_in(ring, head, elems, numPushed);
+        atomic_store_release_u32(&ring->head, head + numPushed);
+    }
+
+    const uint32_t used = head + numPushed - ring->cachedTail;
+    if (used > ring->highWater)
+        atomic_store_release_u32(&ring->highWater, used);
+    if (numPushed < count)
+        atomic_fetch_add_relaxed_u32(&ring->numDropped, count - numPushed);
+    return numPushed;
+}
+
+static inline bool spsc_ring_push_one(SpscRing *ring, const void *elem) {
+    return spsc_ring_push(ring, elem, 1) == 1;
+}
+
+// Consumer only. Pops up to 'maxCount' elements into 'elems' and returns how
+// many were popped
+static inline uint32_t spsc_ring_pop(SpscRing *ring, void *elems,
+                                     uint32_t maxCount) {
+    const uint32_t tail = ring->tail;
+    uint32_t available = ring->cachedHead - tail;
+    if (available < maxCount) {
+        ring->cachedHead = atomic_load_acquire_u32(&ring->head);
+        available = ring->cachedHead - tail;
+    }
+
+    const uint32_t numPopped = maxCount < available ? maxCount : available;
+    if (numPopped > 0) {
+        spsc_ring_copy_out(ring, tail, elems, numPopped);
+        atomic_store_release_u32(&ring->tail, tail + numPopped);
+    }
+    return numPopped;
+}
+
+// Number of queued elements. Exact when called from either end, otherwise a
+// snapshot
+static inline uint32_t spsc_ring_size(const SpscRing *ring) {
+    // Tail first: the head loaded after it can only be further ahead
+    const uint32_t tail = atomic_load_acquire_u32(&ring->tail);
+    const uint32_t head = atomic_load_acquire_u32(&ring->head);
+    return head - tail;
+}
+
+#endif // SPSC_RING_H
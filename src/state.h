@@ -0,0 +1,370 @@
+#ifndef STATE_H
+#define STATE_H
+
+// Versioned, chunked state format
+//
+//   u32 magic 'CPST'
+//   u32 version
+//   chunks: u32 tag, u32 size, 'size' bytes of payload
+//   u32 'END ', u32 4, u32 CRC-32 of every byte before the CRC itself
+//
+// All integers are little endian. Readers skip chunks with tags they don't
+// know, so new chunks can be added without bumping the version, and payloads
+// are streamed through a small buffer so a chunk can be larger than any buffer
+// in the plugin. A state without the magic is the flat {u32 id, f32 value}
+// array written before this format existed.
+//
+// Chunks:
+// - 'PARM': u32 count, then 'count' times {u32 ID, f32 value}
+
+#include <cplug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_MAGIC             'CPST'
+#define STATE_VERSION           1
+#define STATE_TAG_PARAMS        'PARM'
+#define STATE_TAG_END           'END '
+#define STATE_READ_BUFFER_SIZE  4096
+#define STATE_WRITE_BUFFER_SIZE 4096
+
+// CRC-32 (IEEE, reflected polynomial 0xedb88320) of every byte value
+static const uint32_t STATE_CRC32_TABLE[256] = {
+    0x00000000u, 0x77073096u, 0xee0e612cu, 0x990951bau, 0x076dc419u, 0x706af48fu,
+    0xe963a535u, 0x9e6495a3u, 0x0edb8832u, 0x79dcb8a4u, 0xe0d5e91eu, 0x97d2d988u,
+    0x09b64c2bu, 0x7eb17cbdu, 0xe7b82d07u, 0x90bf1d91u, 0x1db71064u, 0x6ab020f2u,
+    0xf3b97148u, 0x84be41deu, 0x1adad47du, 0x6ddde4ebu, 0xf4d4b551u, 0x83d385c7u,
+    0x136c9856u, 0x646ba8c0u, 0xfd62f97au, 0x8a65c9ecu, 0x14015c4fu, 0x63066cd9u,
+    0xfa0f3d63u, 0x8d080df5u, 0x3b6e20c8u, 0x4c69105eu, 0xd56041e4u, 0xa2677172u,
+    0x3c03e4d1u, 0x4b04d447u, 0xd20d85fdu, 0xa50ab56bu, 0x35b5a8fau, 0x42b2986cu,
+    0xdbbbc9d6u, 0xacbcf940u, 0x32d86ce3u, 0x45df5c75u, 0xdcd60dcfu, 0xabd13d59u,
+    0x26d930acu, 0x51de003au, 0xc8d75180u, 0xbfd06116u, 0x21b4f4b5u, 0x56b3c423u,
+    0xcfba9599u, 0xb8bda50fu, 0x2802b89eu, 0x5f058808u, 0xc60cd9b2u, 0xb10be924u,
+    0x2f6f7c87u, 0x58684c11u, 0xc1611dabu, 0xb6662d3du, 0x76dc4190u, 0x01db7106u,
+    0x98d220bcu, 0xefd5102au, 0x71b18589u, 0x06b6b51fu, 0x9fbfe4a5u, 0xe8b8d433u,
+    0x7807c9a2u, 0x0f00f934u, 0x9609a88eu, 0xe10e9818u, 0x7f6a0dbbu, 0x086d3d2du,
+    0x91646c97u, 0xe6635c01u, 0x6b6b51f4u, 0x1c6c6162u, 0x856530d8u, 0xf262004eu,
+    0x6c0695edu, 0x1b01a57bu, 0x8208f4c1u, 0xf50fc457u, 0x65b0d9c6u, 0x12b7e950u,
+    0x8bbeb8eau, 0xfcb9887cu, 0x62dd1ddfu, 0x15da2d49u, 0x8cd37cf3u, 0xfbd44c65u,
+    0x4db26158u, 0x3ab551ceu, 0xa3bc0074u, 0xd4bb30e2u, 0x4adfa541u, 0x3dd895d7u,
+    0xa4d1c46du, 0xd3d6f4fbu, 0x4369e96au, 0x346ed9fcu, 0xad678846u, 0xda60b8d0u,
+    0x44042d73u, 0x33031de5u, 0xaa0a4c5fu, 0xdd0d7cc9u, 0x5005713cu, 0x270241aau,
+    0xbe0b1010u, 0xc90c2086u, 0x5768b525u, 0x206f85b3u, 0xb966d409u, 0xce61e49fu,
+    0x5edef90eu, 0x29d9c998u, 0xb0d09822u, 0xc7d7a8b4u, 0x59b33d17u, 0x2eb40d81u,
+    0xb7bd5c3bu, 0xc0ba6cadu, 0xedb88320u, 0x9abfb3b6u, 0x03b6e20cu, 0x74b1d29au,
+    0xead54739u, 0x9dd277afu, 0x04db2615u, 0x73dc1683u, 0xe3630b12u, 0x94643b84u,
+    0x0d6d6a3eu, 0x7a6a5aa8u, 0xe40ecf0bu, 0x9309ff9du, 0x0a00ae27u, 0x7d079eb1u,
+    0xf00f9344u, 0x8708a3d2u, 0x1e01f268u, 0x6906c2feu, 0xf762575du, 0x806567cbu,
+    0x196c3671u, 0x6e6b06e7u, 0xfed41b76u, 0x89d32be0u, 0x10da7a5au, 0x67dd4accu,
+    0xf9b9df6fu, 0x8ebeeff9u, 0x17b7be43u, 0x60b08ed5u, 0xd6d6a3e8u, 0xa1d1937eu,
+    0x38d8c2c4u, 0x4fdff252u, 0xd1bb67f1u, 0xa6bc5767u, 0x3fb506ddu, 0x48b2364bu,
+    0xd80d2bdau, 0xaf0a1b4cu, 0x36034af6u, 0x41047a60u, 0xdf60efc3u, 0xa867df55u,
+    0x316e8eefu, 0x4669be79u, 0xcb61b38cu, 0xbc66831au, 0x256fd2a0u, 0x5268e236u,
+    0xcc0c7795u, 0xbb0b4703u, 0x220216b9u, 0x5505262fu, 0xc5ba3bbeu, 0xb2bd0b28u,
+    0x2bb45a92u, 0x5cb36a04u, 0xc2d7ffa7u, 0xb5d0cf31u, 0x2cd99e8bu, 0x5bdeae1du,
+    0x9b64c2b0u, 0xec63f226u, 0x756aa39cu, 0x026d930au, 0x9c0906a9u, 0xeb0e363fu,
+    0x72076785u, 0x05005713u, 0x95bf4a82u, 0xe2b87a14u, 0x7bb12baeu, 0x0cb61b38u,
+    0x92d28e9bu, 0xe5d5be0du, 0x7cdcefb7u, 0x0bdbdf21u, 0x86d3d2d4u, 0xf1d4e242u,
+    0x68ddb3f8u, 0x1fda836eu, 0x81be16cdu, 0xf6b9265bu, 0x6fb077e1u, 0x18b74777u,
+    0x88085ae6u, 0xff0f6a70u, 0x66063bcau, 0x11010b5cu, 0x8f659effu, 0xf862ae69u,
+    0x616bffd3u, 0x166ccf45u, 0xa00ae278u, 0xd70dd2eeu, 0x4e048354u, 0x3903b3c2u,
+    0xa7672661u, 0xd06016f7u, 0x4969474du, 0x3e6e77dbu, 0xaed16a4au, 0xd9d65adcu,
+    0x40df0b66u, 0x37d83bf0u, 0xa9bcae53u, 0xdebb9ec5u, 0x47b2cf7fu, 0x30b5ffe9u,
+    0xbdbdf21cu, 0xcabac28au, 0x53b39330u, 0x24b4a3a6u, 0xbad03605u, 0xcdd70693u,
+    0x54de5729u, 0x23d967bfu, 0xb3667a2eu, 0xc4614ab8u, 0x5d681b02u, 0x2a6f2b94u,
+    0xb40bbe37u, 0xc30c8ea1u, 0x5a05df1bu, 0x2d02ef8du,
+};
+
+static inline uint32_t state_crc32_update(uint32_t crc, const void *data,
+                                          size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = STATE_CRC32_TABLE[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline void state_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t state_get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+/* --------------------------------------------------------------------------
+ * Writing */
+
+typedef struct StateWriter {
+    cplug_writeProc writeProc;
+    const void *stateCtx;
+    uint32_t crc;
+    bool failed;
+    uint32_t used;
+    uint8_t *buffer; // STATE_WRITE_BUFFER_SIZE
+} StateWriter;
+
+static inline void state_writer_flush(StateWriter *w) {
+    if (w->used > 0 && !w->failed) {
+        w->crc = state_crc32_update(w->crc, w->buffer, w->used);
+        if (w->writeProc(w->stateCtx, w->buffer, w->used) != (int64_t)w->used)
+            w->failed = true;
+    }
+    w->used = 0;
+}
+
+static inline void state_write(StateWriter *w, const void *data,
+                               uint32_t size) {
+    const uint8_t *src = (const uint8_t *)data;
+    while (size > 0) {
+        if (w->used == STATE_WRITE_BUFFER_SIZE)
+            state_writer_flush(w);
+        uint32_t n = STATE_WRITE_BUFFER_SIZE - w->used;
+        if (n > size)
+            n = size;
+        memcpy(w->buffer + w->used, src, n);
+        w->used += n;
+        src += n;
+        size -= n;
+    }
+}
+
+static inline void state_write_u32(StateWriter *w, uint32_t v) {
+    uint8_t bytes[4];
+    state_put_u32(bytes, v);
+    state_write(w, bytes, sizeof(bytes));
+}
+
+static inline void state_write_f32(StateWriter *w, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    state_write_u32(w, bits);
+}
+
+static inline bool state_writer_begin(StateWriter *w, const void *stateCtx,
+                                      cplug_writeProc writeProc) {
+    memset(w, 0, sizeof(*w));
+    w->writeProc = writeProc;
+    w->stateCtx = stateCtx;
+    w->buffer = (uint8_t *)malloc(STATE_WRITE_BUFFER_SIZE);
+    if (w->buffer == NULL)
+        return false;
+    state_write_u32(w, STATE_MAGIC);
+    state_write_u32(w, STATE_VERSION);
+    return true;
+}
+
+static inline void state_write_chunk_header(StateWriter *w, uint32_t tag,
+                                            uint32_t size) {
+    state_write_u32(w, tag);
+    state_write_u32(w, size);
+}
+
+// Appends the checksum and frees the writer. Returns false if any write failed
+static inline bool state_writer_end(StateWriter *w) {
+    state_write_chunk_header(w, STATE_TAG_END, 4);
+    state_writer_flush(w);
+    uint8_t bytes[4];
+    state_put_u32(bytes, w->crc);
+    if (!w->failed && w->writeProc(w->stateCtx, bytes, 4) != 4)
+        w->failed = true;
+    free(w->buffer);
+    w->buffer = NULL;
+    return !w->failed;
+}
+
+// Bytes state_write_all() writes for 'count' parameters: magic and version,
+// the PARM chunk and the END chunk
+static inline uint32_t state_size(uint32_t count) {
+    return 8 + 8 + 4 + count * 8 + 12;
+}
+
+// Writes a whole state of 'count' parameters, 'ids[i]' set to 'values[i]', to
+// 'writeProc'. What cplug_saveState and preset banks store, read back by
+// state_read_all(). Returns false if any write failed
+static inline bool state_write_all(const void *stateCtx,
+                                   cplug_writeProc writeProc,
+                                   const uint32_t *ids, const float *values,
+                                   uint32_t count) {
+    StateWriter writer;
+    if (!state_writer_begin(&writer, stateCtx, writeProc))
+        return false;
+    state_write_chunk_header(&writer, STATE_TAG_PARAMS, 4 + count * 8);
+    state_write_u32(&writer, count);
+    for (uint32_t i = 0; i < count; i++) {
+        state_write_u32(&writer, ids[i]);
+        state_write_f32(&writer, values[i]);
+    }
+    return state_writer_end(&writer);
+}
+
+/* --------------------------------------------------------------------------
+ * Reading */
+
+typedef struct StateReader {
+    cplug_readProc readProc;
+    const void *stateCtx;
+    uint32_t crc; // of every byte consumed so far
+    bool failed;  // ran out of data
+    uint32_t pos;
+    uint32_t len;
+    uint8_t *buffer; // STATE_READ_BUFFER_SIZE
+} StateReader;
+
+static inline bool state_reader_begin(StateReader *r, const void *stateCtx,
+                                      cplug_readProc readProc) {
+    memset(r, 0, sizeof(*r));
+    r->readProc = readProc;
+    r->stateCtx = stateCtx;
+    r->buffer = (uint8_t *)malloc(STATE_READ_BUFFER_SIZE);
+    return r->buffer != NULL;
+}
+
+static inline void state_reader_end(StateReader *r) {
+    free(r->buffer);
+    r->buffer = NULL;
+}
+
+// Refills the buffer once it's empty. Returns false at the end of the data
+static inline bool state_reader_fill(StateReader *r) {
+    if (r->pos < r->len)
+        return true;
+    int64_t n = r->readProc(r->stateCtx, r->buffer, STATE_READ_BUFFER_SIZE);
+    r->pos = 0;
+    r->len = n > 0 ? (uint32_t)n : 0;
+    return r->len > 0;
+}
+
+// Copies 'size' bytes to 'dst', or skips them when 'dst' is NULL
+static inline bool state_read(StateReader *r, void *dst, uint32_t size) {
+    uint8_t *out = (uint8_t *)dst;
+    while (size > 0) {
+        if (!state_reader_fill(r)) {
+            r->failed = true;
+            return false;
+        }
+        uint32_t n = r->len - r->pos;
+        if (n > size)
+            n = size;
+        r->crc = state_crc32_update(r->crc, r->buffer + r->pos, n);
+        if (out) {
+            memcpy(out, r->buffer + r->pos, n);
+            out += n;
+        }
+        r->pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+static inline bool state_read_u32(StateReader *r, uint32_t *v) {
+    uint8_t bytes[4];
+    if (!state_read(r, bytes, sizeof(bytes)))
+        return false;
+    *v = state_get_u32(bytes);
+    return true;
+}
+
+static inline bool state_read_f32(StateReader *r, float *v) {
+    uint32_t bits;
+    if (!state_read_u32(r, &bits))
+        return false;
+    memcpy(v, &bits, sizeof(*v));
+    return true;
+}
+
+// Called once per parameter found in the state
+typedef void (*StateParamProc)(void *user, uint32_t paramId, float value);
+
+typedef enum StateResult {
+    STATE_OK = 0,
+    STATE_LEGACY_OK,     // the old flat format, no checksum to verify
+    STATE_TRUNCATED,     // data ended early
+    STATE_BAD_CHECKSUM,  // the parameters read may be corrupt
+    STATE_NEWER_VERSION, // written by a newer build, nothing was read
+    STATE_OUT_OF_MEMORY,
+} StateResult;
+
+// Streams a state from 'readProc', reporting every parameter to 'paramProc'.
+// Only trust what was reported when STATE_OK or STATE_LEGACY_OK is returned
+static inline StateResult state_read_all(const void *stateCtx,
+                                         cplug_readProc readProc,
+                                         StateParamProc paramProc, void *user) {
+    StateReader r;
+    if (!state_reader_begin(&r, stateCtx, readProc))
+        return STATE_OUT_OF_MEMORY;
+
+    StateResult result = STATE_TRUNCATED;
+    uint32_t magic, version;
+    if (!state_read_u32(&r, &magic))
+        goto done;
+
+    if (magic != STATE_MAGIC) {
+        // Legacy format: 'magic' was the first parameter ID. Parameters that
+        // end early are dropped, matching the old loader
+        uint32_t paramId = magic;
+        float value;
+        while (state_read_f32(&r, &value)) {
+            paramProc(user, paramId, value);
+            if (!state_read_u32(&r, &paramId))
+                break;
+        }
+        result = STATE_LEGACY_OK;
+        goto done;
+    }
+
+    if (!state_read_u32(&r, &version))
+        goto done;
+    if (version > STATE_VERSION) {
+        result = STATE_NEWER_VERSION;
+        goto done;
+    }
+
+    for (;;) {
+        uint32_t tag, size;
+        if (!state_read_u32(&r, &tag) || !state_read_u32(&r, &size))
+            goto done;
+
+        if (tag == STATE_TAG_END) {
+            const uint32_t crc = r.crc;
+            uint32_t stored;
+            if (size != 4 || !state_read_u32(&r, &stored))
+                goto done;
+            result = stored == crc ? STATE_OK : STATE_BAD_CHECKSUM;
+            goto done;
+        }
+
+        if (tag == STATE_TAG_PARAMS && size >= 4) {
+            uint32_t count;
+            if (!state_read_u32(&r, &count))
+                goto done;
+            if (count > (size - 4) / 8)
+                count = (size - 4) / 8;
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t paramId;
+                float value;
+                if (!state_read_u32(&r, &paramId) ||
+                    !state_read_f32(&r, &value))
+                    goto done;
+                paramProc(user, paramId, value);
+            }
+            size -= 4 + count * 8;
+        }
+
+        // Unknown chunks and any padding after known ones
+        if (!state_read(&r, NULL, size))
+            goto done;
+    }
+
+done:
+    state_reader_end(&r);
+    return result;
+}
+
+#endif // STATE_H
@@ -0,0 +1,154 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Timer wheel of events keyed by absolute sample time
+// An event due at time 't' is linked into slot t % TIMER_WHEEL_SLOTS, so
+// scheduling is O(1) and events come out in time order by visiting the slots
+// one frame after the other: nothing is ever sorted. Events due a whole turn
+// of the wheel or more ahead share a slot with nearer ones and are skipped
+// until their turn comes. A bitmap of the slots holding events lets a block
+// skip the empty ones 32 at a time.
+//
+// Events due at the same time come out in the order they were scheduled.
+// Nodes come from a fixed pool, so nothing allocates: a schedule that doesn't
+// fit is dropped and counted in 'numDropped'.
+//
+// Single threaded. The audio thread schedules and pops.
+
+#include <cplug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bits.h"
+
+// Both powers of 2
+#define TIMER_WHEEL_SLOTS    4096
+#define TIMER_WHEEL_CAPACITY 4096
+
+#define TIMER_WHEEL_NONE 0xffffffff
+
+typedef struct TimerWheelNode {
+    uint64_t time;
+    uint32_t next; // TIMER_WHEEL_NONE ends a list
+    CplugEvent event;
+} TimerWheelNode;
+
+typedef struct TimerWheel {
+    // Time of the next frame to visit. Every event before it has been popped
+    uint64_t now;
+    uint32_t numPending;
+    uint32_t numDropped;
+
+    uint32_t head[TIMER_WHEEL_SLOTS];
+    uint32_t tail[TIMER_WHEEL_SLOTS];
+    uint32_t occupied[TIMER_WHEEL_SLOTS / 32];
+
+    uint32_t freeList;
+    TimerWheelNode nodes[TIMER_WHEEL_CAPACITY];
+} TimerWheel;
+
+static inline void timer_wheel_init(TimerWheel *wheel, uint64_t now) {
+    wheel->now = now;
+    wheel->numPending = 0;
+    wheel->numDropped = 0;
+    memset(wheel->head, 0xff, sizeof(wheel->head));
+    memset(wheel->tail, 0xff, sizeof(wheel->tail));
+    memset(wheel->occupied, 0, sizeof(wheel->occupied));
+    for (uint32_t i = 0; i < TIMER_WHEEL_CAPACITY; i++)
+        wheel->nodes[i].next = i + 1;
+    wheel->nodes[TIMER_WHEEL_CAPACITY - 1].next = TIMER_WHEEL_NONE;
+    wheel->freeList = 0;
+}
+
+// Schedules 'event' at 'time'. Times already passed are due at once. Returns
+// false, dropping the event, when the pool is full
+static inline bool timer_wheel_schedule(TimerWheel *wheel, uint64_t time,
+                                        const CplugEvent *event) {
+    const uint32_t idx = wheel->freeList;
+    if (idx == TIMER_WHEEL_NONE) {
+        wheel->numDropped++;
+        return false;
+    }
+    TimerWheelNode *node = &wheel->nodes[idx];
+    wheel->freeList = node->next;
+
+    node->time = time > wheel->now ? time : wheel->now;
+    node->next = TIMER_WHEEL_NONE;
+    node->event = *event;
+
+    const uint32_t slot = (uint32_t)node->time & (TIMER_WHEEL_SLOTS - 1);
+    if (wheel->head[slot] == TIMER_WHEEL_NONE) {
+        wheel->head[slot] = idx;
+        wheel->occupied[slot >> 5] |= 1u << (slot & 31);
+    } else {
+        wheel->nodes[wheel->tail[slot]].next = idx;
+    }
+    wheel->tail[slot] = idx;
+    wheel->numPending++;
+    return true;
+}
+
+// First time from 'time' on, up to 'end', whose slot holds any event
+static inline uint64_t timer_wheel_next_occupied(const TimerWheel *wheel,
+                                                 uint64_t time, uint64_t end) {
+    while (time < end) {
+        const uint32_t slot = (uint32_t)time & (TIMER_WHEEL_SLOTS - 1);
+        const uint32_t bits = wheel->occupied[slot >> 5] >> (slot & 31);
+        if (bits != 0) {
+            time += bits_lowest_set(bits);
+            return time < end ? time : end;
+        }
+        time += 32 - (slot & 31);
+    }
+    return end;
+}
+
+// Pops the next event due before 'end', in time order, and its time. Returns
+// false once there is none left, the wheel having moved on to 'end'
+static inline bool timer_wheel_pop(TimerWheel *wheel, uint64_t end,
+                                   CplugEvent *event, uint64_t *time) {
+    if (end <= wheel->now)
+        return false;
+    while (wheel->now < end) {
+        if (wheel->numPending == 0)
+            break;
+        const uint64_t t = timer_wheel_next_occupied(wheel, wheel->now, end);
+        if (t == end)
+            break;
+
+        const uint32_t slot = (uint32_t)t & (TIMER_WHEEL_SLOTS - 1);
+        uint32_t prev = TIMER_WHEEL_NONE;
+        for (uint32_t idx = wheel->head[slot]; idx != TIMER_WHEEL_NONE;
+             idx = wheel->nodes[idx].next) {
+            TimerWheelNode *node = &wheel->nodes[idx];
+            if (node->time != t) {
+                // Due on a later turn
+                prev = idx;
+                continue;
+            }
+            if (prev == TIMER_WHEEL_NONE)
+                wheel->head[slot] = node->next;
+            else
+                wheel->nodes[prev].next = node->next;
+            if (wheel->tail[slot] == idx)
+                wheel->tail[slot] = prev;
+            if (wheel->head[slot] == TIMER_WHEEL_NONE)
+                wheel->occupied[slot >> 5] &= ~(1u << (slot & 31));
+
+            *event = node->event;
+            *time = t;
+            node->next = wheel->freeList;
+            wheel->freeList = idx;
+            wheel->numPending--;
+            // More may be due at 't'
+            wheel->now = t;
+            return true;
+        }
+        wheel->now = t + 1;
+    }
+    wheel->now = end;
+    return false;
+}
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,127 @@
+#ifndef VOICE_GROUPS_H
+#define VOICE_GROUPS_H
+
+// Voices rendered on a WorkerPool
+// The active voices are cut into groups of VOICE_GROUP_SIZE, by position in
+// VoicePool::active, and every group is a task of the pool. A group adds its
+// voices into buffers of its own, one per output bus it plays on, and the
+// buffers are mixed into the buses afterwards, in group order. How many
+// threads took part, and which of them rendered which group, doesn't change a
+// single sum, so the output is the same bit for bit whatever the scheduling.
+// Only the order the voices are summed in differs from
+// voice_pool_render_buses(), by rounding.
+//
+// The buffers are allocated by voice_groups_prepare() on the main thread.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "voices.h"
+#include "worker_pool.h"
+
+#define VOICE_GROUP_SIZE 8
+#define VOICE_MAX_GROUPS (MAX_VOICES / VOICE_GROUP_SIZE)
+
+typedef struct VoiceGroups {
+    // 'numBuses' buffers of 'maxFrames' per group
+    float *buffers;
+    uint32_t numBuses;
+    uint32_t maxFrames;
+
+    // The render in progress, read by the tasks
+    VoicePool *pool;
+    uint32_t numFrames;
+    // Written by each group's task: the buses it played on and the voices
+    // that finished
+    uint32_t busMask[VOICE_MAX_GROUPS];
+    uint32_t numDone[VOICE_MAX_GROUPS];
+} VoiceGroups;
+
+// Allocates buffers for 'numBuses' buses and up to 'maxFrames' frames. Main
+// thread only, while the audio thread is idle. Returns false on failure,
+// leaving 'groups' unable to render
+static inline bool voice_groups_prepare(VoiceGroups *groups,
+                                        uint32_t numBuses,
+                                        uint32_t maxFrames) {
+    if (groups->buffers != NULL && groups->numBuses == numBuses &&
+        groups->maxFrames >= maxFrames)
+        return true;
+    free(groups->buffers);
+    groups->buffers = (float *)malloc(sizeof(float) * VOICE_MAX_GROUPS *
+                                      numBuses * maxFrames);
+    groups->numBuses = numBuses;
+    groups->maxFrames = groups->buffers != NULL ? maxFrames : 0;
+    return groups->buffers != NULL;
+}
+
+static inline void voice_groups_free(VoiceGroups *groups) {
+    free(groups->buffers);
+    groups->buffers = NULL;
+    groups->maxFrames = 0;
+}
+
+static inline float *voice_groups_buffer(const VoiceGroups *groups,
+                                         uint32_t group, uint32_t bus) {
+    return groups->buffers +
+           (size_t)(group * groups->numBuses + bus) * groups->maxFrames;
+}
+
+// WorkerTaskFn rendering group 'group'
+static inline void voice_groups_task(void *ctx, uint32_t group) {
+    VoiceGroups *groups = (VoiceGroups *)ctx;
+    VoicePool *pool = groups->pool;
+    const uint32_t first = group * VOICE_GROUP_SIZE;
+    uint32_t end = first + VOICE_GROUP_SIZE;
+    end = end < pool->numActive ? end : pool->numActive;
+
+    uint32_t busMask = 0;
+    for (uint32_t i = first; i < end; i++)
+        busMask |= 1u << pool->bus[pool->active[i]];
+    float *outs[VOICE_MAX_BUSES];
+    for (uint32_t b = 0; b < groups->numBuses; b++) {
+        outs[b] = voice_groups_buffer(groups, group, b);
+        if (busMask & (1u << b))
+            memset(outs[b], 0, sizeof(float) * groups->numFrames);
+    }
+    groups->busMask[group] = busMask;
+    groups->numDone[group] = voice_pool_render_range(
+        pool, outs, groups->numFrames, first, end);
+}
+
+// Adds every active voice of 'pool' into 'outs[bus]', as
+// voice_pool_render_buses() does, on up to 'numThreads' threads of 'workers',
+// the caller's included. Returns false, rendering nothing, for more frames
+// than were prepared for
+static inline bool voice_groups_render(VoiceGroups *groups,
+                                       WorkerPool *workers,
+                                       uint32_t numThreads, VoicePool *pool,
+                                       float *const *outs,
+                                       uint32_t numFrames) {
+    if (numFrames > groups->maxFrames || pool->numBuses > groups->numBuses)
+        return false;
+    const uint32_t numGroups =
+        (pool->numActive + VOICE_GROUP_SIZE - 1) / VOICE_GROUP_SIZE;
+    groups->pool = pool;
+    groups->numFrames = numFrames;
+    worker_pool_run(workers, numThreads, numGroups, voice_groups_task,
+                    groups);
+
+    uint32_t numDone = 0;
+    for (uint32_t g = 0; g < numGroups; g++) {
+        for (uint32_t b = 0; b < groups->numBuses; b++) {
+            if (!(groups->busMask[g] & (1u << b)))
+                continue;
+            const float *in = voice_groups_buffer(groups, g, b);
+            float *out = outs[b];
+            for (uint32_t i = 0; i < numFrames; i++)
+                out[i] += in[i];
+        }
+        numDone += groups->numDone[g];
+    }
+    voice_pool_free_finished(pool, numDone);
+    return true;
+}
+
+#endif // VOICE_GROUPS_H
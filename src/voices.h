@@ -0,0 +1,565 @@
+#ifndef VOICES_H
+#define VOICES_H
+
+// Fixed capacity polyphonic voice pool
+// Per voice state is kept as structure-of-arrays so the renderer can run tight
+// loops over the active voices only.
+// Nothing here allocates; the pool lives inside the Plugin struct and every
+// operation is safe on the audio thread.
+//
+// Expression (pitch bend, pressure, timbre) changes a voice at control rate:
+// voice_pool_express() sets where the voice's pitch and gain should go, and
+// the renderer glides there in VOICE_GLIDE_STEPS steps of VOICE_CONTROL_FRAMES
+// frames, each rendered by the same kernels as a steady voice. Voices that
+// aren't gliding render their whole range in one call. Modulation, see
+// voice_pool_modulate(), glides the same way, over a single control step of
+// the modulation matrix.
+//
+// Every voice plays an ADSR envelope, see voice_pool_env_enter(). Segments are
+// closed form, like the ramps of smoother.h, and the oscillator kernels move
+// the gain along them per sample, so a voice only looks at its envelope again
+// where a segment ends. Voices are freed once their release is over.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "osc.h"
+#include "wavetable.h"
+
+#define MAX_VOICES      256
+#define VOICE_NONE      0xffff
+#define VOICE_NUM_KEYS  (16 * 128) // MIDI channel * note
+#define VOICE_MAX_BUSES 16         // one per MIDI channel
+
+// Expression glides, 8 steps of 16 frames: 2.7 ms at 48 kHz
+#define VOICE_CONTROL_FRAMES 16
+#define VOICE_GLIDE_STEPS    8
+// Mipmap levels a timbre of 0 moves wavetables up, to tables with fewer
+// harmonics, making them darker
+#define VOICE_TIMBRE_LEVELS 4
+
+// Exponential segments head for a target past their end, placed so that this
+// part of the distance to it is left when they get there. Reaching the end in
+// a finite time keeps releases from ringing on far below hearing
+#define VOICE_ENV_CURVE   0.001f
+#define VOICE_ENV_FOREVER 0xffffffff
+
+enum VoiceState {
+    VOICE_IDLE = 0,
+    VOICE_HELD,
+    // Key released, kept sounding by a sustain or sostenuto pedal
+    VOICE_SUSTAINED,
+    // Key released, playing the release of its envelope
+    VOICE_RELEASED,
+};
+
+enum VoiceEnvStage {
+    VOICE_ENV_ATTACK = 0, // linear, up to 1
+    VOICE_ENV_DECAY,      // exponential, down to the sustain level
+    VOICE_ENV_SUSTAIN,
+    VOICE_ENV_RELEASE, // exponential, down to 0
+    // Silent. The voice is freed at the end of the range being rendered
+    VOICE_ENV_DONE,
+};
+
+// What happens to a new note once every voice allowed by 'voiceLimit' is in use
+enum VoiceSteal {
+    VOICE_STEAL_OLDEST = 0,
+    VOICE_STEAL_QUIETEST,
+    // Retriggering a sounding note reuses its voice. Falls back to the oldest
+    // voice when the pool is full
+    VOICE_STEAL_SAME_NOTE,
+    VOICE_STEAL_COUNT,
+};
+
+typedef struct VoicePool {
+    // Hot state, touched every sample
+    float phase[MAX_VOICES]; // 0-1
+    float inc[MAX_VOICES];   // phase increment per sample
+    float gain[MAX_VOICES];  // linear gain
+
+    // Expression, touched every VOICE_CONTROL_FRAMES while gliding
+    float incStep[MAX_VOICES];
+    float gainStep[MAX_VOICES];
+    uint8_t glideSteps[MAX_VOICES]; // steps left, 0 when steady
+    uint8_t darkness[MAX_VOICES];   // mipmap levels added for the timbre
+    // Pitch in semitones and gain factor set by expression and by modulation.
+    // 'inc' and 'gain' head for their product with the base values
+    float exprSemitones[MAX_VOICES];
+    float exprGain[MAX_VOICES];
+    float modSemitones[MAX_VOICES];
+    float modGain[MAX_VOICES];
+    uint8_t modulated[MAX_VOICES]; // 0 until the first voice_pool_modulate
+
+    // Envelope, touched where a segment ends. 'n' frames into a segment the
+    // level is offset + slope*n + scale*2^(log2Rate*n), and from one sample to
+    // the next it moves as level(n + 1) = mul * level(n) + add
+    uint8_t envStage[MAX_VOICES];   // VoiceEnvStage
+    uint32_t envPos[MAX_VOICES];    // frames into the segment
+    uint32_t envLength[MAX_VOICES]; // VOICE_ENV_FOREVER for the held ones
+    float envOffset[MAX_VOICES];
+    float envSlope[MAX_VOICES];
+    float envScale[MAX_VOICES];
+    float envLog2Rate[MAX_VOICES];
+    float envMul[MAX_VOICES];
+    float envAdd[MAX_VOICES];
+
+    // Cold state, touched on note events only
+    uint8_t state[MAX_VOICES];
+    uint16_t key[MAX_VOICES];       // channel * 128 + note
+    uint32_t startedAt[MAX_VOICES]; // value of 'noteCounter' at note on
+    uint16_t activePos[MAX_VOICES]; // index into 'active'
+    uint8_t bus[MAX_VOICES];        // output, from the channel at note on
+    float baseInc[MAX_VOICES];      // 'inc' without expression
+    float baseGain[MAX_VOICES];     // 'gain' without expression, from velocity
+    // Held by the sostenuto pedal: its key was down when the pedal went down
+    uint8_t sostenuto[MAX_VOICES];
+    float pressure[MAX_VOICES];     // poly or channel pressure, 0-1
+    float velocity[MAX_VOICES];     // 0-1
+
+    // Dense list of voices currently sounding
+    uint16_t active[MAX_VOICES];
+    uint32_t numActive;
+
+    // Stack of idle voices
+    uint16_t freeList[MAX_VOICES];
+    uint32_t numFree;
+
+    // Voice holding each key, or VOICE_NONE. Makes note on/off lookups O(1)
+    uint16_t keyToVoice[VOICE_NUM_KEYS];
+
+    // Active voices per output bus
+    uint32_t numOnBus[VOICE_MAX_BUSES];
+    // Notes on MIDI channel 'c' play through bus c % numBuses. 1 -
+    // VOICE_MAX_BUSES
+    uint32_t numBuses;
+
+    uint32_t noteCounter;
+    uint32_t voiceLimit; // 1 - MAX_VOICES
+    uint32_t stealMode;  // VoiceSteal
+    uint32_t waveform;   // Waveform
+    // Offline quality: exact sines and Hermite wavetables
+    bool exact;
+    // Envelope of every voice, read as each segment starts. Times in ms,
+    // sustain level 0-1
+    float attackMs;
+    float decayMs;
+    float sustain;
+    float releaseMs;
+    float sampleRate;
+    // Shared tables for 'sampleRate', NULL until the sample rate is known.
+    // Every voice plays a sine until then
+    const WavetableSet *wavetables;
+} VoicePool;
+
+static inline void voice_pool_init(VoicePool *pool, uint32_t voiceLimit) {
+    memset(pool, 0, sizeof(*pool));
+    for (uint32_t i = 0; i < MAX_VOICES; i++)
+        pool->freeList[i] = (uint16_t)(MAX_VOICES - 1 - i);
+    pool->numFree = MAX_VOICES;
+    for (uint32_t i = 0; i < VOICE_NUM_KEYS; i++)
+        pool->keyToVoice[i] = VOICE_NONE;
+    pool->voiceLimit = voiceLimit;
+    pool->numBuses = 1;
+    pool->stealMode = VOICE_STEAL_OLDEST;
+    pool->waveform = WAVE_SINE;
+    // A plain gate until set: notes start at full level and stop at once
+    pool->sustain = 1.0f;
+    pool->sampleRate = 48000.0f;
+}
+
+// Rescales the increments of sounding voices so held notes keep their pitch
+static inline void voice_pool_set_sample_rate(VoicePool *pool,
+                                              float sampleRate) {
+    const float ratio = pool->sampleRate / sampleRate;
+    for (uint32_t i = 0; i < pool->numActive; i++) {
+        const uint32_t v = pool->active[i];
+        pool->inc[v] *= ratio;
+        pool->incStep[v] *= ratio;
+        pool->baseInc[v] *= ratio;
+    }
+    pool->sampleRate = sampleRate;
+}
+
+static inline void voice_pool_free_voice(VoicePool *pool, uint32_t voice) {
+    // Swap remove from the active list
+    uint32_t pos = pool->activePos[voice];
+    uint16_t last = pool->active[--pool->numActive];
+    pool->active[pos] = last;
+    pool->activePos[last] = (uint16_t)pos;
+    pool->numOnBus[pool->bus[voice]]--;
+
+    if (pool->keyToVoice[pool->key[voice]] == voice)
+        pool->keyToVoice[pool->key[voice]] = VOICE_NONE;
+    pool->state[voice] = VOICE_IDLE;
+    pool->freeList[pool->numFree++] = (uint16_t)voice;
+}
+
+// Envelope level of 'voice' where it stands now
+static inline float voice_pool_env_level(const VoicePool *pool,
+                                         uint32_t voice) {
+    const float n = (float)pool->envPos[voice];
+    float level = pool->envOffset[voice] + pool->envSlope[voice] * n;
+    // Held and linear segments have no exponential part
+    if (pool->envScale[voice] != 0.0f)
+        level +=
+            pool->envScale[voice] * osc_exp2(pool->envLog2Rate[voice] * n);
+    return level;
+}
+
+// Starts segment 'stage' of the envelope of 'voice' from 'level'. Segments too
+// short to last a sample are skipped
+static inline void voice_pool_env_enter(VoicePool *pool, uint32_t voice,
+                                        uint32_t stage, float level) {
+    uint32_t length = VOICE_ENV_FOREVER;
+    float to = level;
+    while (stage == VOICE_ENV_ATTACK || stage == VOICE_ENV_DECAY ||
+           stage == VOICE_ENV_RELEASE) {
+        const float ms = stage == VOICE_ENV_ATTACK  ? pool->attackMs
+                         : stage == VOICE_ENV_DECAY ? pool->decayMs
+                                                    : pool->releaseMs;
+        to = stage == VOICE_ENV_ATTACK  ? 1.0f
+             : stage == VOICE_ENV_DECAY ? pool->sustain
+                                        : 0.0f;
+        const float frames = ms * 0.001f * pool->sampleRate + 0.5f;
+        length = frames < 4e9f ? (uint32_t)frames : 4000000000u;
+        if (length > 0)
+            break;
+        level = to;
+        stage = stage == VOICE_ENV_RELEASE ? VOICE_ENV_DONE : stage + 1;
+        length = VOICE_ENV_FOREVER;
+    }
+
+    float offset = level, slope = 0.0f, scale = 0.0f, log2Rate = 0.0f;
+    if (stage == VOICE_ENV_ATTACK) {
+        slope = (to - level) / (float)length;
+    } else if (length != VOICE_ENV_FOREVER) {
+        offset = to - (level - to) * (VOICE_ENV_CURVE / (1 - VOICE_ENV_CURVE));
+        scale = level - offset;
+        log2Rate = log2f(VOICE_ENV_CURVE) / (float)length;
+    }
+    pool->envStage[voice] = (uint8_t)stage;
+    pool->envPos[voice] = 0;
+    pool->envLength[voice] = length;
+    pool->envOffset[voice] = offset;
+    pool->envSlope[voice] = slope;
+    pool->envScale[voice] = scale;
+    pool->envLog2Rate[voice] = log2Rate;
+    pool->envMul[voice] = osc_exp2(log2Rate);
+    pool->envAdd[voice] = slope + offset * (1.0f - pool->envMul[voice]);
+}
+
+// Moves the envelope of 'voice' on to its next segment, the current one being
+// over
+static inline void voice_pool_env_next(VoicePool *pool, uint32_t voice) {
+    const uint32_t stage = pool->envStage[voice];
+    const uint32_t next = stage < VOICE_ENV_SUSTAIN  ? stage + 1
+                          : stage == VOICE_ENV_RELEASE ? VOICE_ENV_DONE
+                                                       : stage;
+    voice_pool_env_enter(pool, voice, next, voice_pool_env_level(pool, voice));
+}
+
+// Sets the envelope every voice plays. Segments already started keep their
+// shape, but held notes head for a new sustain level over a decay
+static inline void voice_pool_set_envelope(VoicePool *pool, float attackMs,
+                                           float decayMs, float sustain,
+                                           float releaseMs) {
+    const bool sustainMoved = sustain != pool->sustain;
+    pool->attackMs = attackMs;
+    pool->decayMs = decayMs;
+    pool->sustain = sustain;
+    pool->releaseMs = releaseMs;
+    if (!sustainMoved)
+        return;
+    for (uint32_t i = 0; i < pool->numActive; i++) {
+        const uint32_t v = pool->active[i];
+        if (pool->envStage[v] == VOICE_ENV_DECAY ||
+            pool->envStage[v] == VOICE_ENV_SUSTAIN)
+            voice_pool_env_enter(pool, v, VOICE_ENV_DECAY,
+                                 voice_pool_env_level(pool, v));
+    }
+}
+
+// Stealing is the only operation that scans, and only the active voices. It
+// runs when the pool is full. Voices already releasing go first
+static inline uint32_t voice_pool_pick_victim(const VoicePool *pool) {
+    uint32_t victim = pool->active[0];
+    const bool quietest = pool->stealMode == VOICE_STEAL_QUIETEST;
+    float victimGain = quietest ? pool->gain[victim] *
+                                      voice_pool_env_level(pool, victim)
+                                : 0.0f;
+    for (uint32_t i = 1; i < pool->numActive; i++) {
+        const uint32_t v = pool->active[i];
+        const bool released = pool->state[v] == VOICE_RELEASED;
+        if (released != (pool->state[victim] == VOICE_RELEASED)) {
+            if (!released)
+                continue;
+        } else if (quietest) {
+            if (pool->gain[v] * voice_pool_env_level(pool, v) >= victimGain)
+                continue;
+        } else {
+            // Unsigned difference keeps the comparison correct when
+            // 'noteCounter' wraps
+            if (pool->noteCounter - pool->startedAt[v] <=
+                pool->noteCounter - pool->startedAt[victim])
+                continue;
+        }
+        victim = v;
+        if (quietest)
+            victimGain = pool->gain[v] * voice_pool_env_level(pool, v);
+    }
+    return victim;
+}
+
+// Lets go of 'voice': it plays the release of its envelope from wherever that
+// is, then is freed. Without a release time it is freed at once
+static inline void voice_pool_release(VoicePool *pool, uint32_t voice) {
+    pool->state[voice] = VOICE_RELEASED;
+    voice_pool_env_enter(pool, voice, VOICE_ENV_RELEASE,
+                         voice_pool_env_level(pool, voice));
+    if (pool->envStage[voice] == VOICE_ENV_DONE)
+        voice_pool_free_voice(pool, voice);
+}
+
+// Starts 'note' and returns its voice, without any expression
+static inline uint32_t voice_pool_note_on(VoicePool *pool, uint32_t channel,
+                                          uint32_t note, float velocity) {
+    const uint32_t key = (channel & 15) * 128 + (note & 127);
+
+    uint32_t voice = pool->keyToVoice[key];
+    if (voice != VOICE_NONE && pool->stealMode != VOICE_STEAL_SAME_NOTE) {
+        // Retriggering a sounding note. The old voice releases and gives up
+        // the key so the lookup stays one slot deep
+        pool->keyToVoice[key] = VOICE_NONE;
+        if (pool->state[voice] != VOICE_RELEASED)
+            voice_pool_release(pool, voice);
+        voice = VOICE_NONE;
+    }
+    // A voice reused for its note attacks from where it is, without a click
+    const float envFrom =
+        voice != VOICE_NONE ? voice_pool_env_level(pool, voice) : 0.0f;
+
+    if (voice == VOICE_NONE) {
+        if (pool->numActive >= pool->voiceLimit || pool->numFree == 0)
+            voice_pool_free_voice(pool, voice_pool_pick_victim(pool));
+
+        voice = pool->freeList[--pool->numFree];
+        pool->activePos[voice] = (uint16_t)pool->numActive;
+        pool->active[pool->numActive++] = (uint16_t)voice;
+        pool->phase[voice] = 0.0f;
+        // A retriggered voice keeps its key, so its bus is already right
+        pool->bus[voice] = (uint8_t)((channel & 15) % pool->numBuses);
+        pool->numOnBus[pool->bus[voice]]++;
+    }
+
+    float Hz = 440.0f * exp2f(((float)(note & 127) - 69.0f) * 0.0833333f);
+    float dB = -60.0f + velocity * 54; // -6dB max
+
+    pool->baseInc[voice] = Hz / pool->sampleRate;
+    pool->baseGain[voice] = powf(10.0f, dB / 20.0f);
+    pool->inc[voice] = pool->baseInc[voice];
+    pool->gain[voice] = pool->baseGain[voice];
+    pool->glideSteps[voice] = 0;
+    pool->darkness[voice] = 0;
+    pool->exprSemitones[voice] = 0.0f;
+    pool->exprGain[voice] = 1.0f;
+    pool->modSemitones[voice] = 0.0f;
+    pool->modGain[voice] = 1.0f;
+    pool->modulated[voice] = 0;
+    pool->sostenuto[voice] = 0;
+    pool->pressure[voice] = 0.0f;
+    pool->velocity[voice] = velocity;
+    pool->state[voice] = VOICE_HELD;
+    pool->key[voice] = (uint16_t)key;
+    pool->startedAt[voice] = pool->noteCounter++;
+    pool->keyToVoice[key] = (uint16_t)voice;
+    voice_pool_env_enter(pool, voice, VOICE_ENV_ATTACK, envFrom);
+    return voice;
+}
+
+// Sends 'voice' to the bus of 'channel' instead of its own, e.g. to keep the
+// notes of an MPE zone together
+static inline void voice_pool_route(VoicePool *pool, uint32_t voice,
+                                    uint32_t channel) {
+    pool->numOnBus[pool->bus[voice]]--;
+    pool->bus[voice] = (uint8_t)((channel & 15) % pool->numBuses);
+    pool->numOnBus[pool->bus[voice]]++;
+}
+
+// Points the pitch and gain of 'voice' at its expression and modulation. They
+// get there in 'numSteps' glide steps, or at once for 0
+static inline void voice_pool_retarget(VoicePool *pool, uint32_t voice,
+                                       uint32_t numSteps) {
+    const float semitones = pool->exprSemitones[voice] +
+                            pool->modSemitones[voice];
+    const float inc =
+        pool->baseInc[voice] * exp2f(semitones * (1.0f / 12.0f));
+    const float gain =
+        pool->baseGain[voice] * pool->exprGain[voice] * pool->modGain[voice];
+    if (numSteps == 0) {
+        pool->inc[voice] = inc;
+        pool->gain[voice] = gain;
+        pool->glideSteps[voice] = 0;
+        return;
+    }
+    pool->incStep[voice] = (inc - pool->inc[voice]) / (float)numSteps;
+    pool->gainStep[voice] = (gain - pool->gain[voice]) / (float)numSteps;
+    pool->glideSteps[voice] = (uint8_t)numSteps;
+}
+
+// Sets the expression of 'voice': its pitch 'semitones' away from its note,
+// its gain 'gainScale' times the velocity's and its 'timbre' (0-1, 0.5 and up
+// leave the sound unchanged). Pitch and gain glide there unless 'jump' is set,
+// as for a note that just started
+static inline void voice_pool_express(VoicePool *pool, uint32_t voice,
+                                      float semitones, float gainScale,
+                                      float timbre, bool jump) {
+    const float dark = (0.5f - timbre) * (2.0f * VOICE_TIMBRE_LEVELS) + 0.5f;
+    pool->darkness[voice] = (uint8_t)(dark > 0.0f ? dark : 0.0f);
+    pool->exprSemitones[voice] = semitones;
+    pool->exprGain[voice] = gainScale;
+    voice_pool_retarget(pool, voice, jump ? 0 : VOICE_GLIDE_STEPS);
+}
+
+// Sets the modulation of 'voice', on top of its expression: 'semitones' more
+// and 'gainScale' times louder. Glides there in 'numSteps' steps, except the
+// first time after note on, which takes it straight there
+static inline void voice_pool_modulate(VoicePool *pool, uint32_t voice,
+                                       float semitones, float gainScale,
+                                       uint32_t numSteps) {
+    if (pool->modulated[voice] && pool->modSemitones[voice] == semitones &&
+        pool->modGain[voice] == gainScale)
+        return;
+    pool->modSemitones[voice] = semitones;
+    pool->modGain[voice] = gainScale;
+    voice_pool_retarget(pool, voice, pool->modulated[voice] ? numSteps : 0);
+    pool->modulated[voice] = 1;
+}
+
+static inline void voice_pool_note_off(VoicePool *pool, uint32_t channel,
+                                       uint32_t note) {
+    const uint32_t key = (channel & 15) * 128 + (note & 127);
+    uint32_t voice = pool->keyToVoice[key];
+    if (voice != VOICE_NONE && pool->state[voice] != VOICE_RELEASED)
+        voice_pool_release(pool, voice);
+}
+
+// Voice holding 'note' on 'channel', or VOICE_NONE
+static inline uint32_t voice_pool_find(const VoicePool *pool, uint32_t channel,
+                                       uint32_t note) {
+    return pool->keyToVoice[(channel & 15) * 128 + (note & 127)];
+}
+
+// Frees voices until no more than 'voiceLimit' are sounding, after the limit
+// was lowered
+static inline void voice_pool_enforce_limit(VoicePool *pool) {
+    while (pool->numActive > pool->voiceLimit)
+        voice_pool_free_voice(pool, voice_pool_pick_victim(pool));
+}
+
+// Mipmap level 'voice' plays its wavetable at: the one its pitch needs, moved
+// up its darkness towards fewer harmonics
+static inline uint32_t voice_pool_table_level(const VoicePool *pool,
+                                              uint32_t voice) {
+    const uint32_t level = wavetable_level(pool->wavetables, pool->inc[voice]) +
+                           pool->darkness[voice];
+    return level < WAVETABLE_NUM_LEVELS ? level : WAVETABLE_NUM_LEVELS - 1;
+}
+
+// Adds 'numFrames' of 'voice' at its current pitch and gain to 'out', times
+// its envelope from 'env' on, along the current segment
+static inline void voice_pool_add(VoicePool *pool, uint32_t voice, float *out,
+                                  uint32_t numFrames, float env) {
+    const WavetableSet *set = pool->wavetables;
+    const float gain = pool->gain[voice] * env;
+    const float gainMul = pool->envMul[voice];
+    const float gainAdd = pool->gain[voice] * pool->envAdd[voice];
+    if (pool->waveform == WAVE_SINE || set == NULL) {
+        pool->phase[voice] =
+            (pool->exact ? osc_sine_add_exact : osc_sine_add)(
+                out, numFrames, pool->phase[voice], pool->inc[voice], gain,
+                gainMul, gainAdd);
+        return;
+    }
+    const uint32_t level = voice_pool_table_level(pool, voice);
+    pool->phase[voice] = (pool->exact ? wavetable_add_hermite : wavetable_add)(
+        out, numFrames, set->tables[pool->waveform - 1][level],
+        pool->phase[voice], pool->inc[voice], gain, gainMul, gainAdd);
+}
+
+// Adds voices 'first' up to 'end' of 'active' into the buffer of their bus,
+// 'outs[bus]', and returns how many finished their envelope, to be freed with
+// voice_pool_free_finished(). A voice only touches its own state, so separate
+// ranges may render on separate threads at once
+static inline uint32_t voice_pool_render_range(VoicePool *pool,
+                                               float *const *outs,
+                                               uint32_t numFrames,
+                                               uint32_t first, uint32_t end) {
+    uint32_t numDone = 0;
+    for (uint32_t i = first; i < end; i++) {
+        const uint32_t v = pool->active[i];
+        float *out = outs[pool->bus[v]];
+        float level = voice_pool_env_level(pool, v);
+        uint32_t done = 0;
+        // A steady voice renders until its segment ends, or the whole range.
+        // A gliding one steps at control rate until its glide is over
+        while (done < numFrames && pool->envStage[v] != VOICE_ENV_DONE) {
+            uint32_t n = numFrames - done;
+            const uint32_t segmentLeft = pool->envLength[v] - pool->envPos[v];
+            n = n < segmentLeft ? n : segmentLeft;
+            if (pool->glideSteps[v] > 0) {
+                n = n < VOICE_CONTROL_FRAMES ? n : VOICE_CONTROL_FRAMES;
+                pool->inc[v] += pool->incStep[v];
+                pool->gain[v] += pool->gainStep[v];
+                pool->glideSteps[v]--;
+            }
+            voice_pool_add(pool, v, out + done, n, level);
+            done += n;
+            pool->envPos[v] += n;
+            if (pool->envPos[v] == pool->envLength[v])
+                voice_pool_env_next(pool, v);
+            else if (done == numFrames)
+                break;
+            level = voice_pool_env_level(pool, v);
+        }
+        numDone += pool->envStage[v] == VOICE_ENV_DONE;
+    }
+    return numDone;
+}
+
+// Frees the 'numDone' voices whose envelope finished
+static inline void voice_pool_free_finished(VoicePool *pool,
+                                            uint32_t numDone) {
+    // Backwards, as freeing moves the last voice into the freed slot
+    for (uint32_t i = pool->numActive; numDone > 0 && i-- > 0;) {
+        const uint32_t v = pool->active[i];
+        if (pool->envStage[v] == VOICE_ENV_DONE) {
+            voice_pool_free_voice(pool, v);
+            numDone--;
+        }
+    }
+}
+
+// Adds every active voice into the buffer of its bus, 'outs[bus]'. Buses may
+// share a buffer. Still a single pass over the active voices, whatever the
+// number of buses. Voices whose envelope finished are freed at the end
+static inline void voice_pool_render_buses(VoicePool *pool, float *const *outs,
+                                           uint32_t numFrames) {
+    voice_pool_free_finished(
+        pool, voice_pool_render_range(pool, outs, numFrames, 0,
+                                      pool->numActive));
+}
+
+// Sums every active voice into 'out', whatever its bus
+static inline void voice_pool_render(VoicePool *pool, float *out,
+                                     uint32_t numFrames) {
+    float *outs[VOICE_MAX_BUSES];
+    for (uint32_t b = 0; b < VOICE_MAX_BUSES; b++)
+        outs[b] = out;
+    memset(out, 0, sizeof(float) * numFrames);
+    voice_pool_render_buses(pool, outs, numFrames);
+}
+
+#endif // VOICES_H
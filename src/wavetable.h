@@ -0,0 +1,271 @@
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+// Band-limited wavetables
+// Every waveform is stored as a mipmap: one single-cycle table per octave of
+// fundamental frequency, each holding only the harmonics that octave can play
+// without audible aliasing. A voice picks its level from its pitch once per
+// block, then renders with a table lookup and a linear interpolation per
+// sample: no per sample band-limiting math, whatever the waveform. Run
+// 'cplug_example_bench wavetable' to measure aliasing and cost.
+//
+// Which harmonics are audible depends on the sample rate, so a set of tables
+// is built per sample rate. Harmonics may pass Nyquist as long as their alias
+// folds back above 20 kHz, which keeps the top of each octave bright.
+// Building a set takes a few milliseconds and about 250 KB, so sets live in a
+// process-wide cache shared by every instance running at the same rate, see
+// WavetableCache.
+//
+// A waveform is defined by its spectrum, see wavetable_harmonic(). Any single
+// cycle shape can be added the same way.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAVETABLE_SIZE 2048 // samples per cycle, 2^11
+// Level 'l' plays fundamentals up to WAVETABLE_BASE_HZ * 2^(l + 1). The top
+// level covers 20 kHz, above the highest MIDI note
+#define WAVETABLE_NUM_LEVELS 10
+#define WAVETABLE_BASE_HZ    20.0f
+// Aliases of harmonics above Nyquist are allowed as long as they land above
+// this frequency
+#define WAVETABLE_AUDIBLE_HZ 20000.0
+
+enum Waveform {
+    // Played with the polynomial kernels in osc.h, which are alias free
+    WAVE_SINE = 0,
+    WAVE_SAW,
+    WAVE_SQUARE,
+    WAVE_TRIANGLE,
+    WAVE_COUNT,
+};
+
+#define WAVETABLE_NUM_SHAPES (WAVE_COUNT - 1) // every waveform but the sine
+
+typedef struct WavetableSet {
+    float sampleRate;
+    // Tables are followed by a copy of their first sample, so the
+    // interpolation never wraps
+    float tables[WAVETABLE_NUM_SHAPES][WAVETABLE_NUM_LEVELS]
+                [WAVETABLE_SIZE + 1];
+
+    // Owned by the cache
+    uint32_t refCount;
+    struct WavetableSet *next;
+} WavetableSet;
+
+// Sine amplitude of harmonic 'h' (1 based) of 'waveform', normalised to a peak
+// near 1. All built in shapes are odd functions of the phase
+static inline double wavetable_harmonic(int waveform, uint32_t h) {
+    const double pi = 3.14159265358979323846;
+    switch (waveform) {
+    case WAVE_SAW:
+        // Rising ramp
+        return (h & 1 ? -2.0 : 2.0) / (pi * h);
+    case WAVE_SQUARE:
+        return h & 1 ? 4.0 / (pi * h) : 0.0;
+    case WAVE_TRIANGLE:
+        if ((h & 1) == 0)
+            return 0.0;
+        return ((h >> 1) & 1 ? -8.0 : 8.0) / (pi * pi * h * h);
+    default:
+        return 0.0;
+    }
+}
+
+// Highest harmonic allowed in 'level' at 'sampleRate'
+static inline uint32_t wavetable_max_harmonic(uint32_t level,
+                                              double sampleRate) {
+    double limit = sampleRate - WAVETABLE_AUDIBLE_HZ;
+    if (limit < sampleRate * 0.5)
+        limit = sampleRate * 0.5;
+    const double topHz = WAVETABLE_BASE_HZ * (double)(2u << level);
+    uint32_t h = (uint32_t)(limit / topHz);
+    if (h > WAVETABLE_SIZE / 2 - 1)
+        h = WAVETABLE_SIZE / 2 - 1;
+    return h > 0 ? h : 1;
+}
+
+// Builds every table of 'set' by additive synthesis. 'sine' holds one cycle of
+// sin(2 * pi * i / WAVETABLE_SIZE), shared through the cache
+static inline bool wavetable_set_build(WavetableSet *set, float sampleRate,
+                                       const double *sine) {
+    double *sum = (double *)malloc(sizeof(double) * WAVETABLE_SIZE);
+    if (sum == NULL)
+        return false;
+    set->sampleRate = sampleRate;
+
+    for (int s = 0; s < WAVETABLE_NUM_SHAPES; s++) {
+        const int waveform = s + 1;
+        // Levels only differ by how many harmonics they keep, so each one
+        // starts from the one above and adds the missing harmonics
+        memset(sum, 0, sizeof(double) * WAVETABLE_SIZE);
+        uint32_t numHarmonics = 0;
+        for (int level = WAVETABLE_NUM_LEVELS - 1; level >= 0; level--) {
+            const uint32_t maxHarmonic =
+                wavetable_max_harmonic((uint32_t)level, sampleRate);
+            for (uint32_t h = numHarmonics + 1; h <= maxHarmonic; h++) {
+                const double amp = wavetable_harmonic(waveform, h);
+                if (amp == 0.0)
+                    continue;
+                // h * i wraps around the cycle, so the shared sine is exact
+                for (uint32_t i = 0, t = 0; i < WAVETABLE_SIZE; i++) {
+                    sum[i] += amp * sine[t];
+                    t = (t + h) & (WAVETABLE_SIZE - 1);
+                }
+            }
+            numHarmonics = maxHarmonic;
+
+            float *table = set->tables[s][level];
+            for (uint32_t i = 0; i < WAVETABLE_SIZE; i++)
+                table[i] = (float)sum[i];
+            table[WAVETABLE_SIZE] = table[0];
+        }
+    }
+    free(sum);
+    return true;
+}
+
+// Mipmap level for a voice advancing 'inc' cycles per sample
+static inline uint32_t wavetable_level(const WavetableSet *set, float inc) {
+    const float ratio = inc * set->sampleRate / (2.0f * WAVETABLE_BASE_HZ);
+    if (!(ratio > 1.0f))
+        return 0;
+    int exponent;
+    const float mantissa = frexpf(ratio, &exponent); // [0.5, 1)
+    // ceil(log2(ratio))
+    uint32_t level = (uint32_t)(mantissa == 0.5f ? exponent - 1 : exponent);
+    return level < WAVETABLE_NUM_LEVELS ? level : WAVETABLE_NUM_LEVELS - 1;
+}
+
+// Adds 'gain * table(phase)' to 'out' like the kernels in osc.h, the gain
+// moving the same way, returning the phase following the last sample written.
+// The phase runs as a 32 bit fixed point fraction of a cycle inside the loop:
+// it wraps by itself and the samples don't wait on each other's float rounding
+static inline float wavetable_add(float *out, uint32_t numFrames,
+                                  const float *table, float phase, float inc,
+                                  float gain, float gainMul, float gainAdd) {
+    const uint32_t fracBits = 32 - 11; // log2(WAVETABLE_SIZE)
+    const float fracScale = 1.0f / (float)(1u << fracBits);
+    uint32_t p = (uint32_t)((double)phase * 4294967296.0);
+    const uint32_t step = (uint32_t)((double)inc * 4294967296.0);
+    for (uint32_t i = 0; i < numFrames; i++) {
+        const uint32_t index = p >> fracBits;
+        const float frac = (float)(p & ((1u << fracBits) - 1)) * fracScale;
+        const float a = table[index];
+        out[i] += gain * (a + (table[index + 1] - a) * frac);
+        gain = gain * gainMul + gainAdd;
+        p += step;
+    }
+    // Rounding to float can reach 1, which the caller's next call can't take
+    const float next = (float)((double)p * (1.0 / 4294967296.0));
+    return next < 1.0f ? next : 0.0f;
+}
+
+// wavetable_add() with a 4 point Hermite interpolation instead of the linear
+// one, for offline rendering. Reads a sample either side of the pair, wrapping
+// around the cycle
+static inline float wavetable_add_hermite(float *out, uint32_t numFrames,
+                                          const float *table, float phase,
+                                          float inc, float gain,
+                                          float gainMul, float gainAdd) {
+    const uint32_t fracBits = 32 - 11; // log2(WAVETABLE_SIZE)
+    const uint32_t mask = WAVETABLE_SIZE - 1;
+    const float fracScale = 1.0f / (float)(1u << fracBits);
+    uint32_t p = (uint32_t)((double)phase * 4294967296.0);
+    const uint32_t step = (uint32_t)((double)inc * 4294967296.0);
+    for (uint32_t i = 0; i < numFrames; i++) {
+        const uint32_t index = p >> fracBits;
+        const float f = (float)(p & ((1u << fracBits) - 1)) * fracScale;
+        const float xm1 = table[(index - 1) & mask];
+        const float x0 = table[index];
+        const float x1 = table[index + 1];
+        const float x2 = table[(index + 2) & mask];
+        const float c1 = 0.5f * (x1 - xm1);
+        const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+        const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+        out[i] += gain * (((c3 * f + c2) * f + c1) * f + x0);
+        gain = gain * gainMul + gainAdd;
+        p += step;
+    }
+    const float next = (float)((double)p * (1.0 / 4294967296.0));
+    return next < 1.0f ? next : 0.0f;
+}
+
+/* --------------------------------------------------------------------------
+ * Cache */
+
+// Sets in use, one per sample rate. Main thread only, like
+// cplug_libraryLoad() and cplug_setSampleRateAndBlockSize() that drive it
+typedef struct WavetableCache {
+    WavetableSet *sets;
+    double *sine; // WAVETABLE_SIZE
+} WavetableCache;
+
+static inline bool wavetable_cache_init(WavetableCache *cache) {
+    const double pi = 3.14159265358979323846;
+    cache->sets = NULL;
+    cache->sine = (double *)malloc(sizeof(double) * WAVETABLE_SIZE);
+    if (cache->sine == NULL)
+        return false;
+    for (uint32_t i = 0; i < WAVETABLE_SIZE; i++)
+        cache->sine[i] = sin(2.0 * pi * i / WAVETABLE_SIZE);
+    return true;
+}
+
+// Frees the cache and any set still in it
+static inline void wavetable_cache_free(WavetableCache *cache) {
+    while (cache->sets) {
+        WavetableSet *set = cache->sets;
+        cache->sets = set->next;
+        free(set);
+    }
+    free(cache->sine);
+    cache->sine = NULL;
+}
+
+// Returns the set for 'sampleRate', building it if no instance holds one yet.
+// Returns NULL when out of memory
+static inline WavetableSet *wavetable_cache_acquire(WavetableCache *cache,
+                                                    float sampleRate) {
+    for (WavetableSet *set = cache->sets; set; set = set->next) {
+        if (set->sampleRate == sampleRate) {
+            set->refCount++;
+            return set;
+        }
+    }
+    if (cache->sine == NULL)
+        return NULL;
+    WavetableSet *set = (WavetableSet *)malloc(sizeof(WavetableSet));
+    if (set == NULL)
+        return NULL;
+    if (!wavetable_set_build(set, sampleRate, cache->sine)) {
+        free(set);
+        return NULL;
+    }
+    set->refCount = 1;
+    set->next = cache->sets;
+    cache->sets = set;
+    return set;
+}
+
+// Drops a reference taken by wavetable_cache_acquire(). The last one frees the
+// set
+static inline void wavetable_cache_release(WavetableCache *cache,
+                                           const WavetableSet *set) {
+    for (WavetableSet **link = &cache->sets; *link; link = &(*link)->next) {
+        if (*link == set) {
+            if (--(*link)->refCount == 0) {
+                WavetableSet *unused = *link;
+                *link = unused->next;
+                free(unused);
+            }
+            return;
+        }
+    }
+}
+
+#endif // WAVETABLE_H
@@ -0,0 +1,383 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+// Pool of worker threads helping the audio thread through a list of tasks
+// worker_pool_run() hands the tasks 0 to numTasks - 1 out in contiguous
+// ranges, one per thread taking part, the audio thread included. Each thread
+// takes tasks from the front of its own range and, once that is empty, steals
+// them one at a time from the back of the others'. A range is a single 32 bit
+// word, {tag, end, begin}, so taking a task either way is one compare
+// exchange: nothing locks and every task runs exactly once. The tag is the
+// low bits of the run's generation, which keeps a worker late from an earlier
+// run from taking tasks of the next one.
+//
+// The audio thread renders as much as anyone, so a run never waits for a
+// worker to wake up, only for tasks already started to finish. Workers spin
+// for WORKER_POOL_SPINS pauses after a run in case another follows, then sleep
+// on a semaphore. Waking one costs the audio thread a semaphore post; nothing
+// on it ever blocks or allocates.
+//
+// Threads are started by worker_pool_create() and stopped by
+// worker_pool_destroy(), on the main thread. They ask for a real-time
+// priority, and carry on without one when the system refuses.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#endif
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||           \
+    defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+#include "atomics.h"
+
+// Threads taking part in a run, the caller's included
+#define WORKER_POOL_MAX_THREADS 8
+// Tasks per run, as a range holds 8 bit indices
+#define WORKER_POOL_MAX_TASKS 255
+// Pauses a worker spins through after a run before going to sleep, some tens
+// of microseconds
+#define WORKER_POOL_SPINS 4096
+#define WORKER_POOL_NONE  0xffffffff
+
+typedef void (*WorkerTaskFn)(void *ctx, uint32_t task);
+
+typedef struct WorkerSemaphore {
+#ifdef _WIN32
+    HANDLE handle;
+#elif defined(__APPLE__)
+    dispatch_semaphore_t handle;
+#else
+    sem_t handle;
+#endif
+} WorkerSemaphore;
+
+// Tasks of one thread, see worker_pool_claim()
+typedef struct WorkerSlot {
+    volatile uint32_t range;
+    char pad[CACHE_LINE_SIZE - sizeof(uint32_t)];
+} WorkerSlot;
+
+typedef struct Worker {
+    // Generation of the last run handed to the worker, shifted up by one.
+    // The low bit is set while it sleeps
+    volatile uint32_t mailbox;
+    char pad[CACHE_LINE_SIZE - sizeof(uint32_t)];
+
+    struct WorkerPool *pool;
+    uint32_t slot;
+    WorkerSemaphore wake;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} Worker;
+
+typedef struct WorkerPool {
+    WorkerSlot slots[WORKER_POOL_MAX_THREADS];
+
+    // Tasks of the run in progress that are finished
+    volatile uint32_t numDone;
+    char pad0[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    // Tasks taken from another thread's range, for statistics
+    volatile uint32_t numStolen;
+    char pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+
+    // The run in progress, set by the audio thread before it hands it out
+    WorkerTaskFn fn;
+    void *ctx;
+    uint32_t generation;
+
+    volatile uint32_t quit;
+    uint32_t numWorkers;
+    Worker workers[WORKER_POOL_MAX_THREADS - 1];
+} WorkerPool;
+
+static inline void worker_pool_pause(void) {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||           \
+    defined(_M_IX86)
+    _mm_pause();
+#elif defined(_M_ARM64)
+    __yield();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint32_t worker_pool_num_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint32_t)info.dwNumberOfProcessors;
+#else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+#endif
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Semaphores */
+
+static inline bool worker_semaphore_init(WorkerSemaphore *sem) {
+#ifdef _WIN32
+    sem->handle = CreateSemaphoreA(NULL, 0, 1 << 30, NULL);
+    return sem->handle != NULL;
+#elif defined(__APPLE__)
+    sem->handle = dispatch_semaphore_create(0);
+    return sem->handle != NULL;
+#else
+    return sem_init(&sem->handle, 0, 0) == 0;
+#endif
+}
+
+static inline void worker_semaphore_free(WorkerSemaphore *sem) {
+#ifdef _WIN32
+    CloseHandle(sem->handle);
+#elif defined(__APPLE__)
+    dispatch_release(sem->handle);
+#else
+    sem_destroy(&sem->handle);
+#endif
+}
+
+static inline void worker_semaphore_post(WorkerSemaphore *sem) {
+#ifdef _WIN32
+    ReleaseSemaphore(sem->handle, 1, NULL);
+#elif defined(__APPLE__)
+    dispatch_semaphore_signal(sem->handle);
+#else
+    sem_post(&sem->handle);
+#endif
+}
+
+static inline void worker_semaphore_wait(WorkerSemaphore *sem) {
+#ifdef _WIN32
+    WaitForSingleObject(sem->handle, INFINITE);
+#elif defined(__APPLE__)
+    dispatch_semaphore_wait(sem->handle, DISPATCH_TIME_FOREVER);
+#else
+    while (sem_wait(&sem->handle) != 0 && errno == EINTR)
+        ;
+#endif
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Running tasks, from any thread taking part */
+
+// Takes the next task of 'slot' for the run tagged 'tag': from the front of
+// its range, as its owner does, or from the back, as thieves do. Returns
+// WORKER_POOL_NONE once the range is empty or belongs to another run
+static inline uint32_t worker_pool_claim(WorkerSlot *slot, uint32_t tag,
+                                         bool back) {
+    uint32_t range = atomic_load_acquire_u32(&slot->range);
+    while (range >> 16 == tag) {
+        const uint32_t begin = range & 0xff;
+        const uint32_t end = (range >> 8) & 0xff;
+        if (begin == end)
+            break;
+        const uint32_t taken = back ? range - 0x100 : range + 1;
+        if (atomic_compare_exchange_acq_rel_u32(&slot->range, &range, taken))
+            return back ? end - 1 : begin;
+    }
+    return WORKER_POOL_NONE;
+}
+
+// Runs tasks of run 'generation' as thread 'self' until none are left to take
+static inline void worker_pool_work(WorkerPool *pool, uint32_t self,
+                                    uint32_t generation) {
+    const uint32_t tag = generation & 0xffff;
+    for (;;) {
+        uint32_t task = worker_pool_claim(&pool->slots[self], tag, false);
+        for (uint32_t i = 1; task == WORKER_POOL_NONE &&
+                             i < WORKER_POOL_MAX_THREADS;
+             i++) {
+            task = worker_pool_claim(
+                &pool->slots[(self + i) % WORKER_POOL_MAX_THREADS], tag, true);
+            if (task != WORKER_POOL_NONE)
+                atomic_fetch_add_relaxed_u32(&pool->numStolen, 1);
+        }
+        if (task == WORKER_POOL_NONE)
+            return;
+        // Only read once a task is taken: the run can't end before it's done,
+        // so the audio thread can't be setting up the next one meanwhile
+        pool->fn(pool->ctx, task);
+        atomic_fetch_add_release_u32(&pool->numDone, 1);
+    }
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Worker threads */
+
+static inline void worker_pool_serve(Worker *worker) {
+    WorkerPool *pool = worker->pool;
+    uint32_t seen = 0;
+    for (;;) {
+        uint32_t mailbox = atomic_load_acquire_u32(&worker->mailbox);
+        for (uint32_t spin = 0;
+             mailbox >> 1 == seen && spin < WORKER_POOL_SPINS; spin++) {
+            worker_pool_pause();
+            mailbox = atomic_load_acquire_u32(&worker->mailbox);
+        }
+        if (mailbox >> 1 == seen) {
+            // Sleeps, unless a run came in just now
+            uint32_t expected = seen << 1;
+            if (atomic_compare_exchange_acq_rel_u32(&worker->mailbox,
+                                                    &expected, expected | 1))
+                worker_semaphore_wait(&worker->wake);
+            continue;
+        }
+        seen = mailbox >> 1;
+        if (atomic_load_acquire_u32(&pool->quit))
+            return;
+        worker_pool_work(pool, worker->slot, seen);
+    }
+}
+
+static inline void worker_pool_raise_priority(void) {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    const int low = sched_get_priority_min(SCHED_FIFO);
+    const int high = sched_get_priority_max(SCHED_FIFO);
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = low + (high - low) * 3 / 4;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_pool_thread(LPVOID arg) {
+    worker_pool_raise_priority();
+    worker_pool_serve((Worker *)arg);
+    return 0;
+}
+#else
+static void *worker_pool_thread(void *arg) {
+    worker_pool_raise_priority();
+    worker_pool_serve((Worker *)arg);
+    return NULL;
+}
+#endif
+
+// Hands a new run to 'worker', waking it if it sleeps
+static inline void worker_pool_notify(Worker *worker, uint32_t generation) {
+    const uint32_t old =
+        atomic_exchange_acq_rel_u32(&worker->mailbox, generation << 1);
+    if (old & 1)
+        worker_semaphore_post(&worker->wake);
+}
+
+static inline void worker_pool_destroy(WorkerPool *pool) {
+    atomic_store_release_u32(&pool->quit, 1);
+    pool->generation = (pool->generation + 1) & 0x7fffffff;
+    for (uint32_t w = 0; w < pool->numWorkers; w++)
+        worker_pool_notify(&pool->workers[w], pool->generation);
+    for (uint32_t w = 0; w < pool->numWorkers; w++) {
+        Worker *worker = &pool->workers[w];
+#ifdef _WIN32
+        WaitForSingleObject(worker->thread, INFINITE);
+        CloseHandle(worker->thread);
+#else
+        pthread_join(worker->thread, NULL);
+#endif
+        worker_semaphore_free(&worker->wake);
+    }
+    free(pool);
+}
+
+// Starts up to 'numWorkers' threads, no more than WORKER_POOL_MAX_THREADS - 1.
+// Returns NULL when none could be started
+static inline WorkerPool *worker_pool_create(uint32_t numWorkers) {
+    WorkerPool *pool = (WorkerPool *)calloc(1, sizeof(WorkerPool));
+    if (pool == NULL)
+        return NULL;
+    if (numWorkers > WORKER_POOL_MAX_THREADS - 1)
+        numWorkers = WORKER_POOL_MAX_THREADS - 1;
+    for (uint32_t w = 0; w < numWorkers; w++) {
+        Worker *worker = &pool->workers[w];
+        worker->pool = pool;
+        worker->slot = w + 1;
+        if (!worker_semaphore_init(&worker->wake))
+            break;
+#ifdef _WIN32
+        worker->thread =
+            CreateThread(NULL, 0, worker_pool_thread, worker, 0, NULL);
+        const bool started = worker->thread != NULL;
+#else
+        const bool started = pthread_create(&worker->thread, NULL,
+                                            worker_pool_thread, worker) == 0;
+#endif
+        if (!started) {
+            worker_semaphore_free(&worker->wake);
+            break;
+        }
+        pool->numWorkers++;
+    }
+    if (pool->numWorkers == 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* --------------------------------------------------------------------------------------------------------
+ * Audio thread */
+
+// Runs 'fn(ctx, task)' for every task from 0 to 'numTasks' - 1, at most
+// WORKER_POOL_MAX_TASKS, on up to 'numThreads' threads including the caller's.
+// Returns once all of them are done
+static inline void worker_pool_run(WorkerPool *pool, uint32_t numThreads,
+                                   uint32_t numTasks, WorkerTaskFn fn,
+                                   void *ctx) {
+    uint32_t numParts = pool->numWorkers + 1;
+    numParts = numThreads < numParts ? numThreads : numParts;
+    numParts = numTasks < numParts ? numTasks : numParts;
+    if (numParts <= 1) {
+        for (uint32_t task = 0; task < numTasks; task++)
+            fn(ctx, task);
+        return;
+    }
+
+    const uint32_t generation = (pool->generation + 1) & 0x7fffffff;
+    pool->generation = generation;
+    pool->fn = fn;
+    pool->ctx = ctx;
+    atomic_store_relaxed_u32(&pool->numDone, 0);
+    for (uint32_t p = 0; p < numParts; p++) {
+        const uint32_t begin = numTasks * p / numParts;
+        const uint32_t end = numTasks * (p + 1) / numParts;
+        atomic_store_release_u32(&pool->slots[p].range,
+                                 (generation & 0xffff) << 16 | end << 8 |
+                                     begin);
+    }
+    for (uint32_t w = 0; w + 1 < numParts; w++)
+        worker_pool_notify(&pool->workers[w], generation);
+
+    worker_pool_work(pool, 0, generation);
+    // Only tasks already started are left
+    while (atomic_load_acquire_u32(&pool->numDone) != numTasks)
+        worker_pool_pause();
+}
+
+#endif // WORKER_POOL_H